@@ -0,0 +1,84 @@
+/*
+ * bench_batch.c -- lines per second through docopt_batch_fd(), or through
+ * docopt_batch_parallel() when given a number of threads.  Built by
+ * bench_batch.py with DOCOPT_THREADS against the parser generated from
+ * test/example.docopt, and run on a file of naval_fate command lines.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "docopt.h"
+
+struct Count {
+    long ok;
+    long failed;
+    size_t last;
+};
+
+static double now(clockid_t clock) {
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int count(void *data, size_t line, enum DocoptError error, const struct DocoptArgs *args) {
+    struct Count *c = data;
+
+    (void) args;
+    /* results have to come in input order */
+    if (line <= c->last)
+        return -2;
+    c->last = line;
+    if (error == DOCOPT_OK)
+        c->ok++;
+    else
+        c->failed++;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct Count c = {0, 0, 0};
+    struct stat st;
+    double start, start_cpu, ns, ns_cpu;
+    char *buf;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    int fd;
+    int ret;
+
+    if (argc < 2 || ctx == NULL)
+        return EXIT_FAILURE;
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+        return EXIT_FAILURE;
+    start = now(CLOCK_MONOTONIC);
+    start_cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+    if (threads == 0) {
+        ret = docopt_batch_fd(ctx, fd, count, &c);
+    } else {
+        buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (buf == MAP_FAILED)
+            return EXIT_FAILURE;
+        ret = docopt_batch_parallel(ctx, buf, st.st_size, threads, count, &c);
+        munmap(buf, st.st_size);
+    }
+    ns = now(CLOCK_MONOTONIC) - start;
+    ns_cpu = now(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+    if (ret != 0)
+        return EXIT_FAILURE;
+    printf("{\"threads\": %d, \"lines\": %ld, \"failed\": %ld, \"bytes\": %ld, \"cpu_ns_per_line\": %.1f, "
+           "\"lines_per_second\": %.0f, \"mb_per_second\": %.1f}\n",
+           threads, c.ok + c.failed, c.failed, (long) st.st_size, ns_cpu / (c.ok + c.failed),
+           1e9 * (c.ok + c.failed) / ns, 1e3 * st.st_size / ns);
+    close(fd);
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_batch.py [--cc=<cc>] [--lines=<n>] [<threads>...]
+
+Generates the parser of test/example.docopt with batch mode, writes a file
+of naval_fate command lines, and reports how fast docopt_batch_fd() gets
+through it, then docopt_batch_parallel() on each number of <threads>, by
+default 1, 2, 4 ... up to the number of CPUs.  Lines per second are wall
+clock, so that they show how parsing scales with threads.
+
+Options:
+  --cc=<cc>     C compiler [default: cc].
+  --lines=<n>   Number of command lines [default: 1000000].
+
+"""
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+LINES = (
+    'naval_fate ship create {a} {b}',
+    'naval_fate ship {a} move {x} {y} --speed={x}',
+    'naval_fate ship "{a} {b}" move {x} {y}',
+    'naval_fate mine set {x} {y} --moored',
+    "naval_fate mine remove {x} {y} --drifting",
+    'naval_fate ship shoot {x}',
+)
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    work = tempfile.mkdtemp(prefix='docopt_bench_')
+    subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                           '-o', os.path.join(work, 'docopt'),
+                           os.path.join(HERE, '..', 'test', 'example.docopt')])
+    exe = os.path.join(work, 'bench_batch')
+    subprocess.check_call([args['--cc'], '-O2', '-pthread', '-DDOCOPT_THREADS', '-I', work,
+                           os.path.join(HERE, 'bench_batch.c'), os.path.join(work, 'docopt.c'), '-o', exe])
+    corpus = os.path.join(work, 'corpus.txt')
+    rng = random.Random(0)
+    with open(corpus, 'w') as f:
+        for _ in range(int(args['--lines'])):
+            f.write(rng.choice(LINES).format(a='boat%d' % rng.randrange(1000), b="'the %d'" % rng.randrange(100),
+                                             x=rng.randrange(100), y=rng.randrange(100)) + '\n')
+    threads = [int(n) for n in args['<threads>']]
+    if not threads:
+        threads = [1]
+        while threads[-1] * 2 <= (os.cpu_count() or 1):
+            threads.append(threads[-1] * 2)
+    for n in [0] + threads:
+        sys.stdout.write(subprocess.check_output([exe, corpus] + ([str(n)] if n else [])).decode())
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
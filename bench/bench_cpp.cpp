@@ -0,0 +1,57 @@
+/*
+ * bench_cpp.cpp -- parses per second of CPU time through Parser::parse() of
+ * the C++ parser, one Parser reused for every command line, on the command
+ * lines of bench_parse.c.  Built by bench_cpp.py against the parser
+ * generated from test/example.docopt with --cpp.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "docopt.hpp"
+
+#define N_ROUNDS 2000000
+#define MAX_ARGS 16
+
+struct Shape {
+    const char *name;
+    int argc;
+    const char *argv[MAX_ARGS];
+};
+
+static const Shape shapes[] = {
+    {"create", 5, {"naval_fate", "ship", "create", "a", "b"}},
+    {"move", 7, {"naval_fate", "ship", "A", "move", "1", "2", "--speed=20"}},
+    {"mine", 6, {"naval_fate", "mine", "set", "1", "2", "--moored"}},
+    {"no_match", 4, {"naval_fate", "ship", "shoot", "1"}}
+};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(void) {
+    /* as many positionals as the C parser takes without growing */
+    static docopt::Parser<MAX_ARGS> parser;
+    docopt::Args args;
+    docopt::Error expected, ret;
+    double start, ns;
+
+    for (const Shape &shape : shapes) {
+        /* argv is left as it is, no copy per round */
+        expected = parser.parse(shape.argc, shape.argv, args);
+        start = now();
+        for (long r = 0; r < N_ROUNDS; r++) {
+            ret = parser.parse(shape.argc, shape.argv, args);
+            if (ret != expected)
+                return EXIT_FAILURE;
+        }
+        ns = (now() - start) / N_ROUNDS;
+        std::printf("{\"shape\": \"%s\", \"result\": %d, \"ns_per_parse\": %.1f, \"parses_per_second\": %.0f}\n",
+                    shape.name, (int) expected, ns, 1e9 / ns);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_cpp.py [--cc=<cc>] [--cxx=<cxx>]
+
+Generates the C and the C++ parsers of test/example.docopt and reports how
+many command lines each gets through per second, bench_parse.c for the one
+and bench_cpp.cpp for the other, on the same command lines.
+
+Options:
+  --cc=<cc>     C compiler [default: cc].
+  --cxx=<cxx>   C++ compiler [default: c++].
+
+"""
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    work = tempfile.mkdtemp(prefix='docopt_bench_')
+    spec = os.path.join(HERE, '..', 'test', 'example.docopt')
+    generator = os.path.join(HERE, '..', 'docopt_c.py')
+    subprocess.check_call([sys.executable, generator, '-o', os.path.join(work, 'docopt'), spec])
+    subprocess.check_call([sys.executable, generator, '--cpp', '-o', os.path.join(work, 'docopt'), spec])
+    c_exe, cpp_exe = os.path.join(work, 'bench_parse'), os.path.join(work, 'bench_cpp')
+    subprocess.check_call([args['--cc'], '-O2', '-I', work, os.path.join(HERE, 'bench_parse.c'),
+                           os.path.join(work, 'docopt.c'), '-o', c_exe])
+    subprocess.check_call([args['--cxx'], '-std=c++17', '-O2', '-I', work, os.path.join(HERE, 'bench_cpp.cpp'),
+                           '-o', cpp_exe])
+    for backend, exe in (('c', c_exe), ('c++', cpp_exe)):
+        for line in subprocess.check_output([exe]).decode().splitlines():
+            result = json.loads(line)
+            result['backend'] = backend
+            print(json.dumps(result))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_generate.py [<n_options>...]
+
+Times docopt_c.py on the synthetic specs of bench_suite.py, with
+<n_options> options and as many commands, by default 1000, 10000 and
+100000. Prints one JSON object per spec with the seconds spent in each
+stage of generation, and in a whole run of docopt_c.py.
+
+"""
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+sys.path.insert(0, HERE)
+
+import docopt
+import docopt_c
+from bench_suite import spec
+
+
+def stages(doc):
+    """Run the generation pipeline of docopt_c.main() a stage at a time."""
+    usage = docopt.parse_section('usage:', doc)[0]
+    all_options = docopt.parse_defaults(doc)
+    yield 'parse'
+    pattern = docopt.parse_pattern(docopt.formal_usage(usage), all_options)
+    yield 'pattern'
+    leafs, commands, arguments, flags, options = docopt_c.parse_leafs(pattern, all_options)
+    yield 'leafs'
+    docopt_c.parse_repeating(pattern)
+    yield 'repeating'
+    docopt_c.c_table('long', [o.long for o in flags + options if o.long])
+    docopt_c.c_table('command', [cmd.name for cmd in commands])
+    docopt_c.c_short_table(flags + options)
+    yield 'tables'
+    docopt_c.Automaton(docopt_c.usage_lines(pattern), commands, arguments, flags + options).to_c('pattern')
+    yield 'automaton'
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    for n in [int(n) for n in args['<n_options>']] or [1000, 10000, 100000]:
+        doc = spec(n)
+        record = {'options': n, 'commands': n}
+        start = time.time()
+        for stage in stages(doc):
+            record[stage + '_seconds'] = round(time.time() - start, 3)
+            start = time.time()
+        work = tempfile.mkdtemp(prefix='docopt_bench_')
+        with open(os.path.join(work, 'spec.docopt'), 'w') as f:
+            f.write(doc)
+        start = time.time()
+        subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                               '-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt')])
+        record['total_seconds'] = round(time.time() - start, 3)
+        print(json.dumps(record, sort_keys=True))
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,60 @@
+/*
+ * bench_lookup.c -- cost of resolving long options, with and without the
+ * generated hash table.  Built by bench_lookup.py against a generated
+ * parser whose options are `--opt-00000` .. `--opt-<N_OPTIONS - 1>`.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "docopt.c"
+
+#define N_TOKENS 8
+#define N_ROUNDS 200000
+
+static unsigned long given[N_OPTIONS / WORD_BITS + 1];
+static const char *arguments[N_OPTIONS];
+/* each round gives the options again */
+static bool repeating[N_OPTIONS];
+static char *spare[N_TOKENS];
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static double ns_per_token(const struct Table *table, char **tokens) {
+    struct Spec lookup = spec;
+    struct Elements elements = {&lookup, NULL, given, arguments};
+    double start;
+    long rounds = table != NULL ? N_ROUNDS : N_ROUNDS / (N_OPTIONS / 10 + 1) + 1;
+    long r;
+
+    lookup.long_table = table;
+    lookup.option_repeating = repeating;
+    start = now();
+    for (r = 0; r < rounds; r++) {
+        struct Tokens ts = tokens_new(N_TOKENS, tokens, spare);
+        while (ts.current != NULL)
+            if (parse_long(&ts, &elements))
+                return -1;
+    }
+    return (now() - start) / ((double) rounds * N_TOKENS);
+}
+
+int main(void) {
+    char *tokens[N_TOKENS];
+    int i;
+
+    for (i = 0; i < N_OPTIONS; i++)
+        repeating[i] = true;
+    /* spread over the table, the last one is the worst case for a scan */
+    for (i = 0; i < N_TOKENS; i++)
+        tokens[i] = (char *) spec.option_longs[(long) (N_OPTIONS - 1) * (i + 1) / N_TOKENS];
+
+    printf("{\"options\": %d, \"hash_ns_per_token\": %.1f, \"scan_ns_per_token\": %.1f}\n",
+           N_OPTIONS, ns_per_token(&long_table, tokens), ns_per_token(NULL, tokens));
+    return EXIT_SUCCESS;
+}
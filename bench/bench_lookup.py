@@ -0,0 +1,47 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_lookup.py [--cc=<cc>] [<n_options>...]
+
+Generates parsers for specs with many long options and reports the cost of
+resolving one option, through the generated hash table and by linear scan.
+
+Options:
+  --cc=<cc>     C compiler [default: cc].
+
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+
+def spec(n_options):
+    return 'Usage: prog [options]\n\nOptions:\n' + ''.join(
+        '  --opt-{:05d}  Option {}.\n'.format(i, i) for i in range(n_options))
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    sizes = [int(n) for n in args['<n_options>']] or [10, 100, 1000, 10000]
+    for n in sizes:
+        work = tempfile.mkdtemp(prefix='docopt_bench_')
+        with open(os.path.join(work, 'spec.docopt'), 'w') as f:
+            f.write(spec(n))
+        subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                               '-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt')])
+        exe = os.path.join(work, 'bench_lookup')
+        subprocess.check_call([args['--cc'], '-O2', '-I', work, '-DN_OPTIONS={}'.format(n),
+                               os.path.join(HERE, 'bench_lookup.c'), '-o', exe])
+        sys.stdout.write(subprocess.check_output([exe]).decode())
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
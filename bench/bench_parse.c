@@ -0,0 +1,66 @@
+/*
+ * bench_parse.c -- parses per second of CPU time through docopt_parse(), one
+ * context reused for every command line.  Built by bench_parse.py against the
+ * parser generated from test/example.docopt.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "docopt.h"
+
+#define N_ROUNDS 2000000
+#define MAX_ARGS 16
+
+struct Shape {
+    const char *name;
+    int argc;
+    char *argv[MAX_ARGS];
+};
+
+static struct Shape shapes[] = {
+    {"create", 5, {"naval_fate", "ship", "create", "a", "b"}},
+    {"move", 7, {"naval_fate", "ship", "A", "move", "1", "2", "--speed=20"}},
+    {"mine", 6, {"naval_fate", "mine", "set", "1", "2", "--moored"}},
+    {"no_match", 4, {"naval_fate", "ship", "shoot", "1"}}
+};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(void) {
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct DocoptArgs args;
+    char *argv[MAX_ARGS];
+    enum DocoptError expected, ret;
+    double start, ns;
+    size_t i;
+    long r;
+
+    if (ctx == NULL)
+        return EXIT_FAILURE;
+    for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        /* argv is permuted by each parse, start over from a fresh copy */
+        memcpy(argv, shapes[i].argv, sizeof(argv));
+        expected = docopt_parse(ctx, shapes[i].argc, argv, &args);
+        start = now();
+        for (r = 0; r < N_ROUNDS; r++) {
+            memcpy(argv, shapes[i].argv, shapes[i].argc * sizeof(char *));
+            ret = docopt_parse(ctx, shapes[i].argc, argv, &args);
+            if (ret != expected)
+                return EXIT_FAILURE;
+        }
+        ns = (now() - start) / N_ROUNDS;
+        printf("{\"shape\": \"%s\", \"result\": %d, \"ns_per_parse\": %.1f, \"parses_per_second\": %.0f}\n",
+               shapes[i].name, (int) expected, ns, 1e9 / ns);
+    }
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
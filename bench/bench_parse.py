@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_parse.py [--cc=<cc>]
+
+Generates the parser of test/example.docopt and reports how many command
+lines one docopt_parse() context gets through per second.
+
+Options:
+  --cc=<cc>     C compiler [default: cc].
+
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    work = tempfile.mkdtemp(prefix='docopt_bench_')
+    subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                           '-o', os.path.join(work, 'docopt'),
+                           os.path.join(HERE, '..', 'test', 'example.docopt')])
+    exe = os.path.join(work, 'bench_parse')
+    subprocess.check_call([args['--cc'], '-O2', '-I', work, os.path.join(HERE, 'bench_parse.c'),
+                           os.path.join(work, 'docopt.c'), '-o', exe])
+    sys.stdout.write(subprocess.check_output([exe]).decode())
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,263 @@
+/*
+ * bench_suite.c -- cost of one docopt_parse() on a few argv shapes: CPU time,
+ * peak stack and peak heap.  Built by bench_suite.py against a parser
+ * generated from its synthetic spec, with N_OPTIONS options `--opt-%05d`,
+ * the first 52 also -a .. -Z, every 4th taking an argument, and as many
+ * commands `c%05d`, and `pair (<key> <value>)...`.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void *bench_malloc(size_t size);
+static void *bench_calloc(size_t n, size_t size);
+static void *bench_realloc(void *p, size_t size);
+static void bench_free(void *p);
+
+/* count what the parser allocates, the driver itself does not */
+#define malloc bench_malloc
+#define calloc bench_calloc
+#define realloc bench_realloc
+#define free bench_free
+#include "docopt.c"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+#define MAX_ARGS 16384
+#define STACK_PROBE (1 << 20)
+#define PAINT 0xa5
+
+union Header {
+    size_t size;
+    long l;
+    double d;
+    void *p;
+};
+
+static size_t heap_live;
+static size_t heap_peak;
+
+static void *bench_malloc(size_t size) {
+    union Header *h = malloc(sizeof(union Header) + size);
+
+    if (h == NULL)
+        return NULL;
+    h->size = size;
+    heap_live += size;
+    if (heap_live > heap_peak)
+        heap_peak = heap_live;
+    return h + 1;
+}
+
+static void *bench_calloc(size_t n, size_t size) {
+    void *p = bench_malloc(n * size);
+
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+static void bench_free(void *p) {
+    union Header *h = p;
+
+    if (p == NULL)
+        return;
+    heap_live -= h[-1].size;
+    free(h - 1);
+}
+
+static void *bench_realloc(void *p, size_t size) {
+    void *q = bench_malloc(size);
+
+    if (q == NULL)
+        return NULL;
+    if (p != NULL) {
+        memcpy(q, p, ((union Header *) p)[-1].size < size ? ((union Header *) p)[-1].size : size);
+        bench_free(p);
+    }
+    return q;
+}
+
+struct Shape {
+    const char *name;
+    int argc;
+    char *argv[MAX_ARGS];
+};
+
+static char names[3 * MAX_ARGS][32];
+
+static char *name(int i, const char *format, long n) {
+    sprintf(names[i], format, n);
+    return names[i];
+}
+
+/* argv shapes, all of which match the synthetic spec */
+static int make_shapes(struct Shape *shapes) {
+    const char *letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    struct Shape *s;
+    int i, k, n = 0;
+    int next = 52;
+    long j;
+
+    s = &shapes[n++];
+    s->name = "all_long";
+    s->argv[0] = "prog";
+    s->argv[1] = name(0, "c%05ld", N_OPTIONS - 1);
+    for (i = 0; i < 8; i++) {
+        j = (long) (N_OPTIONS - 1) * (i + 1) / 8;
+        s->argv[2 + i] = name(1 + i, j % 4 == 3 ? "--opt-%05ld=v" : "--opt-%05ld", j);
+    }
+    s->argc = 10;
+
+    s = &shapes[n++];
+    s->name = "clustered_shorts";
+    s->argv[0] = "prog";
+    s->argv[1] = "c00000";
+    s->argv[2] = names[10];
+    names[10][0] = '-';
+    for (i = 0, k = 1; i < N_OPTIONS && i < 52 && k < 17; i++)
+        if (i % 4 != 3)
+            names[10][k++] = letters[i];
+    names[10][k] = '\0';
+    s->argc = 3;
+
+    s = &shapes[n++];
+    s->name = "many_positionals";
+    s->argv[0] = "prog";
+    s->argv[1] = "c00000";
+    for (i = 0; i < 32; i++)
+        s->argv[2 + i] = name(11 + i, "arg%ld", i);
+    s->argc = 34;
+
+    s = &shapes[n++];
+    s->name = "doubledash";
+    s->argv[0] = "prog";
+    s->argv[1] = name(43, "--opt-%05ld", 0);
+    s->argv[2] = "--";
+    for (i = 0; i < 8; i++)
+        s->argv[3 + i] = name(44 + i, "-file%ld", i);
+    s->argc = 11;
+
+    /* each positional token after all option tokens so far */
+    s = &shapes[n++];
+    s->name = "interleaved_options";
+    s->argv[0] = "prog";
+    s->argv[1] = "c00000";
+    for (i = 0; i < N_OPTIONS && 2 * i + 3 < MAX_ARGS; i++) {
+        s->argv[2 + 2 * i] = name(next++, "arg%ld", i);
+        s->argv[3 + 2 * i] = name(next++, i % 4 == 3 ? "--opt-%05ld=v" : "--opt-%05ld", i);
+    }
+    s->argc = 2 + 2 * i;
+
+    /* the values of <key> and of <value> alternate */
+    s = &shapes[n++];
+    s->name = "interleaved_repeats";
+    s->argv[0] = "prog";
+    s->argv[1] = "pair";
+    for (i = 0; 2 * i + 3 < MAX_ARGS; i++) {
+        s->argv[2 + 2 * i] = name(next++, "key%ld", i);
+        s->argv[3 + 2 * i] = name(next++, "value%ld", i);
+    }
+    s->argc = 2 + 2 * i;
+    return n;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static NOINLINE void paint_stack(void) {
+    volatile unsigned char probe[STACK_PROBE];
+    size_t i;
+
+    for (i = 0; i < STACK_PROBE; i++)
+        probe[i] = PAINT;
+}
+
+/* Bytes of the painted stack written over since paint_stack() */
+static NOINLINE size_t stack_used(void) {
+    volatile unsigned char probe[STACK_PROBE];
+    size_t i;
+
+    for (i = 0; i < STACK_PROBE && probe[i] == PAINT; i++)
+        ;
+    return STACK_PROBE - i;
+}
+
+static NOINLINE int parse_once(struct Shape *shape, struct DocoptContext **ctx, struct DocoptArgs *args) {
+    static char *argv[MAX_ARGS];
+
+    memcpy(argv, shape->argv, sizeof(argv));
+    *ctx = docopt_context_new(true, true);
+    if (*ctx == NULL)
+        return DOCOPT_NO_MEMORY;
+    return docopt_parse(*ctx, shape->argc, argv, args);
+}
+
+static NOINLINE int parse_none(struct Shape *shape, struct DocoptContext **ctx, struct DocoptArgs *args) {
+    (void) shape;
+    (void) args;
+    *ctx = NULL;
+    return DOCOPT_OK;
+}
+
+int main(void) {
+    static struct Shape shapes[8];
+    static char *argv[MAX_ARGS];
+    struct DocoptContext *ctx;
+    struct DocoptArgs args;
+    size_t base, stack;
+    double start, ns;
+    long r, rounds;
+    int i, n_shapes = make_shapes(shapes);
+    int ret;
+
+    /* the allocator sets itself up on first use, keep that out */
+    parse_once(&shapes[0], &ctx, &args);
+    docopt_context_free(ctx);
+    paint_stack();
+    parse_none(&shapes[0], &ctx, &args);
+    base = stack_used();
+    for (i = 0; i < n_shapes; i++) {
+        /* a first parse, on a new context, for stack and heap */
+        heap_live = heap_peak = 0;
+        paint_stack();
+        ret = parse_once(&shapes[i], &ctx, &args);
+        stack = stack_used() - base;
+        if (ret != DOCOPT_OK) {
+            fprintf(stderr, "%s: error %d at %s\n", shapes[i].name, ret, ctx ? docopt_error_token(ctx) : "");
+            return EXIT_FAILURE;
+        }
+
+        rounds = 1;
+        do {
+            rounds *= 4;
+            start = now();
+            for (r = 0; r < rounds; r++) {
+                memcpy(argv, shapes[i].argv, shapes[i].argc * sizeof(char *));
+                docopt_parse(ctx, shapes[i].argc, argv, &args);
+            }
+            ns = now() - start;
+        } while (ns < 2e8);
+        printf("{\"options\": %d, \"shape\": \"%s\", \"argc\": %d, \"ns_per_parse\": %.1f, "
+               "\"peak_stack_bytes\": %lu, \"peak_heap_bytes\": %lu}\n",
+               N_OPTIONS, shapes[i].name, shapes[i].argc, ns / rounds,
+               (unsigned long) stack, (unsigned long) heap_peak);
+        docopt_context_free(ctx);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_suite.py [--cc=<cc>] [--cflags=<flags>] [<n_options>...]
+
+Generates parsers for synthetic specs with <n_options> options and as many
+commands, by default 10, 100, 1000 and 10000, then prints one JSON object
+per spec and argv shape with:
+
+  gen_seconds       time docopt_c.py takes to generate the parser
+  compile_seconds   time the C compiler takes on the generated docopt.c
+  source_bytes      size of the generated docopt.c
+  text_bytes ...    size of its object file, as reported by `size`
+  ns_per_parse      CPU time of docopt_parse() on a reused context
+  peak_stack_bytes  stack used by the first parse, on a new context
+  peak_heap_bytes   heap used by the first parse, context included
+
+Options:
+  --cc=<cc>             C compiler [default: cc].
+  --cflags=<flags>      Compiler flags [default: -O2].
+
+"""
+
+import json
+import os
+import string
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+LETTERS = string.ascii_lowercase + string.ascii_uppercase
+
+
+def spec(n):
+    """The spec bench_suite.c expects, see there"""
+    lines = ['Usage:',
+             '  prog ({}) [options] [<arg>...]'.format('|'.join('c{:05d}'.format(i) for i in range(n))),
+             '  prog [options] -- <file>...',
+             '  prog pair (<key> <value>)...',
+             '',
+             'Options:']
+    for i in range(n):
+        lines.append('  {}--opt-{:05d}{}  Option {}.'.format('-{} '.format(LETTERS[i]) if i < len(LETTERS) else '',
+                                                          i, '=<v>' if i % 4 == 3 else '', i))
+    return '\n'.join(lines) + '\n'
+
+
+def timed(command):
+    start = time.time()
+    subprocess.check_call(command)
+    return time.time() - start
+
+
+def object_size(path):
+    try:
+        out = subprocess.check_output(['size', path]).decode().splitlines()
+    except OSError:
+        return {'object_bytes': os.path.getsize(path)}
+    text, data, bss = out[1].split()[:3]
+    return {'text_bytes': int(text), 'data_bytes': int(data), 'bss_bytes': int(bss)}
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    cflags = args['--cflags'].split()
+    for n in [int(n) for n in args['<n_options>']] or [10, 100, 1000, 10000]:
+        work = tempfile.mkdtemp(prefix='docopt_bench_')
+        with open(os.path.join(work, 'spec.docopt'), 'w') as f:
+            f.write(spec(n))
+        source = os.path.join(work, 'docopt.c')
+        record = {'options': n, 'commands': n}
+        record['gen_seconds'] = round(timed([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                                             '-o', source, os.path.join(work, 'spec.docopt')]), 3)
+        record['compile_seconds'] = round(timed([args['--cc']] + cflags + ['-c', source, '-o',
+                                                                           os.path.join(work, 'docopt.o')]), 3)
+        record['source_bytes'] = os.path.getsize(source)
+        record.update(object_size(os.path.join(work, 'docopt.o')))
+        exe = os.path.join(work, 'bench_suite')
+        subprocess.check_call([args['--cc']] + cflags + ['-I', work, '-DN_OPTIONS={}'.format(n),
+                                                         os.path.join(HERE, 'bench_suite.c'), '-o', exe])
+        for line in subprocess.check_output([exe]).decode().splitlines():
+            result = dict(record)
+            result.update(json.loads(line))
+            print(json.dumps(result, sort_keys=True))
+            sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
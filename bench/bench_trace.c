@@ -0,0 +1,129 @@
+/*
+ * bench_trace.c -- where the time of docopt_parse() goes, phase by phase,
+ * from the hooks of a parser built with DOCOPT_TRACE.  Built by
+ * bench_trace.py against the parser generated from test/example.docopt.
+ * Without arguments it averages over a few command line shapes; given
+ * naval_fate arguments, it traces the one docopt() call a program would
+ * make at startup.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "docopt.h"
+
+#define N_ROUNDS 200000
+#define MAX_ARGS 16
+
+struct Shape {
+    const char *name;
+    int argc;
+    char *argv[MAX_ARGS];
+};
+
+static struct Shape shapes[] = {
+    {"create", 5, {"naval_fate", "ship", "create", "a", "b"}},
+    {"move", 7, {"naval_fate", "ship", "A", "move", "1", "2", "--speed=20"}},
+    {"mine", 6, {"naval_fate", "mine", "set", "1", "2", "--moored"}},
+    {"no_match", 4, {"naval_fate", "ship", "shoot", "1"}}
+};
+
+static const char *const phase_names[] = {"parse_args", "extras", "match", "elems_to_args"};
+
+/* What the hooks add up, over any number of parses */
+struct Totals {
+    double ns[DOCOPT_PHASE_DONE];
+    long tokens;
+    long lookups;
+    long probes;
+    long errors;
+    enum DocoptPhase phase;
+    double started;
+};
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void on_phase(void *data, enum DocoptPhase phase) {
+    struct Totals *totals = data;
+    double t = now();
+
+    /* the phase before this one ends now */
+    if (phase != DOCOPT_PHASE_PARSE_ARGS)
+        totals->ns[totals->phase] += t - totals->started;
+    totals->phase = phase;
+    totals->started = t;
+}
+
+static void on_token(void *data, const char *token) {
+    (void) token;
+    ((struct Totals *) data)->tokens++;
+}
+
+static void on_lookup(void *data, const char *name, size_t len, int probes) {
+    struct Totals *totals = data;
+
+    (void) name;
+    (void) len;
+    totals->lookups++;
+    totals->probes += probes;
+}
+
+static void on_error(void *data, enum DocoptError error, const char *token) {
+    (void) error;
+    (void) token;
+    ((struct Totals *) data)->errors++;
+}
+
+static void print_totals(const char *name, const struct Totals *totals, long n) {
+    int p;
+
+    printf("{\"shape\": \"%s\"", name);
+    for (p = 0; p < DOCOPT_PHASE_DONE; p++)
+        printf(", \"%s_ns\": %.1f", phase_names[p], totals->ns[p] / n);
+    printf(", \"tokens\": %.1f, \"lookups\": %.1f, \"probes\": %.1f, \"errors\": %.1f}\n",
+           (double) totals->tokens / n, (double) totals->lookups / n, (double) totals->probes / n,
+           (double) totals->errors / n);
+}
+
+int main(int argc, char *argv[]) {
+    struct Totals totals;
+    struct DocoptTrace trace = {on_phase, on_token, on_lookup, on_error, NULL};
+    struct DocoptContext *ctx;
+    struct DocoptArgs args;
+    char *shape_argv[MAX_ARGS];
+    size_t i;
+    long r;
+
+    memset(&totals, 0, sizeof(totals));
+    trace.data = &totals;
+    /* every context from now on, the one docopt() makes too */
+    docopt_trace(NULL, &trace);
+    if (argc > 1) {
+        args = docopt(argc, argv, /* help */ 1, /* version */ "2.0rc2");
+        (void) args;
+        print_totals("argv", &totals, 1);
+        return EXIT_SUCCESS;
+    }
+    ctx = docopt_context_new(true, true);
+    if (ctx == NULL)
+        return EXIT_FAILURE;
+    for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        memset(&totals, 0, sizeof(totals));
+        for (r = 0; r < N_ROUNDS; r++) {
+            /* argv is permuted by each parse, start over from a fresh copy */
+            memcpy(shape_argv, shapes[i].argv, shapes[i].argc * sizeof(char *));
+            docopt_parse(ctx, shapes[i].argc, shape_argv, &args);
+        }
+        print_totals(shapes[i].name, &totals, N_ROUNDS);
+    }
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: bench_trace.py [--cc=<cc>] [<argument>...]
+
+Generates the parser of test/example.docopt with DOCOPT_TRACE and reports
+the time docopt_parse() spends in each of its phases, with the tokens
+consumed and the lookups made.  Given arguments, it traces the docopt()
+call a naval_fate started with them would make.
+
+Options:
+  --cc=<cc>     C compiler [default: cc].
+
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    work = tempfile.mkdtemp(prefix='docopt_bench_')
+    subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                           '-o', os.path.join(work, 'docopt'),
+                           os.path.join(HERE, '..', 'test', 'example.docopt')])
+    exe = os.path.join(work, 'bench_trace')
+    subprocess.check_call([args['--cc'], '-O2', '-DDOCOPT_TRACE', '-I', work, os.path.join(HERE, 'bench_trace.c'),
+                           os.path.join(work, 'docopt.c'), '-o', exe])
+    sys.stdout.write(subprocess.check_output([exe] + args['<argument>']).decode())
+
+
+if __name__ == '__main__':
+    main()
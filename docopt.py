@@ -45,29 +45,56 @@ class Pattern(object):
         """Make pattern-tree tips point to same object if they are equal."""
         if not hasattr(self, 'children'):
             return self
-        uniq = list(set(self.flat())) if uniq is None else uniq
+        if uniq is None:
+            uniq = {}
+            for leaf in self.flat():
+                uniq.setdefault(leaf, leaf)
         for i, child in enumerate(self.children):
             if not hasattr(child, 'children'):
                 assert child in uniq
-                self.children[i] = uniq[uniq.index(child)]
+                self.children[i] = uniq[child]
             else:
                 child.fix_identities(uniq)
 
     def fix_repeating_arguments(self):
         """Fix elements that should accumulate/increment values."""
-        either = [list(child.children) for child in transform(self).children]
-        for case in either:
-            for e in [child for child in case if case.count(child) > 1]:
-                if type(e) is Argument or type(e) is Option and e.argcount:
-                    if e.value is None:
-                        e.value = []
-                    elif type(e.value) is not list:
-                        e.value = e.value.split()
-                if type(e) is Command or type(e) is Option and e.argcount == 0:
-                    e.value = 0
+        for e in repeating(self):
+            if type(e) is Argument or type(e) is Option and e.argcount:
+                if e.value is None:
+                    e.value = []
+                elif type(e.value) is not list:
+                    e.value = e.value.split()
+            if type(e) is Command or type(e) is Option and e.argcount == 0:
+                e.value = 0
         return self
 
 
+def repeating(pattern):
+    """Leaves that some case of transform(pattern) holds more than once.
+
+    Found without expanding the pattern: a sequence adds up the counts of its
+    children, an Either takes the largest count any alternative has.
+
+    """
+    def counts(node):
+        result = {}
+        if not hasattr(node, 'children'):
+            result[node] = 1
+        elif type(node) is Either:
+            for child in node.children:
+                for leaf, n in counts(child).items():
+                    if n > result.get(leaf, 0):
+                        result[leaf] = n
+        else:
+            for child in node.children:
+                for leaf, n in counts(child).items():
+                    result[leaf] = min(2, result.get(leaf, 0) + n)
+            if type(node) is OneOrMore:
+                result = dict.fromkeys(result, 2)
+        return result
+    return [leaf for leaf, n in counts(pattern).items() if n > 1]
+
+
 def transform(pattern):
     """Expand pattern into an (almost) equivalent one, but with single Either.
 
@@ -145,7 +172,10 @@ class BranchPattern(Pattern):
     def flat(self, *types):
         if type(self) in types:
             return [self]
-        return sum([child.flat(*types) for child in self.children], [])
+        result = []
+        for child in self.children:
+            result.extend(child.flat(*types))
+        return result
 
 
 class Argument(LeafPattern):
@@ -158,7 +188,7 @@ class Argument(LeafPattern):
     @classmethod
     def parse(cls, source):
         name = re.findall('(<\S*?>)', source)[0]
-        value = re.findall('\[default: (.*)\]', source, flags=re.I)
+        value = re.findall('\[default: ([^\]]*)\]', source, flags=re.I)
         return cls(name, value[0] if value else None)
 
 
@@ -197,7 +227,7 @@ class Option(LeafPattern):
             else:
                 argcount = 1
         if argcount:
-            matched = re.findall('\[default: (.*)\]', description, flags=re.I)
+            matched = re.findall('\[default: ([^\]]*)\]', description, flags=re.I)
             value = matched[0] if matched else None
         return class_(short, long, argcount, value)
 
@@ -280,11 +310,16 @@ class Either(BranchPattern):
 
 
 class Tokens(list):
+    """Kept back to front, so that move() does not shift what is left."""
+
     def __init__(self, source, error=DocoptExit):
         super(Tokens, self).__init__()
-        self += source.split() if hasattr(source, 'split') else source
+        self += reversed(source.split() if hasattr(source, 'split') else list(source))
         self.error = error
 
+    def __iter__(self):
+        return list.__reversed__(self)
+
     @staticmethod
     def from_pattern(source):
         source = re.sub(r'([\[\]\(\)\|]|\.\.\.)', r' \1 ', source)
@@ -292,10 +327,10 @@ class Tokens(list):
         return Tokens(source, error=DocoptLanguageError)
 
     def move(self):
-        return self.pop(0) if len(self) else None
+        return self.pop() if len(self) else None
 
     def current(self):
-        return self[0] if len(self) else None
+        return self[-1] if len(self) else None
 
 
 def parse_long(tokens, options):
@@ -449,15 +484,19 @@ def parse_argv(tokens, options, options_first=False):
 
 
 def parse_defaults(doc):
-    defaults = []
+    return [Option.parse(s) for s in option_descriptions(doc)]
+
+
+def option_descriptions(doc):
+    """Text describing each option in the options sections of `doc`."""
+    descriptions = []
     for s in parse_section('options:', doc):
         # FIXME corner case "bla: options: --foo"
         _, _, s = s.partition(':')  # get rid of "options:"
         split = re.split('\n[ \t]*(-\S+?)', '\n' + s)[1:]
         split = [s1 + s2 for s1, s2 in zip(split[::2], split[1::2])]
-        options = [Option.parse(s) for s in split if s.startswith('-')]
-        defaults += options
-    return defaults
+        descriptions += [s for s in split if s.startswith('-')]
+    return descriptions
 
 
 def parse_section(name, source):
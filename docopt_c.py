@@ -5,11 +5,18 @@
 # (see LICENSE-MIT file for copying)
 
 
-"""Usage: docopt_c.py [options] [<docopt>]
+"""Usage: docopt_c.py [options] [<docopt>...]
 
 Processes a docopt formatted string, from either stdin or a file, and
 outputs the equivalent C code to parse a CLI, to either the stdout or a file.
 
+Given several specs, or a directory of .docopt files, it writes a parser
+per spec, as <outname>_<spec>.c, and a dispatcher to them, as <outname>.c,
+which runs the parser of the subcommand named by the first argument.
+
+Given a manifest instead, it writes the parser of each spec listed there on
+its own, in one run, on as many processes as there are CPUs.
+
 Options:
   -o, --output-name=<outname>
                 Filename used to write the produced C file.
@@ -18,10 +25,43 @@ Options:
                 Filename used to read a C template.
   -p, --template-header=<template-header>
                 Filename used to read a C template header (prototypes, structs).
+  --packed      Store commands and options without arguments as bits of
+                DocoptArgs, to be read with DOCOPT_FLAG(args, name).
+  --single-header
+                Write the parser as a header alone, its functions static, for
+                the compiler to inline into the program.
+  --cpp         Write the parser as a C++17 header, <outname>.hpp, in the
+                namespace named by --prefix, or docopt.
+  --prefix=<name>
+                Name the functions <name>_docopt() and so on, so that the
+                parsers of several specs link into one program.
+  --stack-budget=<bytes>
+                Fail if docopt() of the parser may take more stack than
+                that, as DOCOPT_STACK_BYTES in the header tells.
+  -m, --manifest=<manifest>
+                Filename used to read the specs to generate parsers for, one
+                per line: the spec, the <outname> of its parser, and the
+                --prefix of it if any, separated by spaces.  Relative paths
+                are taken from the directory of the manifest, and a '#'
+                starts a comment.
+  -j, --jobs=<n>
+                Number of processes generating the parsers of a manifest,
+                by default one per CPU.
+  -c, --cache-dir=<dir>
+                Directory to keep generated files in, keyed by a hash of the
+                spec, the templates and the generator, so that an unchanged
+                spec is not parsed again.
+  -d, --depfile=<depfile>
+                Filename used to write the files the output depends on, as a
+                Make rule that Ninja reads as well.
+  --completion=<script>
+                Filename used to write the bash script that completes the
+                program on the command line, or the zsh one if it ends in .zsh.
   -h,--help     Show this help message and exit.
 
 Arguments:
-  <docopt>      Input file describing your CLI in docopt language.
+  <docopt>      Input file describing your CLI in docopt language, or a
+                directory of them.
 
 """
 
@@ -29,10 +69,12 @@ __author__ = "Vladimir Keleshev"
 __version__ = "2.0rc2"
 __description__ = "C generator for language for description of command-line interfaces"
 
+import bisect
+import hashlib
+import multiprocessing
 import numbers
 import os.path
 import re
-import textwrap
 from string import Template
 
 import sys
@@ -41,9 +83,11 @@ import docopt
 
 template_h = """
 #ifndef DOCOPT_$header_no_ext_H
-#define DOCOPT_$header_no_ext_H
+#define DOCOPT_$header_no_ext_H$renames
 
+#include <limits.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #if defined(__STDC__) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
 
@@ -70,108 +114,566 @@ typedef size_t bool;
 
 #endif
 
-#if defined(_AIX)
+/* values of a repeated positional argument (`<name>...`), viewed in argv */
+struct DocoptSlice {
+    const char **items;
+    size_t count;
+};
 
-#include <sys/limits.h>
+#define DOCOPT_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
 
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-|| defined(__OpenBSD__) || defined(__bsdi__)
-|| defined(__DragonFly__) || defined(macintosh)
-|| defined(__APPLE__) || defined(__APPLE_CC__)
+struct DocoptArgs {
+    $bits$commands$arguments$flags$options
+    /* special */
+    const char *usage_pattern;
+    const char *const *help_message;    /* $help_message_n lines */
+};
+$flag_macros
 
-#include <sys/syslimits.h>
+/* Outcome of docopt_parse(); docopt_error_token() tells what it is about */
+enum DocoptError {
+    DOCOPT_OK = 0,
+    DOCOPT_HELP,                /* --help was given */
+    DOCOPT_VERSION,             /* --version was given */
+    DOCOPT_UNKNOWN_OPTION,
+    DOCOPT_MISSING_ARGUMENT,    /* an option that takes an argument is last */
+    DOCOPT_UNEXPECTED_ARGUMENT, /* --flag=value */
+    DOCOPT_UNTERMINATED_QUOTE,  /* in a line given to docopt_batch() */
+    DOCOPT_NO_MATCH,            /* no usage line matches, or takes the token */
+    DOCOPT_NO_MEMORY,
+    DOCOPT_INVALID_VALUE,       /* not a number, or not one of the choices */
+    DOCOPT_OUT_OF_RANGE,        /* a number too large, or out of its bounds */
+    DOCOPT_AMBIGUOUS_OPTION,    /* a prefix of several long options */
+    DOCOPT_BAD_CONFIG,          /* the file given to docopt_config() cannot be read */
+    DOCOPT_BAD_RESPONSE_FILE    /* an @file argument that cannot be read */
+};
 
-#elif defined(__HAIKU__)
+/* Parser state, reusable for any number of docopt_parse() calls */
+struct DocoptContext;
 
-#include <system/user_runtime.h>
+/* how the functions below are declared, static in a --single-header parser */
+#ifndef DOCOPT_API
+#define DOCOPT_API
+#endif
 
-#elif defined(__linux__) || defined(linux) || defined(__linux)
+DOCOPT_API struct DocoptContext *docopt_context_new(bool, bool);
+DOCOPT_API void docopt_context_free(struct DocoptContext *);
+DOCOPT_API enum DocoptError docopt_parse(struct DocoptContext *, int, char *[], struct DocoptArgs *);
+DOCOPT_API const char *docopt_error_token(const struct DocoptContext *);
+DOCOPT_API int docopt_complete(struct DocoptContext *, int, char *[], int, FILE *);
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *, const char *);
 
-#include <linux/version.h>
+#if defined(DOCOPT_THREADS) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if defined(DOCOPT_RESPONSE_FILES) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
 
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,22)
+#ifdef DOCOPT_BATCH
+/* Receives the outcome of each line, returning nonzero stops the batch */
+typedef int (*DocoptLineCallback)(void *, size_t, enum DocoptError, const struct DocoptArgs *);
 
-#include <linux/limits.h>
+DOCOPT_API int docopt_batch(struct DocoptContext *, char *, size_t, DocoptLineCallback, void *);
+DOCOPT_API int docopt_batch_fd(struct DocoptContext *, int, DocoptLineCallback, void *);
+#endif
 
-#else
+#ifdef DOCOPT_THREADS
+DOCOPT_API int docopt_batch_parallel(struct DocoptContext *, char *, size_t, int, DocoptLineCallback, void *);
+#endif
 
-#define ARG_MAX       131072    /* # bytes of args + environ for exec() */
-/* it's no longer defined, see this example and more at https://unix.stackexchange.com/q/120642 */
+#ifdef DOCOPT_TRACE
+/* Steps of docopt_parse(), in order */
+enum DocoptPhase {
+    DOCOPT_PHASE_PARSE_ARGS,    /* argv into options and positional tokens */
+    DOCOPT_PHASE_EXTRAS,        /* --help and --version */
+    DOCOPT_PHASE_MATCH,         /* positional tokens against the usage section */
+    DOCOPT_PHASE_ELEMS_TO_ARGS, /* what was found into struct DocoptArgs */
+    DOCOPT_PHASE_DONE
+};
+
+/* Called with `data` as a DOCOPT_TRACE parser goes, those that are not NULL */
+struct DocoptTrace {
+    void (*phase)(void *, enum DocoptPhase);                /* as the phase starts */
+    void (*token)(void *, const char *);                    /* an argv token is consumed */
+    void (*lookup)(void *, const char *, size_t, int);      /* a name, its length and the
+                                                               entries of its table looked at */
+    void (*error)(void *, enum DocoptError, const char *);  /* the parse fails, as docopt_error_token() */
+    void *data;
+};
 
+DOCOPT_API void docopt_trace(struct DocoptContext *, const struct DocoptTrace *);
 #endif
 
-#elif (defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__bsdi__) \
- || defined(__DragonFly__) || defined(macintosh) || defined(__APPLE__) || defined(__APPLE_CC__))
+/* Upper bound on the stack docopt() takes: the DocoptArgs it fills in and
+   the frames below it, libc's included; test/test_stack.py checks it */
+#define DOCOPT_STACK_BYTES $stack_bytes
+#if defined(DOCOPT_STACK_BUDGET) && DOCOPT_STACK_BYTES > DOCOPT_STACK_BUDGET
+#error "docopt() may take more stack than DOCOPT_STACK_BUDGET"
+#endif
 
-#include <sys/param.h>
+DOCOPT_API struct DocoptArgs docopt(int, char *[], bool, const char *);
 
-#if defined(__APPLE__) || defined(__APPLE_CC__)
-/* ARG_MAX gives a segfault on macOS when used for array size below */
-#undef ARG_MAX
-#undef NCARGS
 #endif
+"""
 
-#else
+template_bash = """# bash completion for $prog, generated by docopt_c.py
+$func() {
+    local IFS=$$'\\n'
+    COMPREPLY=($$("$${COMP_WORDS[0]}" --docopt-complete "$$COMP_CWORD" "$${COMP_WORDS[@]}" 2>/dev/null))
+}
+complete -o default -F $func $prog
+"""
 
-#include <limits.h>
+template_zsh = """#compdef $prog
+# zsh completion for $prog, generated by docopt_c.py
+$func() {
+    local -a replies
+    replies=($${(f)"$$("$${words[1]}" --docopt-complete $$((CURRENT - 1)) "$${words[@]}" 2>/dev/null)"})
+    if (( $${#replies} )); then
+        compadd -a replies
+    else
+        _files
+    fi
+}
+compdef $func $prog
+"""
 
-#endif
+template_dispatch_h = """
+#ifndef DOCOPT_${header_no_ext}_H
+#define DOCOPT_${header_no_ext}_H$renames
+
+/*
+ * Subcommands of $prog, each with a spec of its own, whose usage lines
+ * start with the subcommand.  The program defines <name>_main() for each of
+ * them, which gets argv as main() does, and parses it with the parser
+ * generated for that spec, whose functions are named <name>_docopt() and
+ * so on.
+ */
+$mains
+
+int docopt_command(const char *);
+int docopt_dispatch(int, char *[]);
 
-#ifndef ARG_MAX
-#ifdef NCARGS
-#define ARG_MAX NCARGS
-#else
-#define ARG_MAX 131072
-#endif
 #endif
+"""
 
-struct DocoptArgs {
-    $commands$arguments$flags$options
-    /* special */
-    const char *usage_pattern;
-    const char *help_message[$help_message_n];
+template_dispatch_c = """
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "$header_name"
+
+#define DOCOPT_HAS_TABLES 1
+
+$table
+static const char usage[] =
+        $usage;
+
+$tables
+/* Index of the subcommand `name`, or -1 */
+int docopt_command(const char *name) {
+    int i = table_find(&command_table, name, strlen(name));
+
+    return i >= 0 && strcmp(command_names[i], name) == 0 ? i : -1;
+}
+
+/*
+ * Run the subcommand that argv[1] names, as if with options_first: argv is
+ * not looked at past it, and only the parser and tables of that subcommand
+ * are touched, when its main() gets to them.  Returns its exit status.
+ */
+int docopt_dispatch(int argc, char *argv[]) {
+    const char *word;
+    int i;
+
+    if (argc > 3 && strcmp(argv[1], "--docopt-complete") == 0) {
+        /* argv[4] on are the words, the name of the subcommand is completed
+           here, the rest by the parser of the subcommand */
+        word = argc > 4 ? argv[4] : "";
+        if (atoi(argv[2]) > 1) {
+            i = docopt_command(word);
+            return i >= 0 ? command_mains[i](argc, argv) : EXIT_SUCCESS;
+        }
+        for (i = 0; i < $n_commands; i++)
+            if (strncmp(command_names[i], word, strlen(word)) == 0)
+                puts(command_names[i]);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        printf("%s\\n", usage);
+        return EXIT_SUCCESS;
+    }
+    i = argc > 1 ? docopt_command(argv[1]) : -1;
+    if (i < 0) {
+        if (argc > 1)
+            fprintf(stderr, "%s is not a command\\n", argv[1]);
+        fprintf(stderr, "%s\\n", usage);
+        return EXIT_FAILURE;
+    }
+    return command_mains[i](argc, argv);
+}
+"""
+
+template_table = """/*
+ * Hash tables
+ */
+
+/*
+ * Collision-free hash table, computed by docopt_c.py: a key is placed in
+ * bucket docopt_hash(key, 0), whose seed selects its slot as
+ * docopt_hash(key, seed).  Slots hold element indices, or -1 when empty.
+ */
+struct Table {
+    int n_buckets;
+    int n_slots;
+    const int *seeds;
+    const int *slots;
 };
 
-struct DocoptArgs docopt(int, char *[], bool, const char *);
+#if DOCOPT_HAS_TABLES
+/* FNV-1a, finalized like murmur3; must match c_hash() in docopt_c.py */
+static unsigned long docopt_hash(const char *key, size_t len, unsigned long seed) {
+    unsigned long h = (2166136261UL ^ seed) & 0xffffffffUL;
+    size_t i;
 
+    for (i = 0; i < len; i++)
+        h = ((h ^ (unsigned char) key[i]) * 16777619UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xffffffffUL;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Index of the only element that may be named `key`, or -1 */
+static int table_find(const struct Table *table, const char *key, size_t len) {
+    unsigned long h = docopt_hash(key, len, 0);
+
+    h = docopt_hash(key, len, table->seeds[h & (table->n_buckets - 1)]);
+    return table->slots[h & (table->n_slots - 1)];
+}
 #endif
+
 """
 
 template_c = """
+/* What the spec has, the code for what it has not is left out */
+$features
+
+#if defined(DOCOPT_THREADS) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if defined(DOCOPT_RESPONSE_FILES) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if (defined(DOCOPT_BATCH) || DOCOPT_HAS_CONFIG) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(DOCOPT_BATCH) || DOCOPT_HAS_CONFIG
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if DOCOPT_HAS_CONFIG || defined(DOCOPT_RESPONSE_FILES)
+#include <fcntl.h>
+#endif
+#ifdef DOCOPT_BATCH
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+#ifdef DOCOPT_THREADS
+#include <pthread.h>
+#endif
+
 #include "$header_name"
 
-struct Command {
-    const char *name;
-    bool value;
+#define DOCOPT_HAS_TABLES (DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS || DOCOPT_HAS_TYPES || DOCOPT_HAS_CONFIG)
+
+#if defined(__GNUC__)
+#define DOCOPT_COLD __attribute__((cold, noinline))
+#else
+#define DOCOPT_COLD
+#endif
+
+/*
+ * All parser state is in the contexts but for two statics, trace_default and
+ * kept_contexts, set by docopt_trace(NULL, ...) and docopt() and read as
+ * contexts are made.  With DOCOPT_THREADS they are taken under this lock.
+ */
+#if defined(DOCOPT_THREADS) && (defined(DOCOPT_TRACE) || defined(DOCOPT_RESPONSE_FILES))
+static pthread_mutex_t statics_lock = PTHREAD_MUTEX_INITIALIZER;
+#define STATICS_LOCK() pthread_mutex_lock(&statics_lock)
+#define STATICS_UNLOCK() pthread_mutex_unlock(&statics_lock)
+#else
+#define STATICS_LOCK()
+#define STATICS_UNLOCK()
+#endif
+
+""" + template_table + """
+/*
+ * Usage patterns, compiled by docopt_c.py into a position automaton: state 0
+ * is the start, any other state stands for one occurrence of a command or an
+ * argument in the usage section, and is entered by consuming a positional
+ * token.  Lists are stored flat: the successors of state s, for instance,
+ * are follow[follow_start[s]] .. follow[follow_start[s + 1] - 1].
+ */
+struct Pattern {
+    int n_states;
+    int n_lines;
+    const int *command;         /* per state: command it matches, or -1 */
+    const int *argument;        /* per state: argument it binds, or -1 */
+    const int *line;            /* per state: usage line it is part of */
+    const bool *accepts;        /* per state: a usage line may end here */
+    const int *follow_start;
+    const int *follow;
+    const int *pred_start;
+    const int *pred;
+    const bool *line_nullable;  /* per line: matches without positionals */
+    const int *allowed_start;   /* per line: options it mentions, or */
+    const int *allowed;         /* [options] stands for */
+    const int *required_start;  /* per line: options it cannot do without */
+    const int *required;
+    const int *needed_start;    /* per line: -1 terminated groups of */
+    const int *needed;          /* options it takes at least one of */
+    const int *exclusive_start; /* per line: -1 terminated groups of */
+    const int *exclusive;       /* options it takes at most one of */
 };
 
-struct Argument {
-    const char *name;
-    const char *value;
-    const char *array[ARG_MAX];
+/* Sets of states reached after each positional token, run-length encoded */
+struct Trail {
+    size_t words;
+    int n;
+    int capacity;
+    unsigned long *sets;
+    int *runs;
 };
 
-struct Option {
-    const char *oshort;
-    const char *olong;
-    bool argcount;
-    bool value;
-    const char *argument;
+/* How an option argument is converted, after its [type: ...] in the spec */
+enum TypeKind {
+    TYPE_INT,                   /* long, at least min and at most max */
+    TYPE_FLOAT,                 /* double */
+    TYPE_ENUM                   /* int, the index of one of the choices */
 };
 
-struct Elements {
+struct Type {
+    enum TypeKind kind;
+    long min;
+    long max;
+    int n_choices;
+    const char *const *choices;
+    const struct Table *table;  /* of the choices, or NULL to scan them */
+};
+
+/*
+ * Names by length: those n long are order[start[n]] .. order[start[n + 1] - 1],
+ * in alphabetical order, where each shares its first lcp[] characters with
+ * the one before.
+ */
+struct ByLength {
+    int max;
+    const int *start;
+    const int *order;
+    const int *lcp;
+};
+
+/*
+ * The elements of the usage section, as parallel arrays in the order of the
+ * members of struct DocoptArgs they are stored in: commands by name,
+ * arguments in the order of usage, options without then with arguments.
+ * `fields` are the offsetof() those members.
+ */
+struct Spec {
     int n_commands;
     int n_arguments;
     int n_options;
-    struct Command *commands;
-    struct Argument *arguments;
-    struct Option *options;
+    const char *const *command_names;
+    const size_t *command_fields;
+    const bool *argument_repeating;
+    const size_t *argument_fields;
+    const char *const *option_shorts;
+    const char *const *option_longs;
+    const bool *option_argcounts;
+    const size_t *option_fields;
+    const int *option_counters;     /* per option: its counter, or -1 */
+    const bool *option_repeating;   /* per option: may be given more than once */
+    const int *command_counters;    /* per command: its counter when it may repeat, or -1 */
+    const int *command_bits;        /* per element: its bit of DocoptArgs.bits, */
+    const int *option_bits;         /* or -1 when it has a member of its own */
+    const int *option_types;        /* per option: its type, or -1 for char * */
+    const int *long_unique;         /* per option: the shortest its long name may be cut to */
+    const int *long_sorted;         /* options with a long name, sorted by it */
+    const char *const *option_envs;     /* per option: its [env: NAME], or NULL */
+    const char *const *option_configs;  /* per option: its [config: key], or NULL */
+    size_t bits_field;
+    const struct Type *types;
+    int n_longs;
+    const struct Table *long_table;
+    const struct Table *command_table;
+    unsigned long command_lengths;      /* bit LENGTH_BIT(n) set when a name is n long */
+    const int *short_table;
+    const struct Table *config_table;   /* of the option_configs, */
+    unsigned long config_lengths;       /* and their lengths like command_lengths */
+    struct ByLength long_by_length;     /* options with a long name, by its length after "--" */
+    struct ByLength command_by_length;
+    const struct Pattern *pattern;
+};
+
+/* Bit of a length in Spec.command_lengths, the last one for all that are longer */
+#define LENGTH_BIT(len) (1UL << ((len) < 31 ? (len) : 31))
+
+/*
+ * What a parse found, the only part of the elements written to: bitsets of
+ * the commands and options given, how often commands and options that may
+ * repeat were, the values of argument i, which are
+ * argv[offsets[i]] .. argv[offsets[i] + counts[i] - 1], and those of the
+ * options with an argument that may repeat, in the order given.
+ */
+struct Elements {
+    const struct Spec *spec;
+    unsigned long *commands;
+    unsigned long *options;
+    const char **option_arguments;
+    int *offsets;
+    int *counts;
+    int *counters;
+    int *bound;                 /* per positional token: its argument, or -1 */
+    const char *error;          /* token or option the last error is about */
+    char error_short[3];        /* "-x" when it is an unknown short option, */
+    const char *error_word;     /* and the "-abx" it is part of */
+    int candidates[2];          /* range of long_sorted an ambiguous option abbreviates */
+#if DOCOPT_HAS_LISTS
+    const char **values;        /* per value of such an option, */
+    int *value_options;         /* and the option it is of */
+    int n_values;
+#endif
+#ifdef DOCOPT_TRACE
+    const struct DocoptTrace *trace;
+#endif
 };
 
+$tables
+
+
+/*
+ * Tracing, compiled out unless DOCOPT_TRACE is defined
+ */
+
+#ifdef DOCOPT_TRACE
+/* what contexts start with, set by docopt_trace(NULL, ...), see statics_lock */
+static const struct DocoptTrace *trace_default;
+
+static void trace_phase(const struct DocoptTrace *trace, enum DocoptPhase phase) {
+    if (trace != NULL && trace->phase != NULL)
+        trace->phase(trace->data, phase);
+}
+
+static void trace_token(const struct DocoptTrace *trace, const char *token) {
+    if (trace != NULL && trace->token != NULL)
+        trace->token(trace->data, token);
+}
+
+#if DOCOPT_HAS_SHORTS || DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS
+/* of find_long(), parse_shorts() and find_command() */
+static void trace_lookup(const struct DocoptTrace *trace, const char *name, size_t len, int probes) {
+    if (trace != NULL && trace->lookup != NULL)
+        trace->lookup(trace->data, name, len, probes);
+}
+#endif
+
+static void trace_error(const struct DocoptTrace *trace, int error, const char *token) {
+    if (trace != NULL && trace->error != NULL)
+        trace->error(trace->data, (enum DocoptError) error, token);
+}
+
+#define TRACE_PHASE(trace, phase) trace_phase(trace, phase)
+#define TRACE_TOKEN(trace, token) trace_token(trace, token)
+#define TRACE_LOOKUP(trace, name, len, probes) trace_lookup(trace, name, len, probes)
+#define TRACE_ERROR(trace, error, token) trace_error(trace, error, token)
+#else
+#define TRACE_PHASE(trace, phase) ((void) 0)
+#define TRACE_TOKEN(trace, token) ((void) 0)
+#define TRACE_LOOKUP(trace, name, len, probes) ((void) 0)
+#define TRACE_ERROR(trace, error, token) ((void) 0)
+#endif
+
+
+/*
+ * Trail object
+ */
+
+#define WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define SET_HAS(set, s) (((set)[(s) / WORD_BITS] >> ((s) % WORD_BITS)) & 1)
+#define SET_ADD(set, s) ((set)[(s) / WORD_BITS] |= 1UL << ((s) % WORD_BITS))
+
+#if defined(__GNUC__)
+#define lowest_bit(w) __builtin_ctzl(w)
+#else
+static int lowest_bit(unsigned long w) {
+    int b = 0;
+
+    while (!(w & 1)) {
+        w >>= 1;
+        b++;
+    }
+    return b;
+}
+#endif
+
+/* Empty set following the last one, or NULL when out of memory */
+static unsigned long *trail_next(struct Trail *trail) {
+    unsigned long *set;
+
+    if (trail->n == trail->capacity) {
+        int capacity = trail->capacity ? 2 * trail->capacity : 16;
+        unsigned long *sets;
+        int *runs;
+
+        sets = realloc(trail->sets, capacity * trail->words * sizeof(unsigned long));
+        if (sets == NULL)
+            return NULL;
+        trail->sets = sets;
+        runs = realloc(trail->runs, capacity * sizeof(int));
+        if (runs == NULL)
+            return NULL;
+        trail->runs = runs;
+        trail->capacity = capacity;
+    }
+    set = &trail->sets[trail->n * trail->words];
+    memset(set, 0, trail->words * sizeof(unsigned long));
+    return set;
+}
+
+/* Append the set filled in after trail_next(), merging it with an equal one */
+static void trail_push(struct Trail *trail) {
+    unsigned long *set = &trail->sets[trail->n * trail->words];
+
+    if (trail->n > 0 && !memcmp(set - trail->words, set, trail->words * sizeof(unsigned long)))
+        trail->runs[trail->n - 1]++;
+    else
+        trail->runs[trail->n++] = 1;
+}
+
+static void trail_free(struct Trail *trail) {
+    free(trail->sets);
+    free(trail->runs);
+    trail->sets = NULL;
+    trail->runs = NULL;
+    trail->n = trail->capacity = 0;
+}
+
 
 /*
  * Tokens object
@@ -182,266 +684,3037 @@ struct Tokens {
     char **argv;
     int i;
     char *current;
+    int n_positional;
+    int separator;              /* the positional token that is the "--" ending options, or -1 */
+    char **spare;               /* the option tokens of argv[n_positional..i), in order */
+#ifdef DOCOPT_TRACE
+    const struct DocoptTrace *trace;
+#endif
 };
 
-const char usage_pattern[] =
+static const char usage_pattern[] =
         $usage_pattern;
 
-struct Tokens tokens_new(int argc, char **argv) {
+/* Tokens of argv, with `spare` room for argc of them */
+static struct Tokens tokens_new(int argc, char **argv, char **spare) {
     struct Tokens ts;
     ts.argc = argc;
     ts.argv = argv;
     ts.i = 0;
-    ts.current = argv[0];
+    ts.current = argc > 0 ? argv[0] : NULL;
+    ts.n_positional = 0;
+    ts.separator = -1;
+    ts.spare = spare;
+#ifdef DOCOPT_TRACE
+    ts.trace = NULL;
+#endif
     return ts;
 }
 
-struct Tokens *tokens_move(struct Tokens *ts) {
+/* Step over the current token, an option or its argument */
+static struct Tokens *tokens_move(struct Tokens *ts) {
     if (ts->i < ts->argc) {
-        ts->current = ts->argv[++ts->i];
-    }
-    if (ts->i == ts->argc) {
-        ts->current = NULL;
+        TRACE_TOKEN(ts->trace, ts->current);
+        ts->spare[ts->i - ts->n_positional] = ts->current;
+        ts->i++;
     }
+    ts->current = ts->i < ts->argc ? ts->argv[ts->i] : NULL;
     return ts;
 }
 
+/*
+ * Take the current token as positional.  It goes to argv[n_positional],
+ * whose option token, if any, is in spare already, so that positional
+ * values end up as one run argv[0..n_positional) and tokens_end() puts the
+ * option tokens back after them.  Like GNU getopt, argv is only permuted,
+ * never copied, but each token is moved once, however they interleave.
+ */
+static int tokens_gather(struct Tokens *ts) {
+    TRACE_TOKEN(ts->trace, ts->current);
+    ts->argv[ts->n_positional] = ts->current;
+    ts->i++;
+    ts->current = ts->i < ts->argc ? ts->argv[ts->i] : NULL;
+    return ts->n_positional++;
+}
+
+/* Put the option tokens stepped over back after the positional ones */
+static void tokens_end(struct Tokens *ts) {
+    if (ts->i > ts->n_positional)
+        memcpy(&ts->argv[ts->n_positional], ts->spare, (ts->i - ts->n_positional) * sizeof(char *));
+}
+
 
 /*
  * ARGV parsing functions
  */
 
-int parse_doubledash(struct Tokens *ts, struct Elements *elements) {
-    /*
-    int n_commands = elements->n_commands;
-    int n_arguments = elements->n_arguments;
-    Command *commands = elements->commands;
-    Argument *arguments = elements->arguments;
-
-    not implemented yet
-    return parsed + [Argument(None, v) for v in tokens]
-    */
-    return 0;
+static int parse_doubledash(struct Tokens *ts, struct Elements *elements) {
+    /* "--" and all that follows are positional, the "--" itself only
+       matches a [--] in the usage section, when there is one */
+    (void) elements;
+    ts->separator = ts->n_positional;
+    while (ts->current != NULL)
+        tokens_gather(ts);
+    return DOCOPT_OK;
+}
+
+#if DOCOPT_HAS_SHORTS || DOCOPT_HAS_LONGS
+/* An option given again matches no usage line unless one repeats it */
+static int option_given(struct Elements *elements, int i) {
+    const struct Spec *spec = elements->spec;
+    const int *counters = spec->option_counters;
+
+    if (SET_HAS(elements->options, i) && spec->option_repeating != NULL && !spec->option_repeating[i]) {
+        elements->error = spec->option_longs[i] != NULL ? spec->option_longs[i] : spec->option_shorts[i];
+        return DOCOPT_NO_MATCH;
+    }
+    SET_ADD(elements->options, i);
+    if (counters != NULL && counters[i] >= 0)
+        elements->counters[counters[i]]++;
+    return DOCOPT_OK;
+}
+
+/* The argument of option i, of which those that may repeat keep every one */
+static void option_argument(struct Elements *elements, int i, const char *value) {
+    elements->option_arguments[i] = value;
+#if DOCOPT_HAS_LISTS
+    if (elements->spec->option_counters[i] >= 0) {
+        elements->values[elements->n_values] = value;
+        elements->value_options[elements->n_values++] = i;
+    }
+#endif
+}
+#endif
+
+#if DOCOPT_HAS_LONGS
+/*
+ * Long options whose names start with the first `len` characters of
+ * `token`, found by binary search in long_sorted: they are
+ * long_sorted[candidates[0] .. candidates[1] - 1].  Only taken on errors.
+ */
+static DOCOPT_COLD int long_candidates(struct Elements *elements, const char *token, size_t len) {
+    const struct Spec *spec = elements->spec;
+    int lo = 0, hi = spec->n_longs, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(spec->option_longs[spec->long_sorted[mid]], token, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    elements->candidates[0] = lo;
+    hi = spec->n_longs;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(spec->option_longs[spec->long_sorted[mid]], token, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    elements->candidates[1] = lo;
+    return elements->candidates[1] - elements->candidates[0];
+}
+
+/*
+ * Option that the first `len` characters of `token` spell or abbreviate,
+ * -1 if none does, -2 if they are the prefix of several.  long_table holds
+ * each long name and its prefixes that are at least long_unique[] long,
+ * which no other name starts with, so one lookup resolves both.
+ */
+static int find_long(struct Elements *elements, const char *token, size_t len) {
+    const struct Spec *spec = elements->spec;
+    const char *const *longs = spec->option_longs;
+    int i, found = -1;
+
+    if (spec->long_table != NULL) {
+        i = table_find(spec->long_table, token, len);
+        TRACE_LOOKUP(elements->trace, token, len, 1);
+        if (i >= 0 && !strncmp(token, longs[i], len)
+                && (longs[i][len] == '\\0' || len >= (size_t) spec->long_unique[i]))
+            return i;
+        return long_candidates(elements, token, len) > 1 ? -2 : -1;
+    }
+    for (i = 0; i < spec->n_options; i++) {
+        if (longs[i] == NULL || strncmp(token, longs[i], len))
+            continue;
+        if (longs[i][len] == '\\0') {
+            TRACE_LOOKUP(elements->trace, token, len, i + 1);
+            return i;
+        }
+        found = found == -1 ? i : -2;
+    }
+    TRACE_LOOKUP(elements->trace, token, len, spec->n_options);
+    return found;
 }
 
-int parse_long(struct Tokens *ts, struct Elements *elements) {
+static int parse_long(struct Tokens *ts, struct Elements *elements) {
+    const struct Spec *spec = elements->spec;
+    const char *const *longs = spec->option_longs;
     int i;
-    int len_prefix;
-    int n_options = elements->n_options;
+    size_t len_prefix;
     char *eq = strchr(ts->current, '=');
-    struct Option *option;
-    struct Option *options = elements->options;
 
-    len_prefix = (eq - (ts->current)) / sizeof(char);
-    for (i = 0; i < n_options; i++) {
-        option = &options[i];
-        if (!strncmp(ts->current, option->olong, len_prefix))
-            break;
-    }
-    if (i == n_options) {
-        /* TODO: %s is not a unique prefix */
-        fprintf(stderr, "%s is not recognized\\n", ts->current);
-        return 1;
+    len_prefix = eq != NULL ? (size_t) (eq - ts->current) : strlen(ts->current);
+    i = find_long(elements, ts->current, len_prefix);
+    if (i < 0) {
+        elements->error = ts->current;
+        return i == -2 ? DOCOPT_AMBIGUOUS_OPTION : DOCOPT_UNKNOWN_OPTION;
     }
     tokens_move(ts);
-    if (option->argcount) {
+    if (spec->option_argcounts[i]) {
         if (eq == NULL) {
             if (ts->current == NULL) {
-                fprintf(stderr, "%s requires argument\\n", option->olong);
-                return 1;
+                elements->error = longs[i];
+                return DOCOPT_MISSING_ARGUMENT;
             }
-            option->argument = ts->current;
+            option_argument(elements, i, ts->current);
             tokens_move(ts);
         } else {
-            option->argument = eq + 1;
-        }
-    } else {
-        if (eq != NULL) {
-            fprintf(stderr, "%s must not have an argument\\n", option->olong);
-            return 1;
+            option_argument(elements, i, eq + 1);
         }
-        option->value = true;
+    } else if (eq != NULL) {
+        elements->error = longs[i];
+        return DOCOPT_UNEXPECTED_ARGUMENT;
     }
-    return 0;
+    return option_given(elements, i);
+}
+#else
+static int parse_long(struct Tokens *ts, struct Elements *elements) {
+    /* the spec has no long options */
+    elements->error = ts->current;
+    return DOCOPT_UNKNOWN_OPTION;
+}
+#endif
+
+/* "-c" of `word` is not an option of the spec */
+static DOCOPT_COLD int unknown_short(struct Elements *elements, const char *word, char c) {
+    elements->error_word = word;
+    elements->error_short[0] = '-';
+    elements->error_short[1] = c;
+    elements->error_short[2] = '\\0';
+    elements->error = elements->error_short;
+    return DOCOPT_UNKNOWN_OPTION;
 }
 
-int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+#if DOCOPT_HAS_SHORTS
+static int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+    const struct Spec *spec = elements->spec;
+    const char *const *shorts = spec->option_shorts;
+    const char *word = ts->current;
     char *raw;
     int i;
-    int n_options = elements->n_options;
-    struct Option *option;
-    struct Option *options = elements->options;
+    int ret;
+    int n_options = spec->n_options;
 
     raw = &ts->current[1];
     tokens_move(ts);
     while (raw[0] != '\\0') {
-        for (i = 0; i < n_options; i++) {
-            option = &options[i];
-            if (option->oshort != NULL && option->oshort[1] == raw[0])
-                break;
-        }
-        if (i == n_options) {
-            /* TODO -%s is specified ambiguously %d times */
-            fprintf(stderr, "-%c is not recognized\\n", raw[0]);
-            return EXIT_FAILURE;
+        if (spec->short_table != NULL) {
+            i = spec->short_table[(unsigned char) raw[0]];
+        } else {
+            for (i = 0; i < n_options; i++)
+                if (shorts[i] != NULL && shorts[i][1] == raw[0])
+                    break;
+            if (i == n_options)
+                i = -1;
         }
+        TRACE_LOOKUP(elements->trace, raw, 1, spec->short_table != NULL ? 1 : (i < 0 ? n_options : i + 1));
+        if (i < 0)
+            return unknown_short(elements, word, raw[0]);
         raw++;
-        if (!option->argcount) {
-            option->value = true;
-        } else {
+        ret = option_given(elements, i);
+        if (ret != DOCOPT_OK)
+            return ret;
+        if (spec->option_argcounts[i]) {
             if (raw[0] == '\\0') {
                 if (ts->current == NULL) {
-                    fprintf(stderr, "%s requires argument\\n", option->oshort);
-                    return EXIT_FAILURE;
+                    elements->error = shorts[i];
+                    return DOCOPT_MISSING_ARGUMENT;
                 }
                 raw = ts->current;
                 tokens_move(ts);
             }
-            option->argument = raw;
+            option_argument(elements, i, raw);
             break;
         }
     }
-    return EXIT_SUCCESS;
+    return DOCOPT_OK;
 }
+#else
+static int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+    /* the spec has no short options */
+    const char *word = ts->current;
 
-int parse_argcmd(struct Tokens *ts, struct Elements *elements) {
-    int i;
-    int n_commands = elements->n_commands;
-    /* int n_arguments = elements->n_arguments; */
-    struct Command *command;
-    struct Command *commands = elements->commands;
-    /* Argument *arguments = elements->arguments; */
-
-    for (i = 0; i < n_commands; i++) {
-        command = &commands[i];
-        if (strcmp(command->name, ts->current) == 0) {
-            command->value = true;
-            tokens_move(ts);
-            return EXIT_SUCCESS;
-        }
-    }
-    /* not implemented yet, just skip for now
-       parsed.append(Argument(None, tokens.move())) */
-    /*
-    fprintf(stderr, "! argument '%s' has been ignored\\n", ts->current);
-    fprintf(stderr, "  '");
-    for (i=0; i<ts->argc ; i++)
-        fprintf(stderr, "%s ", ts->argv[i]);
-    fprintf(stderr, "'\\n");
-    */
     tokens_move(ts);
-    return EXIT_SUCCESS;
+    return unknown_short(elements, word, word[1]);
+}
+#endif
+
+static int parse_argcmd(struct Tokens *ts, struct Elements *elements) {
+    /* whether it is a command or an argument is up to match_pattern */
+    (void) elements;
+    tokens_gather(ts);
+    return DOCOPT_OK;
 }
 
-int parse_args(struct Tokens *ts, struct Elements *elements) {
-    int ret = EXIT_FAILURE;
+static int parse_args(struct Tokens *ts, struct Elements *elements) {
+    int ret = DOCOPT_OK;
 
-    while (ts->current != NULL) {
+    while (ts->current != NULL && ret == DOCOPT_OK) {
         if (strcmp(ts->current, "--") == 0) {
             ret = parse_doubledash(ts, elements);
-            if (ret == EXIT_FAILURE) break;
         } else if (ts->current[0] == '-' && ts->current[1] == '-') {
             ret = parse_long(ts, elements);
         } else if (ts->current[0] == '-' && ts->current[1] != '\\0') {
             ret = parse_shorts(ts, elements);
         } else
             ret = parse_argcmd(ts, elements);
-        if (ret) return ret;
     }
+    tokens_end(ts);
     return ret;
 }
 
-int elems_to_args(struct Elements *elements, struct DocoptArgs *args,
-                     const bool help, const char *version) {
-    struct Command *command;
-    struct Argument *argument;
-    struct Option *option;
-    int i, j;
-
-    /* fix gcc-related compiler warnings (unused) */
-    (void) command;
-    (void) argument;
+static int parse_extras(struct Elements *elements, const bool help, const bool version) {
+#if DOCOPT_HAS_EXTRAS
+    const struct Spec *spec = elements->spec;
+    const char *olong;
+    int i;
 
-    /* options */
-    for (i = 0; i < elements->n_options; i++) {
-        option = &elements->options[i];
-        if (help && option->value && strcmp(option->olong, "--help") == 0) {
-            for (j = 0; j < $help_message_n; j++)
-                puts(args->help_message[j]);
-            return EXIT_FAILURE;
-        } else if (version && option->value &&
-                   strcmp(option->olong, "--version") == 0) {
-            puts(version);
-            return EXIT_FAILURE;
-        }$if_flag$if_option
-    }
-    /* commands */
-    for (i = 0; i < elements->n_commands; i++) {
-        command = &elements->commands[i];
-        $if_command
-    }
-    /* arguments */
-    for (i = 0; i < elements->n_arguments; i++) {
-        argument = &elements->arguments[i];
-        $if_argument
+    for (i = 0; i < spec->n_options; i++) {
+        olong = spec->option_longs[i];
+        if (spec->option_argcounts[i] || !SET_HAS(elements->options, i) || olong == NULL)
+            continue;
+        if (help && strcmp(olong, "--help") == 0) {
+            elements->error = olong;
+            return DOCOPT_HELP;
+        } else if (version && strcmp(olong, "--version") == 0) {
+            elements->error = olong;
+            return DOCOPT_VERSION;
+        }
     }
-    return EXIT_SUCCESS;
+#else
+    /* the spec has neither --help nor --version */
+    (void) elements;
+    (void) help;
+    (void) version;
+#endif
+    return DOCOPT_OK;
 }
 
 
 /*
- * Main docopt function
+ * Usage pattern matching
  */
 
-struct DocoptArgs docopt(int argc, char *argv[], const bool help, const char *version) {
-    struct DocoptArgs args = {$defaults
-            usage_pattern,
-            $help_message
-    };
-    struct Command commands[] = {$elems_cmds
-    };
-    struct Argument arguments[] = {$elems_args
-    };
-    struct Option options[] = {$elems_opts
-    };
-    struct Elements elements;
-    int return_code = EXIT_SUCCESS;
+#if DOCOPT_HAS_COMMANDS
+static int find_command(struct Elements *elements, const char *name) {
+    const struct Spec *spec = elements->spec;
+    const char *const *names = spec->command_names;
+    size_t len = strlen(name);
+    int i;
+
+    if (spec->command_table != NULL) {
+        /* arguments, the other positional tokens, are rarely that long */
+        if (!(spec->command_lengths & LENGTH_BIT(len))) {
+            TRACE_LOOKUP(elements->trace, name, len, 0);
+            return -1;
+        }
+        i = table_find(spec->command_table, name, len);
+        TRACE_LOOKUP(elements->trace, name, len, 1);
+        return i >= 0 && strcmp(names[i], name) == 0 ? i : -1;
+    }
+    for (i = 0; i < spec->n_commands; i++) {
+        if (strcmp(names[i], name) == 0) {
+            TRACE_LOOKUP(elements->trace, name, len, i + 1);
+            return i;
+        }
+    }
+    TRACE_LOOKUP(elements->trace, name, len, spec->n_commands);
+    return -1;
+}
+#endif
 
-    elements.n_commands = $t_elems_n_commands;
-    elements.n_arguments = $t_elems_n_arguments;
-    elements.n_options = $t_elems_n_options;
-    elements.commands = commands;
-    elements.arguments = arguments;
-    elements.options = options;
+/* Whether the options given on the command line are the ones `line` takes */
+static bool match_options(struct Elements *elements, int line) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    const unsigned long *given = elements->options;
+    size_t words = (elements->spec->n_options + WORD_BITS - 1) / WORD_BITS;
+    size_t w;
+    unsigned long bits;
+    int i;
+    int n_given = 0;
+    int n_allowed = 0;
+    int n_group = 0;
 
-    if (argc == 1) {
-        argv[argc++] = "--help";
-        argv[argc++] = NULL;
-        return_code = EXIT_FAILURE;
+    for (i = pattern->required_start[line]; i < pattern->required_start[line + 1]; i++)
+        if (!SET_HAS(given, pattern->required[i]))
+            return false;
+    for (i = pattern->needed_start[line]; i < pattern->needed_start[line + 1]; i++) {
+        if (pattern->needed[i] < 0) {
+            if (n_group == 0)
+                return false;
+            n_group = 0;
+            continue;
+        }
+        if (SET_HAS(given, pattern->needed[i]))
+            n_group++;
     }
+    for (i = pattern->exclusive_start[line]; i < pattern->exclusive_start[line + 1]; i++) {
+        if (pattern->exclusive[i] < 0) {
+            n_group = 0;
+            continue;
+        }
+        if (SET_HAS(given, pattern->exclusive[i]) && ++n_group > 1)
+            return false;
+    }
+    for (w = 0; w < words; w++)
+        for (bits = given[w]; bits != 0; bits &= bits - 1)
+            n_given++;
+    for (i = pattern->allowed_start[line]; i < pattern->allowed_start[line + 1]; i++)
+        if (SET_HAS(given, pattern->allowed[i]))
+            n_allowed++;
+    return n_given == n_allowed;
+}
+
+/* Record that positional token `k` was consumed by entering `state`;
+   whether other tokens sit between it and the later values of its argument */
+static bool bind_token(struct Elements *elements, int k, int state) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    const int *command_counters = elements->spec->command_counters;
+    int *offsets = elements->offsets;
+    int *counts = elements->counts;
+    int c = pattern->command[state];
+    bool apart;
+    int a;
 
-    {
-        struct Tokens ts = tokens_new(argc, argv);
-        if (parse_args(&ts, &elements))
-            exit(EXIT_FAILURE);
+    elements->bound[k] = -1;
+    if (c >= 0) {
+        SET_ADD(elements->commands, c);
+        if (command_counters != NULL && command_counters[c] >= 0)
+            elements->counters[command_counters[c]]++;
+        return false;
     }
-    if (elems_to_args(&elements, &args, help, version))
-        exit(return_code);
-    return args;
+    a = elements->bound[k] = pattern->argument[state];
+    apart = counts[a] > 0 && offsets[a] != k + 1;
+    offsets[a] = k;
+    counts[a]++;
+    return apart;
 }
-"""
 
-def to_initializer(val):
-    if isinstance(val, (str, type(None), bool, numbers.Number)):
-        return to_c(val)
+/*
+ * Make the values of each argument one run of argv[0..n), in their order,
+ * commands first and then the arguments in the order of usage: a stable
+ * counting sort by argument, each token moved once, where moving each value
+ * next to the later ones took O(n^2) when those of (<k> <v>)... alternate.
+ */
+static void sort_values(struct Tokens *ts, struct Elements *elements) {
+    int *offsets = elements->offsets;
+    const int *counts = elements->counts;
+    const int *bound = elements->bound;
+    int n = ts->n_positional;
+    int k, a, at = 0;
 
-    return '{{{}}}'.format(',\n'.join('{}"{}"'.format(' ' * 10, k) for k in val)[9:])
+    for (k = 0; k < n; k++)
+        if (bound[k] < 0)
+            ts->spare[at++] = ts->argv[k];
+    for (a = 0; a < elements->spec->n_arguments; a++) {
+        offsets[a] = at;
+        at += counts[a];
+    }
+    for (k = 0; k < n; k++)
+        if (bound[k] >= 0)
+            ts->spare[offsets[bound[k]]++] = ts->argv[k];
+    for (a = 0; a < elements->spec->n_arguments; a++)
+        offsets[a] -= counts[a];
+    memcpy(ts->argv, ts->spare, n * sizeof(char *));
+}
 
+/*
+ * Run the positional tokens argv[0..n_positional) through the automaton,
+ * keeping the set of states reached after each of them, so that a match
+ * takes O(tokens * states) time whatever the number of alternatives.
+ */
+static int match_states(struct Tokens *ts, struct Elements *elements, struct Trail *trail) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    unsigned long *set;
+    unsigned long *next;
+    int n = ts->n_positional;
+    int k, q, p, j, command;
+    size_t w;
+    unsigned long bits;
+    bool reached, separator;
 
-def to_c(val):
-    if type(val) is str:
-        return '"{}"'.format(val
-                             .replace('\\', r'\\')
+    trail->words = (pattern->n_states + WORD_BITS - 1) / WORD_BITS;
+    trail->n = 0;
+    set = trail_next(trail);
+    if (set == NULL)
+        return DOCOPT_NO_MEMORY;
+    SET_ADD(set, 0);
+    trail_push(trail);
+    for (k = 0; k < n; k++) {
+#if DOCOPT_HAS_COMMANDS
+        command = find_command(elements, ts->argv[k]);
+#else
+        command = -1;
+#endif
+        /* the "--" ending options only matches the [--] of the usage, if it has one */
+        separator = k == ts->separator && command >= 0;
+        next = trail_next(trail);
+        if (next == NULL)
+            return DOCOPT_NO_MEMORY;
+        set = next - trail->words;
+        reached = false;
+        for (w = 0; w < trail->words; w++) {
+            for (bits = set[w]; bits != 0; bits &= bits - 1) {
+                q = w * WORD_BITS + lowest_bit(bits);
+                for (j = pattern->follow_start[q]; j < pattern->follow_start[q + 1]; j++) {
+                    p = pattern->follow[j];
+                    if (pattern->command[p] == command || (pattern->command[p] < 0 && !separator)) {
+                        SET_ADD(next, p);
+                        reached = true;
+                    }
+                }
+            }
+        }
+        if (!reached) {
+            elements->error = ts->argv[k];
+            return DOCOPT_NO_MATCH;
+        }
+        trail_push(trail);
+    }
+    return DOCOPT_OK;
+}
+
+/*
+ * Match the positional tokens against the usage section, then walk back
+ * from an accepting state along the trail to bind them.
+ */
+static int match_pattern(struct Tokens *ts, struct Elements *elements, struct Trail *trail) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    unsigned long *set;
+    int n = ts->n_positional;
+    int state = -1;
+    int line = -1;
+    int k, p, j, entry, run;
+    bool apart = false;
+    int ret = match_states(ts, elements, trail);
+
+    if (ret != DOCOPT_OK)
+        return ret;
+    set = &trail->sets[(trail->n - 1) * trail->words];
+    if (n == 0) {
+        for (line = 0; line < pattern->n_lines; line++)
+            if (pattern->line_nullable[line] && match_options(elements, line))
+                break;
+        return line < pattern->n_lines ? DOCOPT_OK : DOCOPT_NO_MATCH;
+    }
+    for (p = 1; p < pattern->n_states; p++) {
+        if (SET_HAS(set, p) && pattern->accepts[p] && match_options(elements, pattern->line[p])) {
+            state = p;
+            break;
+        }
+    }
+    if (state < 0)
+        return DOCOPT_NO_MATCH;
+
+    entry = trail->n - 1;
+    run = trail->runs[entry];
+    for (k = n - 1; k >= 0; k--) {
+        if (bind_token(elements, k, state))
+            apart = true;
+        if (--run == 0)
+            run = trail->runs[--entry];
+        set = &trail->sets[entry * trail->words];
+        for (j = pattern->pred_start[state]; !SET_HAS(set, pattern->pred[j]); j++)
+            ;
+        state = pattern->pred[j];
+    }
+    if (apart)
+        sort_values(ts, elements);
+    return DOCOPT_OK;
+}
+
+/*
+ * Typed option values
+ */
+
+#if DOCOPT_HAS_TYPES
+/* Decimal integer, with none of the locale or base handling of strtol() */
+static int parse_int(const char *s, long *value) {
+    bool negative = s[0] == '-';
+    unsigned long limit = negative ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+    unsigned long n = 0;
+    unsigned d;
+
+    if (s[0] == '-' || s[0] == '+')
+        s++;
+    if (*s < '0' || *s > '9')
+        return DOCOPT_INVALID_VALUE;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        d = *s - '0';
+        if (n > (limit - d) / 10)
+            return DOCOPT_OUT_OF_RANGE;
+        n = n * 10 + d;
+    }
+    if (*s != '\\0')
+        return DOCOPT_INVALID_VALUE;
+    *value = negative && n > 0 ? -(long) (n - 1) - 1 : (long) n;
+    return DOCOPT_OK;
+}
+
+/*
+ * Decimal number with an optional exponent.  When its digits fit in 2^53
+ * and its exponent is at most 22, both are exact doubles and one multiply
+ * or divide rounds correctly (Clinger's fast path).  Longer numbers go to
+ * strtod(), with the '.' swapped for the decimal point of the locale, in a
+ * copy on the stack or, past 64 bytes, on the heap.
+ */
+static int parse_float(const char *s, double *value) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = s;
+    const char *point = NULL;
+    const char *decimal_point = localeconv()->decimal_point;
+    char copy[64];
+    char *heap = NULL;
+    char *end;
+    unsigned long mantissa = 0;
+    int digits = 0, exponent = 0, e = 0, sign = 1, ret;
+    bool exact = true;
+
+    if (*p == '-' || *p == '+')
+        p++;
+    for (; (*p >= '0' && *p <= '9') || (*p == '.' && point == NULL); p++) {
+        if (*p == '.') {
+            point = p;
+            continue;
+        }
+        digits++;
+        if (mantissa > (ULONG_MAX - 9) / 10)
+            exact = false;
+        else
+            mantissa = mantissa * 10 + (*p - '0');
+        if (point != NULL)
+            exponent--;
+    }
+    if (digits == 0)
+        return DOCOPT_INVALID_VALUE;
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '-' || *p == '+')
+            sign = *p++ == '-' ? -1 : 1;
+        if (*p < '0' || *p > '9')
+            return DOCOPT_INVALID_VALUE;
+        for (; *p >= '0' && *p <= '9'; p++)
+            if (e < 10000)
+                e = e * 10 + (*p - '0');
+        exponent += sign * e;
+    }
+    if (*p != '\\0')
+        return DOCOPT_INVALID_VALUE;
+    if (exact && (double) mantissa <= 9007199254740992.0 && exponent >= -22 && exponent <= 22) {
+        *value = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+        if (s[0] == '-')
+            *value = -*value;
+        return DOCOPT_OK;
+    }
+    if (point != NULL && strcmp(decimal_point, ".") != 0) {
+        /* only copied in such locales */
+        if ((size_t) (p - s) + strlen(decimal_point) > sizeof(copy)) {
+            heap = malloc((size_t) (p - s) + strlen(decimal_point));
+            if (heap == NULL)
+                return DOCOPT_NO_MEMORY;
+        }
+        end = heap != NULL ? heap : copy;
+        memcpy(end, s, point - s);
+        strcpy(end + (point - s), decimal_point);
+        strcat(end, point + 1);
+        s = end;
+    }
+    errno = 0;
+    *value = strtod(s, &end);
+    ret = errno == ERANGE && (*value == HUGE_VAL || *value == -HUGE_VAL)
+        ? DOCOPT_OUT_OF_RANGE : DOCOPT_OK;
+    free(heap);
+    return ret;
+}
+
+/* Index of `s` among the choices of an enum type */
+static int parse_choice(const struct Type *type, const char *s, int *value) {
+    int i;
+
+    if (type->table != NULL) {
+        i = table_find(type->table, s, strlen(s));
+        if (i >= 0 && strcmp(type->choices[i], s) == 0) {
+            *value = i;
+            return DOCOPT_OK;
+        }
+        return DOCOPT_INVALID_VALUE;
+    }
+    for (i = 0; i < type->n_choices; i++) {
+        if (strcmp(type->choices[i], s) == 0) {
+            *value = i;
+            return DOCOPT_OK;
+        }
+    }
+    return DOCOPT_INVALID_VALUE;
+}
+
+#endif
+
+/* Store the argument of option i, converted to its [type: ...] if it has one */
+static int store_argument(const struct Spec *spec, char *base, int i, const char *argument) {
+    char *field = base + spec->option_fields[i];
+#if DOCOPT_HAS_TYPES
+    const struct Type *type;
+    long n;
+    double x;
+    int choice;
+    int ret;
+
+    if (spec->option_types != NULL && spec->option_types[i] >= 0) {
+        type = &spec->types[spec->option_types[i]];
+        switch (type->kind) {
+        case TYPE_INT:
+            ret = parse_int(argument, &n);
+            if (ret == DOCOPT_OK && (n < type->min || n > type->max))
+                ret = DOCOPT_OUT_OF_RANGE;
+            if (ret == DOCOPT_OK)
+                *(long *) field = n;
+            return ret;
+        case TYPE_FLOAT:
+            ret = parse_float(argument, &x);
+            if (ret == DOCOPT_OK)
+                *(double *) field = x;
+            return ret;
+        default:
+            ret = parse_choice(type, argument, &choice);
+            if (ret == DOCOPT_OK)
+                *(int *) field = choice;
+            return ret;
+        }
+    }
+#endif
+    *(char **) field = (char *) argument;
+    return DOCOPT_OK;
+}
+
+/* Store a command or an option without argument in its bit, if it has one */
+static void store_flag(const struct Spec *spec, char *base, int bit, size_t field, size_t value) {
+    if (bit < 0)
+        *(size_t *) (base + field) = value;
+    else if (value)
+        SET_ADD((unsigned long *) (base + spec->bits_field), bit);
+}
+
+#if DOCOPT_HAS_LISTS
+/*
+ * Point the slice of each option with an argument that may repeat at its
+ * values, in the order given, written over the option tokens of argv past
+ * the positional ones, which are no longer needed.
+ */
+static void store_lists(struct Tokens *ts, struct Elements *elements, char *base) {
+    const struct Spec *spec = elements->spec;
+    struct DocoptSlice *slice;
+    const char **at = (const char **) &ts->argv[ts->n_positional];
+    int i, m;
+
+    for (i = 0; i < spec->n_options; i++) {
+        if (spec->option_argcounts[i] && spec->option_counters[i] >= 0 && SET_HAS(elements->options, i)) {
+            slice = (struct DocoptSlice *) (base + spec->option_fields[i]);
+            slice->items = at;
+            slice->count = 0;
+            at += elements->counters[spec->option_counters[i]];
+        }
+    }
+    for (m = 0; m < elements->n_values; m++) {
+        slice = (struct DocoptSlice *) (base + spec->option_fields[elements->value_options[m]]);
+        slice->items[slice->count++] = elements->values[m];
+    }
+}
+#endif
+
+static int elems_to_args(struct Tokens *ts, struct Elements *elements, struct DocoptArgs *args) {
+    const struct Spec *spec = elements->spec;
+    char *base = (char *) args;
+    struct DocoptSlice *slice;
+    int i;
+    int ret;
+
+    /* options */
+#if DOCOPT_HAS_LISTS
+    store_lists(ts, elements, base);
+#endif
+    for (i = 0; i < spec->n_options; i++) {
+        if (spec->option_argcounts[i]) {
+            /* not given, or in a list above */
+            if (elements->option_arguments[i] == NULL || spec->option_counters[i] >= 0)
+                continue;
+            ret = store_argument(spec, base, i, elements->option_arguments[i]);
+            if (ret != DOCOPT_OK) {
+                elements->error = spec->option_longs[i] != NULL ? spec->option_longs[i] : spec->option_shorts[i];
+                return ret;
+            }
+        } else if (spec->option_counters[i] >= 0) {
+            *(size_t *) (base + spec->option_fields[i]) = elements->counters[spec->option_counters[i]];
+        } else {
+            store_flag(spec, base, spec->option_bits[i], spec->option_fields[i], SET_HAS(elements->options, i));
+        }
+    }
+    /* commands */
+    for (i = 0; i < spec->n_commands; i++) {
+        if (spec->command_counters[i] >= 0)
+            *(size_t *) (base + spec->command_fields[i]) = elements->counters[spec->command_counters[i]];
+        else
+            store_flag(spec, base, spec->command_bits[i], spec->command_fields[i], SET_HAS(elements->commands, i));
+    }
+    /* arguments */
+    for (i = 0; i < spec->n_arguments; i++) {
+        if (spec->argument_repeating[i]) {
+            slice = (struct DocoptSlice *) (base + spec->argument_fields[i]);
+            slice->items = (const char **) &ts->argv[elements->offsets[i]];
+            slice->count = elements->counts[i];
+        } else if (elements->counts[i] > 0) {
+            *(char **) (base + spec->argument_fields[i]) = ts->argv[elements->offsets[i]];
+        }
+    }
+    return DOCOPT_OK;
+}
+
+
+/*
+ * Parser context
+ */
+
+static const char *const help_message[] = $help_message;
+
+static const struct DocoptArgs args_default = {$defaults
+        usage_pattern,
+        help_message
+};
+
+/* The state docopt_parse() writes, one element longer than need be so
+   that no array is empty */
+struct DocoptContext {
+    bool help;
+    bool version;
+    unsigned long commands[$n_commands / WORD_BITS + 1];
+    unsigned long options[$n_options / WORD_BITS + 1];
+    const char *option_arguments[$n_options + 1];
+    int offsets[$n_arguments + 1];
+    int counts[$n_arguments + 1];
+    int counters[$n_counters + 1];
+#if DOCOPT_HAS_SOURCES
+    const char *option_sources[$n_options + 1];
+#endif
+#if DOCOPT_HAS_CONFIG
+    const char *config_values[$n_options + 1];
+    char *config;               /* the file given to docopt_config(), mapped */
+    size_t config_size;
+    char *config_tail;          /* its last line, when that has no newline */
+#endif
+#ifdef DOCOPT_RESPONSE_FILES
+    struct Responses *responses;    /* the @files of the last parse, from the first with any */
+    struct DocoptContext *kept;     /* the one docopt() kept before this one */
+#endif
+    struct Elements elements;
+    struct Trail trail;
+    char **spare;               /* Tokens.spare, Elements.bound and its values, */
+    int n_words;                /* for as many words as the longest argv yet */
+};
+
+#ifdef DOCOPT_RESPONSE_FILES
+/* in the section on batches, whose lines @files are split like */
+static int expand_responses(struct DocoptContext *ctx, int *argc, char ***argv);
+static void responses_free(struct Responses *responses);
+#endif
+
+#if DOCOPT_HAS_SOURCES
+/*
+ * Environment and config file
+ */
+
+/* What each option takes when the command line gives it no argument: its
+   [env: NAME] if that is set, else its [config: key], else its default */
+static void context_sources(struct DocoptContext *ctx) {
+    const char *value;
+    int i;
+
+    for (i = 0; i < $n_options; i++) {
+        value = spec.option_envs[i] != NULL ? getenv(spec.option_envs[i]) : NULL;
+#if DOCOPT_HAS_CONFIG
+        if (value == NULL)
+            value = ctx->config_values[i];
+#endif
+        ctx->option_sources[i] = value;
+    }
+}
+
+/* Between the defaults and the command line, before elems_to_args() */
+static void apply_sources(struct DocoptContext *ctx) {
+    int i;
+
+    for (i = 0; i < $n_options; i++)
+        if (ctx->option_arguments[i] == NULL)
+            ctx->option_arguments[i] = ctx->option_sources[i];
+}
+#endif
+
+#if DOCOPT_HAS_CONFIG
+#define CONFIG_BLANK(c) ((c) == ' ' || (c) == '\\t' || (c) == '\\r')
+
+static void config_unmap(struct DocoptContext *ctx) {
+    if (ctx->config != NULL)
+        munmap(ctx->config, ctx->config_size);
+    free(ctx->config_tail);
+    ctx->config = NULL;
+    ctx->config_tail = NULL;
+    ctx->config_size = 0;
+    memset(ctx->config_values, 0, sizeof(ctx->config_values));
+}
+
+/* Option whose [config: key] is key[0..len), or -1 */
+static int find_config(const char *key, size_t len) {
+    int i;
+
+    /* most keys of a config file are for something else */
+    if (spec.config_table == NULL || !(spec.config_lengths & LENGTH_BIT(len)))
+        return -1;
+    i = table_find(spec.config_table, key, len);
+    if (i < 0 || strncmp(spec.option_configs[i], key, len) || spec.option_configs[i][len] != '\\0')
+        return -1;
+    return i;
+}
+
+/* Take the value of line[0..len) if its key is one of an option, ending
+   it with a NUL written at the latest over the newline at line[len] */
+static void config_line(struct DocoptContext *ctx, char *line, size_t len) {
+    char *end = line + len;
+    char *eq = memchr(line, '=', len);
+    char *key_end;
+    int i;
+
+    if (eq == NULL)
+        return;
+    while (line < eq && CONFIG_BLANK(*line))
+        line++;
+    if (line == eq || *line == '#')
+        return;
+    for (key_end = eq; CONFIG_BLANK(key_end[-1]); key_end--)
+        ;
+    i = find_config(line, key_end - line);
+    if (i < 0)
+        return;
+    for (eq++; eq < end && CONFIG_BLANK(*eq); eq++)
+        ;
+    while (end > eq && CONFIG_BLANK(end[-1]))
+        end--;
+    *end = '\\0';
+    ctx->config_values[i] = eq;
+}
+
+/* config_line() for each line of buf[0..len), which ends in a newline */
+static void config_lines(struct DocoptContext *ctx, char *buf, size_t len) {
+    char *end = buf + len;
+    char *nl;
+
+    while (buf < end) {
+        nl = memchr(buf, '\\n', end - buf);
+        config_line(ctx, buf, nl - buf);
+        buf = nl + 1;
+    }
+}
+
+/*
+ * Take the arguments of the options with a [config: key] from the file at
+ * `path`, of key=value lines.  Lines without '=' or starting with '#', and
+ * keys of no option, are skipped; blanks around keys and values are not
+ * part of them.  The file is mapped privately and the values NUL-terminated
+ * in place, nothing is copied: DocoptArgs point into it until the next
+ * docopt_config() or docopt_context_free().  The environment overrides the
+ * file, and the command line both.  DOCOPT_BAD_CONFIG has the path as its
+ * docopt_error_token().
+ */
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *ctx, const char *path) {
+    struct stat st;
+    size_t n;
+    int fd;
+
+    config_unmap(ctx);
+    context_sources(ctx);
+    ctx->elements.error = path;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return DOCOPT_BAD_CONFIG;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return DOCOPT_BAD_CONFIG;
+    }
+    if (st.st_size > 0) {
+        ctx->config = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (ctx->config == MAP_FAILED) {
+            ctx->config = NULL;
+            close(fd);
+            return DOCOPT_BAD_CONFIG;
+        }
+        ctx->config_size = (size_t) st.st_size;
+    }
+    close(fd);
+    for (n = ctx->config_size; n > 0 && ctx->config[n - 1] != '\\n'; n--)
+        ;
+    config_lines(ctx, ctx->config, n);
+    if (n < ctx->config_size) {
+        /* config[config_size] may not exist, let alone be writable */
+        ctx->config_tail = malloc(ctx->config_size - n + 1);
+        if (ctx->config_tail == NULL) {
+            config_unmap(ctx);
+            return DOCOPT_NO_MEMORY;
+        }
+        memcpy(ctx->config_tail, ctx->config + n, ctx->config_size - n);
+        ctx->config_tail[ctx->config_size - n] = '\\n';
+        config_lines(ctx, ctx->config_tail, ctx->config_size - n + 1);
+    }
+    ctx->elements.error = NULL;
+    context_sources(ctx);
+    return DOCOPT_OK;
+}
+#else
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *ctx, const char *path) {
+    /* the spec has no [config: key], nothing in the file is for it */
+    (void) ctx;
+    (void) path;
+    return DOCOPT_OK;
+}
+#endif
+
+
+/* `help` and `version` make --help and --version end the parse early */
+DOCOPT_API struct DocoptContext *docopt_context_new(const bool help, const bool version) {
+    struct DocoptContext *ctx = calloc(1, sizeof(struct DocoptContext));
+
+    if (ctx == NULL)
+        return NULL;
+    ctx->help = help;
+    ctx->version = version;
+    ctx->elements.spec = &spec;
+    ctx->elements.commands = ctx->commands;
+    ctx->elements.options = ctx->options;
+    ctx->elements.option_arguments = ctx->option_arguments;
+    ctx->elements.offsets = ctx->offsets;
+    ctx->elements.counts = ctx->counts;
+    ctx->elements.counters = ctx->counters;
+#ifdef DOCOPT_TRACE
+    STATICS_LOCK();
+    ctx->elements.trace = trace_default;
+    STATICS_UNLOCK();
+#endif
+#if DOCOPT_HAS_SOURCES
+    context_sources(ctx);
+#endif
+    return ctx;
+}
+
+DOCOPT_API void docopt_context_free(struct DocoptContext *ctx) {
+    if (ctx == NULL)
+        return;
+    trail_free(&ctx->trail);
+    free(ctx->spare);
+    free(ctx->elements.bound);
+#if DOCOPT_HAS_LISTS
+    free((void *) ctx->elements.values);
+    free(ctx->elements.value_options);
+#endif
+#if DOCOPT_HAS_CONFIG
+    config_unmap(ctx);
+#endif
+#ifdef DOCOPT_RESPONSE_FILES
+    responses_free(ctx->responses);
+#endif
+    free(ctx);
+}
+
+/* Forget what the last parse found */
+static void context_reset(struct DocoptContext *ctx) {
+    memset(ctx->commands, 0, sizeof(ctx->commands));
+    memset(ctx->options, 0, sizeof(ctx->options));
+    memset(ctx->option_arguments, 0, sizeof(ctx->option_arguments));
+    memset(ctx->counts, 0, sizeof(ctx->counts));
+    memset(ctx->counters, 0, sizeof(ctx->counters));
+    ctx->elements.error = NULL;
+#if DOCOPT_HAS_LISTS
+    ctx->elements.n_values = 0;
+#endif
+}
+
+/* Room for the tokens of an argv of `argc` words, kept for later parses */
+static int context_words(struct DocoptContext *ctx, int argc) {
+    char **spare;
+    int *bound;
+#if DOCOPT_HAS_LISTS
+    const char **values;
+    int *value_options;
+#endif
+
+    if (argc <= ctx->n_words)
+        return DOCOPT_OK;
+    spare = realloc(ctx->spare, argc * sizeof(char *));
+    if (spare == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->spare = spare;
+    bound = realloc(ctx->elements.bound, argc * sizeof(int));
+    if (bound == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.bound = bound;
+#if DOCOPT_HAS_LISTS
+    values = realloc(ctx->elements.values, argc * sizeof(char *));
+    if (values == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.values = values;
+    value_options = realloc(ctx->elements.value_options, argc * sizeof(int));
+    if (value_options == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.value_options = value_options;
+#endif
+    ctx->n_words = argc;
+    return DOCOPT_OK;
+}
+
+/* docopt_parse() but for @files, which the lines of a batch do not have */
+static int parse_argv(struct DocoptContext *ctx, int argc, char *argv[], struct DocoptArgs *args) {
+    struct Elements *elements = &ctx->elements;
+    struct Tokens ts;
+    int ret;
+
+    context_reset(ctx);
+    *args = args_default;
+
+    if (argc > 0) {
+        argc--;
+        argv++;
+    }
+    ret = context_words(ctx, argc);
+    ts = tokens_new(argc, argv, ctx->spare);
+#ifdef DOCOPT_TRACE
+    ts.trace = elements->trace;
+#endif
+    TRACE_PHASE(elements->trace, DOCOPT_PHASE_PARSE_ARGS);
+    if (ret == DOCOPT_OK)
+        ret = parse_args(&ts, elements);
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_EXTRAS);
+        ret = parse_extras(elements, ctx->help, ctx->version);
+    }
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_MATCH);
+        ret = match_pattern(&ts, elements, &ctx->trail);
+    }
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_ELEMS_TO_ARGS);
+#if DOCOPT_HAS_SOURCES
+        apply_sources(ctx);
+#endif
+        ret = elems_to_args(&ts, elements, args);
+    }
+    if (ret != DOCOPT_OK) {
+        TRACE_ERROR(elements->trace, ret, elements->error);
+        *args = args_default;
+    }
+    TRACE_PHASE(elements->trace, DOCOPT_PHASE_DONE);
+    return ret;
+}
+
+/*
+ * Parse argv, argv[0] being the program name, into `args`.  Nothing is
+ * allocated once the context has seen a command line as long as this one,
+ * and nothing is printed.  argv is permuted in place, the values of options
+ * that may repeat written over their tokens, and `args` points into it.  On DOCOPT_OK `args` holds the result, otherwise only its defaults.
+ * With DOCOPT_RESPONSE_FILES an argument @file stands for the words in the
+ * file, see expand_responses().
+ */
+DOCOPT_API enum DocoptError docopt_parse(struct DocoptContext *ctx, int argc, char *argv[],
+                                         struct DocoptArgs *args) {
+#ifdef DOCOPT_RESPONSE_FILES
+    int ret = expand_responses(ctx, &argc, &argv);
+
+    if (ret != DOCOPT_OK) {
+        *args = args_default;
+        return (enum DocoptError) ret;
+    }
+#endif
+    return (enum DocoptError) parse_argv(ctx, argc, argv, args);
+}
+
+#ifdef DOCOPT_TRACE
+/* Call the hooks of `trace` during the parses of `ctx`, or of the contexts
+   made from now on when `ctx` is NULL, docopt()'s among them */
+DOCOPT_API void docopt_trace(struct DocoptContext *ctx, const struct DocoptTrace *trace) {
+    if (ctx == NULL) {
+        STATICS_LOCK();
+        trace_default = trace;
+        STATICS_UNLOCK();
+    } else
+        ctx->elements.trace = trace;
+}
+#endif
+
+/* Token or option name the last docopt_parse() stopped at, or NULL */
+DOCOPT_API const char *docopt_error_token(const struct DocoptContext *ctx) {
+    return ctx->elements.error;
+}
+
+
+/*
+ * Shell completion
+ */
+
+/* Print `prefix` and each choice of `type` that starts with `word` */
+static DOCOPT_COLD void complete_choices(FILE *out, const char *prefix, size_t n_prefix, const struct Type *type,
+                                         const char *word) {
+    size_t len = strlen(word);
+    int i;
+
+    if (type == NULL || type->kind != TYPE_ENUM)
+        return;
+    for (i = 0; i < type->n_choices; i++)
+        if (!strncmp(type->choices[i], word, len))
+            fprintf(out, "%.*s%s\\n", (int) n_prefix, prefix, type->choices[i]);
+}
+
+static const struct Type *option_type(const struct Spec *spec, int i) {
+    if (spec->option_types == NULL || spec->option_types[i] < 0)
+        return NULL;
+    return &spec->types[spec->option_types[i]];
+}
+
+/*
+ * Print the tokens that may replace argv[cword], one per line, from what
+ * argv[0..cword) parses to: the choices of the option waiting for its
+ * argument, options when the word starts with '-', and otherwise the
+ * commands that the usage section lets follow.  argv[0] is not the program
+ * name.  Like docopt_parse(), nothing is allocated once warmed up.
+ */
+DOCOPT_API int docopt_complete(struct DocoptContext *ctx, int argc, char *argv[], int cword,
+                               FILE *out) {
+    struct Elements *elements = &ctx->elements;
+    const struct Spec *spec = elements->spec;
+    const struct Pattern *pattern = spec->pattern;
+    const char *word = cword < argc ? argv[cword] : "";
+    size_t len = strlen(word);
+    struct Tokens ts;
+    unsigned long *set;
+    unsigned long bits;
+    size_t w;
+    int i, j, p, ret;
+    bool positional = false;
+
+    context_reset(ctx);
+    if (cword < 0)
+        return DOCOPT_OK;
+    for (i = 0; i < cword && i < argc; i++)
+        positional = positional || strcmp(argv[i], "--") == 0;
+    ret = context_words(ctx, cword < argc ? cword : argc);
+    if (ret != DOCOPT_OK)
+        return ret;
+    ts = tokens_new(cword < argc ? cword : argc, argv, ctx->spare);
+    ret = parse_args(&ts, elements);
+    if (ret == DOCOPT_MISSING_ARGUMENT) {
+        for (i = 0; i < spec->n_options; i++)
+            if (elements->error == spec->option_longs[i] || elements->error == spec->option_shorts[i])
+                complete_choices(out, "", 0, option_type(spec, i), word);
+        return DOCOPT_OK;
+    }
+    if (ret != DOCOPT_OK)
+        return ret;
+
+    if (word[0] == '-' && !positional) {
+#if DOCOPT_HAS_LONGS
+        const char *eq = strchr(word, '=');
+
+        if (word[1] == '-' && eq != NULL) {
+            i = find_long(elements, word, (size_t) (eq - word));
+            if (i >= 0 && spec->option_argcounts[i])
+                complete_choices(out, word, (size_t) (eq + 1 - word), option_type(spec, i), eq + 1);
+            return DOCOPT_OK;
+        }
+#endif
+        for (i = 0; i < spec->n_options && len <= 2; i++)
+            if (spec->option_shorts[i] != NULL && !strncmp(spec->option_shorts[i], word, len)
+                    && (!SET_HAS(elements->options, i) || spec->option_repeating[i]))
+                fprintf(out, "%s\\n", spec->option_shorts[i]);
+#if DOCOPT_HAS_LONGS
+        long_candidates(elements, word, len);
+        for (j = elements->candidates[0]; j < elements->candidates[1]; j++) {
+            i = spec->long_sorted[j];
+            if (!SET_HAS(elements->options, i) || spec->option_repeating[i])
+                fprintf(out, "%s\\n", spec->option_longs[i]);
+        }
+#endif
+        return DOCOPT_OK;
+    }
+
+    /* commands that may follow a state the positional tokens lead to, each
+       printed once, which elements->commands keeps track of */
+    ret = match_states(&ts, elements, &ctx->trail);
+    if (ret != DOCOPT_OK)
+        return ret == DOCOPT_NO_MATCH ? DOCOPT_OK : ret;
+    set = &ctx->trail.sets[(ctx->trail.n - 1) * ctx->trail.words];
+    for (w = 0; w < ctx->trail.words; w++) {
+        for (bits = set[w]; bits != 0; bits &= bits - 1) {
+            i = w * WORD_BITS + lowest_bit(bits);
+            for (j = pattern->follow_start[i]; j < pattern->follow_start[i + 1]; j++) {
+                p = pattern->command[pattern->follow[j]];
+                if (p < 0 || SET_HAS(elements->commands, p) || strncmp(spec->command_names[p], word, len))
+                    continue;
+                SET_ADD(elements->commands, p);
+                fprintf(out, "%s\\n", spec->command_names[p]);
+            }
+        }
+    }
+    return DOCOPT_OK;
+}
+
+
+#ifdef DOCOPT_BATCH
+
+/*
+ * Batch mode
+ */
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\\t' || (c) == '\\r')
+#define IS_SPECIAL(c) (IS_BLANK(c) || (c) == '\\n' || (c) == '\\'' || (c) == '"' || (c) == '\\\\')
+
+/* Length of the run at p[0..n) that the tokenizer can pass over unchanged */
+static size_t scan_plain(const char *p, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\\t');
+    const __m128i cr = _mm_set1_epi8('\\r'), nl = _mm_set1_epi8('\\n');
+    const __m128i squote = _mm_set1_epi8('\\''), dquote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\\\');
+    __m128i v, m;
+    int mask;
+
+    for (; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (p + i));
+        m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, squote), _mm_cmpeq_epi8(v, dquote)));
+        mask = _mm_movemask_epi8(_mm_or_si128(m, _mm_cmpeq_epi8(v, backslash)));
+        if (mask != 0)
+            return i + lowest_bit((unsigned long) mask);
+    }
+#else
+    /* a word at a time, see "Determine if a word has a zero byte" */
+    const unsigned long ones = (unsigned long) -1 / 255;
+    unsigned long w;
+
+#define HAS_BYTE(w, c) ((((w) ^ ones * (c)) - ones) & ~((w) ^ ones * (c)) & ones * 0x80)
+    for (; i + sizeof(w) <= n; i += sizeof(w)) {
+        memcpy(&w, p + i, sizeof(w));
+        if (HAS_BYTE(w, ' ') || HAS_BYTE(w, '\\t') || HAS_BYTE(w, '\\r') || HAS_BYTE(w, '\\n')
+            || HAS_BYTE(w, '\\'') || HAS_BYTE(w, '"') || HAS_BYTE(w, '\\\\'))
+            break;
+    }
+#undef HAS_BYTE
+#endif
+    while (i < n && !IS_SPECIAL(p[i]))
+        i++;
+    return i;
+}
+
+struct Batch {
+    struct DocoptContext *ctx;
+    DocoptLineCallback callback;
+    void *data;
+    size_t line;
+    int argc;
+    int capacity;
+    char **argv;
+    char *error;                /* token with an unterminated quote */
+};
+
+/* Room for one more word in batch->argv, or -1 when out of memory */
+static int batch_grow(struct Batch *batch) {
+    int capacity = batch->capacity ? 2 * batch->capacity : 16;
+    char **argv = realloc(batch->argv, capacity * sizeof(char *));
+
+    if (argv == NULL)
+        return -1;
+    batch->argv = argv;
+    batch->capacity = capacity;
+    return 0;
+}
+
+/*
+ * Split the line at `p`, which ends with a '\\n', the way a shell would,
+ * appending its words to batch->argv: blanks separate words, '...' is taken
+ * literally, and in "..." as well as unquoted a backslash escapes the next
+ * character.  Words are unquoted and NUL-terminated in place, they only ever
+ * shrink.  Returns the start of the next line, or NULL when out of memory.
+ */
+static char *split_line(struct Batch *batch, char *p, const char *end) {
+    char *out;
+    char quote;
+    bool eol = false;
+    size_t n;
+
+    while (!eol) {
+        while (IS_BLANK(*p))
+            p++;
+        if (*p == '\\n')
+            return p + 1;
+        if (batch->argc == batch->capacity && batch_grow(batch) != 0)
+            return NULL;
+        out = batch->argv[batch->argc++] = p;
+        quote = 0;
+        for (;;) {
+            n = scan_plain(p, end - p);
+            if (out != p)
+                memmove(out, p, n);
+            out += n;
+            p += n;
+            if (*p == '\\n') {
+                eol = true;
+                if (quote && batch->error == NULL)
+                    batch->error = batch->argv[batch->argc - 1];
+                break;
+            } else if (quote == 0 && IS_BLANK(*p)) {
+                break;
+            } else if (*p == quote) {
+                quote = 0;
+                p++;
+            } else if (quote == 0 && (*p == '\\'' || *p == '"')) {
+                quote = *p++;
+            } else if (*p == '\\\\' && quote != '\\'' && p[1] != '\\n'
+                       && (quote == 0 || p[1] == '"' || p[1] == '\\\\')) {
+                *out++ = p[1];
+                p += 2;
+            } else {
+                /* a blank or the other quote inside quotes, a lone backslash */
+                *out++ = *p++;
+            }
+        }
+        p++;
+        *out = '\\0';
+    }
+    return p;
+}
+
+/* Parse the lines of buf[0..len), each ending with a '\\n' */
+static int batch_lines(struct Batch *batch, char *buf, size_t len) {
+    struct DocoptArgs args;
+    enum DocoptError error;
+    char *p = buf;
+    char *end = buf + len;
+    int ret;
+
+    while (p < end) {
+        batch->line++;
+        batch->argc = 0;
+        batch->error = NULL;
+        p = split_line(batch, p, end);
+        if (p == NULL)
+            return -1;
+        if (batch->argc == 0)
+            continue;
+        if (batch->error != NULL) {
+            args = args_default;
+            batch->ctx->elements.error = batch->error;
+            error = DOCOPT_UNTERMINATED_QUOTE;
+        } else {
+            error = (enum DocoptError) parse_argv(batch->ctx, batch->argc, batch->argv, &args);
+        }
+        ret = batch->callback(batch->data, batch->line, error, &args);
+        if (ret != 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Parse the last `len` bytes of a buffer, which lack a '\\n' to end them */
+static int batch_tail(struct Batch *batch, const char *tail, size_t len) {
+    /* tail[len] may not exist, let alone be writable */
+    char *line = malloc(len + 1);
+    int ret;
+
+    if (line == NULL)
+        return -1;
+    memcpy(line, tail, len);
+    line[len] = '\\n';
+    ret = batch_lines(batch, line, len + 1);
+    free(line);
+    return ret;
+}
+
+/*
+ * Parse each line of buf[0..len) as a command line, argv[0] included, and
+ * hand the result to `callback`, along with the line number counted from 1.
+ * Blank lines are skipped.  The buffer is tokenized in place and the
+ * DocoptArgs point into it.  Returns 0 once all lines are done, the first
+ * nonzero value `callback` returns, or -1 when out of memory.
+ */
+DOCOPT_API int docopt_batch(struct DocoptContext *ctx, char *buf, size_t len,
+                            DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    size_t n = len;
+    int ret;
+
+    batch.ctx = ctx;
+    batch.callback = callback;
+    batch.data = data;
+    while (n > 0 && buf[n - 1] != '\\n')
+        n--;
+    ret = batch_lines(&batch, buf, n);
+    if (ret == 0 && n < len)
+        ret = batch_tail(&batch, buf + n, len - n);
+    free(batch.argv);
+    return ret;
+}
+
+/*
+ * docopt_batch() over what can be read from `fd`.  Regular files are mapped
+ * privately, the file itself is never written; anything else is read in
+ * chunks of whole lines.  Returns like docopt_batch(), and -1 also when
+ * reading fails.
+ */
+DOCOPT_API int docopt_batch_fd(struct DocoptContext *ctx, int fd, DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    struct stat st;
+    char *buf;
+    char *grown;
+    size_t size = 0;
+    size_t capacity = 1 << 16;
+    size_t n;
+    ssize_t got;
+    int ret = 0;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = (size_t) st.st_size;
+        buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED) {
+            posix_madvise(buf, size, POSIX_MADV_SEQUENTIAL);
+            ret = docopt_batch(ctx, buf, size, callback, data);
+            munmap(buf, size);
+            return ret;
+        }
+        size = 0;
+    }
+
+    batch.ctx = ctx;
+    batch.callback = callback;
+    batch.data = data;
+    buf = malloc(capacity + 1);
+    if (buf == NULL)
+        return -1;
+    for (;;) {
+        if (size == capacity) {
+            /* a single line fills the buffer */
+            grown = realloc(buf, 2 * capacity + 1);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+            capacity *= 2;
+        }
+        got = read(fd, buf + size, capacity - size);
+        if (got < 0) {
+            ret = -1;
+            break;
+        }
+        if (got == 0) {
+            if (size > 0 && buf[size - 1] != '\\n')
+                buf[size++] = '\\n';
+            ret = batch_lines(&batch, buf, size);
+            break;
+        }
+        size += (size_t) got;
+        for (n = size; n > 0 && buf[n - 1] != '\\n'; n--)
+            ;
+        ret = batch_lines(&batch, buf, n);
+        if (ret != 0)
+            break;
+        memmove(buf, buf + n, size - n);
+        size -= n;
+    }
+    free(buf);
+    free(batch.argv);
+    return ret;
+}
+
+#ifdef DOCOPT_RESPONSE_FILES
+/*
+ * Response files
+ */
+
+/* A file mapped by expand_responses(), with a copy of its last line when
+   that does not end in a newline */
+struct Mapping {
+    char *buf;
+    size_t size;
+    char *tail;
+};
+
+struct Responses {
+    struct Batch words;         /* argv, each @file replaced by its words */
+    struct Mapping *files;
+    int n_files;
+    int capacity;
+};
+
+static void responses_unmap(struct Responses *responses) {
+    int i;
+
+    for (i = 0; i < responses->n_files; i++) {
+        if (responses->files[i].buf != NULL)
+            munmap(responses->files[i].buf, responses->files[i].size);
+        free(responses->files[i].tail);
+    }
+    responses->n_files = 0;
+}
+
+static void responses_free(struct Responses *responses) {
+    if (responses == NULL)
+        return;
+    responses_unmap(responses);
+    free(responses->files);
+    free(responses->words.argv);
+    free(responses);
+}
+
+/* Map the file at `path` and append its words to responses->words */
+static int response_split(struct Responses *responses, const char *path) {
+    struct Mapping *file;
+    struct stat st;
+    char *p;
+    size_t n;
+    int fd;
+
+    if (responses->n_files == responses->capacity) {
+        int capacity = responses->capacity ? 2 * responses->capacity : 4;
+        struct Mapping *files = realloc(responses->files, capacity * sizeof(struct Mapping));
+
+        if (files == NULL)
+            return DOCOPT_NO_MEMORY;
+        responses->files = files;
+        responses->capacity = capacity;
+    }
+    file = &responses->files[responses->n_files];
+    file->buf = file->tail = NULL;
+    file->size = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return DOCOPT_BAD_RESPONSE_FILE;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return DOCOPT_BAD_RESPONSE_FILE;
+    }
+    if (st.st_size > 0) {
+        file->buf = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (file->buf == MAP_FAILED) {
+            file->buf = NULL;
+            close(fd);
+            return DOCOPT_BAD_RESPONSE_FILE;
+        }
+        file->size = (size_t) st.st_size;
+        posix_madvise(file->buf, file->size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+    responses->n_files++;
+    for (n = file->size; n > 0 && file->buf[n - 1] != '\\n'; n--)
+        ;
+    for (p = file->buf; p < file->buf + n;) {
+        p = split_line(&responses->words, p, file->buf + n);
+        if (p == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    if (n < file->size) {
+        /* buf[size] may not exist, let alone be writable */
+        file->tail = malloc(file->size - n + 1);
+        if (file->tail == NULL)
+            return DOCOPT_NO_MEMORY;
+        memcpy(file->tail, file->buf + n, file->size - n);
+        file->tail[file->size - n] = '\\n';
+        if (split_line(&responses->words, file->tail, file->tail + file->size - n + 1) == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    return DOCOPT_OK;
+}
+
+/*
+ * Replace each argument @file after argv[0] by the words of that file,
+ * split like the lines of a batch.  The files are mapped privately and
+ * their words NUL-terminated in place: only pointers are copied, into one
+ * array that is reused from parse to parse.  Words are not expanded again,
+ * and a lone "@" is an argument like any other.  The words, and so the
+ * DocoptArgs, last until the next docopt_parse() or docopt_context_free().
+ */
+static int expand_responses(struct DocoptContext *ctx, int *argc, char ***argv) {
+    struct Responses *responses = ctx->responses;
+    struct Batch *words;
+    char *arg;
+    int i, ret;
+
+    if (responses != NULL)
+        responses_unmap(responses);
+    for (i = 1; i < *argc && ((*argv)[i][0] != '@' || (*argv)[i][1] == '\\0'); i++)
+        ;
+    if (i >= *argc)
+        return DOCOPT_OK;
+    if (responses == NULL) {
+        responses = ctx->responses = calloc(1, sizeof(struct Responses));
+        if (responses == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    words = &responses->words;
+    words->argc = 0;
+    words->error = NULL;
+    for (i = 0; i < *argc; i++) {
+        arg = (*argv)[i];
+        if (i > 0 && arg[0] == '@' && arg[1] != '\\0') {
+            ret = response_split(responses, arg + 1);
+            if (ret != DOCOPT_OK) {
+                ctx->elements.error = arg;
+                return ret;
+            }
+        } else {
+            if (words->argc == words->capacity && batch_grow(words) != 0)
+                return DOCOPT_NO_MEMORY;
+            words->argv[words->argc++] = arg;
+        }
+    }
+    if (words->error != NULL) {
+        ctx->elements.error = words->error;
+        return DOCOPT_UNTERMINATED_QUOTE;
+    }
+    *argc = words->argc;
+    *argv = words->argv;
+    return DOCOPT_OK;
+}
+#endif
+
+#endif
+
+#ifdef DOCOPT_THREADS
+
+/*
+ * Parallel batch mode
+ */
+
+#ifndef DOCOPT_BLOCK_BYTES
+#define DOCOPT_BLOCK_BYTES (1 << 20)
+#endif
+#define CHUNK_BYTES (1 << 16)
+
+union Align {
+    long l;
+    double d;
+    void *p;
+};
+
+struct Chunk {
+    struct Chunk *next;
+    size_t size;
+    union Align data[1];
+};
+
+/* Bump allocator, freed all at once by arena_reset() */
+struct Arena {
+    struct Chunk *first;
+    struct Chunk *current;
+    size_t used;
+};
+
+static void *arena_alloc(struct Arena *arena, size_t size) {
+    struct Chunk *chunk = arena->current;
+    struct Chunk *next;
+    void *p;
+
+    size = (size + sizeof(union Align) - 1) / sizeof(union Align) * sizeof(union Align);
+    if (chunk == NULL || arena->used + size > chunk->size) {
+        if (chunk != NULL && chunk->next != NULL && chunk->next->size >= size) {
+            next = chunk->next;
+        } else {
+            size_t bytes = size > CHUNK_BYTES ? size : CHUNK_BYTES;
+
+            next = malloc(offsetof(struct Chunk, data) + bytes);
+            if (next == NULL)
+                return NULL;
+            next->size = bytes;
+            next->next = chunk != NULL ? chunk->next : NULL;
+            if (chunk != NULL)
+                chunk->next = next;
+            else
+                arena->first = next;
+        }
+        arena->current = chunk = next;
+        arena->used = 0;
+    }
+    p = (char *) chunk->data + arena->used;
+    arena->used += size;
+    return p;
+}
+
+static void arena_reset(struct Arena *arena) {
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+static void arena_free(struct Arena *arena) {
+    struct Chunk *chunk = arena->first;
+    struct Chunk *next;
+
+    while (chunk != NULL) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->first = arena->current = NULL;
+    arena->used = 0;
+}
+
+/* Outcome of one line, kept until it is handed to the callback in order */
+struct Result {
+    struct Result *next;
+    size_t line;                /* counted from the start of the shard */
+    enum DocoptError error;
+    const char *token;
+    char token_short[3];
+    struct DocoptArgs args;
+};
+
+struct Worker {
+    struct DocoptContext *ctx;
+    struct Batch batch;         /* only its argv, as scratch for split_line */
+    struct Arena arena;         /* argv copies and results of the shard */
+    char *begin;
+    char *end;
+    struct Result *results;
+    size_t n_lines;
+    int status;
+    bool started;
+    pthread_t thread;
+};
+
+/* Parse the shard w->begin..w->end, whole lines, into w->results */
+static int worker_lines(struct Worker *w) {
+    struct Result **tail = &w->results;
+    struct Result *result;
+    char **argv;
+    char *p = w->begin;
+
+    arena_reset(&w->arena);
+    w->results = NULL;
+    w->n_lines = 0;
+    while (p < w->end) {
+        w->n_lines++;
+        w->batch.argc = 0;
+        w->batch.error = NULL;
+        p = split_line(&w->batch, p, w->end);
+        if (p == NULL)
+            return -1;
+        if (w->batch.argc == 0)
+            continue;
+        /* DocoptArgs slices point into argv, which has to outlive the line */
+        result = arena_alloc(&w->arena, sizeof(struct Result));
+        argv = arena_alloc(&w->arena, w->batch.argc * sizeof(char *));
+        if (result == NULL || argv == NULL)
+            return -1;
+        memcpy(argv, w->batch.argv, w->batch.argc * sizeof(char *));
+        result->line = w->n_lines;
+        if (w->batch.error != NULL) {
+            result->args = args_default;
+            result->error = DOCOPT_UNTERMINATED_QUOTE;
+            result->token = w->batch.error;
+        } else {
+            result->error = (enum DocoptError) parse_argv(w->ctx, w->batch.argc, argv, &result->args);
+            result->token = docopt_error_token(w->ctx);
+            if (result->token == w->ctx->elements.error_short) {
+                memcpy(result->token_short, result->token, sizeof(result->token_short));
+                result->token = result->token_short;
+            }
+        }
+        result->next = NULL;
+        *tail = result;
+        tail = &result->next;
+    }
+    return 0;
+}
+
+static void *worker_run(void *w) {
+    ((struct Worker *) w)->status = worker_lines(w);
+    return NULL;
+}
+
+/*
+ * docopt_batch() on `n_threads` threads.  The buffer is parsed a round at a
+ * time, each thread taking DOCOPT_BLOCK_BYTES worth of lines with a context
+ * and an arena of its own, then the results of the round are handed to
+ * `callback` in input order on the calling thread, where docopt_error_token()
+ * of `ctx` tells about the line at hand.
+ */
+DOCOPT_API int docopt_batch_parallel(struct DocoptContext *ctx, char *buf, size_t len, int n_threads,
+                                     DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    struct Worker *workers;
+    struct Worker *w;
+    struct Result *result;
+    char *p = buf;
+    char *end;
+    size_t n = len;
+    int ret = 0;
+    int i;
+
+    if (n_threads < 1)
+        n_threads = 1;
+    workers = calloc(n_threads, sizeof(struct Worker));
+    if (workers == NULL)
+        ret = -1;
+    for (i = 0; ret == 0 && i < n_threads; i++) {
+        workers[i].ctx = docopt_context_new(ctx->help, ctx->version);
+        if (workers[i].ctx == NULL)
+            ret = -1;
+#if DOCOPT_HAS_SOURCES
+        else
+            memcpy(workers[i].ctx->option_sources, ctx->option_sources, sizeof(ctx->option_sources));
+#endif
+    }
+    while (n > 0 && buf[n - 1] != '\\n')
+        n--;
+    end = buf + n;
+
+    while (ret == 0 && p < end) {
+        for (i = 0; i < n_threads; i++) {
+            w = &workers[i];
+            w->begin = p;
+            if ((size_t) (end - p) > DOCOPT_BLOCK_BYTES)
+                p = (char *) memchr(p + DOCOPT_BLOCK_BYTES - 1, '\\n', end - p - DOCOPT_BLOCK_BYTES + 1) + 1;
+            else
+                p = end;
+            w->end = p;
+        }
+        for (i = 1; i < n_threads; i++)
+            workers[i].started = !pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+        worker_run(&workers[0]);
+        for (i = 1; i < n_threads; i++) {
+            if (workers[i].started)
+                pthread_join(workers[i].thread, NULL);
+            else
+                worker_run(&workers[i]);
+        }
+
+        for (i = 0; ret == 0 && i < n_threads; i++) {
+            w = &workers[i];
+            ret = w->status;
+            for (result = w->results; ret == 0 && result != NULL; result = result->next) {
+                ctx->elements.error = result->token;
+                ret = callback(data, batch.line + result->line, result->error, &result->args);
+            }
+            batch.line += w->n_lines;
+        }
+    }
+
+    if (ret == 0 && n < len) {
+        batch.ctx = ctx;
+        batch.callback = callback;
+        batch.data = data;
+        ret = batch_tail(&batch, buf + n, len - n);
+    }
+    free(batch.argv);
+    for (i = 0; workers != NULL && i < n_threads; i++) {
+        docopt_context_free(workers[i].ctx);
+        free(workers[i].batch.argv);
+        arena_free(&workers[i].arena);
+    }
+    free(workers);
+    return ret;
+}
+
+#endif
+
+/*
+ * "Did you mean" suggestions
+ */
+
+#define MAX_SUGGESTIONS 4
+
+#if DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS
+#if defined(__GNUC__)
+#define count_bits(w) __builtin_popcountl(w)
+#else
+static int count_bits(unsigned long w) {
+    int n = 0;
+
+    for (; w != 0; w &= w - 1)
+        n++;
+    return n;
+}
+#endif
+
+/*
+ * Column of the dynamic programming matrix of the edit distance between a
+ * word, at most WORD_BITS long, and a prefix of a name, in Myers' bit-parallel
+ * form: bit i of vp (+1) and vn (-1) is the vertical delta into row i + 1,
+ * of d0 that the diagonal does not grow there, eq is what the last character
+ * of the prefix matches and d the distance of the whole word.
+ */
+struct Column {
+    unsigned long vp;
+    unsigned long vn;
+    unsigned long d0;
+    unsigned long eq;
+    int d;
+};
+
+/* What suggest() works in: peq[c] has bit i set where word[i] is c, and
+   columns[q] is the column of the first q characters of a name */
+struct Suggester {
+    unsigned long peq[UCHAR_MAX + 1];
+    struct Column columns[2 * WORD_BITS + 2];
+};
+
+/*
+ * Column of the prefix of `col` and `c`, with Hyyro's transpositions, so that
+ * a swap of neighbours is one edit; `last` is the bit of the last row.
+ */
+static DOCOPT_COLD void column_next(const unsigned long *peq, unsigned long last, const struct Column *col, char c,
+                                    struct Column *next) {
+    unsigned long eq = peq[(unsigned char) c];
+    unsigned long d0 = (((eq & col->vp) + col->vp) ^ col->vp) | eq | col->vn | (((~col->d0 & eq) << 1) & col->eq);
+    unsigned long hp = col->vn | ~(d0 | col->vp);
+    unsigned long hn = col->vp & d0;
+
+    next->d = col->d + ((hp & last) != 0) - ((hn & last) != 0);
+    /* row 0 counts up: a prefix q long is q insertions away from "" */
+    hp = (hp << 1) | 1;
+    hn <<= 1;
+    next->vp = hn | ~(hp | d0);
+    next->vn = hp & d0;
+    next->d0 = d0;
+    next->eq = eq;
+}
+
+/*
+ * Least distance between the m characters of the word and a name `len`
+ * long that starts with the `prefix` characters `col` is the column of:
+ * distances never shrink along a diagonal, and the one down to the last
+ * cell crosses the column at row m - (len - prefix).
+ */
+static DOCOPT_COLD int least_distance(const struct Column *col, size_t m, size_t prefix, size_t len) {
+    unsigned long rows = ((1UL << (m - 1)) << 1) - 1;
+    unsigned long below;
+
+    if (prefix + m <= len)
+        return 0;
+    if (len <= prefix)
+        return col->d;
+    below = rows & ~((1UL << (m + prefix - len)) - 1);
+    return col->d - count_bits(col->vp & below) + count_bits(col->vn & below);
+}
+
+/*
+ * The names closest to the m characters of `word`, names[i] + skip compared
+ * to it, as indices into `names` in `found`; how many there are, at most
+ * MAX_SUGGESTIONS.  None is further than a third of `word` plus one, so
+ * only the names about as long are looked at.  Those of a length are in
+ * order, each sharing lcp[] characters with the one before, so the columns
+ * of a prefix are computed once for all the names that start with it, and
+ * skipped with them once too far.
+ */
+static DOCOPT_COLD int suggest(const struct ByLength *by, const char *const *names, size_t skip,
+                               const char *word, size_t m, int *found) {
+    struct Suggester *s;
+    const char *name;
+    unsigned long last;
+    int bound = 1 + (int) m / 3;
+    int n_found = 0;
+    int j, d;
+    size_t i, len, q, valid, pruned;
+
+    if (m == 0 || m > WORD_BITS || by->start == NULL)
+        return 0;
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return 0;
+    for (i = 0; i < m; i++)
+        s->peq[(unsigned char) word[i]] |= 1UL << i;
+    last = 1UL << (m - 1);
+    s->columns[0].vp = ~0UL;
+    s->columns[0].d = (int) m;
+    for (len = m > (size_t) bound ? m - bound : 0; len <= m + bound && len <= (size_t) by->max; len++) {
+        /* columns[0..valid] are those of the last name looked at, and
+           names that share its first `pruned` characters are too far */
+        valid = 0;
+        pruned = len + 1;
+        for (j = by->start[len]; j < by->start[len + 1]; j++) {
+            if ((size_t) by->lcp[j] >= pruned)
+                continue;
+            name = names[by->order[j]] + skip;
+            pruned = len + 1;
+            for (q = (size_t) by->lcp[j] < valid ? (size_t) by->lcp[j] : valid; q < len; q++) {
+                column_next(s->peq, last, &s->columns[q], name[q], &s->columns[q + 1]);
+                if (least_distance(&s->columns[q + 1], m, q + 1, len) > bound) {
+                    pruned = q + 1;
+                    break;
+                }
+            }
+            valid = q;
+            if (q < len)
+                continue;
+            d = s->columns[len].d;
+            if (d < bound) {
+                bound = d;
+                n_found = 0;
+            }
+            if (d == bound && n_found < MAX_SUGGESTIONS)
+                found[n_found++] = by->order[j];
+        }
+    }
+    free(s);
+    return n_found;
+}
+#endif
+
+/*
+ * Long options close to the unknown option docopt_parse() stopped at, or
+ * commands close to the token no usage line took, as indices into
+ * option_longs or command_names in `found`; how many there are.  An
+ * unknown short option is taken for a long one missing a dash, "-speed"
+ * for "--speed".
+ */
+static DOCOPT_COLD int suggestions(const struct Elements *elements, int ret, int *found) {
+    const struct Spec *spec = elements->spec;
+    const char *word = elements->error;
+    int n;
+
+    if (word == NULL)
+        return 0;
+#if DOCOPT_HAS_LONGS
+    if (ret == DOCOPT_UNKNOWN_OPTION) {
+        word = word == elements->error_short ? elements->error_word + 1 : word + 2;
+        return suggest(&spec->long_by_length, spec->option_longs, 2, word, strcspn(word, "="), found);
+    }
+#endif
+#if DOCOPT_HAS_COMMANDS
+    if (ret == DOCOPT_NO_MATCH) {
+        /* a command where it does not belong is not misspelled */
+        n = suggest(&spec->command_by_length, spec->command_names, 0, word, strlen(word), found);
+        return n > 0 && strcmp(spec->command_names[found[0]], word) == 0 ? 0 : n;
+    }
+#endif
+    (void) spec;
+    (void) ret;
+    (void) found;
+    (void) n;
+    return 0;
+}
+
+/* ", did you mean a, b or c?" */
+static DOCOPT_COLD void print_suggestions(const char *const *names, const int *found, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        fputs(i == 0 ? ", did you mean " : i < n - 1 ? ", " : " or ", stderr);
+        fputs(names[found[i]], stderr);
+    }
+    if (n > 0)
+        fputs("?", stderr);
+}
+
+
+/*
+ * Main docopt function
+ */
+
+static DOCOPT_COLD void print_help(void) {
+    int i;
+
+    for (i = 0; i < $help_message_n; i++)
+        puts(help_message[i]);
+}
+
+/* Report what made docopt_parse() fail, or the help or version asked for,
+   and exit.  Messages go out in pieces with fputs(): fprintf() formats
+   through a buffer of 8KB on the stack when stderr is unbuffered */
+static DOCOPT_COLD void docopt_exit(struct DocoptContext *ctx, int ret, const char *version) {
+    const char *what = NULL;
+    int return_code = EXIT_FAILURE;
+    int found[MAX_SUGGESTIONS];
+    int i, n_found;
+
+    switch (ret) {
+    case DOCOPT_HELP:
+        print_help();
+        return_code = EXIT_SUCCESS;
+        break;
+    case DOCOPT_VERSION:
+        puts(version);
+        return_code = EXIT_SUCCESS;
+        break;
+    case DOCOPT_UNKNOWN_OPTION:
+        what = " is not recognized";
+        break;
+    case DOCOPT_MISSING_ARGUMENT:
+        what = " requires argument";
+        break;
+    case DOCOPT_UNEXPECTED_ARGUMENT:
+        what = " must not have an argument";
+        break;
+    case DOCOPT_UNTERMINATED_QUOTE:
+        what = " has an unterminated quote";
+        break;
+    case DOCOPT_NO_MATCH:
+        n_found = suggestions(&ctx->elements, ret, found);
+        if (n_found > 0) {
+            fputs(docopt_error_token(ctx), stderr);
+            fputs(" is not recognized", stderr);
+            print_suggestions(spec.command_names, found, n_found);
+            fputs("\\n", stderr);
+        }
+        fputs(usage_pattern, stderr);
+        fputs("\\n", stderr);
+        break;
+    case DOCOPT_NO_MEMORY:
+        fputs("out of memory\\n", stderr);
+        break;
+    case DOCOPT_INVALID_VALUE:
+        what = " has an invalid value";
+        break;
+    case DOCOPT_OUT_OF_RANGE:
+        what = " is out of range";
+        break;
+    case DOCOPT_AMBIGUOUS_OPTION:
+        fputs(docopt_error_token(ctx), stderr);
+        fputs(" is not a unique prefix:", stderr);
+        for (i = ctx->elements.candidates[0]; i < ctx->elements.candidates[1]; i++) {
+            fputs(i > ctx->elements.candidates[0] ? ", " : " ", stderr);
+            fputs(spec.option_longs[spec.long_sorted[i]], stderr);
+        }
+        fputs("?\\n", stderr);
+        break;
+    case DOCOPT_BAD_CONFIG:
+    case DOCOPT_BAD_RESPONSE_FILE:
+        what = " cannot be read";
+        break;
+    }
+    if (what != NULL) {
+        fputs(docopt_error_token(ctx), stderr);
+        fputs(what, stderr);
+        if (ret == DOCOPT_UNKNOWN_OPTION)
+            print_suggestions(spec.option_longs, found, suggestions(&ctx->elements, ret, found));
+        fputs("\\n", stderr);
+    }
+    docopt_context_free(ctx);
+    exit(return_code);
+}
+
+#ifdef DOCOPT_RESPONSE_FILES
+/* Contexts of docopt() whose @files its arguments point into, see statics_lock */
+static struct DocoptContext *kept_contexts;
+#endif
+
+DOCOPT_API struct DocoptArgs docopt(int argc, char *argv[], const bool help, const char *version) {
+    struct DocoptArgs args = args_default;
+    struct DocoptContext *ctx;
+    int ret;
+
+    if (argc == 1 && help) {
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+    ctx = docopt_context_new(help, version != NULL);
+    if (ctx == NULL)
+        docopt_exit(ctx, DOCOPT_NO_MEMORY, version);
+    if (argc > 3 && strcmp(argv[1], "--docopt-complete") == 0) {
+        /* hidden, for the scripts of docopt_c.py --completion: argv[2] is
+           the index of the word to complete among argv[3..], the program
+           name and its arguments */
+        ret = docopt_complete(ctx, argc - 4, argv + 4, atoi(argv[2]) - 1, stdout);
+        docopt_context_free(ctx);
+        exit(ret == DOCOPT_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    ret = docopt_parse(ctx, argc, argv, &args);
+    if (ret != DOCOPT_OK)
+        docopt_exit(ctx, ret, version);
+#ifdef DOCOPT_RESPONSE_FILES
+    if (ctx->responses != NULL) {
+        /* the arguments point into the @files the context holds, which
+           stay for the life of the process, like argv */
+        STATICS_LOCK();
+        ctx->kept = kept_contexts;
+        kept_contexts = ctx;
+        STATICS_UNLOCK();
+        return args;
+    }
+#endif
+    docopt_context_free(ctx);
+    return args;
+}
+"""
+
+template_cpp = """
+/*
+ * C++17 parser of the spec, written by docopt_c.py --cpp: the spec is a set
+ * of constexpr tables, the parser a class template over the number of
+ * positional tokens it holds, and the parsed arguments string_views into
+ * argv, which is left as it is.  Everything is constexpr, so a command line
+ * may be parsed at compile time.
+ */
+#ifndef DOCOPT_${guard}_HPP
+#define DOCOPT_${guard}_HPP
+
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <clocale>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace $namespace {
+
+/* Outcome of Parser::parse(); Parser::error_token() tells what it is about */
+enum class Error {
+    ok = 0,
+    help,                       /* --help was given */
+    version,                    /* --version was given */
+    unknown_option,
+    missing_argument,           /* an option that takes an argument is last */
+    unexpected_argument,        /* --flag=value */
+    no_match,                   /* no usage line matches */
+    too_many_arguments,         /* more positional tokens than the Parser holds */
+    invalid_value,              /* not a number, or not one of the choices */
+    out_of_range,               /* a number too large, or out of its bounds */
+    ambiguous_option            /* a prefix of several long options */
+};
+
+/* Values of a repeated positional argument (`<name>...`), in the Parser */
+class Strings {
+public:
+    constexpr Strings() = default;
+    constexpr Strings(const std::string_view *items, std::size_t count) : items_(items), count_(count) {}
+
+    constexpr std::size_t size() const { return count_; }
+    constexpr bool empty() const { return count_ == 0; }
+    constexpr std::string_view operator[](std::size_t i) const { return items_[i]; }
+    constexpr const std::string_view *begin() const { return items_; }
+    constexpr const std::string_view *end() const { return items_ + count_; }
+
+private:
+    const std::string_view *items_ = nullptr;
+    std::size_t count_ = 0;
+};
+$choices
+/* An argument or option argument not given nor defaulted has a null data() */
+struct Args {$members
+};
+
+inline constexpr std::string_view usage_pattern =
+        $usage_pattern;
+
+inline constexpr std::string_view help_message =
+        $help_message;
+
+namespace detail {
+
+/* FNV-1a, finalized like murmur3; must match c_hash() in docopt_c.py */
+constexpr std::uint32_t hash(std::string_view key, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+
+    for (char c : key)
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Perfect hash table built by docopt_c.py: a seed per bucket, then a slot
+   per key, which holds its index, or -1 */
+template <std::size_t Buckets, std::size_t Slots>
+struct Table {
+    std::array<int, Buckets> seeds;
+    std::array<int, Slots> slots;
+
+    constexpr int find(std::string_view key) const {
+        std::uint32_t h = hash(key, 0);
+
+        h = hash(key, static_cast<std::uint32_t>(seeds[h & (Buckets - 1)]));
+        return slots[h & (Slots - 1)];
+    }
+};
+
+/* Bit of the length of a key among the or-ed lengths of a table */
+constexpr unsigned long length_bit(std::size_t len) {
+    return 1UL << (len < 31 ? len : 31);
+}
+
+constexpr int lowest_bit(std::uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+
+    for (; !(bits & 1); bits >>= 1)
+        i++;
+    return i;
+#endif
+}
+
+constexpr bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+/* Decimal integer, with none of the locale or base handling of strtol() */
+constexpr Error parse_int(std::string_view s, long min, long max, long &value) {
+    bool negative = !s.empty() && s[0] == '-';
+    unsigned long limit = negative ? static_cast<unsigned long>(LONG_MAX) + 1 : static_cast<unsigned long>(LONG_MAX);
+    unsigned long n = 0;
+    std::size_t i = 0;
+
+    if (!s.empty() && (s[0] == '-' || s[0] == '+'))
+        i++;
+    if (i == s.size())
+        return Error::invalid_value;
+    for (; i < s.size(); i++) {
+        if (s[i] < '0' || s[i] > '9')
+            return Error::invalid_value;
+        unsigned d = static_cast<unsigned>(s[i] - '0');
+        if (n > (limit - d) / 10)
+            return Error::out_of_range;
+        n = n * 10 + d;
+    }
+    long x = negative && n > 0 ? -static_cast<long>(n - 1) - 1 : static_cast<long>(n);
+    if (x < min || x > max)
+        return Error::out_of_range;
+    value = x;
+    return Error::ok;
+}
+
+/* strtod() of `s` with the '.' swapped for the decimal point of the locale */
+inline Error parse_float_slow(std::string_view s, double &value) {
+    std::size_t point = s.find('.');
+    std::string copy(s.substr(0, point));
+    char *end = nullptr;
+
+    if (point != std::string_view::npos) {
+        copy += std::localeconv()->decimal_point;
+        copy += s.substr(point + 1);
+    }
+    errno = 0;
+    value = std::strtod(copy.c_str(), &end);
+    if (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL))
+        return Error::out_of_range;
+    return Error::ok;
+}
+
+/*
+ * Decimal number with an optional exponent.  When its digits fit in 2^53
+ * and its exponent is at most 22, both are exact doubles and one multiply
+ * or divide rounds correctly (Clinger's fast path), at compile time too.
+ * Longer numbers go to strtod().
+ */
+constexpr Error parse_float(std::string_view s, double &value) {
+    constexpr double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    std::uint64_t mantissa = 0;
+    std::size_t i = 0;
+    int digits = 0, exponent = 0, e = 0, sign = 1;
+    bool point = false, exact = true;
+
+    if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+        i++;
+    for (; i < s.size() && ((s[i] >= '0' && s[i] <= '9') || (s[i] == '.' && !point)); i++) {
+        if (s[i] == '.') {
+            point = true;
+            continue;
+        }
+        digits++;
+        if (mantissa > (UINT64_MAX - 9) / 10)
+            exact = false;
+        else
+            mantissa = mantissa * 10 + static_cast<unsigned>(s[i] - '0');
+        if (point)
+            exponent--;
+    }
+    if (digits == 0)
+        return Error::invalid_value;
+    if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+            sign = s[i++] == '-' ? -1 : 1;
+        if (i == s.size() || s[i] < '0' || s[i] > '9')
+            return Error::invalid_value;
+        for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++)
+            if (e < 10000)
+                e = e * 10 + (s[i] - '0');
+        exponent += sign * e;
+    }
+    if (i != s.size())
+        return Error::invalid_value;
+    if (exact && mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double x = static_cast<double>(mantissa);
+        x = exponent < 0 ? x / powers[-exponent] : x * powers[exponent];
+        value = s[0] == '-' ? -x : x;
+        return Error::ok;
+    }
+    return parse_float_slow(s, value);
+}
+
+/* Index of `s` among `choices`, found through their perfect hash table */
+template <std::size_t N, std::size_t Buckets, std::size_t Slots>
+constexpr Error parse_choice(std::string_view s, const std::array<std::string_view, N> &choices,
+                             const Table<Buckets, Slots> &table, int &value) {
+    int i = table.find(s);
+
+    if (i < 0 || choices[i] != s)
+        return Error::invalid_value;
+    value = i;
+    return Error::ok;
+}
+
+$tables
+} /* namespace detail */
+
+/* MaxArgs of a Parser of any number of positional tokens */
+inline constexpr std::size_t unbounded = static_cast<std::size_t>(-1);
+
+/*
+ * Parser of command lines of at most MaxArgs positional tokens, or of any
+ * number, held on the heap, for MaxArgs = unbounded.  It holds all that
+ * parse() writes, the values of repeated arguments among them, so the Args
+ * it fills in stay valid for as long as the Parser and argv do, and until
+ * its next parse().  Default-constructed it handles --help and --version,
+ * unless told otherwise.
+ */
+template <std::size_t MaxArgs = 256>
+class Parser {
+public:
+    constexpr Parser() = default;
+    constexpr Parser(bool help, bool version) : help_(help), version_(version) {}
+
+    /* Whether the next parse() handles --help and --version */
+    constexpr void set_extras(bool help, bool version) {
+        help_ = help;
+        version_ = version;
+    }
+
+    constexpr Error parse(int argc, const char *const *argv, Args &args) {
+        Error ret = Error::ok;
+
+        reset();
+        args = Args{};
+        ret = parse_args(argc, argv);
+        if (ret == Error::ok)
+            ret = parse_extras();
+        if (ret == Error::ok)
+            ret = match_pattern();
+        if (ret == Error::ok)
+            ret = to_args(args);
+        if (ret != Error::ok)
+            args = Args{};
+        return ret;
+    }
+
+    /* The option or value the last parse() failed on */
+    constexpr std::string_view error_token() const {
+        return error_short_[0] != '\\0' ? std::string_view(error_short_.data(), 2) : error_;
+    }
+
+private:
+    static constexpr std::size_t state_words = (detail::n_states + 63) / 64;
+    using States = std::array<std::uint64_t, state_words>;
+    template <typename T>
+    using Tokens = std::conditional_t<MaxArgs == unbounded, std::vector<T>,
+                                      std::array<T, MaxArgs == unbounded ? 0 : MaxArgs + 1>>;
+    /* for the values of options with an argument that may repeat, if any */
+    template <typename T>
+    using Values = std::conditional_t<detail::n_lists == 0, std::array<T, 1>, Tokens<T>>;
+
+    bool help_ = true;
+    bool version_ = true;
+    std::array<std::size_t, detail::n_commands + 1> commands_{};
+    std::array<bool, detail::n_options + 1> options_{};
+    std::array<std::string_view, detail::n_options + 1> option_arguments_{};
+    std::array<std::size_t, detail::n_counters + 1> counters_{};
+    std::array<int, detail::n_arguments + 1> offsets_{};
+    std::array<int, detail::n_arguments + 1> counts_{};
+    Tokens<std::string_view> positional_{};
+    Tokens<States> trail_{};
+    Tokens<int> bound_{};                   /* per positional token: its argument, or -1 */
+    Tokens<std::string_view> spare_{};      /* for sort_values() */
+    Values<std::string_view> values_{};     /* per value of such an option, */
+    Values<int> value_options_{};           /* the option it is of, */
+    Values<std::string_view> lists_{};      /* and by option, see sort_lists() */
+    std::array<int, detail::n_counters + 1> list_offsets_{};
+    int n_values_ = 0;
+    int n_given_ = 0;
+    int n_positional_ = 0;
+    int separator_ = -1;                    /* the positional token that is the "--" ending options, or -1 */
+    std::string_view error_{};
+    std::array<char, 2> error_short_{};
+
+    constexpr void reset() {
+        for (int i = 0; i < detail::n_commands; i++)
+            commands_[i] = 0;
+        for (int i = 0; i < detail::n_options; i++) {
+            options_[i] = false;
+            option_arguments_[i] = std::string_view();
+        }
+        for (int i = 0; i < detail::n_counters; i++)
+            counters_[i] = 0;
+        for (int i = 0; i < detail::n_arguments; i++)
+            offsets_[i] = counts_[i] = 0;
+        n_values_ = n_given_ = n_positional_ = 0;
+        separator_ = -1;
+        error_ = std::string_view();
+        error_short_[0] = '\\0';
+        if constexpr (MaxArgs == unbounded) {
+            if (trail_.empty())
+                trail_.resize(1);
+        }
+    }
+
+    /*
+     * Options
+     */
+
+    /* An option given again matches no usage line unless one repeats it */
+    constexpr Error option_given(int i) {
+        if (options_[i] && !detail::option_repeating[i]) {
+            error_ = detail::option_longs[i].empty() ? detail::option_shorts[i] : detail::option_longs[i];
+            return Error::no_match;
+        }
+        if (!options_[i]) {
+            options_[i] = true;
+            n_given_++;
+        }
+        if (detail::option_counters[i] >= 0)
+            counters_[detail::option_counters[i]]++;
+        return Error::ok;
+    }
+
+    /* The argument of option i, of which those that may repeat keep every one */
+    constexpr Error option_argument(int i, std::string_view value) {
+        option_arguments_[i] = value;
+        if constexpr (detail::n_lists > 0) {
+            if (detail::option_counters[i] < 0)
+                return Error::ok;
+            if constexpr (MaxArgs == unbounded) {
+                if (static_cast<std::size_t>(n_values_) == values_.size()) {
+                    values_.resize(2 * values_.size() + 16);
+                    value_options_.resize(values_.size());
+                    lists_.resize(values_.size());
+                }
+            } else if (static_cast<std::size_t>(n_values_) == MaxArgs) {
+                error_ = value;
+                return Error::too_many_arguments;
+            }
+            values_[n_values_] = value;
+            value_options_[n_values_++] = i;
+        }
+        return Error::ok;
+    }
+
+    /*
+     * Option that `name` spells or abbreviates, -1 if none does, -2 if it
+     * is the prefix of several.  long_table holds each long name and its
+     * prefixes that are at least long_unique[] long, which no other name
+     * starts with, so one lookup resolves both.
+     */
+    constexpr int find_long(std::string_view name) const {
+        int i = detail::long_table.find(name);
+        int found = 0;
+
+        if (i >= 0 && detail::starts_with(detail::option_longs[i], name)
+                && (detail::option_longs[i].size() == name.size()
+                    || name.size() >= static_cast<std::size_t>(detail::long_unique[i])))
+            return i;
+        for (int o : detail::long_sorted)
+            found += detail::starts_with(detail::option_longs[o], name);
+        return found > 1 ? -2 : -1;
+    }
+
+    constexpr Error parse_long(std::string_view token, int argc, const char *const *argv, int &k) {
+        std::size_t eq = token.find('=');
+        int i = find_long(token.substr(0, eq));
+
+        if (i < 0) {
+            error_ = token;
+            return i == -2 ? Error::ambiguous_option : Error::unknown_option;
+        }
+        if (detail::option_argcounts[i]) {
+            if (eq == std::string_view::npos) {
+                if (k + 1 >= argc) {
+                    error_ = detail::option_longs[i];
+                    return Error::missing_argument;
+                }
+                if (Error ret = option_argument(i, argv[++k]); ret != Error::ok)
+                    return ret;
+            } else if (Error ret = option_argument(i, token.substr(eq + 1)); ret != Error::ok) {
+                return ret;
+            }
+        } else if (eq != std::string_view::npos) {
+            error_ = detail::option_longs[i];
+            return Error::unexpected_argument;
+        }
+        return option_given(i);
+    }
+
+    constexpr Error parse_shorts(std::string_view token, int argc, const char *const *argv, int &k) {
+        for (std::size_t j = 1; j < token.size(); j++) {
+            int i = detail::short_table[static_cast<unsigned char>(token[j])];
+
+            if (i < 0) {
+                error_short_[0] = '-';
+                error_short_[1] = token[j];
+                return Error::unknown_option;
+            }
+            if (Error ret = option_given(i); ret != Error::ok)
+                return ret;
+            if (detail::option_argcounts[i]) {
+                if (j + 1 < token.size())
+                    return option_argument(i, token.substr(j + 1));
+                if (k + 1 < argc)
+                    return option_argument(i, argv[++k]);
+                error_ = detail::option_shorts[i];
+                return Error::missing_argument;
+            }
+        }
+        return Error::ok;
+    }
+
+    /* Whether it is a command or an argument is up to match_pattern() */
+    constexpr Error positional(std::string_view token) {
+        if constexpr (MaxArgs == unbounded) {
+            if (static_cast<std::size_t>(n_positional_) == positional_.size()) {
+                positional_.resize(2 * positional_.size() + 16);
+                trail_.resize(positional_.size() + 1);
+                bound_.resize(positional_.size());
+                spare_.resize(positional_.size());
+            }
+        } else if (static_cast<std::size_t>(n_positional_) == MaxArgs) {
+            error_ = token;
+            return Error::too_many_arguments;
+        }
+        positional_[n_positional_++] = token;
+        return Error::ok;
+    }
+
+    constexpr Error parse_args(int argc, const char *const *argv) {
+        Error ret = Error::ok;
+
+        for (int k = 1; k < argc && ret == Error::ok; k++) {
+            std::string_view token = argv[k];
+
+            if (token == "--") {
+                /* "--" and all that follows are positional, the "--" itself
+                   only matches a [--] in the usage section, when there is one */
+                separator_ = n_positional_;
+                for (; k < argc && ret == Error::ok; k++)
+                    ret = positional(argv[k]);
+                break;
+            } else if (token.size() > 1 && token[0] == '-' && token[1] == '-') {
+                ret = parse_long(token, argc, argv, k);
+            } else if (token.size() > 1 && token[0] == '-') {
+                ret = parse_shorts(token, argc, argv, k);
+            } else {
+                ret = positional(token);
+            }
+        }
+        return ret;
+    }
+
+    constexpr Error parse_extras() {
+        for (int i = 0; i < detail::n_options; i++) {
+            if (detail::option_argcounts[i] || !options_[i])
+                continue;
+            if (help_ && detail::option_longs[i] == "--help") {
+                error_ = detail::option_longs[i];
+                return Error::help;
+            } else if (version_ && detail::option_longs[i] == "--version") {
+                error_ = detail::option_longs[i];
+                return Error::version;
+            }
+        }
+        return Error::ok;
+    }
+
+    /*
+     * Usage pattern matching
+     */
+
+    constexpr int find_command(std::string_view name) const {
+        /* arguments, the other positional tokens, are rarely that long */
+        if (!(detail::command_lengths & detail::length_bit(name.size())))
+            return -1;
+        int i = detail::command_table.find(name);
+        return i >= 0 && detail::command_names[i] == name ? i : -1;
+    }
+
+    /* Whether the options given on the command line are the ones `line` takes */
+    constexpr bool match_options(int line) const {
+        int n_allowed = 0;
+        int n_group = 0;
+
+        for (int i = detail::required_start[line]; i < detail::required_start[line + 1]; i++)
+            if (!options_[detail::required[i]])
+                return false;
+        for (int i = detail::needed_start[line]; i < detail::needed_start[line + 1]; i++) {
+            if (detail::needed[i] < 0) {
+                if (n_group == 0)
+                    return false;
+                n_group = 0;
+                continue;
+            }
+            n_group += options_[detail::needed[i]];
+        }
+        for (int i = detail::exclusive_start[line]; i < detail::exclusive_start[line + 1]; i++) {
+            if (detail::exclusive[i] < 0) {
+                n_group = 0;
+                continue;
+            }
+            if (options_[detail::exclusive[i]] && ++n_group > 1)
+                return false;
+        }
+        for (int i = detail::allowed_start[line]; i < detail::allowed_start[line + 1]; i++)
+            n_allowed += options_[detail::allowed[i]];
+        return n_given_ == n_allowed;
+    }
+
+    /* Record that positional token `k` was consumed by entering `state`;
+       whether other tokens sit between it and the later values of its argument */
+    constexpr bool bind_token(int k, int state) {
+        bound_[k] = -1;
+        if (detail::command[state] >= 0) {
+            commands_[detail::command[state]]++;
+            return false;
+        }
+        int a = bound_[k] = detail::argument[state];
+        bool apart = counts_[a] > 0 && offsets_[a] != k + 1;
+        offsets_[a] = k;
+        counts_[a]++;
+        return apart;
+    }
+
+    /* Make the values of each argument one run, in their order, by one stable
+       counting sort by argument, as sort_values() of the C parser */
+    constexpr void sort_values() {
+        int at = 0;
+
+        for (int k = 0; k < n_positional_; k++)
+            if (bound_[k] < 0)
+                spare_[at++] = positional_[k];
+        for (int a = 0; a < detail::n_arguments; a++) {
+            offsets_[a] = at;
+            at += counts_[a];
+        }
+        for (int k = 0; k < n_positional_; k++)
+            if (bound_[k] >= 0)
+                spare_[offsets_[bound_[k]]++] = positional_[k];
+        for (int a = 0; a < detail::n_arguments; a++)
+            offsets_[a] -= counts_[a];
+        for (int k = 0; k < n_positional_; k++)
+            positional_[k] = spare_[k];
+    }
+
+    /*
+     * Run the positional tokens through the automaton, keeping the set of
+     * states reached after each of them, then walk back from an accepting
+     * state along the trail to bind them.
+     */
+    constexpr Error match_pattern() {
+        int state = -1;
+
+        trail_[0] = States{};
+        trail_[0][0] = 1;
+        for (int k = 0; k < n_positional_; k++) {
+            int command = find_command(positional_[k]);
+            /* the "--" ending options only matches the [--] of the usage, if it has one */
+            bool separator = k == separator_ && command >= 0;
+            const States &set = trail_[k];
+            States &next = trail_[k + 1];
+            bool reached = false;
+
+            next = States{};
+            for (std::size_t w = 0; w < state_words; w++) {
+                for (std::uint64_t bits = set[w]; bits != 0; bits &= bits - 1) {
+                    int q = static_cast<int>(w * 64) + detail::lowest_bit(bits);
+                    for (int j = detail::follow_start[q]; j < detail::follow_start[q + 1]; j++) {
+                        int p = detail::follow[j];
+                        if (detail::command[p] == command || (detail::command[p] < 0 && !separator)) {
+                            next[p / 64] |= std::uint64_t(1) << (p % 64);
+                            reached = true;
+                        }
+                    }
+                }
+            }
+            if (!reached)
+                return Error::no_match;
+        }
+        if (n_positional_ == 0) {
+            for (int line = 0; line < detail::n_lines; line++)
+                if (detail::line_nullable[line] && match_options(line))
+                    return Error::ok;
+            return Error::no_match;
+        }
+        const States &last = trail_[n_positional_];
+        for (int p = 1; p < detail::n_states && state < 0; p++)
+            if ((last[p / 64] >> (p % 64) & 1) && detail::accepts[p] && match_options(detail::line[p]))
+                state = p;
+        if (state < 0)
+            return Error::no_match;
+        bool apart = false;
+        for (int k = n_positional_ - 1; k >= 0; k--) {
+            if (bind_token(k, state))
+                apart = true;
+            int j = detail::pred_start[state];
+            while (!(trail_[k][detail::pred[j] / 64] >> (detail::pred[j] % 64) & 1))
+                j++;
+            state = detail::pred[j];
+        }
+        if (apart)
+            sort_values();
+        return Error::ok;
+    }
+
+    /* Make the values of each option with an argument that may repeat one
+       run of lists_, in the order given, as store_lists() of the C parser */
+    constexpr void sort_lists() {
+        int at = 0;
+
+        for (int i = 0; i < detail::n_options; i++) {
+            if (detail::option_argcounts[i] && detail::option_counters[i] >= 0) {
+                list_offsets_[detail::option_counters[i]] = at;
+                at += static_cast<int>(counters_[detail::option_counters[i]]);
+            }
+        }
+        for (int m = 0; m < n_values_; m++)
+            lists_[list_offsets_[detail::option_counters[value_options_[m]]]++] = values_[m];
+        for (int i = 0; i < detail::n_options; i++)
+            if (detail::option_argcounts[i] && detail::option_counters[i] >= 0)
+                list_offsets_[detail::option_counters[i]] -= static_cast<int>(counters_[detail::option_counters[i]]);
+    }
+
+    /* Fill in `args`, each field from what the spec says of it */
+    constexpr Error to_args(Args &args) {$store
+        return Error::ok;
+    }
+
+    /* Typed option i has a value that is not of its type */
+    constexpr Error invalid(int i, Error ret) {
+        error_ = detail::option_longs[i].empty() ? detail::option_shorts[i] : detail::option_longs[i];
+        return ret;
+    }
+
+    constexpr Error store_int(int i, long min, long max, long &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_int(option_arguments_[i], min, max, value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+
+    constexpr Error store_float(int i, double &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_float(option_arguments_[i], value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+
+    template <std::size_t N, std::size_t Buckets, std::size_t Slots>
+    constexpr Error store_choice(int i, const std::array<std::string_view, N> &choices,
+                                 const detail::Table<Buckets, Slots> &table, int &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_choice(option_arguments_[i], choices, table, value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+};
+
+/* Report what made Parser::parse() fail, or the help or version asked for,
+   and exit; without fprintf(), as docopt_exit() of the C parser */
+template <std::size_t MaxArgs>
+[[noreturn]] void docopt_exit(const Parser<MaxArgs> &parser, Error ret, std::string_view version) {
+    std::string_view token = parser.error_token();
+    const char *what = "";
+
+    switch (ret) {
+    case Error::ok:
+        std::exit(EXIT_SUCCESS);
+    case Error::help:
+        std::printf("%.*s\\n", static_cast<int>(help_message.size()), help_message.data());
+        std::exit(EXIT_SUCCESS);
+    case Error::version:
+        std::printf("%.*s\\n", static_cast<int>(version.size()), version.data());
+        std::exit(EXIT_SUCCESS);
+    case Error::no_match:
+        std::fwrite(usage_pattern.data(), 1, usage_pattern.size(), stderr);
+        std::fputs("\\n", stderr);
+        std::exit(EXIT_FAILURE);
+    case Error::unknown_option: what = " is not recognized\\n"; break;
+    case Error::missing_argument: what = " requires argument\\n"; break;
+    case Error::unexpected_argument: what = " must not have an argument\\n"; break;
+    case Error::too_many_arguments: what = " is one argument too many\\n"; break;
+    case Error::invalid_value: what = " has an invalid value\\n"; break;
+    case Error::out_of_range: what = " is out of range\\n"; break;
+    case Error::ambiguous_option: what = " is not a unique prefix\\n"; break;
+    }
+    std::fwrite(token.data(), 1, token.size(), stderr);
+    std::fputs(what, stderr);
+    std::exit(EXIT_FAILURE);
+}
+
+/* Parse argv as main() gets it, of any length, exiting on --help, --version
+   or an error; the values of repeated arguments live until the next call */
+inline Args docopt(int argc, const char *const *argv, bool help = true, std::string_view version = {}) {
+    static Parser<unbounded> parser;
+    Args args;
+    Error ret;
+
+    parser.set_extras(help, version.data() != nullptr);
+    if (argc == 1 && help) {
+        std::printf("%.*s\\n", static_cast<int>(help_message.size()), help_message.data());
+        std::exit(EXIT_FAILURE);
+    }
+    ret = parser.parse(argc, argv, args);
+    if (ret != Error::ok)
+        docopt_exit(parser, ret, version);
+    return args;
+}
+
+} /* namespace $namespace */
+
+#endif
+"""
+
+def to_initializer(val):
+    if isinstance(val, (str, type(None), bool, numbers.Number)):
+        return to_c(val)
+
+    return '{{{}}}'.format(',\n'.join('{}"{}"'.format(' ' * 10, k) for k in val)[9:])
+
+
+def to_c(val):
+    if type(val) is str:
+        return '"{}"'.format(val
+                             .replace('\\', r'\\')
                              .replace('"', r'\"')
                              .replace('\n', '\\n"\n"')
                              )
@@ -456,60 +3729,197 @@ def to_c(val):
     raise ValueError("can't convert to c type: {!r}".format(val))
 
 
-def c_command(obj):
-    return '{{{!s}}}'.format(', '.join(to_c(v)
-                                       for v in (obj.name, obj.value)))
+def c_field(obj):
+    return 'offsetof(struct DocoptArgs, {})'.format(c_name(obj.name))
 
 
-def c_argument(obj):
-    return '{{{!s}}}'.format(', '.join(to_c(v)
-                                       for v in (obj.name, obj.value, None)))
+def c_types(name, options, types):
+    """struct Type of template_c for each option in `types`, in order."""
+    out, entries = '', []
+    for i, o in enumerate(o for o in options if o.name in types):
+        t = types[o.name]
+        bounds = ['LONG_MIN' if t.min is None else '{}L'.format(t.min),
+                  'LONG_MAX' if t.max is None else '{}L'.format(t.max)]
+        if t.kind == 'enum':
+            choices = '{}_{}_choices'.format(name, i)
+            out += c_array('char *const', choices, t.choices) + c_table(choices, t.choices)
+            entries.append('{{TYPE_ENUM, {}, {}, {}, {}, &{}_table}}'.format(*bounds + [len(t.choices), choices,
+                                                                                     choices]))
+        else:
+            entries.append('{{TYPE_{}, {}, {}, 0, NULL, NULL}}'.format(*[t.kind.upper()] + bounds))
+    return out + 'static const struct Type {}[] = {{\n    {}\n}};\n'.format(name, ',\n    '.join(entries))
 
 
-def c_option(obj):
-    return '{{{!s}}}'.format(', '.join(to_c(v)
-                                       for v in (obj.short, obj.long, obj.argcount,
-                                                 False, None)))
+def c_spec(name, commands, arguments, options, repeating, bits, types, sources, features):
+    """Elements as the parallel arrays of struct Spec in template_c, `bits`
+    mapping the names of those packed into DocoptArgs.bits to their bit,
+    `types` those of typed options to their ValueType, `sources` those with
+    an [env: ...] or [config: ...] to them, and `features` as
+    spec_features() tells which tables were emitted."""
+    counted = [o.name for o in options if o.name in repeating]
+    counted_commands = [c.name for c in commands if c.name in repeating]
+    typed = [o.name for o in options if o.name in types]
+    field = lambda e: '0' if e.name in bits else c_field(e)
+    long_sorted = sorted((i for i, o in enumerate(options) if o.long), key=lambda i: options[i].long)
+    by_length = [c_by_length(name + '_long_by_length', [o.long and o.long[2:] for o in options]),
+                 c_by_length(name + '_command_by_length', [c.name for c in commands])]
+    arrays = [('char *const', 'command_names', [c.name for c in commands], to_c),
+              ('size_t', 'command_fields', [field(c) for c in commands], str),
+              ('bool', 'argument_repeating', [a.name in repeating for a in arguments], to_c),
+              ('size_t', 'argument_fields', [c_field(a) for a in arguments], str),
+              ('char *const', 'option_shorts', [o.short for o in options], to_c),
+              ('char *const', 'option_longs', [o.long for o in options], to_c),
+              ('bool', 'option_argcounts', [o.argcount > 0 for o in options], to_c),
+              ('size_t', 'option_fields', [field(o) for o in options], str),
+              ('int', 'option_counters', [counted.index(o.name) if o.name in counted else -1
+                                          for o in options], to_c),
+              ('bool', 'option_repeating', [o.name in repeating for o in options], to_c),
+              ('int', 'command_counters', [len(counted) + counted_commands.index(c.name) if c.name in repeating
+                                           else -1 for c in commands], to_c),
+              ('int', 'command_bits', [bits.get(c.name, -1) for c in commands], to_c),
+              ('int', 'option_bits', [bits.get(o.name, -1) for o in options], to_c),
+              ('int', 'option_types', [typed.index(o.name) if o.name in typed else -1 for o in options], to_c),
+              ('int', 'long_unique', unique_prefixes(options), to_c),
+              ('int', 'long_sorted', long_sorted, to_c),
+              ('char *const', 'option_envs', [sources.get(o.name, {}).get('env') for o in options], to_c),
+              ('char *const', 'option_configs', [sources.get(o.name, {}).get('config') for o in options], to_c)]
+    fields = ['{}_{}'.format(name, array) for _, array, _, _ in arrays] + \
+        ['offsetof(struct DocoptArgs, bits)' if bits else '0', name + '_types' if types else 'NULL',
+         str(len(long_sorted)), '&long_table' if features['longs'] else 'NULL',
+         '&command_table' if features['commands'] else 'NULL', c_lengths(c.name for c in commands),
+         'short_table' if features['shorts'] else 'NULL', '&config_table' if features['config'] else 'NULL',
+         c_lengths(s['config'] for s in sources.values() if 'config' in s),
+         by_length[0][1], by_length[1][1], '&pattern']
+    return ''.join(c_array(c_type, '{}_{}'.format(name, array), values, convert)
+                   for c_type, array, values, convert in arrays) + \
+        ''.join(tables for tables, _ in by_length) + \
+        (c_types(name + '_types', options, types) if types else '') + \
+        'static const struct Spec {name} = {{\n    {counts},\n    {fields}\n}};\n'.format(
+            name=name, counts=', '.join(str(len(l)) for l in (commands, arguments, options)),
+            fields='\n    '.join(wrap_list(fields)))
 
 
-def c_name(s):
-    return ''.join(c if c.isalnum() else '_' for c in s).strip('_')
+def c_by_length(name, keys):
+    """Arrays and initializer of a struct ByLength of template_c over the
+    indices of `keys`, None where there is no key."""
+    order = sorted((i for i, k in enumerate(keys) if k is not None), key=lambda i: (len(keys[i]), keys[i]))
+    if not order:
+        return '', '{0, NULL, NULL, NULL}'
+    lengths = [len(keys[i]) for i in order]
+    start = [bisect.bisect_left(lengths, n) for n in range(lengths[-1] + 2)]
+    lcp = [len(os.path.commonprefix([keys[i], keys[j]])) if j is not None and len(keys[i]) == len(keys[j]) else 0
+           for i, j in zip(order, [None] + order[:-1])]
+    return c_array('int', name + '_start', start) + c_array('int', name + '_order', order) + \
+        c_array('int', name + '_lcp', lcp), '{{{0}, {1}_start, {1}_order, {1}_lcp}}'.format(lengths[-1], name)
+
+
+def c_lengths(keys):
+    """LENGTH_BIT() of template_c for each length of `keys`, or-ed."""
+    return '{}UL'.format(sum(set(1 << min(len(k), 31) for k in keys)))
+
+
+def spec_features(commands, options, types, sources, lists):
+    """What the spec has, for template_c to leave out the code for what it
+    has not: short and long options, commands, typed options, options
+    taken from the environment or a config file, options with an argument
+    that may repeat, and --help or --version."""
+    return {'shorts': any(o.short for o in options),
+            'longs': any(o.long for o in options),
+            'commands': bool(commands),
+            'types': bool(types),
+            'sources': bool(sources),
+            'config': any('config' in s for s in sources.values()),
+            'lists': bool(lists),
+            'extras': any(o.long in ('--help', '--version') and o.argcount == 0 for o in options)}
+
+
+def c_features(features):
+    """DOCOPT_HAS_* of template_c, which the includer may override."""
+    return '\n'.join('#ifndef DOCOPT_HAS_{0}\n#define DOCOPT_HAS_{0} {1:d}\n#endif'.format(name.upper(), value)
+                     for name, value in sorted(features.items()))
+
+
+# Stack docopt() takes besides its DocoptArgs, for its frame and those of the
+# functions it calls, libc's among them: about 830 bytes with GCC 12 at -O0 on
+# x86-64, doubled and more for other compilers and targets.
+STACK_FRAME_BYTES = 2048
+
+
+def stack_bytes(commands, arguments, flags, options, repeating, types, bits):
+    """DOCOPT_STACK_BYTES of template_h: sizeof(struct DocoptArgs) where
+    pointers and longs are 8 bytes, which no smaller target exceeds, and
+    STACK_FRAME_BYTES."""
+    fields = [(8, 8)] * ((len(bits) + 63) // 64)
+    fields += [(8, 8) for c in commands if c.name not in bits]
+    fields += [(16, 8) if a.name in repeating else (8, 8) for a in arguments]
+    fields += [(8, 8) for f in flags if f.name not in bits]
+    fields += [(4, 4) if o.name in types and types[o.name].kind == 'enum' else
+               (16, 8) if o.name in repeating else (8, 8) for o in options]
+    size = 0
+    for field_size, align in fields + [(8, 8), (8, 8)]:  # usage_pattern, help_message
+        size = (size + align - 1) // align * align + field_size
+    return (size + 7) // 8 * 8 + STACK_FRAME_BYTES
+
 
+class StackBudgetError(Exception):
+    pass
 
-def c_if_command(cmd):
-    return 'if (strcmp(command->name, {val!s}) == 0) {{\n' \
-           '    args->{prop!s} = command->value;\n' \
-           '}}\n'.format(val=to_c(cmd.name),
-                         prop=c_name(cmd.name))
 
+def check_stack_budget(header, budget):
+    """Raise StackBudgetError if the DOCOPT_STACK_BYTES of `header` is over
+    `budget`, a number of bytes, or None for no budget."""
+    bound = re.search(r'^#define DOCOPT_STACK_BYTES (\d+)', header, re.M)
+    if budget is not None and bound is not None and int(bound.group(1)) > int(budget):
+        raise StackBudgetError('docopt() may take {} bytes of stack, over the budget of {}'.format(
+            bound.group(1), budget))
 
-def c_if_argument(arg):
-    return 'if (strcmp(argument->name, {val!s}) == 0) {{\n' \
-           '    args->{prop!s} = (char *) argument->value;\n' \
-           '}}\n'.format(val=to_c(arg.name),
-                         prop=c_name(arg.name))
 
+def c_flag_macros(commands, flags, bits):
+    """DOCOPT_FLAG(args, name) of template_h, reading the bit of `name` if
+    it was packed into DocoptArgs.bits, its size_t member otherwise."""
+    if not bits:
+        return '\n/* whether a command or an option without argument was given, or how often */\n' \
+               '#define DOCOPT_FLAG(args, name) ((args).name)\n'
+    enum = wrap_list(['DOCOPT_BIT_{}'.format(c_name(name)) for name in sorted(bits, key=bits.get)])
+    lines = ['', '/*',
+             ' * Bits of DocoptArgs.bits.  Flags sharing a word are tested at once with',
+             ' * DOCOPT_WORD(args, set) & (DOCOPT_MASK(set) | DOCOPT_MASK(remove)).',
+             ' */',
+             'enum {'] + ['    ' + line for line in enum] + [
+             '};',
+             '#define DOCOPT_WORD(args, name) ((args).bits[DOCOPT_BIT_##name / DOCOPT_WORD_BITS])',
+             '#define DOCOPT_MASK(name) (1UL << DOCOPT_BIT_##name % DOCOPT_WORD_BITS)',
+             '',
+             '/* whether a command or an option without argument was given, or how often */',
+             '#define DOCOPT_FLAG(args, name) DOCOPT_FLAG_##name(args)']
+    for leaf in commands + flags:
+        name = c_name(leaf.name)
+        lines.append('#define DOCOPT_FLAG_{0}(args) ((DOCOPT_WORD(args, {0}) & DOCOPT_MASK({0})) != 0)'.format(name)
+                     if leaf.name in bits else '#define DOCOPT_FLAG_{0}(args) ((args).{0})'.format(name))
+    return '\n'.join(lines) + '\n'
 
-def c_if_flag(obj):
-    return ' else if (strcmp(option->o{typ!s}, {val!s}) == 0) {{\n' \
-           '    args->{prop!s} = option->value;\n' \
-           '}}\n'.format(typ=('long' if obj.long else 'short'),
-                         val=to_c(obj.long or obj.short),
-                         prop=c_name(obj.long or obj.short))
 
+def c_choices(options, types):
+    """Constants for the values of options of an enum type, in template_h."""
+    out = ''
+    for o in options:
+        if o.name in types and types[o.name].kind == 'enum':
+            prefix = 'DOCOPT_{}_'.format(c_name(o.name).upper())
+            out += '\n/* values of DocoptArgs.{}, which is -1 if not given nor defaulted */\nenum {{\n    {}\n}};\n'.format(
+                c_name(o.name), '\n    '.join(wrap_list([prefix + c_name(c).upper() for c in types[o.name].choices])))
+    return out
 
-def c_if_option(obj):
-    return ' else if (strcmp(option->o{typ!s}, {val!s}) == 0) {{\n' \
-           '    if (option->argument) {{\n' \
-           '        args->{prop!s} = (char *) option->argument;\n' \
-           '    }}\n}}\n'.format(typ=('long' if obj.long else 'short'),
-                                 val=to_c(obj.long or obj.short),
-                                 prop=c_name(obj.long or obj.short))
+
+def c_name(s):
+    if s == '--':
+        return 'doubledash'
+    return ''.join(c if c.isalnum() else '_' for c in s).strip('_')
 
 
 def parse_leafs(pattern, all_options):
     options_shortcut = False
     leaves = []
+    seen = set()
     queue = [(0, pattern)]
     while queue:
         level, node = queue.pop(-1)  # depth-first search
@@ -520,12 +3930,14 @@ def parse_leafs(pattern, all_options):
             children.reverse()
             queue.extend(children)
         else:
-            if node not in leaves:
+            if node not in seen:
+                seen.add(node)
                 leaves.append(node)
     sort_by_name = lambda e: e.name
+    # positional values are handed out to arguments in the order of usage
+    arguments = [leaf for leaf in leaves if type(leaf) == docopt.Argument]
     leaves.sort(key=sort_by_name)
     commands = [leaf for leaf in leaves if type(leaf) == docopt.Command]
-    arguments = [leaf for leaf in leaves if type(leaf) == docopt.Argument]
     if options_shortcut:
         option_leafs = all_options
         option_leafs.sort(key=sort_by_name)
@@ -537,37 +3949,447 @@ def parse_leafs(pattern, all_options):
     return leaves, commands, arguments, flags, options
 
 
-def null_if_zero(s):
-    return 'NULL' if s is None or len(s) == 0 else s
+class ValueType(object):
+    """Type an option argument is converted to, after [type: int],
+    [type: int(<min>..<max>)], [type: float] or [type: enum(<a>|<b>...)]."""
 
+    c_types = {'int': 'long', 'float': 'double', 'enum': 'int'}
 
-def main():
-    assert __doc__ is not None
-    args = docopt.docopt(__doc__)
+    def __init__(self, option, kind, params):
+        self.option, self.kind = option, kind
+        self.min, self.max, self.choices = None, None, []
+        if kind not in self.c_types:
+            raise docopt.DocoptLanguageError('%s: unknown type %r' % (option, kind))
+        if kind == 'int' and params:
+            low, dots, high = params.partition('..')
+            if not dots:
+                raise docopt.DocoptLanguageError('%s: bounds must read int(<min>..<max>)' % option)
+            self.min = self.parse_int(low) if low.strip() else None
+            self.max = self.parse_int(high) if high.strip() else None
+        elif kind == 'enum':
+            self.choices = [choice.strip() for choice in params.split('|')]
+            if not all(self.choices) or len(set(self.choices)) != len(self.choices):
+                raise docopt.DocoptLanguageError('%s: choices must read enum(<a>|<b>...)' % option)
+        elif params:
+            raise docopt.DocoptLanguageError('%s: %s takes no parameters' % (option, kind))
 
-    try:
-        if args['<docopt>'] is not None:
-            with open(args['<docopt>'], 'r') as f:
-                args['<docopt>'] = f.read()
-        elif args['<docopt>'] is None and sys.stdin.isatty():
-            print(__doc__.strip("\n"))
-            sys.exit("")
-        else:
-            args['<docopt>'] = sys.stdin.read()
-        if args['--template'] is None:
-            args['--template'] = template_c
-        else:
-            with open(args['--template'], 'rt') as f:
-                args['--template'] = f.read()
-        if args['--template-header'] is None:
-            args['--template-header'] = template_h
+    def parse_int(self, s):
+        try:
+            return int(s, 10)
+        except ValueError:
+            raise docopt.DocoptLanguageError('%s: %r is not an int' % (self.option, s))
+
+    def c_value(self, value):
+        """C initializer of the default `value`, a string or None."""
+        if self.kind == 'int':
+            n = self.parse_int(value) if value is not None else 0
+            if value is not None and not ((self.min is None or n >= self.min) and
+                                          (self.max is None or n <= self.max)):
+                raise docopt.DocoptLanguageError('%s: default %s is out of range' % (self.option, value))
+            return '{}L'.format(n)
+        if self.kind == 'float':
+            try:
+                x = float(value) if value is not None else 0.0
+            except ValueError:
+                raise docopt.DocoptLanguageError('%s: %r is not a float' % (self.option, value))
+            if x != x or x in (float('inf'), float('-inf')):
+                raise docopt.DocoptLanguageError('%s: default %s is not finite' % (self.option, value))
+            return repr(x)
+        if value is None:
+            return '-1'
+        if value not in self.choices:
+            raise docopt.DocoptLanguageError('%s: default %s is not one of the choices' % (self.option, value))
+        return str(self.choices.index(value))
+
+
+def parse_types(doc, options):
+    """ValueType of each option with a [type: ...] annotation, by name."""
+    types = {}
+    for description in docopt.option_descriptions(doc):
+        matched = re.findall(r'\[type:\s*(\w+)\s*(?:\((.*?)\))?\s*\]', description, flags=re.I)
+        if not matched:
+            continue
+        option = docopt.Option.parse(description)
+        if not option.argcount:
+            raise docopt.DocoptLanguageError('%s takes no argument, it cannot have a type' % option.name)
+        types[option.name] = ValueType(option.name, matched[0][0].lower(), matched[0][1])
+    return dict((o.name, types[o.name]) for o in options if o.name in types)
+
+
+def parse_sources(doc, options):
+    """Where options take their argument from besides the command line, by
+    name: {'env': NAME} after [env: NAME], {'config': key} after
+    [config: key], or both."""
+    sources = {}
+    for description in docopt.option_descriptions(doc):
+        matched = re.findall(r'\[(env|config):\s*([^\]\s]+)\s*\]', description, flags=re.I)
+        if not matched:
+            continue
+        option = docopt.Option.parse(description)
+        if not option.argcount:
+            raise docopt.DocoptLanguageError('%s takes no argument, it cannot have [%s: ...]' % (
+                option.name, matched[0][0].lower()))
+        sources[option.name] = dict((kind.lower(), name) for kind, name in matched)
+    configs = [s['config'] for s in sources.values() if 'config' in s]
+    for key in set(k for k in configs if configs.count(k) > 1):
+        raise docopt.DocoptLanguageError('[config: %s] is given to several options' % key)
+    return dict((o.name, sources[o.name]) for o in options if o.name in sources)
+
+
+def parse_lists(options, repeating, types, sources):
+    """Names of the options with an argument that may repeat, whose values
+    are kept in order, as a DocoptSlice; none of them may have a type, nor
+    take its argument from elsewhere than the command line."""
+    lists = frozenset(o.name for o in options if o.argcount and o.name in repeating)
+    for o in options:
+        if o.name in lists and o.name in types:
+            raise docopt.DocoptLanguageError('%s may repeat, it cannot have a type' % o.name)
+        if o.name in lists and o.name in sources:
+            raise docopt.DocoptLanguageError('%s may repeat, it cannot have [%s: ...]' % (
+                o.name, sorted(sources[o.name])[0]))
+    return lists
+
+
+def c_list_defaults(options, lists):
+    """Arrays of the values of the options in `lists` that have a default,
+    split at whitespace as docopt.py does, for args_default of template_c."""
+    return ''.join(c_array('char *const', 'default_' + c_name(o.long or o.short), o.value.split())
+                   for o in options if o.name in lists and o.value is not None)
+
+
+def c_default(leaf, repeating, lists, types):
+    """Initializer of the member of `leaf` in args_default."""
+    if leaf.name in types:
+        return types[leaf.name].c_value(leaf.value)
+    if leaf.name in lists and leaf.value is not None:
+        return '{{(const char **) default_{}, {}}}'.format(c_name(leaf.long or leaf.short), len(leaf.value.split()))
+    if leaf.name in lists or type(leaf) == docopt.Argument and leaf.name in repeating:
+        return '{NULL, 0}'
+    return re.sub(r'"(.*?)"', r'(char *) "\1"', to_c(leaf.value))
+
+
+def c_config_table(options, sources):
+    """Option index for each [config: key], in a table like long_table."""
+    keyed = [(sources[o.name]['config'], i) for i, o in enumerate(options)
+             if 'config' in sources.get(o.name, {})]
+    return c_table('config', [k for k, _ in keyed], [i for _, i in keyed])
+
+
+def parse_repeating(pattern):
+    """Names of the leaves that may match more than once, e.g. `<name>...`."""
+    return frozenset(e.name for e in docopt.repeating(pattern))
+
+
+def c_hash(key, seed):
+    """FNV-1a, finalized like murmur3; must match docopt_hash() in template_c."""
+    h = (2166136261 ^ seed) & 0xffffffff
+    for c in bytearray(key.encode('utf-8')):
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+
+def next_pow2(n):
+    return 1 << max(0, n - 1).bit_length()
+
+
+def perfect_hash(keys):
+    """Hash and displace: find a seed per bucket such that every key lands in
+    its own slot. Returns (seeds, slots), slots holding indices into `keys`,
+    of which those that are None are left out."""
+    present = [key for key in keys if key is not None]
+    if len(set(present)) != len(present):
+        raise docopt.DocoptLanguageError('duplicate names: %s' % ', '.join(
+            sorted(set(k for k in present if present.count(k) > 1))))
+    n_buckets = next_pow2(max(1, len(present) // 2))
+    n_slots = next_pow2(max(1, len(present) + len(present) // 4))
+    buckets = [[] for _ in range(n_buckets)]
+    for i, key in enumerate(keys):
+        if key is not None:
+            buckets[c_hash(key, 0) & (n_buckets - 1)].append(i)
+    seeds = [0] * n_buckets
+    slots = [-1] * n_slots
+    for b in sorted(range(n_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        seed = 1
+        while True:
+            placed = set(c_hash(keys[i], seed) & (n_slots - 1) for i in buckets[b])
+            if len(placed) == len(buckets[b]) and all(slots[s] == -1 for s in placed):
+                break
+            seed += 1
+        seeds[b] = seed
+        for i in buckets[b]:
+            slots[c_hash(keys[i], seed) & (n_slots - 1)] = i
+    return seeds, slots
+
+
+def c_table(name, keys, values=None):
+    """Perfect hash table of `keys`, its slots holding their index, or the
+    value at that index of `values`."""
+    seeds, slots = perfect_hash(keys)
+    if values is not None:
+        slots = [values[i] if i >= 0 else -1 for i in slots]
+    return c_array('int', name + '_seeds', seeds) + c_array('int', name + '_slots', slots) + \
+        'static const struct Table {name}_table = {{\n' \
+        '    {n_buckets}, {n_slots}, {name}_seeds, {name}_slots\n}};\n'.format(
+            name=name, n_buckets=len(seeds), n_slots=len(slots))
+
+
+def unique_prefixes(options):
+    """Per option, the length of the shortest prefix of its long name that
+    no other long name starts with, at least '--' and a character; longer
+    than the name if that is a prefix of another one, 0 without a name."""
+    longs = sorted(o.long for o in options if o.long)
+    common = lambda a, b: next((k for k, (x, y) in enumerate(zip(a, b)) if x != y), min(len(a), len(b)))
+    unique = {}
+    for k, name in enumerate(longs):
+        shared = max([common(name, longs[j]) for j in (k - 1, k + 1) if 0 <= j < len(longs)] or [0])
+        unique[name] = max(3, shared + 1)
+    return [unique[o.long] if o.long else 0 for o in options]
+
+
+def long_prefixes(options):
+    """Keys of the long_table of template_c with the option each resolves
+    to: every long name, and the prefixes of it that abbreviate only it."""
+    keys, values = [], []
+    for i, (o, unique) in enumerate(zip(options, unique_prefixes(options))):
+        if o.long:
+            for n in range(min(unique, len(o.long)), len(o.long) + 1):
+                keys.append(o.long[:n])
+                values.append(i)
+    return keys, values
+
+
+def short_indices(options):
+    """Option index for every byte that may follow a '-', -1 for the others."""
+    table = [-1] * 256
+    for i, o in enumerate(options):
+        if o.short is None:
+            continue
+        c = bytearray(o.short[1:].encode('utf-8'))[0]
+        if table[c] != -1:
+            raise docopt.DocoptLanguageError('%s is specified ambiguously %d times' % (
+                o.short, sum(1 for other in options if other.short == o.short)))
+        table[c] = i
+    return table
+
+
+def c_short_table(options):
+    return c_array('int', 'short_table', short_indices(options)).replace('[]', '[256]')
+
+
+def wrap_list(items, width=72):
+    """Lines of `items` joined with ', ', like textwrap.wrap() of the joined
+    string, without its cost on long lists."""
+    lines, line = [], ''
+    for i, item in enumerate(items):
+        # the ',' after it counts unless it is the last item
+        if line and len(line) + 2 + len(item) + (i < len(items) - 1) > width:
+            lines.append(line + ',')
+            line = item
         else:
-            with open(args['--template-header'], 'rt') as f:
-                args['--template-header'] = f.read()
-    except IOError as e:
-        sys.exit(e)
+            line = line + ', ' + item if line else item
+    return lines + [line]
+
+
+def c_array(c_type, name, values, convert=to_c):
+    values = list(values) or [0]
+    return 'static const {} {}[] = {{\n    {}\n}};\n'.format(
+        c_type, name, '\n    '.join(wrap_list([str(convert(v)) for v in values])))
+
+
+def usage_lines(pattern):
+    """Top-level alternatives of the usage section, one per usage line, and
+    one per path through the alternatives that hold options, see paths()."""
+    node = pattern
+    while type(node) is docopt.Required and len(node.children) == 1:
+        node = node.children[0]
+    return [path for line in (node.children if type(node) is docopt.Either else [node]) for path in paths(line)]
+
+
+def paths(node):
+    """`node` as alternatives without an Either of options in them, but for
+    those of single options, (-a | -b), which Automaton.groups() and needs()
+    check, and those under a OneOrMore, whose repeats may take several.
+    Options are checked per line, so that the options of one alternative
+    may not come with the positionals of another, as in docopt.py."""
+    kind = type(node)
+    if kind is docopt.Either and node.flat(docopt.Option, docopt.OptionsShortcut):
+        alternatives = [child.children[0] if type(child) is docopt.Required and len(child.children) == 1
+                        else child for child in node.children]
+        if not all(type(a) is docopt.Option for a in alternatives):
+            return [path for child in node.children for path in paths(child)]
+    if kind in (docopt.Required, docopt.Optional) and node.flat(docopt.Either):
+        combos = [[]]
+        for child in node.children:
+            combos = [combo + [path] for combo in combos for path in paths(child)]
+        if len(combos) > 1:
+            return [kind(*combo) for combo in combos]
+    return [node]
+
+
+class Automaton(object):
+    """Position automaton of the usage lines (Glushkov construction).
+
+    State 0 is the start state, every occurrence of a command or an argument
+    in the usage section is a state of its own, entered by consuming one
+    positional token. Options do not take part in the order of tokens, they
+    are checked per line of usage_lines() by `match_options` in template_c,
+    against that of the accepting state. [options] stands for the options no
+    usage line names, as in docopt.py."""
+
+    def __init__(self, lines, commands, arguments, options):
+        self.commands = dict((c.name, i) for i, c in enumerate(commands))
+        self.arguments = dict((a.name, i) for i, a in enumerate(arguments))
+        self.options = dict((o.name, i) for i, o in enumerate(options))
+        self.command, self.argument, self.line = [-1], [-1], [-1]
+        self.accepts, self.follow, self.follow_set = [False], [[]], [set()]
+        self.nullable = []
+        self.allowed, self.required, self.needed, self.exclusive = [], [], [], []
+        named = set(o.name for line in lines for o in line.flat(docopt.Option))
+        shortcut = set(i for name, i in self.options.items() if name not in named)
+        for n, line in enumerate(lines):
+            nullable, first, last = self.compile(line, n)
+            self.add_follow(0, first)
+            for p in last:
+                self.accepts[p] = True
+            self.nullable.append(nullable)
+            allowed = set(self.options[o.name] for o in line.flat(docopt.Option))
+            if line.flat(docopt.OptionsShortcut):
+                allowed |= shortcut
+            self.allowed.append(sorted(allowed))
+            self.required.append(sorted(self.must(line)))
+            self.needed.append(self.needs(line))
+            self.exclusive.append(self.groups(line))
+
+    def add_follow(self, state, states):
+        follow, follow_set = self.follow[state], self.follow_set[state]
+        for p in states:
+            if p not in follow_set:
+                follow_set.add(p)
+                follow.append(p)
+
+    def compile(self, node, line):
+        """Add the states of `node`, return (nullable, first, last) of it."""
+        kind = type(node)
+        if kind in (docopt.Command, docopt.Argument):
+            self.command.append(self.commands[node.name] if kind is docopt.Command else -1)
+            self.argument.append(self.arguments[node.name] if kind is docopt.Argument else -1)
+            self.line.append(line)
+            self.accepts.append(False)
+            self.follow.append([])
+            self.follow_set.append(set())
+            p = len(self.follow) - 1
+            return False, [p], [p]
+        if kind is docopt.Either:
+            parts = [self.compile(child, line) for child in node.children]
+            return (any(part[0] for part in parts),
+                    [p for part in parts for p in part[1]],
+                    [p for part in parts for p in part[2]])
+        if kind is docopt.OneOrMore:
+            nullable, first, last = self.compile(node.children[0], line)
+            for p in last:
+                self.add_follow(p, first)
+            return nullable, first, last
+        if kind in (docopt.Required, docopt.Optional):
+            # in an Optional every child may be left out on its own
+            nullable, first, last = True, [], []
+            for child in node.children:
+                child_nullable, child_first, child_last = self.compile(child, line)
+                child_nullable = child_nullable or kind is docopt.Optional
+                for p in last:
+                    self.add_follow(p, child_first)
+                if nullable:
+                    first.extend(child_first)
+                if child_nullable:
+                    last.extend(child_last)
+                else:
+                    last = list(child_last)
+                nullable = nullable and child_nullable
+            return nullable, first, last
+        return True, [], []  # options and [options] consume no positionals
+
+    def must(self, node):
+        """Options that every match of `node` needs."""
+        kind = type(node)
+        if kind is docopt.Option:
+            return set([self.options[node.name]])
+        if kind is docopt.Either:
+            return set.intersection(*[self.must(child) for child in node.children])
+        if kind in (docopt.Required, docopt.OneOrMore):
+            return set().union(*[self.must(child) for child in node.children])
+        return set()
+
+    def needs(self, node):
+        """Options of alternatives one of which every match of `node` needs,
+        e.g. (--fast|--slow), flattened into one list with -1 after each group."""
+        kind = type(node)
+        if kind is docopt.Either:
+            musts = [self.must(child) for child in node.children]
+            if all(musts) and not set.intersection(*musts):
+                return sorted(set().union(*musts)) + [-1]
+            return []
+        if kind in (docopt.Required, docopt.OneOrMore):
+            return [i for child in node.children for i in self.needs(child)]
+        return []
+
+    def groups(self, node):
+        """Options of mutually exclusive alternatives, e.g. (--moored|--drifting),
+        flattened into one list with -1 after each group."""
+        if type(node) is docopt.OneOrMore or not hasattr(node, 'children'):
+            return []
+        alternatives = [child.children[0] if type(child) is docopt.Required and len(child.children) == 1
+                        else child for child in node.children]
+        if type(node) is docopt.Either and all(type(a) is docopt.Option for a in alternatives):
+            return [self.options[a.name] for a in alternatives] + [-1]
+        return [i for child in node.children for i in self.groups(child)]
 
-    doc = args['<docopt>']
+    def arrays(self):
+        """(type, name, values) of the arrays of struct Pattern in template_c."""
+        n_states = len(self.follow)
+        pred = [[] for _ in range(n_states)]
+        for q in range(n_states):
+            for p in self.follow[q]:
+                pred[p].append(q)
+
+        def flat(lists):
+            start = [0]
+            for values in lists:
+                start.append(start[-1] + len(values))
+            return start, [v for values in lists for v in values]
+
+        arrays = [('int', 'command', self.command), ('int', 'argument', self.argument),
+                  ('int', 'line', self.line), ('bool', 'accepts', self.accepts)]
+        for list_name, lists in (('follow', self.follow), ('pred', pred), ('allowed', self.allowed),
+                                 ('required', self.required), ('needed', self.needed),
+                                 ('exclusive', self.exclusive)):
+            start, values = flat(lists)
+            arrays += [('int', list_name + '_start', start), ('int', list_name, values)]
+        return arrays + [('bool', 'line_nullable', self.nullable)]
+
+    def to_c(self, name):
+        fields = ('command', 'argument', 'line', 'accepts', 'follow_start', 'follow', 'pred_start', 'pred',
+                  'line_nullable', 'allowed_start', 'allowed', 'required_start', 'required',
+                  'needed_start', 'needed', 'exclusive_start', 'exclusive')
+        return ''.join(c_array(c_type, '{}_{}'.format(name, array), values)
+                       for c_type, array, values in self.arrays()) + \
+            'static const struct Pattern {name} = {{\n    {n_states}, {n_lines},\n    {fields}\n}};\n'.format(
+                name=name, n_states=len(self.follow), n_lines=len(self.nullable),
+                fields='\n    '.join(wrap_list(['{}_{}'.format(name, f) for f in fields])))
+
+    def to_cpp(self):
+        """The arrays as constexpr ones in namespace detail of template_cpp."""
+        return ''.join(cpp_array(c_type, array, [to_cpp(v) for v in values])
+                       for c_type, array, values in self.arrays())
+
+
+def parse_spec(doc):
+    """Usage section, pattern and leaves of the docopt string `doc`."""
     usage = docopt.parse_section('usage:', doc)
     error_str_l = 'More than one ', '"usage:" (case-insensitive)', ' not found.'
     usage = {0: error_str_l[1:], 1: usage[0] if usage else None}.get(len(usage), error_str_l[:2])
@@ -576,41 +4398,64 @@ def main():
 
     all_options = docopt.parse_defaults(doc)
     pattern = docopt.parse_pattern(docopt.formal_usage(usage), all_options)
-    leafs, commands, arguments, flags, options = parse_leafs(pattern, all_options)
+    return (usage, pattern) + parse_leafs(pattern, all_options)
+
+
+_compiled = {}
+
+
+def compiled(template):
+    """string.Template of the text `template`, made once per process, and
+    before the workers of a manifest start, once for all of them."""
+    t = _compiled.get(template)
+    if t is None:
+        t = _compiled[template] = Template(template)
+    return t
+
+
+def generate(doc, template, template_header, header_name, packed=False, prefix=None):
+    """C source and header of the parser for the docopt string `doc`, with
+    commands and options without arguments packed into bits if `packed`,
+    and the functions of the header named after `prefix` if given."""
+    usage, pattern, leafs, commands, arguments, flags, options = parse_spec(doc)
+    repeating = parse_repeating(pattern)
+    types = parse_types(doc, options)
+    sources = parse_sources(doc, options)
+    lists = parse_lists(options, repeating, types, sources)
+    # commands and options without arguments that may repeat count in a size_t of their own
+    bits = [cmd.name for cmd in commands if cmd.name not in repeating] + \
+        [flag.name for flag in flags if flag.name not in repeating]
+    bits = dict((name, i) for i, name in enumerate(bits)) if packed else {}
 
     _indent = ' ' * 4
 
+    t_bits = '\n{indent}/* commands and options without arguments, see DOCOPT_FLAG() */\n' \
+             '{indent}unsigned long bits[({n} + DOCOPT_WORD_BITS - 1) / DOCOPT_WORD_BITS];'.format(
+                 indent=_indent, n=len(bits)) if bits else ''
     t_commands = ';\n{indent}'.format(indent=_indent).join('size_t {!s}'.format(c_name(cmd.name))
-                                                           for cmd in commands)
+                                                           for cmd in commands if cmd.name not in bits)
     t_commands = '\n{indent}/* commands */\n{indent}{t_commands};'.format(indent=_indent, t_commands=t_commands) \
         if t_commands != '' else ''
-    t_arguments = ';\n{indent}'.join('char *{!s}'.format(c_name(arg.name))
-                                     for arg in arguments)
+    t_arguments = ';\n{indent}'.format(indent=_indent).join(
+        ('struct DocoptSlice {!s}' if arg.name in repeating else 'char *{!s}').format(c_name(arg.name))
+        for arg in arguments)
     t_arguments = '\n{indent}/* arguments */\n{indent}{t_arguments};'.format(indent=_indent, t_arguments=t_arguments) \
         if t_arguments != '' else ''
     t_flags = ';\n{indent}'.format(indent=_indent).join('size_t {!s}'.format(c_name(flag.long or flag.short))
-                                                        for flag in flags)
+                                                        for flag in flags if flag.name not in bits)
     t_flags = '\n{indent}/* options without arguments */\n{indent}{t_flags};'.format(indent=_indent, t_flags=t_flags) \
         if t_flags != '' else ''
-    t_options = ';\n{indent}'.format(indent=_indent).join('char *{!s}'.format(c_name(opt.long or opt.short))
-                                                          for opt in options)
+    t_options = ';\n{indent}'.format(indent=_indent).join(
+        (types[opt.name].c_types[types[opt.name].kind] + ' ' if opt.name in types else
+         'struct DocoptSlice ' if opt.name in lists else 'char *') +
+        c_name(opt.long or opt.short) for opt in options)
     t_options = '\n{indent}/* options with arguments */\n{indent}{t_options};'.format(indent=_indent,
                                                                                       t_options=t_options) \
         if t_options != '' else ''
-    t_defaults = ', '.join(to_c(leaf.value) for leaf in leafs)
-    t_defaults = re.sub(r'"(.*?)"', r'(char *) "\1"', t_defaults)
-    t_defaults = '\n{indent}'.format(indent=_indent * 2).join(textwrap.wrap(t_defaults, 72))
+    t_defaults = ['{0}'] if bits else []
+    t_defaults += [c_default(leaf, repeating, lists, types) for leaf in leafs if leaf.name not in bits]
+    t_defaults = '\n{indent}'.format(indent=_indent * 2).join(wrap_list(t_defaults)) if t_defaults else ''
     t_defaults = '\n{indent}{t_defaults},'.format(indent=_indent * 2, t_defaults=t_defaults) if t_defaults != '' else ''
-    t_elems_cmds = ',\n{indent}'.format(indent=_indent * 2).join(c_command(cmd) for cmd in commands)
-    t_elems_cmds = '\n{indent}{t_elems_cmds}'.format(indent=_indent * 2,
-                                                     t_elems_cmds=t_elems_cmds) if t_elems_cmds != '' else ''
-    t_elems_args = ',\n{indent}'.format(indent=_indent * 2).join(c_argument(arg) for arg in arguments)
-    t_elems_args = '\n{indent}{t_elems_args}'.format(indent=_indent * 2,
-                                                     t_elems_args=t_elems_args) if t_elems_args != '' else ''
-    t_elems_opts = ',\n{indent}'.format(indent=_indent * 2).join(c_option(o) for o in (flags + options))
-    t_elems_opts = '\n{indent}{t_elems_opts}'.format(indent=_indent * 2,
-                                                     t_elems_opts=t_elems_opts) if t_elems_opts != '' else ''
-
     '''
     t_elems_n_commands = str(len(commands))
     t_elems_n_arguments = str(len(arguments))
@@ -626,75 +4471,568 @@ def main():
     )
     '''
 
-    t_if_command = ' else '.join(c_if_command(command) for command in commands)
-    t_if_command = '\n{indent}{t_if_command}'.format(indent=_indent * 2,
-                                                     t_if_command=t_if_command) if t_if_command != '' else ''
-    t_if_argument = ' else '.join(c_if_argument(arg) for arg in arguments)
-    t_if_argument = '\n{indent}{t_if_argument}'.format(
-        indent=_indent * 2,
-        t_if_argument='\n{indent}'.format(indent=_indent * 2).join(t_if_argument.splitlines())
-    ) if t_if_argument != '' else ''
-    t_if_flag = ''.join('\n{indent}'.format(indent=_indent * 2).join(c_if_flag(flag).splitlines())
-                        for flag in flags)
-    t_if_option = ''.join(
-        '\n{indent}'.format(indent=_indent * 2).join(c_if_option(opt).splitlines())
-        for opt in options
-    )
-
-    if not args['--output-name']:
-        header_output_name = '<stdout>'
-    else:
-        base, ext = os.path.splitext(args['--output-name'])
-        if ext not in frozenset(('.h', '.c')):
-            base = args['--output-name']
-
-        args['--output-name'] = "{base}.c".format(base=base)
-        header_output_name = "{base}.h".format(base=base)
-
-    header_name = os.path.basename(header_output_name)
+    features = spec_features(commands, flags + options, types, sources, lists)
+    # indices into the `options` and `commands` arrays of template_c
+    t_tables = '\n'.join(
+        ([c_table('long', *long_prefixes(flags + options))] if features['longs'] else []) +
+        ([c_table('command', [cmd.name for cmd in commands])] if features['commands'] else []) +
+        ([c_short_table(flags + options)] if features['shorts'] else []) +
+        ([c_config_table(flags + options, sources)] if features['config'] else []) +
+        ([c_list_defaults(options, lists)] if features['lists'] else []) +
+        [Automaton(usage_lines(pattern), commands, arguments, flags + options).to_c('pattern'),
+         c_spec('spec', commands, arguments, flags + options, repeating, bits, types, sources, features)])
 
     doc = doc.splitlines()
     doc_n = len(doc)
 
-    template_out = Template(args['--template']).safe_substitute(
+    template_out = compiled(template).safe_substitute(
         help_message='\n{indent}'.format(indent=_indent).join(to_initializer(doc).splitlines()),
         help_message_n=doc_n,
         usage_pattern='\n{indent}'.format(indent=_indent * 2).join(to_c(usage).splitlines()),
-        if_flag=t_if_flag,
-        if_option=t_if_option,
-        if_command=t_if_command,
-        if_argument=t_if_argument,
+        tables=t_tables,
+        features=c_features(features),
         defaults=t_defaults,
-        elems_cmds=null_if_zero(t_elems_cmds),
-        elems_args=null_if_zero(t_elems_args),
-        elems_opts=null_if_zero(t_elems_opts),
-        t_elems_n_commands=str(len(commands)),
-        t_elems_n_arguments=str(len(arguments)),
-        t_elems_n_options=str(len(flags + options)),
+        n_commands=len(commands),
+        n_arguments=len(arguments),
+        n_options=len(flags + options),
+        n_counters=sum(1 for leaf in commands + flags + options if leaf.name in repeating),
         header_name=header_name
     )
 
-    template_header_out = Template(args['--template-header']).safe_substitute(
+    template_header_out = compiled(template_header).safe_substitute(
+        bits=t_bits,
+        flag_macros=c_flag_macros(commands, flags, bits) + c_choices(options, types),
         commands=t_commands,
         arguments=t_arguments,
         flags=t_flags,
         options=t_options,
         help_message_n=doc_n,
+        renames=c_renames(prefix),
+        stack_bytes=stack_bytes(commands, arguments, flags, options, repeating, types, bits),
         # nargs=t_nargs
     ).replace('$header_no_ext', os.path.splitext(header_name)[0].upper())
+    return template_out, template_header_out
 
-    if args['--output-name'] is None:
-        print(template_out.strip(), '\n')
+
+def cpp_array(cpp_type, name, values):
+    """constexpr std::array of template_cpp, which may be empty."""
+    values = [str(v) for v in values]
+    if not values:
+        return 'inline constexpr std::array<{}, 0> {}{{}};\n'.format(cpp_type, name)
+    return 'inline constexpr std::array<{}, {}> {} = {{{{\n    {}\n}}}};\n'.format(
+        cpp_type, len(values), name, '\n    '.join(wrap_list(values)))
+
+
+def to_cpp(val):
+    if val is None:
+        return '{}'
+    if val is True or val is False:
+        return str(val).lower()
+    return to_c(val)
+
+
+def cpp_table(name, keys, values=None):
+    """c_table() as a constexpr detail::Table of template_cpp."""
+    seeds, slots = perfect_hash(keys)
+    if values is not None:
+        slots = [values[i] if i >= 0 else -1 for i in slots]
+    return cpp_array('int', name + '_seeds', seeds) + cpp_array('int', name + '_slots', slots) + \
+        'inline constexpr Table<{n_buckets}, {n_slots}> {name}_table = {{{name}_seeds, {name}_slots}};\n'.format(
+            name=name, n_buckets=len(seeds), n_slots=len(slots))
+
+
+def generate_cpp(doc, namespace=None):
+    """C++17 header of the parser for the docopt string `doc`, in `namespace`,
+    docopt if not given."""
+    usage, pattern, leafs, commands, arguments, flags, options = parse_spec(doc)
+    repeating = parse_repeating(pattern)
+    types = parse_types(doc, options)
+    lists = parse_lists(options, repeating, types, parse_sources(doc, options))
+    all_options = flags + options
+    indent = ' ' * 4
+
+    counted = [o.name for o in all_options if o.name in repeating]
+    members, store = [], []
+    choices, type_tables = '', ''
+    if commands:
+        members += ['/* commands */'] + ['std::size_t {} = 0;'.format(c_name(c.name)) if c.name in repeating
+                                         else 'bool {} = false;'.format(c_name(c.name)) for c in commands]
+    if arguments:
+        members += ['/* arguments */'] + ['{} {}{{}};'.format('Strings' if a.name in repeating else 'std::string_view',
+                                                             c_name(a.name)) for a in arguments]
+    if flags:
+        members += ['/* options without arguments */'] + [
+            'std::size_t {} = 0;'.format(c_name(f.long or f.short)) if f.name in counted
+            else 'bool {} = false;'.format(c_name(f.long or f.short)) for f in flags]
+    if options:
+        members += ['/* options with arguments */'] + [
+            '{} {} = {};'.format(types[o.name].c_types[types[o.name].kind], c_name(o.long or o.short),
+                                 types[o.name].c_value(o.value)) if o.name in types
+            else 'Strings {0}{1};'.format(c_name(o.long or o.short), '{}' if o.value is None else
+                                          ' = Strings({}_default.data(), {}_default.size())'.format(
+                                              c_name(o.long or o.short), c_name(o.long or o.short)))
+            if o.name in lists
+            else 'std::string_view {}{};'.format(c_name(o.long or o.short),
+                                                 '{}' if o.value is None else ' = ' + to_c(o.value))
+            for o in options]
+        for o in options:
+            if o.name in lists and o.value is not None:
+                choices += '\n/* default of Args::{} */\n'.format(c_name(o.long or o.short)) + cpp_array(
+                    'std::string_view', c_name(o.long or o.short) + '_default', map(to_c, o.value.split()))
+
+    parsers = {'int': 'store_int({i}, {min}, {max}, args.{field})',
+               'float': 'store_float({i}, args.{field})',
+               'enum': 'store_choice({i}, detail::{field}_choices, detail::{field}_choices_table, args.{field})'}
+    if types:
+        store.append('Error ret = Error::ok;\n')
+    store += ['/* options */'] if all_options else []
+    store += ['sort_lists();'] if lists else []
+    for i, o in enumerate(all_options):
+        field = c_name(o.long or o.short)
+        if o.argcount == 0:
+            store.append('args.{} = {}_[{}];'.format(field, 'counters' if o.name in counted else 'options',
+                                                     counted.index(o.name) if o.name in counted else i))
+        elif o.name in lists:
+            store.append('if (counters_[{0}] > 0)\n{1}args.{2} = Strings(&lists_[list_offsets_[{0}]], counters_[{0}]);'
+                         .format(counted.index(o.name), indent, field))
+        elif o.name in types:
+            t = types[o.name]
+            store.append('if ((ret = {parse}) != Error::ok)\n{indent}return ret;'.format(
+                             i=i, indent=indent, parse=parsers[t.kind].format(
+                                 i=i, field=field, min='LONG_MIN' if t.min is None else '{}L'.format(t.min),
+                                 max='LONG_MAX' if t.max is None else '{}L'.format(t.max))))
+            if t.kind == 'enum':
+                choices += '\n/* values of Args::{}, which is -1 if not given nor defaulted */\n' \
+                    'inline constexpr int {};\n'.format(field, ', '.join(wrap_list(
+                        ['{}_{} = {}'.format(field, c_name(c), n) for n, c in enumerate(t.choices)])))
+                type_tables += cpp_array('std::string_view', field + '_choices', map(to_c, t.choices)) + \
+                    cpp_table(field + '_choices', t.choices)
+        else:
+            store.append('if (option_arguments_[{0}].data() != nullptr)\n{1}args.{2} = option_arguments_[{0}];'.format(
+                i, indent, field))
+    store += ['/* commands */'] if commands else []
+    store += ['args.{} = commands_[{}]{};'.format(c_name(c.name), i, '' if c.name in repeating else ' != 0')
+              for i, c in enumerate(commands)]
+    store += ['/* arguments */'] if arguments else []
+    for i, a in enumerate(arguments):
+        if a.name in repeating:
+            store.append('args.{} = Strings(&positional_[offsets_[{}]], counts_[{}]);'.format(c_name(a.name), i, i))
+        else:
+            store.append('if (counts_[{0}] > 0)\n{1}args.{2} = positional_[offsets_[{0}]];'.format(
+                i, indent, c_name(a.name)))
+
+    if not store:
+        store.append('(void) args;')
+    long_sorted = sorted((i for i, o in enumerate(all_options) if o.long), key=lambda i: all_options[i].long)
+    automaton = Automaton(usage_lines(pattern), commands, arguments, all_options)
+    tables = ''.join('inline constexpr int {} = {};\n'.format(name, value) for name, value in (
+        ('n_commands', len(commands)), ('n_arguments', len(arguments)), ('n_options', len(all_options)),
+        ('n_counters', len(counted)), ('n_lists', len(lists)), ('n_states', len(automaton.follow)),
+        ('n_lines', len(automaton.nullable))))
+    tables += '\n' + ''.join([
+        cpp_array('std::string_view', 'command_names', [to_c(c.name) for c in commands]),
+        cpp_array('std::string_view', 'option_shorts', [to_cpp(o.short) for o in all_options]),
+        cpp_array('std::string_view', 'option_longs', [to_cpp(o.long) for o in all_options]),
+        cpp_array('bool', 'option_argcounts', [to_cpp(o.argcount > 0) for o in all_options]),
+        cpp_array('int', 'option_counters', [counted.index(o.name) if o.name in counted else -1
+                                             for o in all_options]),
+        cpp_array('bool', 'option_repeating', [to_cpp(o.name in repeating) for o in all_options]),
+        cpp_array('int', 'long_unique', unique_prefixes(all_options)),
+        cpp_array('int', 'long_sorted', long_sorted),
+        cpp_array('int', 'short_table', short_indices(all_options)),
+        cpp_table('long', *long_prefixes(all_options)),
+        cpp_table('command', [c.name for c in commands]),
+        'inline constexpr unsigned long command_lengths = {};\n'.format(c_lengths(c.name for c in commands)),
+        type_tables,
+        automaton.to_cpp()])
+
+    return compiled(template_cpp).safe_substitute(
+        guard=c_name(namespace or 'docopt').upper(),
+        namespace=namespace or 'docopt',
+        choices=choices,
+        members=''.join('\n' + indent + m for m in members),
+        usage_pattern='\n{}'.format(indent * 2).join(to_c(usage).splitlines()),
+        help_message='\n{}'.format(indent * 2).join(to_c('\n'.join(doc.splitlines())).splitlines()),
+        tables=tables,
+        store=''.join('\n' + '\n'.join(indent * 2 + line if line else '' for line in s.split('\n'))
+                      for s in store))
+
+
+def single_header(c, h):
+    """The parser of source `c` and header `h` as one header: the source
+    inside the include guard, with the functions static, so that the compiler
+    may fold them into their callers.  Whatever the source defines before its
+    first #include comes first, since that is for the system headers."""
+    header_include = re.compile(r'^#include "[^"]*"\n', re.M)
+    first_include = re.search(r'^#include', c, re.M).start()
+    guard_end = re.search(r'^#define \w+', h, re.M).end()
+    renames_end = h.index('\n\n', guard_end)
+    return h[:renames_end] + '\n\n' + \
+        '#ifndef DOCOPT_API\n' \
+        '#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L\n' \
+        '#define DOCOPT_API static inline\n' \
+        '#elif defined(__GNUC__)\n' \
+        '#define DOCOPT_API static __inline__\n' \
+        '#else\n' \
+        '#define DOCOPT_API static\n' \
+        '#endif\n' \
+        '#endif\n' + \
+        c[:first_include].rstrip('\n') + '\n' + h[renames_end:h.rindex('#endif')] + \
+        header_include.sub('', c[first_include:]).strip('\n') + '\n\n#endif\n'
+
+
+def c_renames(prefix, functions=('docopt', 'docopt_parse', 'docopt_context_new', 'docopt_context_free',
+                                  'docopt_error_token', 'docopt_complete', 'docopt_batch', 'docopt_batch_fd',
+                                  'docopt_batch_parallel', 'docopt_trace', 'docopt_config')):
+    """Macros of template_h that name its functions `prefix`_docopt() and so
+    on, so that the parsers of several specs link into one program."""
+    if not prefix:
+        return ''
+    return '\n\n/* generated with --prefix={} */\n'.format(prefix) + \
+        '\n'.join('#define {0} {1}_{0}'.format(f, prefix) for f in functions)
+
+
+def generate_dispatch(names, prog, header_name, prefix=None):
+    """C source and header of the dispatcher of `prog` to the subcommands
+    `names`, each parsed by the parser generated for its own spec."""
+    usage = 'Usage: {} <command> [<args>...]\n\nCommands:\n{}'.format(
+        prog, '\n'.join('  ' + name for name in names))
+    mains = ['int {}_main(int, char *[]);'.format(c_name(name)) for name in names]
+    tables = c_array('char *const', 'command_names', names) + \
+        'static int (*const command_mains[])(int, char *[]) = {{\n    {}\n}};\n'.format(
+            '\n    '.join(wrap_list(['{}_main'.format(c_name(name)) for name in names]))) + \
+        c_table('command', names)
+    header_no_ext = os.path.splitext(header_name)[0].upper()
+    c = Template(template_dispatch_c).substitute(
+        header_name=header_name, table=template_table, tables=tables, n_commands=len(names),
+        usage='\n        '.join(to_c(usage).splitlines()))
+    h = Template(template_dispatch_h).substitute(
+        header_no_ext=header_no_ext, prog=prog, mains='\n'.join(mains),
+        renames=c_renames(prefix, ('docopt_command', 'docopt_dispatch')))
+    return c, h
+
+
+def usage_program(doc):
+    """The program name the usage section of `doc` starts with."""
+    usage = docopt.parse_section('usage:', doc)
+    if not usage:
+        raise docopt.DocoptLanguageError('"usage:" (case-insensitive) not found.')
+    return usage[0].partition(':')[2].split()[0]
+
+
+def completion_script(doc, shell):
+    """The bash or zsh code that completes the program of the usage section
+    of `doc`, by asking the program itself with --docopt-complete."""
+    prog = usage_program(doc)
+    return Template(template_zsh if shell == 'zsh' else template_bash).substitute(
+        prog=prog, func='_docopt_' + re.sub(r'\W', '_', os.path.basename(prog)))
+
+
+def generator_sources():
+    """The Python files generation depends on, this one and docopt.py."""
+    return [os.path.abspath(path).replace('.pyc', '.py') for path in (__file__, docopt.__file__)]
+
+
+def cache_key(doc, template, template_header, header_name, packed, prefix=None, single=False):
+    """Hash of everything the generated files depend on: the spec, the
+    templates, the name of the header, the options, and the generator."""
+    h = hashlib.sha256()
+    parts = [__version__, doc, template, template_header, header_name, str(packed), str(prefix), str(single)]
+    for path in generator_sources():
+        with open(path, 'rb') as f:
+            parts.append(hashlib.sha256(f.read()).hexdigest())
+    for part in parts:
+        data = part.encode('utf-8')
+        # length-prefixed, so that no two lists of parts hash alike
+        h.update(('%d:' % len(data)).encode('ascii') + data)
+    return h.hexdigest()
+
+
+def cache_get(cache_dir, key):
+    """(source, header) generated before under `key`, or None."""
+    base = os.path.join(cache_dir, key[:2], key)
+    try:
+        with open(base + '.c', 'r') as f:
+            source = f.read()
+        with open(base + '.h', 'r') as f:
+            header = f.read()
+    except (IOError, OSError):
+        return None
+    return source, header
+
+
+def cache_put(cache_dir, key, source, header):
+    directory = os.path.join(cache_dir, key[:2])
+    if not os.path.isdir(directory):
+        try:
+            os.makedirs(directory)
+        except OSError:
+            if not os.path.isdir(directory):  # made by a concurrent run
+                raise
+    # the header goes last, cache_get() only trusts a complete pair
+    for ext, content in (('.c', source), ('.h', header)):
+        path = os.path.join(directory, key + ext)
+        temp = '{}.{}.tmp'.format(path, os.getpid())
+        with open(temp, 'w') as f:
+            f.write(content)
+        os.rename(temp, path)
+
+
+def write_if_changed(path, content):
+    """Write `content` to `path` unless the file holds it already, so that
+    its mtime only moves when it changes. Returns whether it was written."""
+    try:
+        with open(path, 'r') as f:
+            if f.read() == content:
+                return False
+    except (IOError, OSError):
+        pass
+    with open(path, 'w') as f:
+        f.write(content)
+    return True
+
+
+def depfile(targets, dependencies):
+    """Make rule listing what `targets` were generated from, which Ninja
+    reads as well (depfile = ..., deps = gcc)."""
+    escape = lambda path: path.replace('\\', '\\\\').replace(' ', '\\ ').replace('#', '\\#').replace('$', '$$')
+    return '{}: {}\n'.format(' '.join(escape(t) for t in targets),
+                             ' \\\n  '.join(escape(d) for d in dependencies))
+
+
+def spec_paths(paths):
+    """The spec files among `paths`, those ending in .docopt standing for
+    the directories."""
+    found = []
+    for path in paths:
+        if os.path.isdir(path):
+            found += sorted(os.path.join(path, name) for name in os.listdir(path) if name.endswith('.docopt'))
+        else:
+            found.append(path)
+    return found
+
+
+def write_parser(args, doc, output_name, prefix=None):
+    """Write the parser for `doc` to output_name with the extensions .c and
+    .h, taking it from the cache if there is one; returns their paths."""
+    base, ext = os.path.splitext(output_name)
+    if ext not in frozenset(('.h', '.c', '.hpp')):
+        base = output_name
+    if args['--cpp']:
+        return write_parser_cpp(args, doc, base + '.hpp', prefix)
+    output_name, header_output_name = base + '.c', base + '.h'
+    header_name = os.path.basename(header_output_name)
+    single = args['--single-header']
+
+    key = cache_key(doc, args['--template'], args['--template-header'], header_name,
+                    args['--packed'], prefix, single)
+    cached = cache_get(args['--cache-dir'], key) if args['--cache-dir'] else None
+    if cached is not None:
+        template_out, template_header_out = cached
+    else:
+        template_out, template_header_out = generate(doc, args['--template'], args['--template-header'],
+                                                     header_name, args['--packed'], prefix)
+        template_out = template_out.strip() + '\n'
+        template_header_out = template_header_out.strip() + '\n'
+        if single:
+            template_out, template_header_out = '', single_header(template_out, template_header_out)
+    if args['--cache-dir'] and cached is None:
+        cache_put(args['--cache-dir'], key, template_out, template_header_out)
+    check_stack_budget(template_header_out, args['--stack-budget'])
+    write_if_changed(header_output_name, template_header_out)
+    if single:
+        return [header_output_name]
+    write_if_changed(output_name, template_out)
+    return [output_name, header_output_name]
+
+
+def write_parser_cpp(args, doc, output_name, namespace=None):
+    """Write the C++ parser for `doc` to output_name, taking it from the cache
+    if there is one; returns its path."""
+    key = cache_key(doc, template_cpp, '', os.path.basename(output_name), False, namespace, 'cpp')
+    cached = cache_get(args['--cache-dir'], key) if args['--cache-dir'] else None
+    if cached is not None:
+        header = cached[1]
+    else:
+        header = generate_cpp(doc, namespace).strip() + '\n'
+    if args['--cache-dir'] and cached is None:
+        cache_put(args['--cache-dir'], key, '', header)
+    write_if_changed(output_name, header)
+    return [output_name]
+
+
+def read_manifest(path):
+    """(spec, outname, prefix) for each line of the manifest at `path`."""
+    base = os.path.dirname(path)
+    jobs = []
+    with open(path, 'r') as f:
+        for n, line in enumerate(f, 1):
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) not in (2, 3):
+                raise ValueError('{}:{}: expected <docopt> <outname> [<prefix>]'.format(path, n))
+            jobs.append((os.path.join(base, fields[0]), os.path.join(base, fields[1]),
+                         fields[2] if len(fields) == 3 else None))
+    return jobs
+
+
+_manifest_args = None
+
+
+def manifest_init(args):
+    global _manifest_args
+    _manifest_args = args
+
+
+def manifest_job(job):
+    """Write the parser of one line of a manifest; returns the spec, the
+    files written, and what went wrong if anything did."""
+    spec, output_name, prefix = job
+    try:
+        with open(spec, 'r') as f:
+            doc = f.read()
+        return spec, write_parser(_manifest_args, doc, output_name, prefix), None
+    except (IOError, OSError, ValueError, docopt.DocoptLanguageError, StackBudgetError) as e:
+        return spec, [], str(e)
+
+
+def write_manifest(args, jobs, n_processes):
+    """Write the parsers of the manifest `jobs` on `n_processes` processes;
+    returns the files written and the errors, one per spec that failed.
+    The templates are compiled here, before the processes fork."""
+    for template in (args['--template'], args['--template-header'], template_cpp):
+        compiled(template)
+    n_processes = max(1, min(n_processes, len(jobs)))
+    if n_processes == 1:
+        manifest_init(args)
+        results = [manifest_job(job) for job in jobs]
+    else:
+        pool = multiprocessing.Pool(n_processes, manifest_init, (args,))
+        try:
+            # a few chunks per process, to even out specs of different sizes
+            results = pool.map(manifest_job, jobs, max(1, len(jobs) // (4 * n_processes)))
+        finally:
+            pool.close()
+            pool.join()
+    outputs = [path for _, written, _ in results for path in written]
+    errors = ['{}: {}'.format(spec, error) for spec, _, error in results if error is not None]
+    return outputs, errors
+
+
+def read_templates(args):
+    """Replace the --template and --template-header paths of `args` with
+    the text of the files, or with template_c and template_h."""
+    if args['--template'] is None:
+        args['--template'] = template_c
     else:
+        with open(args['--template'], 'rt') as f:
+            args['--template'] = f.read()
+    if args['--template-header'] is None:
+        args['--template-header'] = template_h
+    else:
+        with open(args['--template-header'], 'rt') as f:
+            args['--template-header'] = f.read()
+
+
+def main_manifest(args):
+    """main() of --manifest: every spec listed there in one run."""
+    if args['<docopt>'] or args['--output-name'] or args['--completion']:
+        sys.exit('--manifest takes the specs and their <outname> from the manifest alone')
+    inputs = [args['--manifest']] + [path for path in (args['--template'], args['--template-header']) if path]
+    try:
+        jobs = read_manifest(args['--manifest'])
+        read_templates(args)
+    except (IOError, ValueError) as e:
+        sys.exit(e)
+    try:
+        n_processes = int(args['--jobs']) if args['--jobs'] else multiprocessing.cpu_count()
+    except ValueError:
+        sys.exit('--jobs must be a number')
+    outputs, errors = write_manifest(args, jobs, n_processes)
+    if errors:
+        sys.exit('\n'.join(errors))
+    if args['--depfile']:
+        inputs += [spec for spec, _, _ in jobs] + generator_sources()
         try:
-            with open(sys.stdout if args['--output-name'] in (None, "<stdout>") else args['--output-name'], 'w') as f:
-                f.write(template_out.strip() + '\n')
+            write_if_changed(args['--depfile'], depfile(outputs, inputs))
+        except (IOError, OSError) as e:
+            sys.exit(str(e))
+
+
+def main():
+    assert __doc__ is not None
+    args = docopt.docopt(__doc__)
+    if args['--manifest']:
+        return main_manifest(args)
+    specs = spec_paths(args['<docopt>'])
+    # several specs make a program with a subcommand per spec
+    dispatch = len(specs) > 1 or any(os.path.isdir(path) for path in args['<docopt>'])
+    # files the outputs depend on, for --depfile
+    inputs = specs + [path for path in (args['--template'], args['--template-header']) if path]
+    inputs += generator_sources()
+
+    try:
+        docs = []
+        for path in specs:
+            with open(path, 'r') as f:
+                docs.append(f.read())
+        if not specs and sys.stdin.isatty():
+            print(__doc__.strip("\n"))
+            sys.exit("")
+        elif not specs:
+            docs.append(sys.stdin.read())
+        read_templates(args)
+    except IOError as e:
+        sys.exit(e)
+    if not docs:
+        sys.exit('no .docopt files in %s' % ', '.join(args['<docopt>']))
 
-            with open(sys.stdout if header_output_name == "<stdout>" else header_output_name, 'w') as f:
-                f.write(template_header_out.strip() + '\n')
+    if args['--completion']:
+        shell = 'zsh' if args['--completion'].endswith('.zsh') else 'bash'
+        try:
+            write_if_changed(args['--completion'], completion_script(docs[0], shell))
+        except (IOError, OSError) as e:
+            sys.exit(str(e))
 
-        except IOError as e:
+    if dispatch and args['--cpp']:
+        sys.exit('--cpp writes the parser of one spec')
+    if args['--output-name'] is None:
+        if dispatch:
+            sys.exit('--output-name is needed to write the parsers of several specs')
+        if args['--cpp']:
+            print(generate_cpp(docs[0], args['--prefix']).strip(), '\n')
+            return
+        template_out, template_header_out = generate(docs[0], args['--template'], args['--template-header'],
+                                                     '<stdout>', args['--packed'], args['--prefix'])
+        try:
+            check_stack_budget(template_header_out, args['--stack-budget'])
+        except StackBudgetError as e:
             sys.exit(str(e))
+        print(template_out.strip(), '\n')
+        return
+
+    try:
+        if dispatch:
+            base, ext = os.path.splitext(args['--output-name'])
+            if ext not in frozenset(('.h', '.c')):
+                base = args['--output-name']
+            names = [os.path.splitext(os.path.basename(path))[0] for path in specs]
+            outputs = []
+            for name, doc in zip(names, docs):
+                outputs += write_parser(args, doc, '{}_{}'.format(base, c_name(name)), c_name(name))
+            dispatch_out, dispatch_header_out = generate_dispatch(
+                names, usage_program(docs[0]), os.path.basename(base + '.h'), args['--prefix'])
+            write_if_changed(base + '.c', dispatch_out.strip() + '\n')
+            write_if_changed(base + '.h', dispatch_header_out.strip() + '\n')
+            outputs += [base + '.c', base + '.h']
+        else:
+            outputs = write_parser(args, docs[0], args['--output-name'], args['--prefix'])
+        if args['--depfile']:
+            outputs += [args['--completion']] if args['--completion'] else []
+            write_if_changed(args['--depfile'], depfile(outputs, inputs))
+    except (IOError, OSError, StackBudgetError) as e:
+        sys.exit(str(e))
 
 
 if __name__ == '__main__':
@@ -1,36 +1,582 @@
+/* What the spec has, the code for what it has not is left out */
+#ifndef DOCOPT_HAS_COMMANDS
+#define DOCOPT_HAS_COMMANDS 1
+#endif
+#ifndef DOCOPT_HAS_CONFIG
+#define DOCOPT_HAS_CONFIG 1
+#endif
+#ifndef DOCOPT_HAS_EXTRAS
+#define DOCOPT_HAS_EXTRAS 1
+#endif
+#ifndef DOCOPT_HAS_LISTS
+#define DOCOPT_HAS_LISTS 0
+#endif
+#ifndef DOCOPT_HAS_LONGS
+#define DOCOPT_HAS_LONGS 1
+#endif
+#ifndef DOCOPT_HAS_SHORTS
+#define DOCOPT_HAS_SHORTS 1
+#endif
+#ifndef DOCOPT_HAS_SOURCES
+#define DOCOPT_HAS_SOURCES 1
+#endif
+#ifndef DOCOPT_HAS_TYPES
+#define DOCOPT_HAS_TYPES 0
+#endif
+
+#if defined(DOCOPT_THREADS) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if defined(DOCOPT_RESPONSE_FILES) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if (defined(DOCOPT_BATCH) || DOCOPT_HAS_CONFIG) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(DOCOPT_BATCH) || DOCOPT_HAS_CONFIG
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if DOCOPT_HAS_CONFIG || defined(DOCOPT_RESPONSE_FILES)
+#include <fcntl.h>
+#endif
+#ifdef DOCOPT_BATCH
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+#ifdef DOCOPT_THREADS
+#include <pthread.h>
+#endif
+
 #include "docopt.h"
 
-struct Command {
-    const char *name;
-    bool value;
+#define DOCOPT_HAS_TABLES (DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS || DOCOPT_HAS_TYPES || DOCOPT_HAS_CONFIG)
+
+#if defined(__GNUC__)
+#define DOCOPT_COLD __attribute__((cold, noinline))
+#else
+#define DOCOPT_COLD
+#endif
+
+/*
+ * All parser state is in the contexts but for two statics, trace_default and
+ * kept_contexts, set by docopt_trace(NULL, ...) and docopt() and read as
+ * contexts are made.  With DOCOPT_THREADS they are taken under this lock.
+ */
+#if defined(DOCOPT_THREADS) && (defined(DOCOPT_TRACE) || defined(DOCOPT_RESPONSE_FILES))
+static pthread_mutex_t statics_lock = PTHREAD_MUTEX_INITIALIZER;
+#define STATICS_LOCK() pthread_mutex_lock(&statics_lock)
+#define STATICS_UNLOCK() pthread_mutex_unlock(&statics_lock)
+#else
+#define STATICS_LOCK()
+#define STATICS_UNLOCK()
+#endif
+
+/*
+ * Hash tables
+ */
+
+/*
+ * Collision-free hash table, computed by docopt_c.py: a key is placed in
+ * bucket docopt_hash(key, 0), whose seed selects its slot as
+ * docopt_hash(key, seed).  Slots hold element indices, or -1 when empty.
+ */
+struct Table {
+    int n_buckets;
+    int n_slots;
+    const int *seeds;
+    const int *slots;
 };
 
-struct Argument {
-    const char *name;
-    const char *value;
-    const char *array[ARG_MAX];
+#if DOCOPT_HAS_TABLES
+/* FNV-1a, finalized like murmur3; must match c_hash() in docopt_c.py */
+static unsigned long docopt_hash(const char *key, size_t len, unsigned long seed) {
+    unsigned long h = (2166136261UL ^ seed) & 0xffffffffUL;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = ((h ^ (unsigned char) key[i]) * 16777619UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xffffffffUL;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Index of the only element that may be named `key`, or -1 */
+static int table_find(const struct Table *table, const char *key, size_t len) {
+    unsigned long h = docopt_hash(key, len, 0);
+
+    h = docopt_hash(key, len, table->seeds[h & (table->n_buckets - 1)]);
+    return table->slots[h & (table->n_slots - 1)];
+}
+#endif
+
+
+/*
+ * Usage patterns, compiled by docopt_c.py into a position automaton: state 0
+ * is the start, any other state stands for one occurrence of a command or an
+ * argument in the usage section, and is entered by consuming a positional
+ * token.  Lists are stored flat: the successors of state s, for instance,
+ * are follow[follow_start[s]] .. follow[follow_start[s + 1] - 1].
+ */
+struct Pattern {
+    int n_states;
+    int n_lines;
+    const int *command;         /* per state: command it matches, or -1 */
+    const int *argument;        /* per state: argument it binds, or -1 */
+    const int *line;            /* per state: usage line it is part of */
+    const bool *accepts;        /* per state: a usage line may end here */
+    const int *follow_start;
+    const int *follow;
+    const int *pred_start;
+    const int *pred;
+    const bool *line_nullable;  /* per line: matches without positionals */
+    const int *allowed_start;   /* per line: options it mentions, or */
+    const int *allowed;         /* [options] stands for */
+    const int *required_start;  /* per line: options it cannot do without */
+    const int *required;
+    const int *needed_start;    /* per line: -1 terminated groups of */
+    const int *needed;          /* options it takes at least one of */
+    const int *exclusive_start; /* per line: -1 terminated groups of */
+    const int *exclusive;       /* options it takes at most one of */
 };
 
-struct Option {
-    const char *oshort;
-    const char *olong;
-    bool argcount;
-    bool value;
-    const char *argument;
+/* Sets of states reached after each positional token, run-length encoded */
+struct Trail {
+    size_t words;
+    int n;
+    int capacity;
+    unsigned long *sets;
+    int *runs;
 };
 
-struct Elements {
+/* How an option argument is converted, after its [type: ...] in the spec */
+enum TypeKind {
+    TYPE_INT,                   /* long, at least min and at most max */
+    TYPE_FLOAT,                 /* double */
+    TYPE_ENUM                   /* int, the index of one of the choices */
+};
+
+struct Type {
+    enum TypeKind kind;
+    long min;
+    long max;
+    int n_choices;
+    const char *const *choices;
+    const struct Table *table;  /* of the choices, or NULL to scan them */
+};
+
+/*
+ * Names by length: those n long are order[start[n]] .. order[start[n + 1] - 1],
+ * in alphabetical order, where each shares its first lcp[] characters with
+ * the one before.
+ */
+struct ByLength {
+    int max;
+    const int *start;
+    const int *order;
+    const int *lcp;
+};
+
+/*
+ * The elements of the usage section, as parallel arrays in the order of the
+ * members of struct DocoptArgs they are stored in: commands by name,
+ * arguments in the order of usage, options without then with arguments.
+ * `fields` are the offsetof() those members.
+ */
+struct Spec {
     int n_commands;
     int n_arguments;
     int n_options;
-    struct Command *commands;
-    struct Argument *arguments;
-    struct Option *options;
+    const char *const *command_names;
+    const size_t *command_fields;
+    const bool *argument_repeating;
+    const size_t *argument_fields;
+    const char *const *option_shorts;
+    const char *const *option_longs;
+    const bool *option_argcounts;
+    const size_t *option_fields;
+    const int *option_counters;     /* per option: its counter, or -1 */
+    const bool *option_repeating;   /* per option: may be given more than once */
+    const int *command_counters;    /* per command: its counter when it may repeat, or -1 */
+    const int *command_bits;        /* per element: its bit of DocoptArgs.bits, */
+    const int *option_bits;         /* or -1 when it has a member of its own */
+    const int *option_types;        /* per option: its type, or -1 for char * */
+    const int *long_unique;         /* per option: the shortest its long name may be cut to */
+    const int *long_sorted;         /* options with a long name, sorted by it */
+    const char *const *option_envs;     /* per option: its [env: NAME], or NULL */
+    const char *const *option_configs;  /* per option: its [config: key], or NULL */
+    size_t bits_field;
+    const struct Type *types;
+    int n_longs;
+    const struct Table *long_table;
+    const struct Table *command_table;
+    unsigned long command_lengths;      /* bit LENGTH_BIT(n) set when a name is n long */
+    const int *short_table;
+    const struct Table *config_table;   /* of the option_configs, */
+    unsigned long config_lengths;       /* and their lengths like command_lengths */
+    struct ByLength long_by_length;     /* options with a long name, by its length after "--" */
+    struct ByLength command_by_length;
+    const struct Pattern *pattern;
+};
+
+/* Bit of a length in Spec.command_lengths, the last one for all that are longer */
+#define LENGTH_BIT(len) (1UL << ((len) < 31 ? (len) : 31))
+
+/*
+ * What a parse found, the only part of the elements written to: bitsets of
+ * the commands and options given, how often commands and options that may
+ * repeat were, the values of argument i, which are
+ * argv[offsets[i]] .. argv[offsets[i] + counts[i] - 1], and those of the
+ * options with an argument that may repeat, in the order given.
+ */
+struct Elements {
+    const struct Spec *spec;
+    unsigned long *commands;
+    unsigned long *options;
+    const char **option_arguments;
+    int *offsets;
+    int *counts;
+    int *counters;
+    int *bound;                 /* per positional token: its argument, or -1 */
+    const char *error;          /* token or option the last error is about */
+    char error_short[3];        /* "-x" when it is an unknown short option, */
+    const char *error_word;     /* and the "-abx" it is part of */
+    int candidates[2];          /* range of long_sorted an ambiguous option abbreviates */
+#if DOCOPT_HAS_LISTS
+    const char **values;        /* per value of such an option, */
+    int *value_options;         /* and the option it is of */
+    int n_values;
+#endif
+#ifdef DOCOPT_TRACE
+    const struct DocoptTrace *trace;
+#endif
+};
+
+static const int long_seeds[] = {
+    1, 1, 0, 3, 2, 0, 6, 1, 1, 1, 1, 0, 1, 2, 12, 2
+};
+static const int long_slots[] = {
+    3, -1, 2, -1, 4, 2, -1, 4, -1, -1, -1, -1, -1, -1, -1, 0, 0, 3, -1, -1,
+    -1, 2, 3, 0, 2, 1, -1, -1, -1, 0, -1, -1, -1, 4, 3, -1, 0, -1, 2, -1,
+    -1, -1, -1, -1, 0, 3, 0, -1, 3, -1, 4, 1, 0, 1, -1, -1, 2, -1, -1, 1, 4,
+    -1, -1, 3
+};
+static const struct Table long_table = {
+    16, 64, long_seeds, long_slots
+};
+
+static const int command_seeds[] = {
+    4, 3, 1, 2
+};
+static const int command_slots[] = {
+    1, 5, 4, 3, -1, 6, 2, 0
+};
+static const struct Table command_table = {
+    4, 8, command_seeds, command_slots
+};
+
+static const int short_table[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1
+};
+
+static const int config_seeds[] = {
+    1
+};
+static const int config_slots[] = {
+    4
+};
+static const struct Table config_table = {
+    1, 1, config_seeds, config_slots
+};
+
+static const int pattern_command[] = {
+    -1, 5, 0, -1, 5, -1, 2, -1, -1, 5, 6, -1, -1, 1, 4, 3, -1, -1
+};
+static const int pattern_argument[] = {
+    -1, -1, -1, 0, -1, 0, -1, 1, 2, -1, -1, 1, 2, -1, -1, -1, 1, 2
+};
+static const int pattern_line[] = {
+    -1, 0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3
+};
+static const bool pattern_accepts[] = {
+    0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1
+};
+static const int pattern_follow_start[] = {
+    0, 4, 5, 6, 7, 8, 9, 10, 11, 11, 12, 13, 14, 14, 16, 17, 18, 19, 19
+};
+static const int pattern_follow[] = {
+    1, 4, 9, 13, 2, 3, 3, 5, 6, 7, 8, 10, 11, 12, 14, 15, 16, 16, 17
 };
+static const int pattern_pred_start[] = {
+    0, 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 19
+};
+static const int pattern_pred[] = {
+    0, 1, 2, 3, 0, 4, 5, 6, 7, 0, 9, 10, 11, 0, 13, 13, 14, 15, 16
+};
+static const int pattern_allowed_start[] = {
+    0, 0, 1, 1, 3, 4, 5
+};
+static const int pattern_allowed[] = {
+    4, 0, 2, 1, 3
+};
+static const int pattern_required_start[] = {
+    0, 0, 0, 0, 0, 1, 2
+};
+static const int pattern_required[] = {
+    1, 3
+};
+static const int pattern_needed_start[] = {
+    0, 0, 0, 0, 0, 0, 0
+};
+static const int pattern_needed[] = {
+    0
+};
+static const int pattern_exclusive_start[] = {
+    0, 0, 0, 0, 3, 3, 3
+};
+static const int pattern_exclusive[] = {
+    2, 0, -1
+};
+static const bool pattern_line_nullable[] = {
+    0, 0, 0, 0, 1, 1
+};
+static const struct Pattern pattern = {
+    18, 6,
+    pattern_command, pattern_argument, pattern_line, pattern_accepts,
+    pattern_follow_start, pattern_follow, pattern_pred_start, pattern_pred,
+    pattern_line_nullable, pattern_allowed_start, pattern_allowed,
+    pattern_required_start, pattern_required, pattern_needed_start,
+    pattern_needed, pattern_exclusive_start, pattern_exclusive
+};
+
+static const char *const spec_command_names[] = {
+    "create", "mine", "move", "remove", "set", "ship", "shoot"
+};
+static const size_t spec_command_fields[] = {
+    offsetof(struct DocoptArgs, create), offsetof(struct DocoptArgs, mine),
+    offsetof(struct DocoptArgs, move), offsetof(struct DocoptArgs, remove),
+    offsetof(struct DocoptArgs, set), offsetof(struct DocoptArgs, ship),
+    offsetof(struct DocoptArgs, shoot)
+};
+static const bool spec_argument_repeating[] = {
+    1, 0, 0
+};
+static const size_t spec_argument_fields[] = {
+    offsetof(struct DocoptArgs, name), offsetof(struct DocoptArgs, x),
+    offsetof(struct DocoptArgs, y)
+};
+static const char *const spec_option_shorts[] = {
+    NULL, "-h", NULL, NULL, NULL
+};
+static const char *const spec_option_longs[] = {
+    "--drifting", "--help", "--moored", "--version", "--speed"
+};
+static const bool spec_option_argcounts[] = {
+    0, 0, 0, 0, 1
+};
+static const size_t spec_option_fields[] = {
+    offsetof(struct DocoptArgs, drifting),
+    offsetof(struct DocoptArgs, help), offsetof(struct DocoptArgs, moored),
+    offsetof(struct DocoptArgs, version), offsetof(struct DocoptArgs, speed)
+};
+static const int spec_option_counters[] = {
+    -1, -1, -1, -1, -1
+};
+static const bool spec_option_repeating[] = {
+    0, 0, 0, 0, 0
+};
+static const int spec_command_counters[] = {
+    -1, -1, -1, -1, -1, -1, -1
+};
+static const int spec_command_bits[] = {
+    -1, -1, -1, -1, -1, -1, -1
+};
+static const int spec_option_bits[] = {
+    -1, -1, -1, -1, -1
+};
+static const int spec_option_types[] = {
+    -1, -1, -1, -1, -1
+};
+static const int spec_long_unique[] = {
+    3, 3, 3, 3, 3
+};
+static const int spec_long_sorted[] = {
+    0, 1, 2, 4, 3
+};
+static const char *const spec_option_envs[] = {
+    NULL, NULL, NULL, NULL, "NAVAL_SPEED"
+};
+static const char *const spec_option_configs[] = {
+    NULL, NULL, NULL, NULL, "speed"
+};
+static const int spec_long_by_length_start[] = {
+    0, 0, 0, 0, 0, 1, 2, 3, 4, 5
+};
+static const int spec_long_by_length_order[] = {
+    1, 4, 2, 3, 0
+};
+static const int spec_long_by_length_lcp[] = {
+    0, 0, 0, 0, 0
+};
+static const int spec_command_by_length_start[] = {
+    0, 0, 0, 0, 1, 4, 5, 7
+};
+static const int spec_command_by_length_order[] = {
+    4, 1, 2, 5, 6, 0, 3
+};
+static const int spec_command_by_length_lcp[] = {
+    0, 0, 1, 0, 0, 0, 0
+};
+static const struct Spec spec = {
+    7, 3, 5,
+    spec_command_names, spec_command_fields, spec_argument_repeating,
+    spec_argument_fields, spec_option_shorts, spec_option_longs,
+    spec_option_argcounts, spec_option_fields, spec_option_counters,
+    spec_option_repeating, spec_command_counters, spec_command_bits,
+    spec_option_bits, spec_option_types, spec_long_unique, spec_long_sorted,
+    spec_option_envs, spec_option_configs, 0, NULL, 5, &long_table,
+    &command_table, 120UL, short_table, &config_table, 32UL,
+    {8, spec_long_by_length_start, spec_long_by_length_order, spec_long_by_length_lcp},
+    {6, spec_command_by_length_start, spec_command_by_length_order, spec_command_by_length_lcp},
+    &pattern
+};
+
+
+
+/*
+ * Tracing, compiled out unless DOCOPT_TRACE is defined
+ */
+
+#ifdef DOCOPT_TRACE
+/* what contexts start with, set by docopt_trace(NULL, ...), see statics_lock */
+static const struct DocoptTrace *trace_default;
+
+static void trace_phase(const struct DocoptTrace *trace, enum DocoptPhase phase) {
+    if (trace != NULL && trace->phase != NULL)
+        trace->phase(trace->data, phase);
+}
+
+static void trace_token(const struct DocoptTrace *trace, const char *token) {
+    if (trace != NULL && trace->token != NULL)
+        trace->token(trace->data, token);
+}
+
+#if DOCOPT_HAS_SHORTS || DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS
+/* of find_long(), parse_shorts() and find_command() */
+static void trace_lookup(const struct DocoptTrace *trace, const char *name, size_t len, int probes) {
+    if (trace != NULL && trace->lookup != NULL)
+        trace->lookup(trace->data, name, len, probes);
+}
+#endif
+
+static void trace_error(const struct DocoptTrace *trace, int error, const char *token) {
+    if (trace != NULL && trace->error != NULL)
+        trace->error(trace->data, (enum DocoptError) error, token);
+}
+
+#define TRACE_PHASE(trace, phase) trace_phase(trace, phase)
+#define TRACE_TOKEN(trace, token) trace_token(trace, token)
+#define TRACE_LOOKUP(trace, name, len, probes) trace_lookup(trace, name, len, probes)
+#define TRACE_ERROR(trace, error, token) trace_error(trace, error, token)
+#else
+#define TRACE_PHASE(trace, phase) ((void) 0)
+#define TRACE_TOKEN(trace, token) ((void) 0)
+#define TRACE_LOOKUP(trace, name, len, probes) ((void) 0)
+#define TRACE_ERROR(trace, error, token) ((void) 0)
+#endif
+
+
+/*
+ * Trail object
+ */
+
+#define WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define SET_HAS(set, s) (((set)[(s) / WORD_BITS] >> ((s) % WORD_BITS)) & 1)
+#define SET_ADD(set, s) ((set)[(s) / WORD_BITS] |= 1UL << ((s) % WORD_BITS))
+
+#if defined(__GNUC__)
+#define lowest_bit(w) __builtin_ctzl(w)
+#else
+static int lowest_bit(unsigned long w) {
+    int b = 0;
+
+    while (!(w & 1)) {
+        w >>= 1;
+        b++;
+    }
+    return b;
+}
+#endif
+
+/* Empty set following the last one, or NULL when out of memory */
+static unsigned long *trail_next(struct Trail *trail) {
+    unsigned long *set;
+
+    if (trail->n == trail->capacity) {
+        int capacity = trail->capacity ? 2 * trail->capacity : 16;
+        unsigned long *sets;
+        int *runs;
+
+        sets = realloc(trail->sets, capacity * trail->words * sizeof(unsigned long));
+        if (sets == NULL)
+            return NULL;
+        trail->sets = sets;
+        runs = realloc(trail->runs, capacity * sizeof(int));
+        if (runs == NULL)
+            return NULL;
+        trail->runs = runs;
+        trail->capacity = capacity;
+    }
+    set = &trail->sets[trail->n * trail->words];
+    memset(set, 0, trail->words * sizeof(unsigned long));
+    return set;
+}
+
+/* Append the set filled in after trail_next(), merging it with an equal one */
+static void trail_push(struct Trail *trail) {
+    unsigned long *set = &trail->sets[trail->n * trail->words];
+
+    if (trail->n > 0 && !memcmp(set - trail->words, set, trail->words * sizeof(unsigned long)))
+        trail->runs[trail->n - 1]++;
+    else
+        trail->runs[trail->n++] = 1;
+}
+
+static void trail_free(struct Trail *trail) {
+    free(trail->sets);
+    free(trail->runs);
+    trail->sets = NULL;
+    trail->runs = NULL;
+    trail->n = trail->capacity = 0;
+}
 
 
 /*
@@ -42,9 +588,15 @@ struct Tokens {
     char **argv;
     int i;
     char *current;
+    int n_positional;
+    int separator;              /* the positional token that is the "--" ending options, or -1 */
+    char **spare;               /* the option tokens of argv[n_positional..i), in order */
+#ifdef DOCOPT_TRACE
+    const struct DocoptTrace *trace;
+#endif
 };
 
-const char usage_pattern[] =
+static const char usage_pattern[] =
         "Usage:\n"
         "  naval_fate ship create <name>...\n"
         "  naval_fate ship <name> move <x> <y> [--speed=<kn>]\n"
@@ -53,320 +605,2278 @@ const char usage_pattern[] =
         "  naval_fate --help\n"
         "  naval_fate --version";
 
-struct Tokens tokens_new(int argc, char **argv) {
+/* Tokens of argv, with `spare` room for argc of them */
+static struct Tokens tokens_new(int argc, char **argv, char **spare) {
     struct Tokens ts;
     ts.argc = argc;
     ts.argv = argv;
     ts.i = 0;
-    ts.current = argv[0];
+    ts.current = argc > 0 ? argv[0] : NULL;
+    ts.n_positional = 0;
+    ts.separator = -1;
+    ts.spare = spare;
+#ifdef DOCOPT_TRACE
+    ts.trace = NULL;
+#endif
     return ts;
 }
 
-struct Tokens *tokens_move(struct Tokens *ts) {
+/* Step over the current token, an option or its argument */
+static struct Tokens *tokens_move(struct Tokens *ts) {
     if (ts->i < ts->argc) {
-        ts->current = ts->argv[++ts->i];
-    }
-    if (ts->i == ts->argc) {
-        ts->current = NULL;
+        TRACE_TOKEN(ts->trace, ts->current);
+        ts->spare[ts->i - ts->n_positional] = ts->current;
+        ts->i++;
     }
+    ts->current = ts->i < ts->argc ? ts->argv[ts->i] : NULL;
     return ts;
 }
 
+/*
+ * Take the current token as positional.  It goes to argv[n_positional],
+ * whose option token, if any, is in spare already, so that positional
+ * values end up as one run argv[0..n_positional) and tokens_end() puts the
+ * option tokens back after them.  Like GNU getopt, argv is only permuted,
+ * never copied, but each token is moved once, however they interleave.
+ */
+static int tokens_gather(struct Tokens *ts) {
+    TRACE_TOKEN(ts->trace, ts->current);
+    ts->argv[ts->n_positional] = ts->current;
+    ts->i++;
+    ts->current = ts->i < ts->argc ? ts->argv[ts->i] : NULL;
+    return ts->n_positional++;
+}
+
+/* Put the option tokens stepped over back after the positional ones */
+static void tokens_end(struct Tokens *ts) {
+    if (ts->i > ts->n_positional)
+        memcpy(&ts->argv[ts->n_positional], ts->spare, (ts->i - ts->n_positional) * sizeof(char *));
+}
+
 
 /*
  * ARGV parsing functions
  */
 
-int parse_doubledash(struct Tokens *ts, struct Elements *elements) {
-    /*
-    int n_commands = elements->n_commands;
-    int n_arguments = elements->n_arguments;
-    Command *commands = elements->commands;
-    Argument *arguments = elements->arguments;
+static int parse_doubledash(struct Tokens *ts, struct Elements *elements) {
+    /* "--" and all that follows are positional, the "--" itself only
+       matches a [--] in the usage section, when there is one */
+    (void) elements;
+    ts->separator = ts->n_positional;
+    while (ts->current != NULL)
+        tokens_gather(ts);
+    return DOCOPT_OK;
+}
+
+#if DOCOPT_HAS_SHORTS || DOCOPT_HAS_LONGS
+/* An option given again matches no usage line unless one repeats it */
+static int option_given(struct Elements *elements, int i) {
+    const struct Spec *spec = elements->spec;
+    const int *counters = spec->option_counters;
+
+    if (SET_HAS(elements->options, i) && spec->option_repeating != NULL && !spec->option_repeating[i]) {
+        elements->error = spec->option_longs[i] != NULL ? spec->option_longs[i] : spec->option_shorts[i];
+        return DOCOPT_NO_MATCH;
+    }
+    SET_ADD(elements->options, i);
+    if (counters != NULL && counters[i] >= 0)
+        elements->counters[counters[i]]++;
+    return DOCOPT_OK;
+}
+
+/* The argument of option i, of which those that may repeat keep every one */
+static void option_argument(struct Elements *elements, int i, const char *value) {
+    elements->option_arguments[i] = value;
+#if DOCOPT_HAS_LISTS
+    if (elements->spec->option_counters[i] >= 0) {
+        elements->values[elements->n_values] = value;
+        elements->value_options[elements->n_values++] = i;
+    }
+#endif
+}
+#endif
+
+#if DOCOPT_HAS_LONGS
+/*
+ * Long options whose names start with the first `len` characters of
+ * `token`, found by binary search in long_sorted: they are
+ * long_sorted[candidates[0] .. candidates[1] - 1].  Only taken on errors.
+ */
+static DOCOPT_COLD int long_candidates(struct Elements *elements, const char *token, size_t len) {
+    const struct Spec *spec = elements->spec;
+    int lo = 0, hi = spec->n_longs, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(spec->option_longs[spec->long_sorted[mid]], token, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    elements->candidates[0] = lo;
+    hi = spec->n_longs;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(spec->option_longs[spec->long_sorted[mid]], token, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    elements->candidates[1] = lo;
+    return elements->candidates[1] - elements->candidates[0];
+}
 
-    not implemented yet
-    return parsed + [Argument(None, v) for v in tokens]
-    */
-    return 0;
+/*
+ * Option that the first `len` characters of `token` spell or abbreviate,
+ * -1 if none does, -2 if they are the prefix of several.  long_table holds
+ * each long name and its prefixes that are at least long_unique[] long,
+ * which no other name starts with, so one lookup resolves both.
+ */
+static int find_long(struct Elements *elements, const char *token, size_t len) {
+    const struct Spec *spec = elements->spec;
+    const char *const *longs = spec->option_longs;
+    int i, found = -1;
+
+    if (spec->long_table != NULL) {
+        i = table_find(spec->long_table, token, len);
+        TRACE_LOOKUP(elements->trace, token, len, 1);
+        if (i >= 0 && !strncmp(token, longs[i], len)
+                && (longs[i][len] == '\0' || len >= (size_t) spec->long_unique[i]))
+            return i;
+        return long_candidates(elements, token, len) > 1 ? -2 : -1;
+    }
+    for (i = 0; i < spec->n_options; i++) {
+        if (longs[i] == NULL || strncmp(token, longs[i], len))
+            continue;
+        if (longs[i][len] == '\0') {
+            TRACE_LOOKUP(elements->trace, token, len, i + 1);
+            return i;
+        }
+        found = found == -1 ? i : -2;
+    }
+    TRACE_LOOKUP(elements->trace, token, len, spec->n_options);
+    return found;
 }
 
-int parse_long(struct Tokens *ts, struct Elements *elements) {
+static int parse_long(struct Tokens *ts, struct Elements *elements) {
+    const struct Spec *spec = elements->spec;
+    const char *const *longs = spec->option_longs;
     int i;
-    int len_prefix;
-    int n_options = elements->n_options;
+    size_t len_prefix;
     char *eq = strchr(ts->current, '=');
-    struct Option *option;
-    struct Option *options = elements->options;
 
-    len_prefix = (eq - (ts->current)) / sizeof(char);
-    for (i = 0; i < n_options; i++) {
-        option = &options[i];
-        if (!strncmp(ts->current, option->olong, len_prefix))
-            break;
-    }
-    if (i == n_options) {
-        /* TODO: %s is not a unique prefix */
-        fprintf(stderr, "%s is not recognized\n", ts->current);
-        return 1;
+    len_prefix = eq != NULL ? (size_t) (eq - ts->current) : strlen(ts->current);
+    i = find_long(elements, ts->current, len_prefix);
+    if (i < 0) {
+        elements->error = ts->current;
+        return i == -2 ? DOCOPT_AMBIGUOUS_OPTION : DOCOPT_UNKNOWN_OPTION;
     }
     tokens_move(ts);
-    if (option->argcount) {
+    if (spec->option_argcounts[i]) {
         if (eq == NULL) {
             if (ts->current == NULL) {
-                fprintf(stderr, "%s requires argument\n", option->olong);
-                return 1;
+                elements->error = longs[i];
+                return DOCOPT_MISSING_ARGUMENT;
             }
-            option->argument = ts->current;
+            option_argument(elements, i, ts->current);
             tokens_move(ts);
         } else {
-            option->argument = eq + 1;
-        }
-    } else {
-        if (eq != NULL) {
-            fprintf(stderr, "%s must not have an argument\n", option->olong);
-            return 1;
+            option_argument(elements, i, eq + 1);
         }
-        option->value = true;
+    } else if (eq != NULL) {
+        elements->error = longs[i];
+        return DOCOPT_UNEXPECTED_ARGUMENT;
     }
-    return 0;
+    return option_given(elements, i);
+}
+#else
+static int parse_long(struct Tokens *ts, struct Elements *elements) {
+    /* the spec has no long options */
+    elements->error = ts->current;
+    return DOCOPT_UNKNOWN_OPTION;
+}
+#endif
+
+/* "-c" of `word` is not an option of the spec */
+static DOCOPT_COLD int unknown_short(struct Elements *elements, const char *word, char c) {
+    elements->error_word = word;
+    elements->error_short[0] = '-';
+    elements->error_short[1] = c;
+    elements->error_short[2] = '\0';
+    elements->error = elements->error_short;
+    return DOCOPT_UNKNOWN_OPTION;
 }
 
-int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+#if DOCOPT_HAS_SHORTS
+static int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+    const struct Spec *spec = elements->spec;
+    const char *const *shorts = spec->option_shorts;
+    const char *word = ts->current;
     char *raw;
     int i;
-    int n_options = elements->n_options;
-    struct Option *option;
-    struct Option *options = elements->options;
+    int ret;
+    int n_options = spec->n_options;
 
     raw = &ts->current[1];
     tokens_move(ts);
     while (raw[0] != '\0') {
-        for (i = 0; i < n_options; i++) {
-            option = &options[i];
-            if (option->oshort != NULL && option->oshort[1] == raw[0])
-                break;
-        }
-        if (i == n_options) {
-            /* TODO -%s is specified ambiguously %d times */
-            fprintf(stderr, "-%c is not recognized\n", raw[0]);
-            return EXIT_FAILURE;
+        if (spec->short_table != NULL) {
+            i = spec->short_table[(unsigned char) raw[0]];
+        } else {
+            for (i = 0; i < n_options; i++)
+                if (shorts[i] != NULL && shorts[i][1] == raw[0])
+                    break;
+            if (i == n_options)
+                i = -1;
         }
+        TRACE_LOOKUP(elements->trace, raw, 1, spec->short_table != NULL ? 1 : (i < 0 ? n_options : i + 1));
+        if (i < 0)
+            return unknown_short(elements, word, raw[0]);
         raw++;
-        if (!option->argcount) {
-            option->value = true;
-        } else {
+        ret = option_given(elements, i);
+        if (ret != DOCOPT_OK)
+            return ret;
+        if (spec->option_argcounts[i]) {
             if (raw[0] == '\0') {
                 if (ts->current == NULL) {
-                    fprintf(stderr, "%s requires argument\n", option->oshort);
-                    return EXIT_FAILURE;
+                    elements->error = shorts[i];
+                    return DOCOPT_MISSING_ARGUMENT;
                 }
                 raw = ts->current;
                 tokens_move(ts);
             }
-            option->argument = raw;
+            option_argument(elements, i, raw);
             break;
         }
     }
-    return EXIT_SUCCESS;
+    return DOCOPT_OK;
 }
+#else
+static int parse_shorts(struct Tokens *ts, struct Elements *elements) {
+    /* the spec has no short options */
+    const char *word = ts->current;
 
-int parse_argcmd(struct Tokens *ts, struct Elements *elements) {
-    int i;
-    int n_commands = elements->n_commands;
-    /* int n_arguments = elements->n_arguments; */
-    struct Command *command;
-    struct Command *commands = elements->commands;
-    /* Argument *arguments = elements->arguments; */
-
-    for (i = 0; i < n_commands; i++) {
-        command = &commands[i];
-        if (strcmp(command->name, ts->current) == 0) {
-            command->value = true;
-            tokens_move(ts);
-            return EXIT_SUCCESS;
-        }
-    }
-    /* not implemented yet, just skip for now
-       parsed.append(Argument(None, tokens.move())) */
-    /*
-    fprintf(stderr, "! argument '%s' has been ignored\n", ts->current);
-    fprintf(stderr, "  '");
-    for (i=0; i<ts->argc ; i++)
-        fprintf(stderr, "%s ", ts->argv[i]);
-    fprintf(stderr, "'\n");
-    */
     tokens_move(ts);
-    return EXIT_SUCCESS;
+    return unknown_short(elements, word, word[1]);
+}
+#endif
+
+static int parse_argcmd(struct Tokens *ts, struct Elements *elements) {
+    /* whether it is a command or an argument is up to match_pattern */
+    (void) elements;
+    tokens_gather(ts);
+    return DOCOPT_OK;
 }
 
-int parse_args(struct Tokens *ts, struct Elements *elements) {
-    int ret = EXIT_FAILURE;
+static int parse_args(struct Tokens *ts, struct Elements *elements) {
+    int ret = DOCOPT_OK;
 
-    while (ts->current != NULL) {
+    while (ts->current != NULL && ret == DOCOPT_OK) {
         if (strcmp(ts->current, "--") == 0) {
             ret = parse_doubledash(ts, elements);
-            if (ret == EXIT_FAILURE) break;
         } else if (ts->current[0] == '-' && ts->current[1] == '-') {
             ret = parse_long(ts, elements);
         } else if (ts->current[0] == '-' && ts->current[1] != '\0') {
             ret = parse_shorts(ts, elements);
         } else
             ret = parse_argcmd(ts, elements);
-        if (ret) return ret;
     }
+    tokens_end(ts);
     return ret;
 }
 
-int elems_to_args(struct Elements *elements, struct DocoptArgs *args,
-                     const bool help, const char *version) {
-    struct Command *command;
-    struct Argument *argument;
-    struct Option *option;
-    int i, j;
-
-    /* fix gcc-related compiler warnings (unused) */
-    (void) command;
-    (void) argument;
+static int parse_extras(struct Elements *elements, const bool help, const bool version) {
+#if DOCOPT_HAS_EXTRAS
+    const struct Spec *spec = elements->spec;
+    const char *olong;
+    int i;
 
-    /* options */
-    for (i = 0; i < elements->n_options; i++) {
-        option = &elements->options[i];
-        if (help && option->value && strcmp(option->olong, "--help") == 0) {
-            for (j = 0; j < 17; j++)
-                puts(args->help_message[j]);
-            return EXIT_FAILURE;
-        } else if (version && option->value &&
-                   strcmp(option->olong, "--version") == 0) {
-            puts(version);
-            return EXIT_FAILURE;
-        } else if (strcmp(option->olong, "--drifting") == 0) {
-            args->drifting = option->value;
-        } else if (strcmp(option->olong, "--help") == 0) {
-            args->help = option->value;
-        } else if (strcmp(option->olong, "--moored") == 0) {
-            args->moored = option->value;
-        } else if (strcmp(option->olong, "--version") == 0) {
-            args->version = option->value;
-        } else if (strcmp(option->olong, "--speed") == 0) {
-            if (option->argument) {
-                args->speed = (char *) option->argument;
-            }
+    for (i = 0; i < spec->n_options; i++) {
+        olong = spec->option_longs[i];
+        if (spec->option_argcounts[i] || !SET_HAS(elements->options, i) || olong == NULL)
+            continue;
+        if (help && strcmp(olong, "--help") == 0) {
+            elements->error = olong;
+            return DOCOPT_HELP;
+        } else if (version && strcmp(olong, "--version") == 0) {
+            elements->error = olong;
+            return DOCOPT_VERSION;
         }
     }
-    /* commands */
-    for (i = 0; i < elements->n_commands; i++) {
-        command = &elements->commands[i];
-        
-        if (strcmp(command->name, "create") == 0) {
-    args->create = command->value;
-}
- else if (strcmp(command->name, "mine") == 0) {
-    args->mine = command->value;
-}
- else if (strcmp(command->name, "move") == 0) {
-    args->move = command->value;
+#else
+    /* the spec has neither --help nor --version */
+    (void) elements;
+    (void) help;
+    (void) version;
+#endif
+    return DOCOPT_OK;
 }
- else if (strcmp(command->name, "remove") == 0) {
-    args->remove = command->value;
-}
- else if (strcmp(command->name, "set") == 0) {
-    args->set = command->value;
+
+
+/*
+ * Usage pattern matching
+ */
+
+#if DOCOPT_HAS_COMMANDS
+static int find_command(struct Elements *elements, const char *name) {
+    const struct Spec *spec = elements->spec;
+    const char *const *names = spec->command_names;
+    size_t len = strlen(name);
+    int i;
+
+    if (spec->command_table != NULL) {
+        /* arguments, the other positional tokens, are rarely that long */
+        if (!(spec->command_lengths & LENGTH_BIT(len))) {
+            TRACE_LOOKUP(elements->trace, name, len, 0);
+            return -1;
+        }
+        i = table_find(spec->command_table, name, len);
+        TRACE_LOOKUP(elements->trace, name, len, 1);
+        return i >= 0 && strcmp(names[i], name) == 0 ? i : -1;
+    }
+    for (i = 0; i < spec->n_commands; i++) {
+        if (strcmp(names[i], name) == 0) {
+            TRACE_LOOKUP(elements->trace, name, len, i + 1);
+            return i;
+        }
+    }
+    TRACE_LOOKUP(elements->trace, name, len, spec->n_commands);
+    return -1;
 }
- else if (strcmp(command->name, "ship") == 0) {
-    args->ship = command->value;
+#endif
+
+/* Whether the options given on the command line are the ones `line` takes */
+static bool match_options(struct Elements *elements, int line) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    const unsigned long *given = elements->options;
+    size_t words = (elements->spec->n_options + WORD_BITS - 1) / WORD_BITS;
+    size_t w;
+    unsigned long bits;
+    int i;
+    int n_given = 0;
+    int n_allowed = 0;
+    int n_group = 0;
+
+    for (i = pattern->required_start[line]; i < pattern->required_start[line + 1]; i++)
+        if (!SET_HAS(given, pattern->required[i]))
+            return false;
+    for (i = pattern->needed_start[line]; i < pattern->needed_start[line + 1]; i++) {
+        if (pattern->needed[i] < 0) {
+            if (n_group == 0)
+                return false;
+            n_group = 0;
+            continue;
+        }
+        if (SET_HAS(given, pattern->needed[i]))
+            n_group++;
+    }
+    for (i = pattern->exclusive_start[line]; i < pattern->exclusive_start[line + 1]; i++) {
+        if (pattern->exclusive[i] < 0) {
+            n_group = 0;
+            continue;
+        }
+        if (SET_HAS(given, pattern->exclusive[i]) && ++n_group > 1)
+            return false;
+    }
+    for (w = 0; w < words; w++)
+        for (bits = given[w]; bits != 0; bits &= bits - 1)
+            n_given++;
+    for (i = pattern->allowed_start[line]; i < pattern->allowed_start[line + 1]; i++)
+        if (SET_HAS(given, pattern->allowed[i]))
+            n_allowed++;
+    return n_given == n_allowed;
 }
- else if (strcmp(command->name, "shoot") == 0) {
-    args->shoot = command->value;
+
+/* Record that positional token `k` was consumed by entering `state`;
+   whether other tokens sit between it and the later values of its argument */
+static bool bind_token(struct Elements *elements, int k, int state) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    const int *command_counters = elements->spec->command_counters;
+    int *offsets = elements->offsets;
+    int *counts = elements->counts;
+    int c = pattern->command[state];
+    bool apart;
+    int a;
+
+    elements->bound[k] = -1;
+    if (c >= 0) {
+        SET_ADD(elements->commands, c);
+        if (command_counters != NULL && command_counters[c] >= 0)
+            elements->counters[command_counters[c]]++;
+        return false;
+    }
+    a = elements->bound[k] = pattern->argument[state];
+    apart = counts[a] > 0 && offsets[a] != k + 1;
+    offsets[a] = k;
+    counts[a]++;
+    return apart;
 }
 
+/*
+ * Make the values of each argument one run of argv[0..n), in their order,
+ * commands first and then the arguments in the order of usage: a stable
+ * counting sort by argument, each token moved once, where moving each value
+ * next to the later ones took O(n^2) when those of (<k> <v>)... alternate.
+ */
+static void sort_values(struct Tokens *ts, struct Elements *elements) {
+    int *offsets = elements->offsets;
+    const int *counts = elements->counts;
+    const int *bound = elements->bound;
+    int n = ts->n_positional;
+    int k, a, at = 0;
+
+    for (k = 0; k < n; k++)
+        if (bound[k] < 0)
+            ts->spare[at++] = ts->argv[k];
+    for (a = 0; a < elements->spec->n_arguments; a++) {
+        offsets[a] = at;
+        at += counts[a];
     }
-    /* arguments */
-    for (i = 0; i < elements->n_arguments; i++) {
-        argument = &elements->arguments[i];
-        
-        if (strcmp(argument->name, "<name>") == 0) {
-            args->name = (char *) argument->value;
-        }
-         else if (strcmp(argument->name, "<x>") == 0) {
-            args->x = (char *) argument->value;
+    for (k = 0; k < n; k++)
+        if (bound[k] >= 0)
+            ts->spare[offsets[bound[k]]++] = ts->argv[k];
+    for (a = 0; a < elements->spec->n_arguments; a++)
+        offsets[a] -= counts[a];
+    memcpy(ts->argv, ts->spare, n * sizeof(char *));
+}
+
+/*
+ * Run the positional tokens argv[0..n_positional) through the automaton,
+ * keeping the set of states reached after each of them, so that a match
+ * takes O(tokens * states) time whatever the number of alternatives.
+ */
+static int match_states(struct Tokens *ts, struct Elements *elements, struct Trail *trail) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    unsigned long *set;
+    unsigned long *next;
+    int n = ts->n_positional;
+    int k, q, p, j, command;
+    size_t w;
+    unsigned long bits;
+    bool reached, separator;
+
+    trail->words = (pattern->n_states + WORD_BITS - 1) / WORD_BITS;
+    trail->n = 0;
+    set = trail_next(trail);
+    if (set == NULL)
+        return DOCOPT_NO_MEMORY;
+    SET_ADD(set, 0);
+    trail_push(trail);
+    for (k = 0; k < n; k++) {
+#if DOCOPT_HAS_COMMANDS
+        command = find_command(elements, ts->argv[k]);
+#else
+        command = -1;
+#endif
+        /* the "--" ending options only matches the [--] of the usage, if it has one */
+        separator = k == ts->separator && command >= 0;
+        next = trail_next(trail);
+        if (next == NULL)
+            return DOCOPT_NO_MEMORY;
+        set = next - trail->words;
+        reached = false;
+        for (w = 0; w < trail->words; w++) {
+            for (bits = set[w]; bits != 0; bits &= bits - 1) {
+                q = w * WORD_BITS + lowest_bit(bits);
+                for (j = pattern->follow_start[q]; j < pattern->follow_start[q + 1]; j++) {
+                    p = pattern->follow[j];
+                    if (pattern->command[p] == command || (pattern->command[p] < 0 && !separator)) {
+                        SET_ADD(next, p);
+                        reached = true;
+                    }
+                }
+            }
         }
-         else if (strcmp(argument->name, "<y>") == 0) {
-            args->y = (char *) argument->value;
+        if (!reached) {
+            elements->error = ts->argv[k];
+            return DOCOPT_NO_MATCH;
         }
+        trail_push(trail);
     }
-    return EXIT_SUCCESS;
+    return DOCOPT_OK;
 }
 
-
 /*
- * Main docopt function
+ * Match the positional tokens against the usage section, then walk back
+ * from an accepting state along the trail to bind them.
  */
+static int match_pattern(struct Tokens *ts, struct Elements *elements, struct Trail *trail) {
+    const struct Pattern *pattern = elements->spec->pattern;
+    unsigned long *set;
+    int n = ts->n_positional;
+    int state = -1;
+    int line = -1;
+    int k, p, j, entry, run;
+    bool apart = false;
+    int ret = match_states(ts, elements, trail);
 
-struct DocoptArgs docopt(int argc, char *argv[], const bool help, const char *version) {
-    struct DocoptArgs args = {
-        0, 0, 0, 0, 0, 0, 0, NULL, NULL, NULL, 0, 0, 0, 0, (char *) "10",
-            usage_pattern,
-            { "Naval Fate.",
-              "",
-              "Usage:",
-              "  naval_fate ship create <name>...",
-              "  naval_fate ship <name> move <x> <y> [--speed=<kn>]",
-              "  naval_fate ship shoot <x> <y>",
-              "  naval_fate mine (set|remove) <x> <y> [--moored|--drifting]",
-              "  naval_fate --help",
-              "  naval_fate --version",
-              "",
-              "Options:",
-              "  -h --help     Show this screen.",
-              "  --version     Show version.",
-              "  --speed=<kn>  Speed in knots [default: 10].",
-              "  --moored      Moored (anchored) mine.",
-              "  --drifting    Drifting mine.",
-              ""}
-    };
-    struct Command commands[] = {
-        {"create", 0},
-        {"mine", 0},
-        {"move", 0},
-        {"remove", 0},
-        {"set", 0},
-        {"ship", 0},
-        {"shoot", 0}
-    };
-    struct Argument arguments[] = {
-        {"<name>", NULL, NULL},
-        {"<x>", NULL, NULL},
-        {"<y>", NULL, NULL}
-    };
-    struct Option options[] = {
-        {NULL, "--drifting", 0, 0, NULL},
-        {"-h", "--help", 0, 0, NULL},
-        {NULL, "--moored", 0, 0, NULL},
-        {NULL, "--version", 0, 0, NULL},
-        {NULL, "--speed", 1, 0, NULL}
-    };
-    struct Elements elements;
-    int return_code = EXIT_SUCCESS;
+    if (ret != DOCOPT_OK)
+        return ret;
+    set = &trail->sets[(trail->n - 1) * trail->words];
+    if (n == 0) {
+        for (line = 0; line < pattern->n_lines; line++)
+            if (pattern->line_nullable[line] && match_options(elements, line))
+                break;
+        return line < pattern->n_lines ? DOCOPT_OK : DOCOPT_NO_MATCH;
+    }
+    for (p = 1; p < pattern->n_states; p++) {
+        if (SET_HAS(set, p) && pattern->accepts[p] && match_options(elements, pattern->line[p])) {
+            state = p;
+            break;
+        }
+    }
+    if (state < 0)
+        return DOCOPT_NO_MATCH;
 
-    elements.n_commands = 7;
-    elements.n_arguments = 3;
-    elements.n_options = 5;
-    elements.commands = commands;
-    elements.arguments = arguments;
-    elements.options = options;
+    entry = trail->n - 1;
+    run = trail->runs[entry];
+    for (k = n - 1; k >= 0; k--) {
+        if (bind_token(elements, k, state))
+            apart = true;
+        if (--run == 0)
+            run = trail->runs[--entry];
+        set = &trail->sets[entry * trail->words];
+        for (j = pattern->pred_start[state]; !SET_HAS(set, pattern->pred[j]); j++)
+            ;
+        state = pattern->pred[j];
+    }
+    if (apart)
+        sort_values(ts, elements);
+    return DOCOPT_OK;
+}
+
+/*
+ * Typed option values
+ */
+
+#if DOCOPT_HAS_TYPES
+/* Decimal integer, with none of the locale or base handling of strtol() */
+static int parse_int(const char *s, long *value) {
+    bool negative = s[0] == '-';
+    unsigned long limit = negative ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+    unsigned long n = 0;
+    unsigned d;
 
-    if (argc == 1) {
-        argv[argc++] = "--help";
-        argv[argc++] = NULL;
-        return_code = EXIT_FAILURE;
+    if (s[0] == '-' || s[0] == '+')
+        s++;
+    if (*s < '0' || *s > '9')
+        return DOCOPT_INVALID_VALUE;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        d = *s - '0';
+        if (n > (limit - d) / 10)
+            return DOCOPT_OUT_OF_RANGE;
+        n = n * 10 + d;
     }
+    if (*s != '\0')
+        return DOCOPT_INVALID_VALUE;
+    *value = negative && n > 0 ? -(long) (n - 1) - 1 : (long) n;
+    return DOCOPT_OK;
+}
 
-    {
-        struct Tokens ts = tokens_new(argc, argv);
-        if (parse_args(&ts, &elements))
-            exit(EXIT_FAILURE);
+/*
+ * Decimal number with an optional exponent.  When its digits fit in 2^53
+ * and its exponent is at most 22, both are exact doubles and one multiply
+ * or divide rounds correctly (Clinger's fast path).  Longer numbers go to
+ * strtod(), with the '.' swapped for the decimal point of the locale, in a
+ * copy on the stack or, past 64 bytes, on the heap.
+ */
+static int parse_float(const char *s, double *value) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *p = s;
+    const char *point = NULL;
+    const char *decimal_point = localeconv()->decimal_point;
+    char copy[64];
+    char *heap = NULL;
+    char *end;
+    unsigned long mantissa = 0;
+    int digits = 0, exponent = 0, e = 0, sign = 1, ret;
+    bool exact = true;
+
+    if (*p == '-' || *p == '+')
+        p++;
+    for (; (*p >= '0' && *p <= '9') || (*p == '.' && point == NULL); p++) {
+        if (*p == '.') {
+            point = p;
+            continue;
+        }
+        digits++;
+        if (mantissa > (ULONG_MAX - 9) / 10)
+            exact = false;
+        else
+            mantissa = mantissa * 10 + (*p - '0');
+        if (point != NULL)
+            exponent--;
+    }
+    if (digits == 0)
+        return DOCOPT_INVALID_VALUE;
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '-' || *p == '+')
+            sign = *p++ == '-' ? -1 : 1;
+        if (*p < '0' || *p > '9')
+            return DOCOPT_INVALID_VALUE;
+        for (; *p >= '0' && *p <= '9'; p++)
+            if (e < 10000)
+                e = e * 10 + (*p - '0');
+        exponent += sign * e;
+    }
+    if (*p != '\0')
+        return DOCOPT_INVALID_VALUE;
+    if (exact && (double) mantissa <= 9007199254740992.0 && exponent >= -22 && exponent <= 22) {
+        *value = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+        if (s[0] == '-')
+            *value = -*value;
+        return DOCOPT_OK;
+    }
+    if (point != NULL && strcmp(decimal_point, ".") != 0) {
+        /* only copied in such locales */
+        if ((size_t) (p - s) + strlen(decimal_point) > sizeof(copy)) {
+            heap = malloc((size_t) (p - s) + strlen(decimal_point));
+            if (heap == NULL)
+                return DOCOPT_NO_MEMORY;
+        }
+        end = heap != NULL ? heap : copy;
+        memcpy(end, s, point - s);
+        strcpy(end + (point - s), decimal_point);
+        strcat(end, point + 1);
+        s = end;
+    }
+    errno = 0;
+    *value = strtod(s, &end);
+    ret = errno == ERANGE && (*value == HUGE_VAL || *value == -HUGE_VAL)
+        ? DOCOPT_OUT_OF_RANGE : DOCOPT_OK;
+    free(heap);
+    return ret;
+}
+
+/* Index of `s` among the choices of an enum type */
+static int parse_choice(const struct Type *type, const char *s, int *value) {
+    int i;
+
+    if (type->table != NULL) {
+        i = table_find(type->table, s, strlen(s));
+        if (i >= 0 && strcmp(type->choices[i], s) == 0) {
+            *value = i;
+            return DOCOPT_OK;
+        }
+        return DOCOPT_INVALID_VALUE;
+    }
+    for (i = 0; i < type->n_choices; i++) {
+        if (strcmp(type->choices[i], s) == 0) {
+            *value = i;
+            return DOCOPT_OK;
+        }
+    }
+    return DOCOPT_INVALID_VALUE;
+}
+
+#endif
+
+/* Store the argument of option i, converted to its [type: ...] if it has one */
+static int store_argument(const struct Spec *spec, char *base, int i, const char *argument) {
+    char *field = base + spec->option_fields[i];
+#if DOCOPT_HAS_TYPES
+    const struct Type *type;
+    long n;
+    double x;
+    int choice;
+    int ret;
+
+    if (spec->option_types != NULL && spec->option_types[i] >= 0) {
+        type = &spec->types[spec->option_types[i]];
+        switch (type->kind) {
+        case TYPE_INT:
+            ret = parse_int(argument, &n);
+            if (ret == DOCOPT_OK && (n < type->min || n > type->max))
+                ret = DOCOPT_OUT_OF_RANGE;
+            if (ret == DOCOPT_OK)
+                *(long *) field = n;
+            return ret;
+        case TYPE_FLOAT:
+            ret = parse_float(argument, &x);
+            if (ret == DOCOPT_OK)
+                *(double *) field = x;
+            return ret;
+        default:
+            ret = parse_choice(type, argument, &choice);
+            if (ret == DOCOPT_OK)
+                *(int *) field = choice;
+            return ret;
+        }
+    }
+#endif
+    *(char **) field = (char *) argument;
+    return DOCOPT_OK;
+}
+
+/* Store a command or an option without argument in its bit, if it has one */
+static void store_flag(const struct Spec *spec, char *base, int bit, size_t field, size_t value) {
+    if (bit < 0)
+        *(size_t *) (base + field) = value;
+    else if (value)
+        SET_ADD((unsigned long *) (base + spec->bits_field), bit);
+}
+
+#if DOCOPT_HAS_LISTS
+/*
+ * Point the slice of each option with an argument that may repeat at its
+ * values, in the order given, written over the option tokens of argv past
+ * the positional ones, which are no longer needed.
+ */
+static void store_lists(struct Tokens *ts, struct Elements *elements, char *base) {
+    const struct Spec *spec = elements->spec;
+    struct DocoptSlice *slice;
+    const char **at = (const char **) &ts->argv[ts->n_positional];
+    int i, m;
+
+    for (i = 0; i < spec->n_options; i++) {
+        if (spec->option_argcounts[i] && spec->option_counters[i] >= 0 && SET_HAS(elements->options, i)) {
+            slice = (struct DocoptSlice *) (base + spec->option_fields[i]);
+            slice->items = at;
+            slice->count = 0;
+            at += elements->counters[spec->option_counters[i]];
+        }
+    }
+    for (m = 0; m < elements->n_values; m++) {
+        slice = (struct DocoptSlice *) (base + spec->option_fields[elements->value_options[m]]);
+        slice->items[slice->count++] = elements->values[m];
+    }
+}
+#endif
+
+static int elems_to_args(struct Tokens *ts, struct Elements *elements, struct DocoptArgs *args) {
+    const struct Spec *spec = elements->spec;
+    char *base = (char *) args;
+    struct DocoptSlice *slice;
+    int i;
+    int ret;
+
+    /* options */
+#if DOCOPT_HAS_LISTS
+    store_lists(ts, elements, base);
+#endif
+    for (i = 0; i < spec->n_options; i++) {
+        if (spec->option_argcounts[i]) {
+            /* not given, or in a list above */
+            if (elements->option_arguments[i] == NULL || spec->option_counters[i] >= 0)
+                continue;
+            ret = store_argument(spec, base, i, elements->option_arguments[i]);
+            if (ret != DOCOPT_OK) {
+                elements->error = spec->option_longs[i] != NULL ? spec->option_longs[i] : spec->option_shorts[i];
+                return ret;
+            }
+        } else if (spec->option_counters[i] >= 0) {
+            *(size_t *) (base + spec->option_fields[i]) = elements->counters[spec->option_counters[i]];
+        } else {
+            store_flag(spec, base, spec->option_bits[i], spec->option_fields[i], SET_HAS(elements->options, i));
+        }
+    }
+    /* commands */
+    for (i = 0; i < spec->n_commands; i++) {
+        if (spec->command_counters[i] >= 0)
+            *(size_t *) (base + spec->command_fields[i]) = elements->counters[spec->command_counters[i]];
+        else
+            store_flag(spec, base, spec->command_bits[i], spec->command_fields[i], SET_HAS(elements->commands, i));
+    }
+    /* arguments */
+    for (i = 0; i < spec->n_arguments; i++) {
+        if (spec->argument_repeating[i]) {
+            slice = (struct DocoptSlice *) (base + spec->argument_fields[i]);
+            slice->items = (const char **) &ts->argv[elements->offsets[i]];
+            slice->count = elements->counts[i];
+        } else if (elements->counts[i] > 0) {
+            *(char **) (base + spec->argument_fields[i]) = ts->argv[elements->offsets[i]];
+        }
+    }
+    return DOCOPT_OK;
+}
+
+
+/*
+ * Parser context
+ */
+
+static const char *const help_message[] = { "Naval Fate.",
+              "",
+              "Usage:",
+              "  naval_fate ship create <name>...",
+              "  naval_fate ship <name> move <x> <y> [--speed=<kn>]",
+              "  naval_fate ship shoot <x> <y>",
+              "  naval_fate mine (set|remove) <x> <y> [--moored|--drifting]",
+              "  naval_fate --help",
+              "  naval_fate --version",
+              "",
+              "Options:",
+              "  -h --help     Show this screen.",
+              "  --version     Show version.",
+              "  --speed=<kn>  Speed in knots [env: NAVAL_SPEED] [config: speed] [default: 10].",
+              "  --moored      Moored (anchored) mine.",
+              "  --drifting    Drifting mine.",
+              ""};
+
+static const struct DocoptArgs args_default = {
+        0, 0, 0, 0, 0, 0, 0, {NULL, 0}, NULL, NULL, 0, 0, 0, 0, (char *) "10",
+        usage_pattern,
+        help_message
+};
+
+/* The state docopt_parse() writes, one element longer than need be so
+   that no array is empty */
+struct DocoptContext {
+    bool help;
+    bool version;
+    unsigned long commands[7 / WORD_BITS + 1];
+    unsigned long options[5 / WORD_BITS + 1];
+    const char *option_arguments[5 + 1];
+    int offsets[3 + 1];
+    int counts[3 + 1];
+    int counters[0 + 1];
+#if DOCOPT_HAS_SOURCES
+    const char *option_sources[5 + 1];
+#endif
+#if DOCOPT_HAS_CONFIG
+    const char *config_values[5 + 1];
+    char *config;               /* the file given to docopt_config(), mapped */
+    size_t config_size;
+    char *config_tail;          /* its last line, when that has no newline */
+#endif
+#ifdef DOCOPT_RESPONSE_FILES
+    struct Responses *responses;    /* the @files of the last parse, from the first with any */
+    struct DocoptContext *kept;     /* the one docopt() kept before this one */
+#endif
+    struct Elements elements;
+    struct Trail trail;
+    char **spare;               /* Tokens.spare, Elements.bound and its values, */
+    int n_words;                /* for as many words as the longest argv yet */
+};
+
+#ifdef DOCOPT_RESPONSE_FILES
+/* in the section on batches, whose lines @files are split like */
+static int expand_responses(struct DocoptContext *ctx, int *argc, char ***argv);
+static void responses_free(struct Responses *responses);
+#endif
+
+#if DOCOPT_HAS_SOURCES
+/*
+ * Environment and config file
+ */
+
+/* What each option takes when the command line gives it no argument: its
+   [env: NAME] if that is set, else its [config: key], else its default */
+static void context_sources(struct DocoptContext *ctx) {
+    const char *value;
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        value = spec.option_envs[i] != NULL ? getenv(spec.option_envs[i]) : NULL;
+#if DOCOPT_HAS_CONFIG
+        if (value == NULL)
+            value = ctx->config_values[i];
+#endif
+        ctx->option_sources[i] = value;
+    }
+}
+
+/* Between the defaults and the command line, before elems_to_args() */
+static void apply_sources(struct DocoptContext *ctx) {
+    int i;
+
+    for (i = 0; i < 5; i++)
+        if (ctx->option_arguments[i] == NULL)
+            ctx->option_arguments[i] = ctx->option_sources[i];
+}
+#endif
+
+#if DOCOPT_HAS_CONFIG
+#define CONFIG_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+static void config_unmap(struct DocoptContext *ctx) {
+    if (ctx->config != NULL)
+        munmap(ctx->config, ctx->config_size);
+    free(ctx->config_tail);
+    ctx->config = NULL;
+    ctx->config_tail = NULL;
+    ctx->config_size = 0;
+    memset(ctx->config_values, 0, sizeof(ctx->config_values));
+}
+
+/* Option whose [config: key] is key[0..len), or -1 */
+static int find_config(const char *key, size_t len) {
+    int i;
+
+    /* most keys of a config file are for something else */
+    if (spec.config_table == NULL || !(spec.config_lengths & LENGTH_BIT(len)))
+        return -1;
+    i = table_find(spec.config_table, key, len);
+    if (i < 0 || strncmp(spec.option_configs[i], key, len) || spec.option_configs[i][len] != '\0')
+        return -1;
+    return i;
+}
+
+/* Take the value of line[0..len) if its key is one of an option, ending
+   it with a NUL written at the latest over the newline at line[len] */
+static void config_line(struct DocoptContext *ctx, char *line, size_t len) {
+    char *end = line + len;
+    char *eq = memchr(line, '=', len);
+    char *key_end;
+    int i;
+
+    if (eq == NULL)
+        return;
+    while (line < eq && CONFIG_BLANK(*line))
+        line++;
+    if (line == eq || *line == '#')
+        return;
+    for (key_end = eq; CONFIG_BLANK(key_end[-1]); key_end--)
+        ;
+    i = find_config(line, key_end - line);
+    if (i < 0)
+        return;
+    for (eq++; eq < end && CONFIG_BLANK(*eq); eq++)
+        ;
+    while (end > eq && CONFIG_BLANK(end[-1]))
+        end--;
+    *end = '\0';
+    ctx->config_values[i] = eq;
+}
+
+/* config_line() for each line of buf[0..len), which ends in a newline */
+static void config_lines(struct DocoptContext *ctx, char *buf, size_t len) {
+    char *end = buf + len;
+    char *nl;
+
+    while (buf < end) {
+        nl = memchr(buf, '\n', end - buf);
+        config_line(ctx, buf, nl - buf);
+        buf = nl + 1;
+    }
+}
+
+/*
+ * Take the arguments of the options with a [config: key] from the file at
+ * `path`, of key=value lines.  Lines without '=' or starting with '#', and
+ * keys of no option, are skipped; blanks around keys and values are not
+ * part of them.  The file is mapped privately and the values NUL-terminated
+ * in place, nothing is copied: DocoptArgs point into it until the next
+ * docopt_config() or docopt_context_free().  The environment overrides the
+ * file, and the command line both.  DOCOPT_BAD_CONFIG has the path as its
+ * docopt_error_token().
+ */
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *ctx, const char *path) {
+    struct stat st;
+    size_t n;
+    int fd;
+
+    config_unmap(ctx);
+    context_sources(ctx);
+    ctx->elements.error = path;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return DOCOPT_BAD_CONFIG;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return DOCOPT_BAD_CONFIG;
+    }
+    if (st.st_size > 0) {
+        ctx->config = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (ctx->config == MAP_FAILED) {
+            ctx->config = NULL;
+            close(fd);
+            return DOCOPT_BAD_CONFIG;
+        }
+        ctx->config_size = (size_t) st.st_size;
+    }
+    close(fd);
+    for (n = ctx->config_size; n > 0 && ctx->config[n - 1] != '\n'; n--)
+        ;
+    config_lines(ctx, ctx->config, n);
+    if (n < ctx->config_size) {
+        /* config[config_size] may not exist, let alone be writable */
+        ctx->config_tail = malloc(ctx->config_size - n + 1);
+        if (ctx->config_tail == NULL) {
+            config_unmap(ctx);
+            return DOCOPT_NO_MEMORY;
+        }
+        memcpy(ctx->config_tail, ctx->config + n, ctx->config_size - n);
+        ctx->config_tail[ctx->config_size - n] = '\n';
+        config_lines(ctx, ctx->config_tail, ctx->config_size - n + 1);
+    }
+    ctx->elements.error = NULL;
+    context_sources(ctx);
+    return DOCOPT_OK;
+}
+#else
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *ctx, const char *path) {
+    /* the spec has no [config: key], nothing in the file is for it */
+    (void) ctx;
+    (void) path;
+    return DOCOPT_OK;
+}
+#endif
+
+
+/* `help` and `version` make --help and --version end the parse early */
+DOCOPT_API struct DocoptContext *docopt_context_new(const bool help, const bool version) {
+    struct DocoptContext *ctx = calloc(1, sizeof(struct DocoptContext));
+
+    if (ctx == NULL)
+        return NULL;
+    ctx->help = help;
+    ctx->version = version;
+    ctx->elements.spec = &spec;
+    ctx->elements.commands = ctx->commands;
+    ctx->elements.options = ctx->options;
+    ctx->elements.option_arguments = ctx->option_arguments;
+    ctx->elements.offsets = ctx->offsets;
+    ctx->elements.counts = ctx->counts;
+    ctx->elements.counters = ctx->counters;
+#ifdef DOCOPT_TRACE
+    STATICS_LOCK();
+    ctx->elements.trace = trace_default;
+    STATICS_UNLOCK();
+#endif
+#if DOCOPT_HAS_SOURCES
+    context_sources(ctx);
+#endif
+    return ctx;
+}
+
+DOCOPT_API void docopt_context_free(struct DocoptContext *ctx) {
+    if (ctx == NULL)
+        return;
+    trail_free(&ctx->trail);
+    free(ctx->spare);
+    free(ctx->elements.bound);
+#if DOCOPT_HAS_LISTS
+    free((void *) ctx->elements.values);
+    free(ctx->elements.value_options);
+#endif
+#if DOCOPT_HAS_CONFIG
+    config_unmap(ctx);
+#endif
+#ifdef DOCOPT_RESPONSE_FILES
+    responses_free(ctx->responses);
+#endif
+    free(ctx);
+}
+
+/* Forget what the last parse found */
+static void context_reset(struct DocoptContext *ctx) {
+    memset(ctx->commands, 0, sizeof(ctx->commands));
+    memset(ctx->options, 0, sizeof(ctx->options));
+    memset(ctx->option_arguments, 0, sizeof(ctx->option_arguments));
+    memset(ctx->counts, 0, sizeof(ctx->counts));
+    memset(ctx->counters, 0, sizeof(ctx->counters));
+    ctx->elements.error = NULL;
+#if DOCOPT_HAS_LISTS
+    ctx->elements.n_values = 0;
+#endif
+}
+
+/* Room for the tokens of an argv of `argc` words, kept for later parses */
+static int context_words(struct DocoptContext *ctx, int argc) {
+    char **spare;
+    int *bound;
+#if DOCOPT_HAS_LISTS
+    const char **values;
+    int *value_options;
+#endif
+
+    if (argc <= ctx->n_words)
+        return DOCOPT_OK;
+    spare = realloc(ctx->spare, argc * sizeof(char *));
+    if (spare == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->spare = spare;
+    bound = realloc(ctx->elements.bound, argc * sizeof(int));
+    if (bound == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.bound = bound;
+#if DOCOPT_HAS_LISTS
+    values = realloc(ctx->elements.values, argc * sizeof(char *));
+    if (values == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.values = values;
+    value_options = realloc(ctx->elements.value_options, argc * sizeof(int));
+    if (value_options == NULL)
+        return DOCOPT_NO_MEMORY;
+    ctx->elements.value_options = value_options;
+#endif
+    ctx->n_words = argc;
+    return DOCOPT_OK;
+}
+
+/* docopt_parse() but for @files, which the lines of a batch do not have */
+static int parse_argv(struct DocoptContext *ctx, int argc, char *argv[], struct DocoptArgs *args) {
+    struct Elements *elements = &ctx->elements;
+    struct Tokens ts;
+    int ret;
+
+    context_reset(ctx);
+    *args = args_default;
+
+    if (argc > 0) {
+        argc--;
+        argv++;
+    }
+    ret = context_words(ctx, argc);
+    ts = tokens_new(argc, argv, ctx->spare);
+#ifdef DOCOPT_TRACE
+    ts.trace = elements->trace;
+#endif
+    TRACE_PHASE(elements->trace, DOCOPT_PHASE_PARSE_ARGS);
+    if (ret == DOCOPT_OK)
+        ret = parse_args(&ts, elements);
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_EXTRAS);
+        ret = parse_extras(elements, ctx->help, ctx->version);
+    }
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_MATCH);
+        ret = match_pattern(&ts, elements, &ctx->trail);
+    }
+    if (ret == DOCOPT_OK) {
+        TRACE_PHASE(elements->trace, DOCOPT_PHASE_ELEMS_TO_ARGS);
+#if DOCOPT_HAS_SOURCES
+        apply_sources(ctx);
+#endif
+        ret = elems_to_args(&ts, elements, args);
+    }
+    if (ret != DOCOPT_OK) {
+        TRACE_ERROR(elements->trace, ret, elements->error);
+        *args = args_default;
+    }
+    TRACE_PHASE(elements->trace, DOCOPT_PHASE_DONE);
+    return ret;
+}
+
+/*
+ * Parse argv, argv[0] being the program name, into `args`.  Nothing is
+ * allocated once the context has seen a command line as long as this one,
+ * and nothing is printed.  argv is permuted in place, the values of options
+ * that may repeat written over their tokens, and `args` points into it.  On DOCOPT_OK `args` holds the result, otherwise only its defaults.
+ * With DOCOPT_RESPONSE_FILES an argument @file stands for the words in the
+ * file, see expand_responses().
+ */
+DOCOPT_API enum DocoptError docopt_parse(struct DocoptContext *ctx, int argc, char *argv[],
+                                         struct DocoptArgs *args) {
+#ifdef DOCOPT_RESPONSE_FILES
+    int ret = expand_responses(ctx, &argc, &argv);
+
+    if (ret != DOCOPT_OK) {
+        *args = args_default;
+        return (enum DocoptError) ret;
+    }
+#endif
+    return (enum DocoptError) parse_argv(ctx, argc, argv, args);
+}
+
+#ifdef DOCOPT_TRACE
+/* Call the hooks of `trace` during the parses of `ctx`, or of the contexts
+   made from now on when `ctx` is NULL, docopt()'s among them */
+DOCOPT_API void docopt_trace(struct DocoptContext *ctx, const struct DocoptTrace *trace) {
+    if (ctx == NULL) {
+        STATICS_LOCK();
+        trace_default = trace;
+        STATICS_UNLOCK();
+    } else
+        ctx->elements.trace = trace;
+}
+#endif
+
+/* Token or option name the last docopt_parse() stopped at, or NULL */
+DOCOPT_API const char *docopt_error_token(const struct DocoptContext *ctx) {
+    return ctx->elements.error;
+}
+
+
+/*
+ * Shell completion
+ */
+
+/* Print `prefix` and each choice of `type` that starts with `word` */
+static DOCOPT_COLD void complete_choices(FILE *out, const char *prefix, size_t n_prefix, const struct Type *type,
+                                         const char *word) {
+    size_t len = strlen(word);
+    int i;
+
+    if (type == NULL || type->kind != TYPE_ENUM)
+        return;
+    for (i = 0; i < type->n_choices; i++)
+        if (!strncmp(type->choices[i], word, len))
+            fprintf(out, "%.*s%s\n", (int) n_prefix, prefix, type->choices[i]);
+}
+
+static const struct Type *option_type(const struct Spec *spec, int i) {
+    if (spec->option_types == NULL || spec->option_types[i] < 0)
+        return NULL;
+    return &spec->types[spec->option_types[i]];
+}
+
+/*
+ * Print the tokens that may replace argv[cword], one per line, from what
+ * argv[0..cword) parses to: the choices of the option waiting for its
+ * argument, options when the word starts with '-', and otherwise the
+ * commands that the usage section lets follow.  argv[0] is not the program
+ * name.  Like docopt_parse(), nothing is allocated once warmed up.
+ */
+DOCOPT_API int docopt_complete(struct DocoptContext *ctx, int argc, char *argv[], int cword,
+                               FILE *out) {
+    struct Elements *elements = &ctx->elements;
+    const struct Spec *spec = elements->spec;
+    const struct Pattern *pattern = spec->pattern;
+    const char *word = cword < argc ? argv[cword] : "";
+    size_t len = strlen(word);
+    struct Tokens ts;
+    unsigned long *set;
+    unsigned long bits;
+    size_t w;
+    int i, j, p, ret;
+    bool positional = false;
+
+    context_reset(ctx);
+    if (cword < 0)
+        return DOCOPT_OK;
+    for (i = 0; i < cword && i < argc; i++)
+        positional = positional || strcmp(argv[i], "--") == 0;
+    ret = context_words(ctx, cword < argc ? cword : argc);
+    if (ret != DOCOPT_OK)
+        return ret;
+    ts = tokens_new(cword < argc ? cword : argc, argv, ctx->spare);
+    ret = parse_args(&ts, elements);
+    if (ret == DOCOPT_MISSING_ARGUMENT) {
+        for (i = 0; i < spec->n_options; i++)
+            if (elements->error == spec->option_longs[i] || elements->error == spec->option_shorts[i])
+                complete_choices(out, "", 0, option_type(spec, i), word);
+        return DOCOPT_OK;
+    }
+    if (ret != DOCOPT_OK)
+        return ret;
+
+    if (word[0] == '-' && !positional) {
+#if DOCOPT_HAS_LONGS
+        const char *eq = strchr(word, '=');
+
+        if (word[1] == '-' && eq != NULL) {
+            i = find_long(elements, word, (size_t) (eq - word));
+            if (i >= 0 && spec->option_argcounts[i])
+                complete_choices(out, word, (size_t) (eq + 1 - word), option_type(spec, i), eq + 1);
+            return DOCOPT_OK;
+        }
+#endif
+        for (i = 0; i < spec->n_options && len <= 2; i++)
+            if (spec->option_shorts[i] != NULL && !strncmp(spec->option_shorts[i], word, len)
+                    && (!SET_HAS(elements->options, i) || spec->option_repeating[i]))
+                fprintf(out, "%s\n", spec->option_shorts[i]);
+#if DOCOPT_HAS_LONGS
+        long_candidates(elements, word, len);
+        for (j = elements->candidates[0]; j < elements->candidates[1]; j++) {
+            i = spec->long_sorted[j];
+            if (!SET_HAS(elements->options, i) || spec->option_repeating[i])
+                fprintf(out, "%s\n", spec->option_longs[i]);
+        }
+#endif
+        return DOCOPT_OK;
+    }
+
+    /* commands that may follow a state the positional tokens lead to, each
+       printed once, which elements->commands keeps track of */
+    ret = match_states(&ts, elements, &ctx->trail);
+    if (ret != DOCOPT_OK)
+        return ret == DOCOPT_NO_MATCH ? DOCOPT_OK : ret;
+    set = &ctx->trail.sets[(ctx->trail.n - 1) * ctx->trail.words];
+    for (w = 0; w < ctx->trail.words; w++) {
+        for (bits = set[w]; bits != 0; bits &= bits - 1) {
+            i = w * WORD_BITS + lowest_bit(bits);
+            for (j = pattern->follow_start[i]; j < pattern->follow_start[i + 1]; j++) {
+                p = pattern->command[pattern->follow[j]];
+                if (p < 0 || SET_HAS(elements->commands, p) || strncmp(spec->command_names[p], word, len))
+                    continue;
+                SET_ADD(elements->commands, p);
+                fprintf(out, "%s\n", spec->command_names[p]);
+            }
+        }
+    }
+    return DOCOPT_OK;
+}
+
+
+#ifdef DOCOPT_BATCH
+
+/*
+ * Batch mode
+ */
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+#define IS_SPECIAL(c) (IS_BLANK(c) || (c) == '\n' || (c) == '\'' || (c) == '"' || (c) == '\\')
+
+/* Length of the run at p[0..n) that the tokenizer can pass over unchanged */
+static size_t scan_plain(const char *p, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    const __m128i squote = _mm_set1_epi8('\''), dquote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    __m128i v, m;
+    int mask;
+
+    for (; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (p + i));
+        m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, squote), _mm_cmpeq_epi8(v, dquote)));
+        mask = _mm_movemask_epi8(_mm_or_si128(m, _mm_cmpeq_epi8(v, backslash)));
+        if (mask != 0)
+            return i + lowest_bit((unsigned long) mask);
+    }
+#else
+    /* a word at a time, see "Determine if a word has a zero byte" */
+    const unsigned long ones = (unsigned long) -1 / 255;
+    unsigned long w;
+
+#define HAS_BYTE(w, c) ((((w) ^ ones * (c)) - ones) & ~((w) ^ ones * (c)) & ones * 0x80)
+    for (; i + sizeof(w) <= n; i += sizeof(w)) {
+        memcpy(&w, p + i, sizeof(w));
+        if (HAS_BYTE(w, ' ') || HAS_BYTE(w, '\t') || HAS_BYTE(w, '\r') || HAS_BYTE(w, '\n')
+            || HAS_BYTE(w, '\'') || HAS_BYTE(w, '"') || HAS_BYTE(w, '\\'))
+            break;
+    }
+#undef HAS_BYTE
+#endif
+    while (i < n && !IS_SPECIAL(p[i]))
+        i++;
+    return i;
+}
+
+struct Batch {
+    struct DocoptContext *ctx;
+    DocoptLineCallback callback;
+    void *data;
+    size_t line;
+    int argc;
+    int capacity;
+    char **argv;
+    char *error;                /* token with an unterminated quote */
+};
+
+/* Room for one more word in batch->argv, or -1 when out of memory */
+static int batch_grow(struct Batch *batch) {
+    int capacity = batch->capacity ? 2 * batch->capacity : 16;
+    char **argv = realloc(batch->argv, capacity * sizeof(char *));
+
+    if (argv == NULL)
+        return -1;
+    batch->argv = argv;
+    batch->capacity = capacity;
+    return 0;
+}
+
+/*
+ * Split the line at `p`, which ends with a '\n', the way a shell would,
+ * appending its words to batch->argv: blanks separate words, '...' is taken
+ * literally, and in "..." as well as unquoted a backslash escapes the next
+ * character.  Words are unquoted and NUL-terminated in place, they only ever
+ * shrink.  Returns the start of the next line, or NULL when out of memory.
+ */
+static char *split_line(struct Batch *batch, char *p, const char *end) {
+    char *out;
+    char quote;
+    bool eol = false;
+    size_t n;
+
+    while (!eol) {
+        while (IS_BLANK(*p))
+            p++;
+        if (*p == '\n')
+            return p + 1;
+        if (batch->argc == batch->capacity && batch_grow(batch) != 0)
+            return NULL;
+        out = batch->argv[batch->argc++] = p;
+        quote = 0;
+        for (;;) {
+            n = scan_plain(p, end - p);
+            if (out != p)
+                memmove(out, p, n);
+            out += n;
+            p += n;
+            if (*p == '\n') {
+                eol = true;
+                if (quote && batch->error == NULL)
+                    batch->error = batch->argv[batch->argc - 1];
+                break;
+            } else if (quote == 0 && IS_BLANK(*p)) {
+                break;
+            } else if (*p == quote) {
+                quote = 0;
+                p++;
+            } else if (quote == 0 && (*p == '\'' || *p == '"')) {
+                quote = *p++;
+            } else if (*p == '\\' && quote != '\'' && p[1] != '\n'
+                       && (quote == 0 || p[1] == '"' || p[1] == '\\')) {
+                *out++ = p[1];
+                p += 2;
+            } else {
+                /* a blank or the other quote inside quotes, a lone backslash */
+                *out++ = *p++;
+            }
+        }
+        p++;
+        *out = '\0';
+    }
+    return p;
+}
+
+/* Parse the lines of buf[0..len), each ending with a '\n' */
+static int batch_lines(struct Batch *batch, char *buf, size_t len) {
+    struct DocoptArgs args;
+    enum DocoptError error;
+    char *p = buf;
+    char *end = buf + len;
+    int ret;
+
+    while (p < end) {
+        batch->line++;
+        batch->argc = 0;
+        batch->error = NULL;
+        p = split_line(batch, p, end);
+        if (p == NULL)
+            return -1;
+        if (batch->argc == 0)
+            continue;
+        if (batch->error != NULL) {
+            args = args_default;
+            batch->ctx->elements.error = batch->error;
+            error = DOCOPT_UNTERMINATED_QUOTE;
+        } else {
+            error = (enum DocoptError) parse_argv(batch->ctx, batch->argc, batch->argv, &args);
+        }
+        ret = batch->callback(batch->data, batch->line, error, &args);
+        if (ret != 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Parse the last `len` bytes of a buffer, which lack a '\n' to end them */
+static int batch_tail(struct Batch *batch, const char *tail, size_t len) {
+    /* tail[len] may not exist, let alone be writable */
+    char *line = malloc(len + 1);
+    int ret;
+
+    if (line == NULL)
+        return -1;
+    memcpy(line, tail, len);
+    line[len] = '\n';
+    ret = batch_lines(batch, line, len + 1);
+    free(line);
+    return ret;
+}
+
+/*
+ * Parse each line of buf[0..len) as a command line, argv[0] included, and
+ * hand the result to `callback`, along with the line number counted from 1.
+ * Blank lines are skipped.  The buffer is tokenized in place and the
+ * DocoptArgs point into it.  Returns 0 once all lines are done, the first
+ * nonzero value `callback` returns, or -1 when out of memory.
+ */
+DOCOPT_API int docopt_batch(struct DocoptContext *ctx, char *buf, size_t len,
+                            DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    size_t n = len;
+    int ret;
+
+    batch.ctx = ctx;
+    batch.callback = callback;
+    batch.data = data;
+    while (n > 0 && buf[n - 1] != '\n')
+        n--;
+    ret = batch_lines(&batch, buf, n);
+    if (ret == 0 && n < len)
+        ret = batch_tail(&batch, buf + n, len - n);
+    free(batch.argv);
+    return ret;
+}
+
+/*
+ * docopt_batch() over what can be read from `fd`.  Regular files are mapped
+ * privately, the file itself is never written; anything else is read in
+ * chunks of whole lines.  Returns like docopt_batch(), and -1 also when
+ * reading fails.
+ */
+DOCOPT_API int docopt_batch_fd(struct DocoptContext *ctx, int fd, DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    struct stat st;
+    char *buf;
+    char *grown;
+    size_t size = 0;
+    size_t capacity = 1 << 16;
+    size_t n;
+    ssize_t got;
+    int ret = 0;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = (size_t) st.st_size;
+        buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED) {
+            posix_madvise(buf, size, POSIX_MADV_SEQUENTIAL);
+            ret = docopt_batch(ctx, buf, size, callback, data);
+            munmap(buf, size);
+            return ret;
+        }
+        size = 0;
+    }
+
+    batch.ctx = ctx;
+    batch.callback = callback;
+    batch.data = data;
+    buf = malloc(capacity + 1);
+    if (buf == NULL)
+        return -1;
+    for (;;) {
+        if (size == capacity) {
+            /* a single line fills the buffer */
+            grown = realloc(buf, 2 * capacity + 1);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+            capacity *= 2;
+        }
+        got = read(fd, buf + size, capacity - size);
+        if (got < 0) {
+            ret = -1;
+            break;
+        }
+        if (got == 0) {
+            if (size > 0 && buf[size - 1] != '\n')
+                buf[size++] = '\n';
+            ret = batch_lines(&batch, buf, size);
+            break;
+        }
+        size += (size_t) got;
+        for (n = size; n > 0 && buf[n - 1] != '\n'; n--)
+            ;
+        ret = batch_lines(&batch, buf, n);
+        if (ret != 0)
+            break;
+        memmove(buf, buf + n, size - n);
+        size -= n;
+    }
+    free(buf);
+    free(batch.argv);
+    return ret;
+}
+
+#ifdef DOCOPT_RESPONSE_FILES
+/*
+ * Response files
+ */
+
+/* A file mapped by expand_responses(), with a copy of its last line when
+   that does not end in a newline */
+struct Mapping {
+    char *buf;
+    size_t size;
+    char *tail;
+};
+
+struct Responses {
+    struct Batch words;         /* argv, each @file replaced by its words */
+    struct Mapping *files;
+    int n_files;
+    int capacity;
+};
+
+static void responses_unmap(struct Responses *responses) {
+    int i;
+
+    for (i = 0; i < responses->n_files; i++) {
+        if (responses->files[i].buf != NULL)
+            munmap(responses->files[i].buf, responses->files[i].size);
+        free(responses->files[i].tail);
+    }
+    responses->n_files = 0;
+}
+
+static void responses_free(struct Responses *responses) {
+    if (responses == NULL)
+        return;
+    responses_unmap(responses);
+    free(responses->files);
+    free(responses->words.argv);
+    free(responses);
+}
+
+/* Map the file at `path` and append its words to responses->words */
+static int response_split(struct Responses *responses, const char *path) {
+    struct Mapping *file;
+    struct stat st;
+    char *p;
+    size_t n;
+    int fd;
+
+    if (responses->n_files == responses->capacity) {
+        int capacity = responses->capacity ? 2 * responses->capacity : 4;
+        struct Mapping *files = realloc(responses->files, capacity * sizeof(struct Mapping));
+
+        if (files == NULL)
+            return DOCOPT_NO_MEMORY;
+        responses->files = files;
+        responses->capacity = capacity;
+    }
+    file = &responses->files[responses->n_files];
+    file->buf = file->tail = NULL;
+    file->size = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return DOCOPT_BAD_RESPONSE_FILE;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return DOCOPT_BAD_RESPONSE_FILE;
+    }
+    if (st.st_size > 0) {
+        file->buf = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (file->buf == MAP_FAILED) {
+            file->buf = NULL;
+            close(fd);
+            return DOCOPT_BAD_RESPONSE_FILE;
+        }
+        file->size = (size_t) st.st_size;
+        posix_madvise(file->buf, file->size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+    responses->n_files++;
+    for (n = file->size; n > 0 && file->buf[n - 1] != '\n'; n--)
+        ;
+    for (p = file->buf; p < file->buf + n;) {
+        p = split_line(&responses->words, p, file->buf + n);
+        if (p == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    if (n < file->size) {
+        /* buf[size] may not exist, let alone be writable */
+        file->tail = malloc(file->size - n + 1);
+        if (file->tail == NULL)
+            return DOCOPT_NO_MEMORY;
+        memcpy(file->tail, file->buf + n, file->size - n);
+        file->tail[file->size - n] = '\n';
+        if (split_line(&responses->words, file->tail, file->tail + file->size - n + 1) == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    return DOCOPT_OK;
+}
+
+/*
+ * Replace each argument @file after argv[0] by the words of that file,
+ * split like the lines of a batch.  The files are mapped privately and
+ * their words NUL-terminated in place: only pointers are copied, into one
+ * array that is reused from parse to parse.  Words are not expanded again,
+ * and a lone "@" is an argument like any other.  The words, and so the
+ * DocoptArgs, last until the next docopt_parse() or docopt_context_free().
+ */
+static int expand_responses(struct DocoptContext *ctx, int *argc, char ***argv) {
+    struct Responses *responses = ctx->responses;
+    struct Batch *words;
+    char *arg;
+    int i, ret;
+
+    if (responses != NULL)
+        responses_unmap(responses);
+    for (i = 1; i < *argc && ((*argv)[i][0] != '@' || (*argv)[i][1] == '\0'); i++)
+        ;
+    if (i >= *argc)
+        return DOCOPT_OK;
+    if (responses == NULL) {
+        responses = ctx->responses = calloc(1, sizeof(struct Responses));
+        if (responses == NULL)
+            return DOCOPT_NO_MEMORY;
+    }
+    words = &responses->words;
+    words->argc = 0;
+    words->error = NULL;
+    for (i = 0; i < *argc; i++) {
+        arg = (*argv)[i];
+        if (i > 0 && arg[0] == '@' && arg[1] != '\0') {
+            ret = response_split(responses, arg + 1);
+            if (ret != DOCOPT_OK) {
+                ctx->elements.error = arg;
+                return ret;
+            }
+        } else {
+            if (words->argc == words->capacity && batch_grow(words) != 0)
+                return DOCOPT_NO_MEMORY;
+            words->argv[words->argc++] = arg;
+        }
+    }
+    if (words->error != NULL) {
+        ctx->elements.error = words->error;
+        return DOCOPT_UNTERMINATED_QUOTE;
+    }
+    *argc = words->argc;
+    *argv = words->argv;
+    return DOCOPT_OK;
+}
+#endif
+
+#endif
+
+#ifdef DOCOPT_THREADS
+
+/*
+ * Parallel batch mode
+ */
+
+#ifndef DOCOPT_BLOCK_BYTES
+#define DOCOPT_BLOCK_BYTES (1 << 20)
+#endif
+#define CHUNK_BYTES (1 << 16)
+
+union Align {
+    long l;
+    double d;
+    void *p;
+};
+
+struct Chunk {
+    struct Chunk *next;
+    size_t size;
+    union Align data[1];
+};
+
+/* Bump allocator, freed all at once by arena_reset() */
+struct Arena {
+    struct Chunk *first;
+    struct Chunk *current;
+    size_t used;
+};
+
+static void *arena_alloc(struct Arena *arena, size_t size) {
+    struct Chunk *chunk = arena->current;
+    struct Chunk *next;
+    void *p;
+
+    size = (size + sizeof(union Align) - 1) / sizeof(union Align) * sizeof(union Align);
+    if (chunk == NULL || arena->used + size > chunk->size) {
+        if (chunk != NULL && chunk->next != NULL && chunk->next->size >= size) {
+            next = chunk->next;
+        } else {
+            size_t bytes = size > CHUNK_BYTES ? size : CHUNK_BYTES;
+
+            next = malloc(offsetof(struct Chunk, data) + bytes);
+            if (next == NULL)
+                return NULL;
+            next->size = bytes;
+            next->next = chunk != NULL ? chunk->next : NULL;
+            if (chunk != NULL)
+                chunk->next = next;
+            else
+                arena->first = next;
+        }
+        arena->current = chunk = next;
+        arena->used = 0;
+    }
+    p = (char *) chunk->data + arena->used;
+    arena->used += size;
+    return p;
+}
+
+static void arena_reset(struct Arena *arena) {
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+static void arena_free(struct Arena *arena) {
+    struct Chunk *chunk = arena->first;
+    struct Chunk *next;
+
+    while (chunk != NULL) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->first = arena->current = NULL;
+    arena->used = 0;
+}
+
+/* Outcome of one line, kept until it is handed to the callback in order */
+struct Result {
+    struct Result *next;
+    size_t line;                /* counted from the start of the shard */
+    enum DocoptError error;
+    const char *token;
+    char token_short[3];
+    struct DocoptArgs args;
+};
+
+struct Worker {
+    struct DocoptContext *ctx;
+    struct Batch batch;         /* only its argv, as scratch for split_line */
+    struct Arena arena;         /* argv copies and results of the shard */
+    char *begin;
+    char *end;
+    struct Result *results;
+    size_t n_lines;
+    int status;
+    bool started;
+    pthread_t thread;
+};
+
+/* Parse the shard w->begin..w->end, whole lines, into w->results */
+static int worker_lines(struct Worker *w) {
+    struct Result **tail = &w->results;
+    struct Result *result;
+    char **argv;
+    char *p = w->begin;
+
+    arena_reset(&w->arena);
+    w->results = NULL;
+    w->n_lines = 0;
+    while (p < w->end) {
+        w->n_lines++;
+        w->batch.argc = 0;
+        w->batch.error = NULL;
+        p = split_line(&w->batch, p, w->end);
+        if (p == NULL)
+            return -1;
+        if (w->batch.argc == 0)
+            continue;
+        /* DocoptArgs slices point into argv, which has to outlive the line */
+        result = arena_alloc(&w->arena, sizeof(struct Result));
+        argv = arena_alloc(&w->arena, w->batch.argc * sizeof(char *));
+        if (result == NULL || argv == NULL)
+            return -1;
+        memcpy(argv, w->batch.argv, w->batch.argc * sizeof(char *));
+        result->line = w->n_lines;
+        if (w->batch.error != NULL) {
+            result->args = args_default;
+            result->error = DOCOPT_UNTERMINATED_QUOTE;
+            result->token = w->batch.error;
+        } else {
+            result->error = (enum DocoptError) parse_argv(w->ctx, w->batch.argc, argv, &result->args);
+            result->token = docopt_error_token(w->ctx);
+            if (result->token == w->ctx->elements.error_short) {
+                memcpy(result->token_short, result->token, sizeof(result->token_short));
+                result->token = result->token_short;
+            }
+        }
+        result->next = NULL;
+        *tail = result;
+        tail = &result->next;
+    }
+    return 0;
+}
+
+static void *worker_run(void *w) {
+    ((struct Worker *) w)->status = worker_lines(w);
+    return NULL;
+}
+
+/*
+ * docopt_batch() on `n_threads` threads.  The buffer is parsed a round at a
+ * time, each thread taking DOCOPT_BLOCK_BYTES worth of lines with a context
+ * and an arena of its own, then the results of the round are handed to
+ * `callback` in input order on the calling thread, where docopt_error_token()
+ * of `ctx` tells about the line at hand.
+ */
+DOCOPT_API int docopt_batch_parallel(struct DocoptContext *ctx, char *buf, size_t len, int n_threads,
+                                     DocoptLineCallback callback, void *data) {
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    struct Worker *workers;
+    struct Worker *w;
+    struct Result *result;
+    char *p = buf;
+    char *end;
+    size_t n = len;
+    int ret = 0;
+    int i;
+
+    if (n_threads < 1)
+        n_threads = 1;
+    workers = calloc(n_threads, sizeof(struct Worker));
+    if (workers == NULL)
+        ret = -1;
+    for (i = 0; ret == 0 && i < n_threads; i++) {
+        workers[i].ctx = docopt_context_new(ctx->help, ctx->version);
+        if (workers[i].ctx == NULL)
+            ret = -1;
+#if DOCOPT_HAS_SOURCES
+        else
+            memcpy(workers[i].ctx->option_sources, ctx->option_sources, sizeof(ctx->option_sources));
+#endif
+    }
+    while (n > 0 && buf[n - 1] != '\n')
+        n--;
+    end = buf + n;
+
+    while (ret == 0 && p < end) {
+        for (i = 0; i < n_threads; i++) {
+            w = &workers[i];
+            w->begin = p;
+            if ((size_t) (end - p) > DOCOPT_BLOCK_BYTES)
+                p = (char *) memchr(p + DOCOPT_BLOCK_BYTES - 1, '\n', end - p - DOCOPT_BLOCK_BYTES + 1) + 1;
+            else
+                p = end;
+            w->end = p;
+        }
+        for (i = 1; i < n_threads; i++)
+            workers[i].started = !pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+        worker_run(&workers[0]);
+        for (i = 1; i < n_threads; i++) {
+            if (workers[i].started)
+                pthread_join(workers[i].thread, NULL);
+            else
+                worker_run(&workers[i]);
+        }
+
+        for (i = 0; ret == 0 && i < n_threads; i++) {
+            w = &workers[i];
+            ret = w->status;
+            for (result = w->results; ret == 0 && result != NULL; result = result->next) {
+                ctx->elements.error = result->token;
+                ret = callback(data, batch.line + result->line, result->error, &result->args);
+            }
+            batch.line += w->n_lines;
+        }
+    }
+
+    if (ret == 0 && n < len) {
+        batch.ctx = ctx;
+        batch.callback = callback;
+        batch.data = data;
+        ret = batch_tail(&batch, buf + n, len - n);
+    }
+    free(batch.argv);
+    for (i = 0; workers != NULL && i < n_threads; i++) {
+        docopt_context_free(workers[i].ctx);
+        free(workers[i].batch.argv);
+        arena_free(&workers[i].arena);
+    }
+    free(workers);
+    return ret;
+}
+
+#endif
+
+/*
+ * "Did you mean" suggestions
+ */
+
+#define MAX_SUGGESTIONS 4
+
+#if DOCOPT_HAS_LONGS || DOCOPT_HAS_COMMANDS
+#if defined(__GNUC__)
+#define count_bits(w) __builtin_popcountl(w)
+#else
+static int count_bits(unsigned long w) {
+    int n = 0;
+
+    for (; w != 0; w &= w - 1)
+        n++;
+    return n;
+}
+#endif
+
+/*
+ * Column of the dynamic programming matrix of the edit distance between a
+ * word, at most WORD_BITS long, and a prefix of a name, in Myers' bit-parallel
+ * form: bit i of vp (+1) and vn (-1) is the vertical delta into row i + 1,
+ * of d0 that the diagonal does not grow there, eq is what the last character
+ * of the prefix matches and d the distance of the whole word.
+ */
+struct Column {
+    unsigned long vp;
+    unsigned long vn;
+    unsigned long d0;
+    unsigned long eq;
+    int d;
+};
+
+/* What suggest() works in: peq[c] has bit i set where word[i] is c, and
+   columns[q] is the column of the first q characters of a name */
+struct Suggester {
+    unsigned long peq[UCHAR_MAX + 1];
+    struct Column columns[2 * WORD_BITS + 2];
+};
+
+/*
+ * Column of the prefix of `col` and `c`, with Hyyro's transpositions, so that
+ * a swap of neighbours is one edit; `last` is the bit of the last row.
+ */
+static DOCOPT_COLD void column_next(const unsigned long *peq, unsigned long last, const struct Column *col, char c,
+                                    struct Column *next) {
+    unsigned long eq = peq[(unsigned char) c];
+    unsigned long d0 = (((eq & col->vp) + col->vp) ^ col->vp) | eq | col->vn | (((~col->d0 & eq) << 1) & col->eq);
+    unsigned long hp = col->vn | ~(d0 | col->vp);
+    unsigned long hn = col->vp & d0;
+
+    next->d = col->d + ((hp & last) != 0) - ((hn & last) != 0);
+    /* row 0 counts up: a prefix q long is q insertions away from "" */
+    hp = (hp << 1) | 1;
+    hn <<= 1;
+    next->vp = hn | ~(hp | d0);
+    next->vn = hp & d0;
+    next->d0 = d0;
+    next->eq = eq;
+}
+
+/*
+ * Least distance between the m characters of the word and a name `len`
+ * long that starts with the `prefix` characters `col` is the column of:
+ * distances never shrink along a diagonal, and the one down to the last
+ * cell crosses the column at row m - (len - prefix).
+ */
+static DOCOPT_COLD int least_distance(const struct Column *col, size_t m, size_t prefix, size_t len) {
+    unsigned long rows = ((1UL << (m - 1)) << 1) - 1;
+    unsigned long below;
+
+    if (prefix + m <= len)
+        return 0;
+    if (len <= prefix)
+        return col->d;
+    below = rows & ~((1UL << (m + prefix - len)) - 1);
+    return col->d - count_bits(col->vp & below) + count_bits(col->vn & below);
+}
+
+/*
+ * The names closest to the m characters of `word`, names[i] + skip compared
+ * to it, as indices into `names` in `found`; how many there are, at most
+ * MAX_SUGGESTIONS.  None is further than a third of `word` plus one, so
+ * only the names about as long are looked at.  Those of a length are in
+ * order, each sharing lcp[] characters with the one before, so the columns
+ * of a prefix are computed once for all the names that start with it, and
+ * skipped with them once too far.
+ */
+static DOCOPT_COLD int suggest(const struct ByLength *by, const char *const *names, size_t skip,
+                               const char *word, size_t m, int *found) {
+    struct Suggester *s;
+    const char *name;
+    unsigned long last;
+    int bound = 1 + (int) m / 3;
+    int n_found = 0;
+    int j, d;
+    size_t i, len, q, valid, pruned;
+
+    if (m == 0 || m > WORD_BITS || by->start == NULL)
+        return 0;
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return 0;
+    for (i = 0; i < m; i++)
+        s->peq[(unsigned char) word[i]] |= 1UL << i;
+    last = 1UL << (m - 1);
+    s->columns[0].vp = ~0UL;
+    s->columns[0].d = (int) m;
+    for (len = m > (size_t) bound ? m - bound : 0; len <= m + bound && len <= (size_t) by->max; len++) {
+        /* columns[0..valid] are those of the last name looked at, and
+           names that share its first `pruned` characters are too far */
+        valid = 0;
+        pruned = len + 1;
+        for (j = by->start[len]; j < by->start[len + 1]; j++) {
+            if ((size_t) by->lcp[j] >= pruned)
+                continue;
+            name = names[by->order[j]] + skip;
+            pruned = len + 1;
+            for (q = (size_t) by->lcp[j] < valid ? (size_t) by->lcp[j] : valid; q < len; q++) {
+                column_next(s->peq, last, &s->columns[q], name[q], &s->columns[q + 1]);
+                if (least_distance(&s->columns[q + 1], m, q + 1, len) > bound) {
+                    pruned = q + 1;
+                    break;
+                }
+            }
+            valid = q;
+            if (q < len)
+                continue;
+            d = s->columns[len].d;
+            if (d < bound) {
+                bound = d;
+                n_found = 0;
+            }
+            if (d == bound && n_found < MAX_SUGGESTIONS)
+                found[n_found++] = by->order[j];
+        }
+    }
+    free(s);
+    return n_found;
+}
+#endif
+
+/*
+ * Long options close to the unknown option docopt_parse() stopped at, or
+ * commands close to the token no usage line took, as indices into
+ * option_longs or command_names in `found`; how many there are.  An
+ * unknown short option is taken for a long one missing a dash, "-speed"
+ * for "--speed".
+ */
+static DOCOPT_COLD int suggestions(const struct Elements *elements, int ret, int *found) {
+    const struct Spec *spec = elements->spec;
+    const char *word = elements->error;
+    int n;
+
+    if (word == NULL)
+        return 0;
+#if DOCOPT_HAS_LONGS
+    if (ret == DOCOPT_UNKNOWN_OPTION) {
+        word = word == elements->error_short ? elements->error_word + 1 : word + 2;
+        return suggest(&spec->long_by_length, spec->option_longs, 2, word, strcspn(word, "="), found);
+    }
+#endif
+#if DOCOPT_HAS_COMMANDS
+    if (ret == DOCOPT_NO_MATCH) {
+        /* a command where it does not belong is not misspelled */
+        n = suggest(&spec->command_by_length, spec->command_names, 0, word, strlen(word), found);
+        return n > 0 && strcmp(spec->command_names[found[0]], word) == 0 ? 0 : n;
+    }
+#endif
+    (void) spec;
+    (void) ret;
+    (void) found;
+    (void) n;
+    return 0;
+}
+
+/* ", did you mean a, b or c?" */
+static DOCOPT_COLD void print_suggestions(const char *const *names, const int *found, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        fputs(i == 0 ? ", did you mean " : i < n - 1 ? ", " : " or ", stderr);
+        fputs(names[found[i]], stderr);
+    }
+    if (n > 0)
+        fputs("?", stderr);
+}
+
+
+/*
+ * Main docopt function
+ */
+
+static DOCOPT_COLD void print_help(void) {
+    int i;
+
+    for (i = 0; i < 17; i++)
+        puts(help_message[i]);
+}
+
+/* Report what made docopt_parse() fail, or the help or version asked for,
+   and exit.  Messages go out in pieces with fputs(): fprintf() formats
+   through a buffer of 8KB on the stack when stderr is unbuffered */
+static DOCOPT_COLD void docopt_exit(struct DocoptContext *ctx, int ret, const char *version) {
+    const char *what = NULL;
+    int return_code = EXIT_FAILURE;
+    int found[MAX_SUGGESTIONS];
+    int i, n_found;
+
+    switch (ret) {
+    case DOCOPT_HELP:
+        print_help();
+        return_code = EXIT_SUCCESS;
+        break;
+    case DOCOPT_VERSION:
+        puts(version);
+        return_code = EXIT_SUCCESS;
+        break;
+    case DOCOPT_UNKNOWN_OPTION:
+        what = " is not recognized";
+        break;
+    case DOCOPT_MISSING_ARGUMENT:
+        what = " requires argument";
+        break;
+    case DOCOPT_UNEXPECTED_ARGUMENT:
+        what = " must not have an argument";
+        break;
+    case DOCOPT_UNTERMINATED_QUOTE:
+        what = " has an unterminated quote";
+        break;
+    case DOCOPT_NO_MATCH:
+        n_found = suggestions(&ctx->elements, ret, found);
+        if (n_found > 0) {
+            fputs(docopt_error_token(ctx), stderr);
+            fputs(" is not recognized", stderr);
+            print_suggestions(spec.command_names, found, n_found);
+            fputs("\n", stderr);
+        }
+        fputs(usage_pattern, stderr);
+        fputs("\n", stderr);
+        break;
+    case DOCOPT_NO_MEMORY:
+        fputs("out of memory\n", stderr);
+        break;
+    case DOCOPT_INVALID_VALUE:
+        what = " has an invalid value";
+        break;
+    case DOCOPT_OUT_OF_RANGE:
+        what = " is out of range";
+        break;
+    case DOCOPT_AMBIGUOUS_OPTION:
+        fputs(docopt_error_token(ctx), stderr);
+        fputs(" is not a unique prefix:", stderr);
+        for (i = ctx->elements.candidates[0]; i < ctx->elements.candidates[1]; i++) {
+            fputs(i > ctx->elements.candidates[0] ? ", " : " ", stderr);
+            fputs(spec.option_longs[spec.long_sorted[i]], stderr);
+        }
+        fputs("?\n", stderr);
+        break;
+    case DOCOPT_BAD_CONFIG:
+    case DOCOPT_BAD_RESPONSE_FILE:
+        what = " cannot be read";
+        break;
+    }
+    if (what != NULL) {
+        fputs(docopt_error_token(ctx), stderr);
+        fputs(what, stderr);
+        if (ret == DOCOPT_UNKNOWN_OPTION)
+            print_suggestions(spec.option_longs, found, suggestions(&ctx->elements, ret, found));
+        fputs("\n", stderr);
+    }
+    docopt_context_free(ctx);
+    exit(return_code);
+}
+
+#ifdef DOCOPT_RESPONSE_FILES
+/* Contexts of docopt() whose @files its arguments point into, see statics_lock */
+static struct DocoptContext *kept_contexts;
+#endif
+
+DOCOPT_API struct DocoptArgs docopt(int argc, char *argv[], const bool help, const char *version) {
+    struct DocoptArgs args = args_default;
+    struct DocoptContext *ctx;
+    int ret;
+
+    if (argc == 1 && help) {
+        print_help();
+        exit(EXIT_FAILURE);
+    }
+    ctx = docopt_context_new(help, version != NULL);
+    if (ctx == NULL)
+        docopt_exit(ctx, DOCOPT_NO_MEMORY, version);
+    if (argc > 3 && strcmp(argv[1], "--docopt-complete") == 0) {
+        /* hidden, for the scripts of docopt_c.py --completion: argv[2] is
+           the index of the word to complete among argv[3..], the program
+           name and its arguments */
+        ret = docopt_complete(ctx, argc - 4, argv + 4, atoi(argv[2]) - 1, stdout);
+        docopt_context_free(ctx);
+        exit(ret == DOCOPT_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    ret = docopt_parse(ctx, argc, argv, &args);
+    if (ret != DOCOPT_OK)
+        docopt_exit(ctx, ret, version);
+#ifdef DOCOPT_RESPONSE_FILES
+    if (ctx->responses != NULL) {
+        /* the arguments point into the @files the context holds, which
+           stay for the life of the process, like argv */
+        STATICS_LOCK();
+        ctx->kept = kept_contexts;
+        kept_contexts = ctx;
+        STATICS_UNLOCK();
+        return args;
     }
-    if (elems_to_args(&elements, &args, help, version))
-        exit(return_code);
+#endif
+    docopt_context_free(ctx);
     return args;
 }
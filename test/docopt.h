@@ -1,7 +1,9 @@
 #ifndef DOCOPT_DOCOPT_H
 #define DOCOPT_DOCOPT_H
 
+#include <limits.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #if defined(__STDC__) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
 
@@ -28,59 +30,13 @@ typedef size_t bool;
 
 #endif
 
-#if defined(_AIX)
-
-#include <sys/limits.h>
-
-#elif defined(__FreeBSD__) || defined(__NetBSD__)
-|| defined(__OpenBSD__) || defined(__bsdi__)
-|| defined(__DragonFly__) || defined(macintosh)
-|| defined(__APPLE__) || defined(__APPLE_CC__)
-
-#include <sys/syslimits.h>
-
-#elif defined(__HAIKU__)
-
-#include <system/user_runtime.h>
-
-#elif defined(__linux__) || defined(linux) || defined(__linux)
-
-#include <linux/version.h>
-
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,22)
-
-#include <linux/limits.h>
-
-#else
-
-#define ARG_MAX       131072    /* # bytes of args + environ for exec() */
-/* it's no longer defined, see this example and more at https://unix.stackexchange.com/q/120642 */
-
-#endif
-
-#elif (defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__bsdi__)  || defined(__DragonFly__) || defined(macintosh) || defined(__APPLE__) || defined(__APPLE_CC__))
-
-#include <sys/param.h>
-
-#if defined(__APPLE__) || defined(__APPLE_CC__)
-/* ARG_MAX gives a segfault on macOS when used for array size below */
-#undef ARG_MAX
-#undef NCARGS
-#endif
-
-#else
-
-#include <limits.h>
-
-#endif
+/* values of a repeated positional argument (`<name>...`), viewed in argv */
+struct DocoptSlice {
+    const char **items;
+    size_t count;
+};
 
-#ifndef ARG_MAX
-#ifdef NCARGS
-#define ARG_MAX NCARGS
-#else
-#define ARG_MAX 131072
-#endif
-#endif
+#define DOCOPT_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
 
 struct DocoptArgs {
     
@@ -93,9 +49,9 @@ struct DocoptArgs {
     size_t ship;
     size_t shoot;
     /* arguments */
-    char *name;
-{indent}char *x;
-{indent}char *y;
+    struct DocoptSlice name;
+    char *x;
+    char *y;
     /* options without arguments */
     size_t drifting;
     size_t help;
@@ -105,9 +61,95 @@ struct DocoptArgs {
     char *speed;
     /* special */
     const char *usage_pattern;
-    const char *help_message[17];
+    const char *const *help_message;    /* 17 lines */
+};
+
+/* whether a command or an option without argument was given, or how often */
+#define DOCOPT_FLAG(args, name) ((args).name)
+
+
+/* Outcome of docopt_parse(); docopt_error_token() tells what it is about */
+enum DocoptError {
+    DOCOPT_OK = 0,
+    DOCOPT_HELP,                /* --help was given */
+    DOCOPT_VERSION,             /* --version was given */
+    DOCOPT_UNKNOWN_OPTION,
+    DOCOPT_MISSING_ARGUMENT,    /* an option that takes an argument is last */
+    DOCOPT_UNEXPECTED_ARGUMENT, /* --flag=value */
+    DOCOPT_UNTERMINATED_QUOTE,  /* in a line given to docopt_batch() */
+    DOCOPT_NO_MATCH,            /* no usage line matches, or takes the token */
+    DOCOPT_NO_MEMORY,
+    DOCOPT_INVALID_VALUE,       /* not a number, or not one of the choices */
+    DOCOPT_OUT_OF_RANGE,        /* a number too large, or out of its bounds */
+    DOCOPT_AMBIGUOUS_OPTION,    /* a prefix of several long options */
+    DOCOPT_BAD_CONFIG,          /* the file given to docopt_config() cannot be read */
+    DOCOPT_BAD_RESPONSE_FILE    /* an @file argument that cannot be read */
+};
+
+/* Parser state, reusable for any number of docopt_parse() calls */
+struct DocoptContext;
+
+/* how the functions below are declared, static in a --single-header parser */
+#ifndef DOCOPT_API
+#define DOCOPT_API
+#endif
+
+DOCOPT_API struct DocoptContext *docopt_context_new(bool, bool);
+DOCOPT_API void docopt_context_free(struct DocoptContext *);
+DOCOPT_API enum DocoptError docopt_parse(struct DocoptContext *, int, char *[], struct DocoptArgs *);
+DOCOPT_API const char *docopt_error_token(const struct DocoptContext *);
+DOCOPT_API int docopt_complete(struct DocoptContext *, int, char *[], int, FILE *);
+DOCOPT_API enum DocoptError docopt_config(struct DocoptContext *, const char *);
+
+#if defined(DOCOPT_THREADS) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+#if defined(DOCOPT_RESPONSE_FILES) && !defined(DOCOPT_BATCH)
+#define DOCOPT_BATCH
+#endif
+
+#ifdef DOCOPT_BATCH
+/* Receives the outcome of each line, returning nonzero stops the batch */
+typedef int (*DocoptLineCallback)(void *, size_t, enum DocoptError, const struct DocoptArgs *);
+
+DOCOPT_API int docopt_batch(struct DocoptContext *, char *, size_t, DocoptLineCallback, void *);
+DOCOPT_API int docopt_batch_fd(struct DocoptContext *, int, DocoptLineCallback, void *);
+#endif
+
+#ifdef DOCOPT_THREADS
+DOCOPT_API int docopt_batch_parallel(struct DocoptContext *, char *, size_t, int, DocoptLineCallback, void *);
+#endif
+
+#ifdef DOCOPT_TRACE
+/* Steps of docopt_parse(), in order */
+enum DocoptPhase {
+    DOCOPT_PHASE_PARSE_ARGS,    /* argv into options and positional tokens */
+    DOCOPT_PHASE_EXTRAS,        /* --help and --version */
+    DOCOPT_PHASE_MATCH,         /* positional tokens against the usage section */
+    DOCOPT_PHASE_ELEMS_TO_ARGS, /* what was found into struct DocoptArgs */
+    DOCOPT_PHASE_DONE
 };
 
-struct DocoptArgs docopt(int, char *[], bool, const char *);
+/* Called with `data` as a DOCOPT_TRACE parser goes, those that are not NULL */
+struct DocoptTrace {
+    void (*phase)(void *, enum DocoptPhase);                /* as the phase starts */
+    void (*token)(void *, const char *);                    /* an argv token is consumed */
+    void (*lookup)(void *, const char *, size_t, int);      /* a name, its length and the
+                                                               entries of its table looked at */
+    void (*error)(void *, enum DocoptError, const char *);  /* the parse fails, as docopt_error_token() */
+    void *data;
+};
+
+DOCOPT_API void docopt_trace(struct DocoptContext *, const struct DocoptTrace *);
+#endif
+
+/* Upper bound on the stack docopt() takes: the DocoptArgs it fills in and
+   the frames below it, libc's included; test/test_stack.py checks it */
+#define DOCOPT_STACK_BYTES 2192
+#if defined(DOCOPT_STACK_BUDGET) && DOCOPT_STACK_BYTES > DOCOPT_STACK_BUDGET
+#error "docopt() may take more stack than DOCOPT_STACK_BUDGET"
+#endif
+
+DOCOPT_API struct DocoptArgs docopt(int, char *[], bool, const char *);
 
 #endif
@@ -0,0 +1,925 @@
+/*
+ * C++17 parser of the spec, written by docopt_c.py --cpp: the spec is a set
+ * of constexpr tables, the parser a class template over the number of
+ * positional tokens it holds, and the parsed arguments string_views into
+ * argv, which is left as it is.  Everything is constexpr, so a command line
+ * may be parsed at compile time.
+ */
+#ifndef DOCOPT_DOCOPT_HPP
+#define DOCOPT_DOCOPT_HPP
+
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <clocale>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace docopt {
+
+/* Outcome of Parser::parse(); Parser::error_token() tells what it is about */
+enum class Error {
+    ok = 0,
+    help,                       /* --help was given */
+    version,                    /* --version was given */
+    unknown_option,
+    missing_argument,           /* an option that takes an argument is last */
+    unexpected_argument,        /* --flag=value */
+    no_match,                   /* no usage line matches */
+    too_many_arguments,         /* more positional tokens than the Parser holds */
+    invalid_value,              /* not a number, or not one of the choices */
+    out_of_range,               /* a number too large, or out of its bounds */
+    ambiguous_option            /* a prefix of several long options */
+};
+
+/* Values of a repeated positional argument (`<name>...`), in the Parser */
+class Strings {
+public:
+    constexpr Strings() = default;
+    constexpr Strings(const std::string_view *items, std::size_t count) : items_(items), count_(count) {}
+
+    constexpr std::size_t size() const { return count_; }
+    constexpr bool empty() const { return count_ == 0; }
+    constexpr std::string_view operator[](std::size_t i) const { return items_[i]; }
+    constexpr const std::string_view *begin() const { return items_; }
+    constexpr const std::string_view *end() const { return items_ + count_; }
+
+private:
+    const std::string_view *items_ = nullptr;
+    std::size_t count_ = 0;
+};
+
+/* An argument or option argument not given nor defaulted has a null data() */
+struct Args {
+    /* commands */
+    bool create = false;
+    bool mine = false;
+    bool move = false;
+    bool remove = false;
+    bool set = false;
+    bool ship = false;
+    bool shoot = false;
+    /* arguments */
+    Strings name{};
+    std::string_view x{};
+    std::string_view y{};
+    /* options without arguments */
+    bool drifting = false;
+    bool help = false;
+    bool moored = false;
+    bool version = false;
+    /* options with arguments */
+    std::string_view speed = "10";
+};
+
+inline constexpr std::string_view usage_pattern =
+        "Usage:\n"
+        "  naval_fate ship create <name>...\n"
+        "  naval_fate ship <name> move <x> <y> [--speed=<kn>]\n"
+        "  naval_fate ship shoot <x> <y>\n"
+        "  naval_fate mine (set|remove) <x> <y> [--moored|--drifting]\n"
+        "  naval_fate --help\n"
+        "  naval_fate --version";
+
+inline constexpr std::string_view help_message =
+        "Naval Fate.\n"
+        "\n"
+        "Usage:\n"
+        "  naval_fate ship create <name>...\n"
+        "  naval_fate ship <name> move <x> <y> [--speed=<kn>]\n"
+        "  naval_fate ship shoot <x> <y>\n"
+        "  naval_fate mine (set|remove) <x> <y> [--moored|--drifting]\n"
+        "  naval_fate --help\n"
+        "  naval_fate --version\n"
+        "\n"
+        "Options:\n"
+        "  -h --help     Show this screen.\n"
+        "  --version     Show version.\n"
+        "  --speed=<kn>  Speed in knots [env: NAVAL_SPEED] [config: speed] [default: 10].\n"
+        "  --moored      Moored (anchored) mine.\n"
+        "  --drifting    Drifting mine.\n"
+        "";
+
+namespace detail {
+
+/* FNV-1a, finalized like murmur3; must match c_hash() in docopt_c.py */
+constexpr std::uint32_t hash(std::string_view key, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+
+    for (char c : key)
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Perfect hash table built by docopt_c.py: a seed per bucket, then a slot
+   per key, which holds its index, or -1 */
+template <std::size_t Buckets, std::size_t Slots>
+struct Table {
+    std::array<int, Buckets> seeds;
+    std::array<int, Slots> slots;
+
+    constexpr int find(std::string_view key) const {
+        std::uint32_t h = hash(key, 0);
+
+        h = hash(key, static_cast<std::uint32_t>(seeds[h & (Buckets - 1)]));
+        return slots[h & (Slots - 1)];
+    }
+};
+
+/* Bit of the length of a key among the or-ed lengths of a table */
+constexpr unsigned long length_bit(std::size_t len) {
+    return 1UL << (len < 31 ? len : 31);
+}
+
+constexpr int lowest_bit(std::uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+
+    for (; !(bits & 1); bits >>= 1)
+        i++;
+    return i;
+#endif
+}
+
+constexpr bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+/* Decimal integer, with none of the locale or base handling of strtol() */
+constexpr Error parse_int(std::string_view s, long min, long max, long &value) {
+    bool negative = !s.empty() && s[0] == '-';
+    unsigned long limit = negative ? static_cast<unsigned long>(LONG_MAX) + 1 : static_cast<unsigned long>(LONG_MAX);
+    unsigned long n = 0;
+    std::size_t i = 0;
+
+    if (!s.empty() && (s[0] == '-' || s[0] == '+'))
+        i++;
+    if (i == s.size())
+        return Error::invalid_value;
+    for (; i < s.size(); i++) {
+        if (s[i] < '0' || s[i] > '9')
+            return Error::invalid_value;
+        unsigned d = static_cast<unsigned>(s[i] - '0');
+        if (n > (limit - d) / 10)
+            return Error::out_of_range;
+        n = n * 10 + d;
+    }
+    long x = negative && n > 0 ? -static_cast<long>(n - 1) - 1 : static_cast<long>(n);
+    if (x < min || x > max)
+        return Error::out_of_range;
+    value = x;
+    return Error::ok;
+}
+
+/* strtod() of `s` with the '.' swapped for the decimal point of the locale */
+inline Error parse_float_slow(std::string_view s, double &value) {
+    std::size_t point = s.find('.');
+    std::string copy(s.substr(0, point));
+    char *end = nullptr;
+
+    if (point != std::string_view::npos) {
+        copy += std::localeconv()->decimal_point;
+        copy += s.substr(point + 1);
+    }
+    errno = 0;
+    value = std::strtod(copy.c_str(), &end);
+    if (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL))
+        return Error::out_of_range;
+    return Error::ok;
+}
+
+/*
+ * Decimal number with an optional exponent.  When its digits fit in 2^53
+ * and its exponent is at most 22, both are exact doubles and one multiply
+ * or divide rounds correctly (Clinger's fast path), at compile time too.
+ * Longer numbers go to strtod().
+ */
+constexpr Error parse_float(std::string_view s, double &value) {
+    constexpr double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    std::uint64_t mantissa = 0;
+    std::size_t i = 0;
+    int digits = 0, exponent = 0, e = 0, sign = 1;
+    bool point = false, exact = true;
+
+    if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+        i++;
+    for (; i < s.size() && ((s[i] >= '0' && s[i] <= '9') || (s[i] == '.' && !point)); i++) {
+        if (s[i] == '.') {
+            point = true;
+            continue;
+        }
+        digits++;
+        if (mantissa > (UINT64_MAX - 9) / 10)
+            exact = false;
+        else
+            mantissa = mantissa * 10 + static_cast<unsigned>(s[i] - '0');
+        if (point)
+            exponent--;
+    }
+    if (digits == 0)
+        return Error::invalid_value;
+    if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+            sign = s[i++] == '-' ? -1 : 1;
+        if (i == s.size() || s[i] < '0' || s[i] > '9')
+            return Error::invalid_value;
+        for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++)
+            if (e < 10000)
+                e = e * 10 + (s[i] - '0');
+        exponent += sign * e;
+    }
+    if (i != s.size())
+        return Error::invalid_value;
+    if (exact && mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double x = static_cast<double>(mantissa);
+        x = exponent < 0 ? x / powers[-exponent] : x * powers[exponent];
+        value = s[0] == '-' ? -x : x;
+        return Error::ok;
+    }
+    return parse_float_slow(s, value);
+}
+
+/* Index of `s` among `choices`, found through their perfect hash table */
+template <std::size_t N, std::size_t Buckets, std::size_t Slots>
+constexpr Error parse_choice(std::string_view s, const std::array<std::string_view, N> &choices,
+                             const Table<Buckets, Slots> &table, int &value) {
+    int i = table.find(s);
+
+    if (i < 0 || choices[i] != s)
+        return Error::invalid_value;
+    value = i;
+    return Error::ok;
+}
+
+inline constexpr int n_commands = 7;
+inline constexpr int n_arguments = 3;
+inline constexpr int n_options = 5;
+inline constexpr int n_counters = 0;
+inline constexpr int n_lists = 0;
+inline constexpr int n_states = 18;
+inline constexpr int n_lines = 6;
+
+inline constexpr std::array<std::string_view, 7> command_names = {{
+    "create", "mine", "move", "remove", "set", "ship", "shoot"
+}};
+inline constexpr std::array<std::string_view, 5> option_shorts = {{
+    {}, "-h", {}, {}, {}
+}};
+inline constexpr std::array<std::string_view, 5> option_longs = {{
+    "--drifting", "--help", "--moored", "--version", "--speed"
+}};
+inline constexpr std::array<bool, 5> option_argcounts = {{
+    false, false, false, false, true
+}};
+inline constexpr std::array<int, 5> option_counters = {{
+    -1, -1, -1, -1, -1
+}};
+inline constexpr std::array<bool, 5> option_repeating = {{
+    false, false, false, false, false
+}};
+inline constexpr std::array<int, 5> long_unique = {{
+    3, 3, 3, 3, 3
+}};
+inline constexpr std::array<int, 5> long_sorted = {{
+    0, 1, 2, 4, 3
+}};
+inline constexpr std::array<int, 256> short_table = {{
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1
+}};
+inline constexpr std::array<int, 16> long_seeds = {{
+    1, 1, 0, 3, 2, 0, 6, 1, 1, 1, 1, 0, 1, 2, 12, 2
+}};
+inline constexpr std::array<int, 64> long_slots = {{
+    3, -1, 2, -1, 4, 2, -1, 4, -1, -1, -1, -1, -1, -1, -1, 0, 0, 3, -1, -1,
+    -1, 2, 3, 0, 2, 1, -1, -1, -1, 0, -1, -1, -1, 4, 3, -1, 0, -1, 2, -1,
+    -1, -1, -1, -1, 0, 3, 0, -1, 3, -1, 4, 1, 0, 1, -1, -1, 2, -1, -1, 1, 4,
+    -1, -1, 3
+}};
+inline constexpr Table<16, 64> long_table = {long_seeds, long_slots};
+inline constexpr std::array<int, 4> command_seeds = {{
+    4, 3, 1, 2
+}};
+inline constexpr std::array<int, 8> command_slots = {{
+    1, 5, 4, 3, -1, 6, 2, 0
+}};
+inline constexpr Table<4, 8> command_table = {command_seeds, command_slots};
+inline constexpr unsigned long command_lengths = 120UL;
+inline constexpr std::array<int, 18> command = {{
+    -1, 5, 0, -1, 5, -1, 2, -1, -1, 5, 6, -1, -1, 1, 4, 3, -1, -1
+}};
+inline constexpr std::array<int, 18> argument = {{
+    -1, -1, -1, 0, -1, 0, -1, 1, 2, -1, -1, 1, 2, -1, -1, -1, 1, 2
+}};
+inline constexpr std::array<int, 18> line = {{
+    -1, 0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3
+}};
+inline constexpr std::array<bool, 18> accepts = {{
+    false, false, false, true, false, false, false, false, true, false,
+    false, false, true, false, false, false, false, true
+}};
+inline constexpr std::array<int, 19> follow_start = {{
+    0, 4, 5, 6, 7, 8, 9, 10, 11, 11, 12, 13, 14, 14, 16, 17, 18, 19, 19
+}};
+inline constexpr std::array<int, 19> follow = {{
+    1, 4, 9, 13, 2, 3, 3, 5, 6, 7, 8, 10, 11, 12, 14, 15, 16, 16, 17
+}};
+inline constexpr std::array<int, 19> pred_start = {{
+    0, 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 19
+}};
+inline constexpr std::array<int, 19> pred = {{
+    0, 1, 2, 3, 0, 4, 5, 6, 7, 0, 9, 10, 11, 0, 13, 13, 14, 15, 16
+}};
+inline constexpr std::array<int, 7> allowed_start = {{
+    0, 0, 1, 1, 3, 4, 5
+}};
+inline constexpr std::array<int, 5> allowed = {{
+    4, 0, 2, 1, 3
+}};
+inline constexpr std::array<int, 7> required_start = {{
+    0, 0, 0, 0, 0, 1, 2
+}};
+inline constexpr std::array<int, 2> required = {{
+    1, 3
+}};
+inline constexpr std::array<int, 7> needed_start = {{
+    0, 0, 0, 0, 0, 0, 0
+}};
+inline constexpr std::array<int, 0> needed{};
+inline constexpr std::array<int, 7> exclusive_start = {{
+    0, 0, 0, 0, 3, 3, 3
+}};
+inline constexpr std::array<int, 3> exclusive = {{
+    2, 0, -1
+}};
+inline constexpr std::array<bool, 6> line_nullable = {{
+    false, false, false, false, true, true
+}};
+
+} /* namespace detail */
+
+/* MaxArgs of a Parser of any number of positional tokens */
+inline constexpr std::size_t unbounded = static_cast<std::size_t>(-1);
+
+/*
+ * Parser of command lines of at most MaxArgs positional tokens, or of any
+ * number, held on the heap, for MaxArgs = unbounded.  It holds all that
+ * parse() writes, the values of repeated arguments among them, so the Args
+ * it fills in stay valid for as long as the Parser and argv do, and until
+ * its next parse().  Default-constructed it handles --help and --version,
+ * unless told otherwise.
+ */
+template <std::size_t MaxArgs = 256>
+class Parser {
+public:
+    constexpr Parser() = default;
+    constexpr Parser(bool help, bool version) : help_(help), version_(version) {}
+
+    /* Whether the next parse() handles --help and --version */
+    constexpr void set_extras(bool help, bool version) {
+        help_ = help;
+        version_ = version;
+    }
+
+    constexpr Error parse(int argc, const char *const *argv, Args &args) {
+        Error ret = Error::ok;
+
+        reset();
+        args = Args{};
+        ret = parse_args(argc, argv);
+        if (ret == Error::ok)
+            ret = parse_extras();
+        if (ret == Error::ok)
+            ret = match_pattern();
+        if (ret == Error::ok)
+            ret = to_args(args);
+        if (ret != Error::ok)
+            args = Args{};
+        return ret;
+    }
+
+    /* The option or value the last parse() failed on */
+    constexpr std::string_view error_token() const {
+        return error_short_[0] != '\0' ? std::string_view(error_short_.data(), 2) : error_;
+    }
+
+private:
+    static constexpr std::size_t state_words = (detail::n_states + 63) / 64;
+    using States = std::array<std::uint64_t, state_words>;
+    template <typename T>
+    using Tokens = std::conditional_t<MaxArgs == unbounded, std::vector<T>,
+                                      std::array<T, MaxArgs == unbounded ? 0 : MaxArgs + 1>>;
+    /* for the values of options with an argument that may repeat, if any */
+    template <typename T>
+    using Values = std::conditional_t<detail::n_lists == 0, std::array<T, 1>, Tokens<T>>;
+
+    bool help_ = true;
+    bool version_ = true;
+    std::array<std::size_t, detail::n_commands + 1> commands_{};
+    std::array<bool, detail::n_options + 1> options_{};
+    std::array<std::string_view, detail::n_options + 1> option_arguments_{};
+    std::array<std::size_t, detail::n_counters + 1> counters_{};
+    std::array<int, detail::n_arguments + 1> offsets_{};
+    std::array<int, detail::n_arguments + 1> counts_{};
+    Tokens<std::string_view> positional_{};
+    Tokens<States> trail_{};
+    Tokens<int> bound_{};                   /* per positional token: its argument, or -1 */
+    Tokens<std::string_view> spare_{};      /* for sort_values() */
+    Values<std::string_view> values_{};     /* per value of such an option, */
+    Values<int> value_options_{};           /* the option it is of, */
+    Values<std::string_view> lists_{};      /* and by option, see sort_lists() */
+    std::array<int, detail::n_counters + 1> list_offsets_{};
+    int n_values_ = 0;
+    int n_given_ = 0;
+    int n_positional_ = 0;
+    int separator_ = -1;                    /* the positional token that is the "--" ending options, or -1 */
+    std::string_view error_{};
+    std::array<char, 2> error_short_{};
+
+    constexpr void reset() {
+        for (int i = 0; i < detail::n_commands; i++)
+            commands_[i] = 0;
+        for (int i = 0; i < detail::n_options; i++) {
+            options_[i] = false;
+            option_arguments_[i] = std::string_view();
+        }
+        for (int i = 0; i < detail::n_counters; i++)
+            counters_[i] = 0;
+        for (int i = 0; i < detail::n_arguments; i++)
+            offsets_[i] = counts_[i] = 0;
+        n_values_ = n_given_ = n_positional_ = 0;
+        separator_ = -1;
+        error_ = std::string_view();
+        error_short_[0] = '\0';
+        if constexpr (MaxArgs == unbounded) {
+            if (trail_.empty())
+                trail_.resize(1);
+        }
+    }
+
+    /*
+     * Options
+     */
+
+    /* An option given again matches no usage line unless one repeats it */
+    constexpr Error option_given(int i) {
+        if (options_[i] && !detail::option_repeating[i]) {
+            error_ = detail::option_longs[i].empty() ? detail::option_shorts[i] : detail::option_longs[i];
+            return Error::no_match;
+        }
+        if (!options_[i]) {
+            options_[i] = true;
+            n_given_++;
+        }
+        if (detail::option_counters[i] >= 0)
+            counters_[detail::option_counters[i]]++;
+        return Error::ok;
+    }
+
+    /* The argument of option i, of which those that may repeat keep every one */
+    constexpr Error option_argument(int i, std::string_view value) {
+        option_arguments_[i] = value;
+        if constexpr (detail::n_lists > 0) {
+            if (detail::option_counters[i] < 0)
+                return Error::ok;
+            if constexpr (MaxArgs == unbounded) {
+                if (static_cast<std::size_t>(n_values_) == values_.size()) {
+                    values_.resize(2 * values_.size() + 16);
+                    value_options_.resize(values_.size());
+                    lists_.resize(values_.size());
+                }
+            } else if (static_cast<std::size_t>(n_values_) == MaxArgs) {
+                error_ = value;
+                return Error::too_many_arguments;
+            }
+            values_[n_values_] = value;
+            value_options_[n_values_++] = i;
+        }
+        return Error::ok;
+    }
+
+    /*
+     * Option that `name` spells or abbreviates, -1 if none does, -2 if it
+     * is the prefix of several.  long_table holds each long name and its
+     * prefixes that are at least long_unique[] long, which no other name
+     * starts with, so one lookup resolves both.
+     */
+    constexpr int find_long(std::string_view name) const {
+        int i = detail::long_table.find(name);
+        int found = 0;
+
+        if (i >= 0 && detail::starts_with(detail::option_longs[i], name)
+                && (detail::option_longs[i].size() == name.size()
+                    || name.size() >= static_cast<std::size_t>(detail::long_unique[i])))
+            return i;
+        for (int o : detail::long_sorted)
+            found += detail::starts_with(detail::option_longs[o], name);
+        return found > 1 ? -2 : -1;
+    }
+
+    constexpr Error parse_long(std::string_view token, int argc, const char *const *argv, int &k) {
+        std::size_t eq = token.find('=');
+        int i = find_long(token.substr(0, eq));
+
+        if (i < 0) {
+            error_ = token;
+            return i == -2 ? Error::ambiguous_option : Error::unknown_option;
+        }
+        if (detail::option_argcounts[i]) {
+            if (eq == std::string_view::npos) {
+                if (k + 1 >= argc) {
+                    error_ = detail::option_longs[i];
+                    return Error::missing_argument;
+                }
+                if (Error ret = option_argument(i, argv[++k]); ret != Error::ok)
+                    return ret;
+            } else if (Error ret = option_argument(i, token.substr(eq + 1)); ret != Error::ok) {
+                return ret;
+            }
+        } else if (eq != std::string_view::npos) {
+            error_ = detail::option_longs[i];
+            return Error::unexpected_argument;
+        }
+        return option_given(i);
+    }
+
+    constexpr Error parse_shorts(std::string_view token, int argc, const char *const *argv, int &k) {
+        for (std::size_t j = 1; j < token.size(); j++) {
+            int i = detail::short_table[static_cast<unsigned char>(token[j])];
+
+            if (i < 0) {
+                error_short_[0] = '-';
+                error_short_[1] = token[j];
+                return Error::unknown_option;
+            }
+            if (Error ret = option_given(i); ret != Error::ok)
+                return ret;
+            if (detail::option_argcounts[i]) {
+                if (j + 1 < token.size())
+                    return option_argument(i, token.substr(j + 1));
+                if (k + 1 < argc)
+                    return option_argument(i, argv[++k]);
+                error_ = detail::option_shorts[i];
+                return Error::missing_argument;
+            }
+        }
+        return Error::ok;
+    }
+
+    /* Whether it is a command or an argument is up to match_pattern() */
+    constexpr Error positional(std::string_view token) {
+        if constexpr (MaxArgs == unbounded) {
+            if (static_cast<std::size_t>(n_positional_) == positional_.size()) {
+                positional_.resize(2 * positional_.size() + 16);
+                trail_.resize(positional_.size() + 1);
+                bound_.resize(positional_.size());
+                spare_.resize(positional_.size());
+            }
+        } else if (static_cast<std::size_t>(n_positional_) == MaxArgs) {
+            error_ = token;
+            return Error::too_many_arguments;
+        }
+        positional_[n_positional_++] = token;
+        return Error::ok;
+    }
+
+    constexpr Error parse_args(int argc, const char *const *argv) {
+        Error ret = Error::ok;
+
+        for (int k = 1; k < argc && ret == Error::ok; k++) {
+            std::string_view token = argv[k];
+
+            if (token == "--") {
+                /* "--" and all that follows are positional, the "--" itself
+                   only matches a [--] in the usage section, when there is one */
+                separator_ = n_positional_;
+                for (; k < argc && ret == Error::ok; k++)
+                    ret = positional(argv[k]);
+                break;
+            } else if (token.size() > 1 && token[0] == '-' && token[1] == '-') {
+                ret = parse_long(token, argc, argv, k);
+            } else if (token.size() > 1 && token[0] == '-') {
+                ret = parse_shorts(token, argc, argv, k);
+            } else {
+                ret = positional(token);
+            }
+        }
+        return ret;
+    }
+
+    constexpr Error parse_extras() {
+        for (int i = 0; i < detail::n_options; i++) {
+            if (detail::option_argcounts[i] || !options_[i])
+                continue;
+            if (help_ && detail::option_longs[i] == "--help") {
+                error_ = detail::option_longs[i];
+                return Error::help;
+            } else if (version_ && detail::option_longs[i] == "--version") {
+                error_ = detail::option_longs[i];
+                return Error::version;
+            }
+        }
+        return Error::ok;
+    }
+
+    /*
+     * Usage pattern matching
+     */
+
+    constexpr int find_command(std::string_view name) const {
+        /* arguments, the other positional tokens, are rarely that long */
+        if (!(detail::command_lengths & detail::length_bit(name.size())))
+            return -1;
+        int i = detail::command_table.find(name);
+        return i >= 0 && detail::command_names[i] == name ? i : -1;
+    }
+
+    /* Whether the options given on the command line are the ones `line` takes */
+    constexpr bool match_options(int line) const {
+        int n_allowed = 0;
+        int n_group = 0;
+
+        for (int i = detail::required_start[line]; i < detail::required_start[line + 1]; i++)
+            if (!options_[detail::required[i]])
+                return false;
+        for (int i = detail::needed_start[line]; i < detail::needed_start[line + 1]; i++) {
+            if (detail::needed[i] < 0) {
+                if (n_group == 0)
+                    return false;
+                n_group = 0;
+                continue;
+            }
+            n_group += options_[detail::needed[i]];
+        }
+        for (int i = detail::exclusive_start[line]; i < detail::exclusive_start[line + 1]; i++) {
+            if (detail::exclusive[i] < 0) {
+                n_group = 0;
+                continue;
+            }
+            if (options_[detail::exclusive[i]] && ++n_group > 1)
+                return false;
+        }
+        for (int i = detail::allowed_start[line]; i < detail::allowed_start[line + 1]; i++)
+            n_allowed += options_[detail::allowed[i]];
+        return n_given_ == n_allowed;
+    }
+
+    /* Record that positional token `k` was consumed by entering `state`;
+       whether other tokens sit between it and the later values of its argument */
+    constexpr bool bind_token(int k, int state) {
+        bound_[k] = -1;
+        if (detail::command[state] >= 0) {
+            commands_[detail::command[state]]++;
+            return false;
+        }
+        int a = bound_[k] = detail::argument[state];
+        bool apart = counts_[a] > 0 && offsets_[a] != k + 1;
+        offsets_[a] = k;
+        counts_[a]++;
+        return apart;
+    }
+
+    /* Make the values of each argument one run, in their order, by one stable
+       counting sort by argument, as sort_values() of the C parser */
+    constexpr void sort_values() {
+        int at = 0;
+
+        for (int k = 0; k < n_positional_; k++)
+            if (bound_[k] < 0)
+                spare_[at++] = positional_[k];
+        for (int a = 0; a < detail::n_arguments; a++) {
+            offsets_[a] = at;
+            at += counts_[a];
+        }
+        for (int k = 0; k < n_positional_; k++)
+            if (bound_[k] >= 0)
+                spare_[offsets_[bound_[k]]++] = positional_[k];
+        for (int a = 0; a < detail::n_arguments; a++)
+            offsets_[a] -= counts_[a];
+        for (int k = 0; k < n_positional_; k++)
+            positional_[k] = spare_[k];
+    }
+
+    /*
+     * Run the positional tokens through the automaton, keeping the set of
+     * states reached after each of them, then walk back from an accepting
+     * state along the trail to bind them.
+     */
+    constexpr Error match_pattern() {
+        int state = -1;
+
+        trail_[0] = States{};
+        trail_[0][0] = 1;
+        for (int k = 0; k < n_positional_; k++) {
+            int command = find_command(positional_[k]);
+            /* the "--" ending options only matches the [--] of the usage, if it has one */
+            bool separator = k == separator_ && command >= 0;
+            const States &set = trail_[k];
+            States &next = trail_[k + 1];
+            bool reached = false;
+
+            next = States{};
+            for (std::size_t w = 0; w < state_words; w++) {
+                for (std::uint64_t bits = set[w]; bits != 0; bits &= bits - 1) {
+                    int q = static_cast<int>(w * 64) + detail::lowest_bit(bits);
+                    for (int j = detail::follow_start[q]; j < detail::follow_start[q + 1]; j++) {
+                        int p = detail::follow[j];
+                        if (detail::command[p] == command || (detail::command[p] < 0 && !separator)) {
+                            next[p / 64] |= std::uint64_t(1) << (p % 64);
+                            reached = true;
+                        }
+                    }
+                }
+            }
+            if (!reached)
+                return Error::no_match;
+        }
+        if (n_positional_ == 0) {
+            for (int line = 0; line < detail::n_lines; line++)
+                if (detail::line_nullable[line] && match_options(line))
+                    return Error::ok;
+            return Error::no_match;
+        }
+        const States &last = trail_[n_positional_];
+        for (int p = 1; p < detail::n_states && state < 0; p++)
+            if ((last[p / 64] >> (p % 64) & 1) && detail::accepts[p] && match_options(detail::line[p]))
+                state = p;
+        if (state < 0)
+            return Error::no_match;
+        bool apart = false;
+        for (int k = n_positional_ - 1; k >= 0; k--) {
+            if (bind_token(k, state))
+                apart = true;
+            int j = detail::pred_start[state];
+            while (!(trail_[k][detail::pred[j] / 64] >> (detail::pred[j] % 64) & 1))
+                j++;
+            state = detail::pred[j];
+        }
+        if (apart)
+            sort_values();
+        return Error::ok;
+    }
+
+    /* Make the values of each option with an argument that may repeat one
+       run of lists_, in the order given, as store_lists() of the C parser */
+    constexpr void sort_lists() {
+        int at = 0;
+
+        for (int i = 0; i < detail::n_options; i++) {
+            if (detail::option_argcounts[i] && detail::option_counters[i] >= 0) {
+                list_offsets_[detail::option_counters[i]] = at;
+                at += static_cast<int>(counters_[detail::option_counters[i]]);
+            }
+        }
+        for (int m = 0; m < n_values_; m++)
+            lists_[list_offsets_[detail::option_counters[value_options_[m]]]++] = values_[m];
+        for (int i = 0; i < detail::n_options; i++)
+            if (detail::option_argcounts[i] && detail::option_counters[i] >= 0)
+                list_offsets_[detail::option_counters[i]] -= static_cast<int>(counters_[detail::option_counters[i]]);
+    }
+
+    /* Fill in `args`, each field from what the spec says of it */
+    constexpr Error to_args(Args &args) {
+        /* options */
+        args.drifting = options_[0];
+        args.help = options_[1];
+        args.moored = options_[2];
+        args.version = options_[3];
+        if (option_arguments_[4].data() != nullptr)
+            args.speed = option_arguments_[4];
+        /* commands */
+        args.create = commands_[0] != 0;
+        args.mine = commands_[1] != 0;
+        args.move = commands_[2] != 0;
+        args.remove = commands_[3] != 0;
+        args.set = commands_[4] != 0;
+        args.ship = commands_[5] != 0;
+        args.shoot = commands_[6] != 0;
+        /* arguments */
+        args.name = Strings(&positional_[offsets_[0]], counts_[0]);
+        if (counts_[1] > 0)
+            args.x = positional_[offsets_[1]];
+        if (counts_[2] > 0)
+            args.y = positional_[offsets_[2]];
+        return Error::ok;
+    }
+
+    /* Typed option i has a value that is not of its type */
+    constexpr Error invalid(int i, Error ret) {
+        error_ = detail::option_longs[i].empty() ? detail::option_shorts[i] : detail::option_longs[i];
+        return ret;
+    }
+
+    constexpr Error store_int(int i, long min, long max, long &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_int(option_arguments_[i], min, max, value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+
+    constexpr Error store_float(int i, double &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_float(option_arguments_[i], value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+
+    template <std::size_t N, std::size_t Buckets, std::size_t Slots>
+    constexpr Error store_choice(int i, const std::array<std::string_view, N> &choices,
+                                 const detail::Table<Buckets, Slots> &table, int &value) {
+        Error ret = Error::ok;
+
+        if (option_arguments_[i].data() != nullptr)
+            ret = detail::parse_choice(option_arguments_[i], choices, table, value);
+        return ret == Error::ok ? ret : invalid(i, ret);
+    }
+};
+
+/* Report what made Parser::parse() fail, or the help or version asked for,
+   and exit; without fprintf(), as docopt_exit() of the C parser */
+template <std::size_t MaxArgs>
+[[noreturn]] void docopt_exit(const Parser<MaxArgs> &parser, Error ret, std::string_view version) {
+    std::string_view token = parser.error_token();
+    const char *what = "";
+
+    switch (ret) {
+    case Error::ok:
+        std::exit(EXIT_SUCCESS);
+    case Error::help:
+        std::printf("%.*s\n", static_cast<int>(help_message.size()), help_message.data());
+        std::exit(EXIT_SUCCESS);
+    case Error::version:
+        std::printf("%.*s\n", static_cast<int>(version.size()), version.data());
+        std::exit(EXIT_SUCCESS);
+    case Error::no_match:
+        std::fwrite(usage_pattern.data(), 1, usage_pattern.size(), stderr);
+        std::fputs("\n", stderr);
+        std::exit(EXIT_FAILURE);
+    case Error::unknown_option: what = " is not recognized\n"; break;
+    case Error::missing_argument: what = " requires argument\n"; break;
+    case Error::unexpected_argument: what = " must not have an argument\n"; break;
+    case Error::too_many_arguments: what = " is one argument too many\n"; break;
+    case Error::invalid_value: what = " has an invalid value\n"; break;
+    case Error::out_of_range: what = " is out of range\n"; break;
+    case Error::ambiguous_option: what = " is not a unique prefix\n"; break;
+    }
+    std::fwrite(token.data(), 1, token.size(), stderr);
+    std::fputs(what, stderr);
+    std::exit(EXIT_FAILURE);
+}
+
+/* Parse argv as main() gets it, of any length, exiting on --help, --version
+   or an error; the values of repeated arguments live until the next call */
+inline Args docopt(int argc, const char *const *argv, bool help = true, std::string_view version = {}) {
+    static Parser<unbounded> parser;
+    Args args;
+    Error ret;
+
+    parser.set_extras(help, version.data() != nullptr);
+    if (argc == 1 && help) {
+        std::printf("%.*s\n", static_cast<int>(help_message.size()), help_message.data());
+        std::exit(EXIT_FAILURE);
+    }
+    ret = parser.parse(argc, argv, args);
+    if (ret != Error::ok)
+        docopt_exit(parser, ret, version);
+    return args;
+}
+
+} /* namespace docopt */
+
+#endif
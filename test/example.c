@@ -1,8 +1,12 @@
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "docopt.h"
 
 int main(int argc, char *argv[])
 {
     struct DocoptArgs args = docopt(argc, argv, /* help */ 1, /* version */ "2.0rc2");
+    size_t i;
 
     puts("Commands");
     printf("\tmine == %s\n", args.mine ? "true" : "false");
@@ -13,6 +17,8 @@ int main(int argc, char *argv[])
     printf("\tship == %s\n", args.ship ? "true" : "false");
     printf("\tshoot == %s\n", args.shoot ? "true" : "false");
     puts("Arguments");
+    for (i = 0; i < args.name.count; i++)
+        printf("\tname[%lu] == %s\n", (unsigned long) i, args.name.items[i]);
     printf("\tx == %s\n", args.x);
     printf("\ty == %s\n", args.y);
     puts("Flags");
@@ -1,3 +1,12 @@
+/* mkstemp() */
+#define _POSIX_C_SOURCE 200809L
+#define DOCOPT_THREADS
+#define DOCOPT_BLOCK_BYTES 64
+#define DOCOPT_TRACE
+#define DOCOPT_RESPONSE_FILES
+/* the example has no typed options, whose code is tested all the same */
+#define DOCOPT_HAS_TYPES 1
+
 #include "docopt.c"
 
 #define assert(x) \
@@ -6,13 +15,16 @@
     else \
         printf("\n[%s, line %d] test failed", __FILE__, __LINE__)
 
+/* Tokens.spare of the tests below, none of which has more words */
+char *spare[8];
+
  /*
   * TokenStream
   */
 
 int test_tokens(void) {
     char *argv[] = {"prog", "-o", "12"};
-    Tokens ts = tokens_new(3, argv);
+    struct Tokens ts = tokens_new(3, argv, spare);
 
     assert(!strcmp(ts.current, "prog"));
     tokens_move(&ts);
@@ -31,108 +43,145 @@ int test_tokens(void) {
 int test_parse_shorts_1(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"-a"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {"-a", NULL, false, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {"-a"};
+    const char *longs[] = {NULL};
+    bool argcounts[] = {false};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_shorts(&ts, &elements);
-    option = options[0];
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(option.oshort, "-a"));
-    assert(option.olong == NULL);
-    assert(option.argcount == false);
-    assert(option.value == true);
-    assert(option.argument == NULL);
+    assert(SET_HAS(options, 0));
+    assert(arguments[0] == NULL);
     return EXIT_SUCCESS;
 }
 
 int test_parse_shorts_2(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"-ab"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {"-a", NULL, false, false, NULL},
-        {"-b", NULL, false, false, NULL}
-    };
-    struct Option option1, option2;
-    struct Elements elements = {0, 0, 2, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {"-a", "-b"};
+    const char *longs[] = {NULL, NULL};
+    bool argcounts[] = {false, false};
+    struct Spec spec = {0, 0, 2, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[2] = {NULL, NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_shorts(&ts, &elements);
-    option1 = options[0];
-    option2 = options[1];
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(option1.oshort, "-a"));
-    assert(option1.value == true);
-    assert(!strcmp(option2.oshort, "-b"));
-    assert(option2.value == true);
+    assert(SET_HAS(options, 0));
+    assert(SET_HAS(options, 1));
     return EXIT_SUCCESS;
 }
 
 int test_parse_shorts_3(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"-b"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {"-a", NULL, false, false, NULL},
-        {"-b", NULL, false, false, NULL}
-    };
-    struct Option option1, option2;
-    struct Elements elements = {0, 0, 2, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {"-a", "-b"};
+    const char *longs[] = {NULL, NULL};
+    bool argcounts[] = {false, false};
+    struct Spec spec = {0, 0, 2, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[2] = {NULL, NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_shorts(&ts, &elements);
-    option1 = options[0];
-    option2 = options[1];
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(option1.oshort, "-a"));
-    assert(option1.value == false);
-    assert(!strcmp(option2.oshort, "-b"));
-    assert(option2.value == true);
+    assert(!SET_HAS(options, 0));
+    assert(SET_HAS(options, 1));
     return EXIT_SUCCESS;
 }
 
 int test_parse_shorts_4(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"-aARG"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {"-a", NULL, true, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {"-a"};
+    const char *longs[] = {NULL};
+    bool argcounts[] = {true};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_shorts(&ts, &elements);
-    option = options[0];
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(option.oshort, "-a"));
-    assert(option.value == false);
-    assert(!strcmp(option.argument, "ARG"));
+    assert(SET_HAS(options, 0));
+    assert(!strcmp(arguments[0], "ARG"));
     return EXIT_SUCCESS;
 }
 
 int test_parse_shorts_5(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"-a", "ARG"};
-    struct Tokens ts = tokens_new(2, argv);
-    struct Option options[] = {
-        {"-a", NULL, true, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(2, argv, spare);
+    const char *shorts[] = {"-a"};
+    const char *longs[] = {NULL};
+    bool argcounts[] = {true};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_shorts(&ts, &elements);
-    option = options[0];
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(option.oshort, "-a"));
-    assert(option.value == false);
-    assert(!strcmp(option.argument, "ARG"));
+    assert(SET_HAS(options, 0));
+    assert(!strcmp(arguments[0], "ARG"));
+    return EXIT_SUCCESS;
+}
+
+int test_parse_shorts_6(void) {
+    int ret = EXIT_SUCCESS;
+    char *argv[] = {"-h"};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    /* the spec of example.docopt, through its short_table */
+    unsigned long options[1] = {0};
+    const char *arguments[5] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
+
+    assert(short_table['h'] == 1);
+    assert(short_table['x'] == -1);
+    ret = parse_shorts(&ts, &elements);
+    assert(!ret);
+    if (ret) return ret;
+    assert(SET_HAS(options, 1));
+    assert(!SET_HAS(options, 0));
+    return EXIT_SUCCESS;
+}
+
+int test_parse_shorts_7(void) {
+    int ret = EXIT_SUCCESS;
+    char *argv[] = {"-vqv", "-v"};
+    struct Tokens ts = tokens_new(2, argv, spare);
+    const char *shorts[] = {"-q", "-v"};
+    const char *longs[] = {NULL, NULL};
+    bool argcounts[] = {false, false};
+    int option_counters[] = {-1, 0};
+    struct Spec spec = {0, 0, 2, NULL, NULL, NULL, NULL, shorts, longs, argcounts, NULL, option_counters};
+    unsigned long options[1] = {0};
+    const char *arguments[2] = {NULL, NULL};
+    int counters[1] = {0};
+    struct Elements elements = {&spec, NULL, options, arguments, NULL, NULL, counters};
+
+    while (ts.current != NULL) {
+        ret = parse_shorts(&ts, &elements);
+        assert(!ret);
+        if (ret) return ret;
+    }
+    /* -v may repeat, so it is counted */
+    assert(SET_HAS(options, 0));
+    assert(SET_HAS(options, 1));
+    assert(counters[0] == 3);
     return EXIT_SUCCESS;
 }
 
@@ -143,96 +192,153 @@ int test_parse_shorts_5(void) {
 int test_parse_long_1(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"--all"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {NULL, "--all", false, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {NULL};
+    const char *longs[] = {"--all"};
+    bool argcounts[] = {false};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_long(&ts, &elements);
-    option = options[0];
     assert(!ret);
     if (ret) return ret;
-    assert(option.oshort == NULL);
-    assert(!strcmp(option.olong, "--all"));
-    assert(option.argcount == false);
-    assert(option.value == true);
-    assert(option.argument == NULL);
+    assert(SET_HAS(options, 0));
+    assert(arguments[0] == NULL);
     return EXIT_SUCCESS;
 }
 
 int test_parse_long_2(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"--all"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {NULL, "--all", false, false, NULL},
-        {NULL, "--not", false, false, NULL}
-    };
-    struct Option option1;
-    struct Option option2;
-    struct Elements elements = {0, 0, 2, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {NULL, NULL};
+    const char *longs[] = {"--all", "--not"};
+    bool argcounts[] = {false, false};
+    struct Spec spec = {0, 0, 2, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[2] = {NULL, NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_long(&ts, &elements);
-    option1 = options[0];
-    option2 = options[1];
     assert(!ret);
     if (ret) return ret;
-    assert(option1.oshort == NULL);
-    assert(!strcmp(option1.olong, "--all"));
-    assert(option1.argcount == false);
-    assert(option1.value == true);
-    assert(option1.argument == NULL);
-    assert(option2.oshort == NULL);
-    assert(!strcmp(option2.olong, "--not"));
-    assert(option2.argcount == false);
-    assert(option2.value == false);
-    assert(option2.argument == NULL);
+    assert(SET_HAS(options, 0));
+    assert(arguments[0] == NULL);
+    assert(!SET_HAS(options, 1));
+    assert(arguments[1] == NULL);
     return EXIT_SUCCESS;
 }
 
 int test_parse_long_3(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"--all=ARG"};
-    struct Tokens ts = tokens_new(1, argv);
-    struct Option options[] = {
-        {NULL, "--all", true, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(1, argv, spare);
+    const char *shorts[] = {NULL};
+    const char *longs[] = {"--all"};
+    bool argcounts[] = {true};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_long(&ts, &elements);
-    option = options[0];
     assert(!ret);
     if (ret) return ret;
-    assert(option.oshort == NULL);
-    assert(!strcmp(option.olong, "--all"));
-    assert(option.argcount == true);
-    assert(option.value == false);
-    assert(!strcmp(option.argument, "ARG"));
+    assert(SET_HAS(options, 0));
+    assert(!strcmp(arguments[0], "ARG"));
     return EXIT_SUCCESS;
 }
 
 int test_parse_long_4(void) {
     int ret = EXIT_SUCCESS;
     char *argv[] = {"--all", "ARG"};
-    struct Tokens ts = tokens_new(2, argv);
-    struct Option options[] = {
-        {NULL, "--all", true, false, NULL}
-    };
-    struct Option option;
-    struct Elements elements = {0, 0, 1, NULL, NULL, options};
+    struct Tokens ts = tokens_new(2, argv, spare);
+    const char *shorts[] = {NULL};
+    const char *longs[] = {"--all"};
+    bool argcounts[] = {true};
+    struct Spec spec = {0, 0, 1, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
+
+    ret = parse_long(&ts, &elements);
+    assert(!ret);
+    if (ret) return ret;
+    assert(SET_HAS(options, 0));
+    assert(!strcmp(arguments[0], "ARG"));
+    return EXIT_SUCCESS;
+}
+
+int test_parse_long_5(void) {
+    int ret = EXIT_SUCCESS;
+    char *argv[] = {"--speed=20", "--mo", "--version"};
+    struct Tokens ts = tokens_new(3, argv, spare);
+    /* the spec of example.docopt, through its long_table */
+    unsigned long options[1] = {0};
+    const char *arguments[5] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
+
+    assert(table_find(&long_table, "--speed", 7) == 4);
+    assert(table_find(&long_table, "--drifting", 10) == 0);
+    while (ts.current != NULL) {
+        ret = parse_long(&ts, &elements);
+        assert(!ret);
+        if (ret) return ret;
+    }
+    assert(!strcmp(arguments[4], "20"));
+    assert(SET_HAS(options, 2));
+    assert(SET_HAS(options, 3));
+    assert(!SET_HAS(options, 0));
+    return EXIT_SUCCESS;
+}
+
+int test_parse_long_6(void) {
+    int ret = EXIT_SUCCESS;
+    char *argv[] = {"--mo", "--foo", "--foob", "--fo"};
+    struct Tokens ts = tokens_new(4, argv, spare);
+    const char *shorts[] = {NULL, NULL, NULL, NULL};
+    const char *longs[] = {"--moored", "--mode", "--foo", "--foobar"};
+    bool argcounts[] = {false, false, false, false};
+    struct Spec spec = {0, 0, 4, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[4] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
 
     ret = parse_long(&ts, &elements);
-    option = options[0];
+    assert(ret == DOCOPT_AMBIGUOUS_OPTION);
+    assert(!strcmp(elements.error, "--mo"));
+    tokens_move(&ts);
+    ret = parse_long(&ts, &elements);
+    assert(!ret);
+    ret = parse_long(&ts, &elements);
     assert(!ret);
     if (ret) return ret;
-    assert(option.oshort == NULL);
-    assert(!strcmp(option.olong, "--all"));
-    assert(option.argcount == true);
-    assert(option.value == false);
-    assert(!strcmp(option.argument, "ARG"));
+    assert(SET_HAS(options, 2));
+    assert(SET_HAS(options, 3));
+    assert(!SET_HAS(options, 0));
+    ret = parse_long(&ts, &elements);
+    assert(ret == DOCOPT_AMBIGUOUS_OPTION);
+    return EXIT_SUCCESS;
+}
+
+int test_parse_long_7(void) {
+    /* the spec of example.docopt, where long_table holds abbreviations */
+    unsigned long options[1] = {0};
+    const char *arguments[5] = {NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
+
+    assert(spec.long_unique[0] == 3);
+    assert(find_long(&elements, "--d", 3) == 0);
+    assert(find_long(&elements, "--drifting", 10) == 0);
+    assert(find_long(&elements, "--vers=1", 6) == 3);
+    assert(find_long(&elements, "--x", 3) == -1);
+    assert(find_long(&elements, "--driftingx", 11) == -1);
+    assert(long_candidates(&elements, "--", 2) == 5);
+    assert(elements.candidates[0] == 0 && elements.candidates[1] == 5);
+    assert(long_candidates(&elements, "--s", 3) == 1);
+    assert(!strcmp(spec.option_longs[spec.long_sorted[elements.candidates[0]]], "--speed"));
     return EXIT_SUCCESS;
 }
 
@@ -241,55 +347,685 @@ int test_parse_long_4(void) {
   */
 
 int test_parse_args_1(void) {
-    struct Command commands[] = {};
-    struct Argument arguments[] = {};
-    struct Option options[] = {
-        {NULL, "--all", false, false, NULL},
-        {"-b", NULL, false, false, NULL},
-        {"-W", NULL, true, false, NULL}
-    };
-    struct Elements elements = {0, 0, 3, commands, arguments, options};
+    const char *shorts[] = {NULL, "-b", "-W"};
+    const char *longs[] = {"--all", NULL, NULL};
+    bool argcounts[] = {false, false, true};
+    struct Spec spec = {0, 0, 3, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[3] = {NULL, NULL, NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
     char *argv[] = {"--all", "-b", "ARG"};
-    struct Tokens ts = tokens_new(3, argv);
+    struct Tokens ts = tokens_new(3, argv, spare);
     int ret;
 
     ret = parse_args(&ts, &elements);
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(options[0].olong, "--all"));
-    assert(options[0].value == true);
-    assert(!strcmp(options[1].oshort, "-b"));
-    assert(options[1].value == true);
-    assert(!strcmp(options[2].oshort, "-W"));
-    assert(options[2].argument == NULL);
+    assert(SET_HAS(options, 0));
+    assert(SET_HAS(options, 1));
+    assert(!SET_HAS(options, 2));
+    assert(arguments[2] == NULL);
     return EXIT_SUCCESS;
 }
 
 int test_parse_args_2(void) {
-    struct Command commands[] = {};
-    struct Argument arguments[] = {};
-    struct Option options[] = {
-        {NULL, "--all", false, false, NULL},
-        {"-b", NULL, false, false, NULL},
-        {"-W", NULL, true, false, NULL}
-    };
-    struct Elements elements = {0, 0, 3, commands, arguments, options};
+    const char *shorts[] = {NULL, "-b", "-W"};
+    const char *longs[] = {"--all", NULL, NULL};
+    bool argcounts[] = {false, false, true};
+    struct Spec spec = {0, 0, 3, NULL, NULL, NULL, NULL, shorts, longs, argcounts};
+    unsigned long options[1] = {0};
+    const char *arguments[3] = {NULL, NULL, NULL};
+    struct Elements elements = {&spec, NULL, options, arguments};
     char *argv[] = {"ARG", "-Wall"};
-    struct Tokens ts = tokens_new(2, argv);
+    struct Tokens ts = tokens_new(2, argv, spare);
     int ret;
 
     ret = parse_args(&ts, &elements);
     assert(!ret);
     if (ret) return ret;
-    assert(!strcmp(options[0].olong, "--all"));
-    assert(options[0].value == false);
-    assert(!strcmp(options[1].oshort, "-b"));
-    assert(options[1].value == false);
-    assert(!strcmp(options[2].oshort, "-W"));
-    assert(!strcmp(options[2].argument, "all"));
+    assert(!SET_HAS(options, 0));
+    assert(!SET_HAS(options, 1));
+    assert(SET_HAS(options, 2));
+    assert(!strcmp(arguments[2], "all"));
     return 0;
 }
 
+int test_parse_args_3(void) {
+    const char *names[] = {"ship"};
+    bool repeating[] = {true};
+    const char *shorts[] = {NULL};
+    const char *longs[] = {"--all"};
+    bool argcounts[] = {false};
+    struct Spec spec = {1, 1, 1, names, NULL, repeating, NULL, shorts, longs, argcounts};
+    unsigned long commands[1] = {0};
+    unsigned long options[1] = {0};
+    const char *arguments[1] = {NULL};
+    int offsets[1] = {0};
+    int counts[1] = {0};
+    struct Elements elements = {&spec, commands, options, arguments, offsets, counts};
+    char *argv[] = {"ship", "a", "--all", "b", "--", "-c"};
+    struct Tokens ts = tokens_new(6, argv, spare);
+    int ret;
+
+    ret = parse_args(&ts, &elements);
+    assert(!ret);
+    if (ret) return ret;
+    assert(SET_HAS(options, 0));
+    assert(ts.n_positional == 5);
+    /* positional values are gathered at the front, argv is only permuted */
+    assert(!strcmp(argv[0], "ship"));
+    assert(!strcmp(argv[1], "a"));
+    assert(!strcmp(argv[2], "b"));
+    assert(!strcmp(argv[3], "--"));
+    assert(!strcmp(argv[4], "-c"));
+    assert(!strcmp(argv[5], "--all"));
+    return EXIT_SUCCESS;
+}
+
+ /*
+  * match_pattern, against the usage section of example.docopt
+  */
+
+unsigned long example_commands[1];
+unsigned long example_options[1];
+const char *example_arguments[5];
+int example_offsets[3];
+int example_counts[3];
+int example_bound[8];
+struct Trail example_trail = {0, 0, 0, NULL, NULL};
+
+int example_match(int argc, char *argv[]) {
+    struct Elements elements = {&spec, example_commands, example_options, example_arguments,
+                                example_offsets, example_counts, NULL, example_bound};
+    struct Tokens ts = tokens_new(argc, argv, spare);
+
+    memset(example_commands, 0, sizeof(example_commands));
+    memset(example_options, 0, sizeof(example_options));
+    memset(example_arguments, 0, sizeof(example_arguments));
+    memset(example_counts, 0, sizeof(example_counts));
+    if (parse_args(&ts, &elements))
+        return EXIT_FAILURE;
+    return match_pattern(&ts, &elements, &example_trail);
+}
+
+int test_match_pattern_1(void) {
+    char *argv[] = {"ship", "create", "a", "b"};
+    int ret;
+
+    ret = example_match(4, argv);
+    assert(!ret);
+    if (ret) return ret;
+    assert(SET_HAS(example_commands, 0));
+    assert(SET_HAS(example_commands, 5));
+    assert(!SET_HAS(example_commands, 2));
+    assert(example_offsets[0] == 2);
+    assert(example_counts[0] == 2);
+    assert(example_counts[1] == 0);
+    return EXIT_SUCCESS;
+}
+
+int test_match_pattern_2(void) {
+    char *argv[] = {"ship", "A", "--speed=3", "move", "1", "2"};
+    int ret;
+
+    ret = example_match(6, argv);
+    assert(!ret);
+    if (ret) return ret;
+    assert(!SET_HAS(example_commands, 0));
+    assert(SET_HAS(example_commands, 2));
+    assert(SET_HAS(example_commands, 5));
+    assert(example_counts[0] == 1);
+    assert(!strcmp(argv[example_offsets[0]], "A"));
+    assert(!strcmp(argv[example_offsets[1]], "1"));
+    assert(!strcmp(argv[example_offsets[2]], "2"));
+    assert(!strcmp(example_arguments[4], "3"));
+    return EXIT_SUCCESS;
+}
+
+int test_match_pattern_3(void) {
+    char *argv1[] = {"mine", "set", "1", "2", "--moored", "--drifting"};
+    char *argv2[] = {"ship", "create", "a", "--speed=3"};
+    char *argv3[] = {"ship", "shoot", "1"};
+    char *argv4[] = {"--version"};
+
+    /* (--moored|--drifting) */
+    assert(example_match(6, argv1));
+    /* --speed is not part of the `ship create` line */
+    assert(example_match(4, argv2));
+    assert(example_match(3, argv3));
+    assert(!example_match(1, argv4));
+    trail_free(&example_trail);
+    return EXIT_SUCCESS;
+}
+
+int test_sort_values(void) {
+    struct Spec spec = {1, 2, 0};
+    int offsets[2] = {3, 4};
+    int counts[2] = {2, 2};
+    int bound[5] = {-1, 0, 1, 0, 1};
+    struct Elements elements = {&spec, NULL, NULL, NULL, offsets, counts, NULL, bound};
+    char *argv[] = {"pair", "k1", "v1", "k2", "v2"};
+    struct Tokens ts = tokens_new(5, argv, spare);
+
+    /* (<key> <value>)... as match_pattern() leaves it */
+    ts.n_positional = 5;
+    sort_values(&ts, &elements);
+    assert(offsets[0] == 1 && offsets[1] == 3);
+    assert(!strcmp(argv[0], "pair"));
+    assert(!strcmp(argv[1], "k1") && !strcmp(argv[2], "k2"));
+    assert(!strcmp(argv[3], "v1") && !strcmp(argv[4], "v2"));
+    return EXIT_SUCCESS;
+}
+
+ /*
+  * Typed option values
+  */
+
+int test_parse_int(void) {
+    long n = 0;
+
+    assert(parse_int("42", &n) == DOCOPT_OK && n == 42);
+    assert(parse_int("-7", &n) == DOCOPT_OK && n == -7);
+    assert(parse_int("+0", &n) == DOCOPT_OK && n == 0);
+    assert(parse_int("-0", &n) == DOCOPT_OK && n == 0);
+    assert(parse_int("99999999999999999999", &n) == DOCOPT_OUT_OF_RANGE);
+    assert(parse_int("", &n) == DOCOPT_INVALID_VALUE);
+    assert(parse_int("-", &n) == DOCOPT_INVALID_VALUE);
+    assert(parse_int("12a", &n) == DOCOPT_INVALID_VALUE);
+    assert(parse_int("0x10", &n) == DOCOPT_INVALID_VALUE);
+    return EXIT_SUCCESS;
+}
+
+int test_parse_float(void) {
+    double x = 0;
+
+    assert(parse_float("0.1", &x) == DOCOPT_OK && x == 0.1);
+    assert(parse_float("-2.5e3", &x) == DOCOPT_OK && x == -2500);
+    assert(parse_float(".5", &x) == DOCOPT_OK && x == 0.5);
+    assert(parse_float("7", &x) == DOCOPT_OK && x == 7);
+    /* past the fast path */
+    assert(parse_float("3.14159265358979323846", &x) == DOCOPT_OK && x == 3.14159265358979323846);
+    assert(parse_float("1e-300", &x) == DOCOPT_OK && x == 1e-300);
+    assert(parse_float("1e400", &x) == DOCOPT_OUT_OF_RANGE);
+    assert(parse_float(".", &x) == DOCOPT_INVALID_VALUE);
+    assert(parse_float("1e", &x) == DOCOPT_INVALID_VALUE);
+    assert(parse_float("1.2.3", &x) == DOCOPT_INVALID_VALUE);
+    assert(parse_float("nan", &x) == DOCOPT_INVALID_VALUE);
+    return EXIT_SUCCESS;
+}
+
+int test_store_argument(void) {
+    struct Values {
+        long port;
+        double ratio;
+        int mode;
+    } values = {0, 0, -1};
+    const char *choices[] = {"slow", "fast"};
+    struct Type types[] = {
+        {TYPE_INT, 1, 65535, 0, NULL, NULL},
+        {TYPE_FLOAT, LONG_MIN, LONG_MAX, 0, NULL, NULL},
+        {TYPE_ENUM, LONG_MIN, LONG_MAX, 2, choices, NULL}
+    };
+    size_t fields[] = {offsetof(struct Values, port), offsetof(struct Values, ratio),
+                       offsetof(struct Values, mode)};
+    int option_types[] = {0, 1, 2};
+    struct Spec spec = {0, 0, 3, NULL, NULL, NULL, NULL, NULL, NULL, NULL, fields,
+                        NULL, NULL, NULL, NULL, NULL, option_types, NULL, NULL, NULL, NULL, 0, types};
+    char *base = (char *) &values;
+
+    assert(store_argument(&spec, base, 0, "8080") == DOCOPT_OK && values.port == 8080);
+    assert(store_argument(&spec, base, 0, "65536") == DOCOPT_OUT_OF_RANGE);
+    assert(store_argument(&spec, base, 0, "0") == DOCOPT_OUT_OF_RANGE);
+    assert(values.port == 8080);
+    assert(store_argument(&spec, base, 1, "0.25") == DOCOPT_OK && values.ratio == 0.25);
+    assert(store_argument(&spec, base, 2, "fast") == DOCOPT_OK && values.mode == 1);
+    assert(store_argument(&spec, base, 2, "fastest") == DOCOPT_INVALID_VALUE);
+    assert(values.mode == 1);
+    return EXIT_SUCCESS;
+}
+
+ /*
+  * docopt_parse
+  */
+
+int test_docopt_parse_1(void) {
+    char *argv1[] = {"naval_fate", "ship", "create", "a", "b"};
+    char *argv2[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed=3"};
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct DocoptArgs args;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    assert(docopt_parse(ctx, 5, argv1, &args) == DOCOPT_OK);
+    assert(args.ship && args.create && !args.move);
+    assert(args.name.count == 2);
+    assert(!strcmp(args.name.items[1], "b"));
+    assert(args.x == NULL);
+    assert(!strcmp(args.speed, "10"));
+    assert(!strcmp(args.help_message[0], "Naval Fate."));
+    /* nothing is left over from the previous parse */
+    assert(docopt_parse(ctx, 7, argv2, &args) == DOCOPT_OK);
+    assert(args.ship && !args.create && args.move);
+    assert(args.name.count == 1);
+    assert(!strcmp(args.x, "1"));
+    assert(!strcmp(args.speed, "3"));
+    assert(docopt_error_token(ctx) == NULL);
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_parse_2(void) {
+    char *argv1[] = {"naval_fate", "mine", "set", "-x"};
+    char *argv2[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed"};
+    char *argv3[] = {"naval_fate", "--moored=1"};
+    char *argv4[] = {"naval_fate", "ship", "shoot", "1"};
+    char *argv5[] = {"naval_fate", "ship", "shoot", "1", "2", "-h"};
+    char *argv6[] = {"naval_fate", "mine", "set", "1", "2", "--moored", "--moored"};
+    char *argv7[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed=3", "--speed", "4"};
+    struct DocoptContext *ctx = docopt_context_new(true, false);
+    struct DocoptArgs args;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    assert(docopt_parse(ctx, 4, argv1, &args) == DOCOPT_UNKNOWN_OPTION);
+    assert(!strcmp(docopt_error_token(ctx), "-x"));
+    assert(docopt_parse(ctx, 7, argv2, &args) == DOCOPT_MISSING_ARGUMENT);
+    assert(!strcmp(docopt_error_token(ctx), "--speed"));
+    assert(docopt_parse(ctx, 2, argv3, &args) == DOCOPT_UNEXPECTED_ARGUMENT);
+    assert(!strcmp(docopt_error_token(ctx), "--moored"));
+    assert(docopt_parse(ctx, 4, argv4, &args) == DOCOPT_NO_MATCH);
+    assert(!args.ship && args.x == NULL);
+    assert(docopt_parse(ctx, 6, argv5, &args) == DOCOPT_HELP);
+    /* options the usage does not repeat may be given once */
+    assert(docopt_parse(ctx, 7, argv6, &args) == DOCOPT_NO_MATCH);
+    assert(!strcmp(docopt_error_token(ctx), "--moored"));
+    assert(docopt_parse(ctx, 9, argv7, &args) == DOCOPT_NO_MATCH);
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+/* Path of a new file holding `text` */
+static const char *text_file(const char *text) {
+    static char path[] = "/tmp/docopt_test_XXXXXX";
+    int fd;
+
+    strcpy(path + sizeof(path) - 7, "XXXXXX");
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, text, strlen(text)) != (ssize_t) strlen(text))
+        return "";
+    close(fd);
+    return path;
+}
+
+int test_docopt_config(void) {
+    char *argv1[] = {"naval_fate", "ship", "A", "move", "1", "2"};
+    char *argv2[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed=3"};
+    char *argv3[] = {"naval_fate", "mine", "set", "1", "2"};
+    struct DocoptContext *ctx;
+    struct DocoptArgs args;
+    const char *path;
+
+    unsetenv("NAVAL_SPEED");
+    ctx = docopt_context_new(true, true);
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    path = text_file("# fleet\n  speed = 15 \nmoored=1\n\nfleet.size=4");
+    assert(docopt_config(ctx, path) == DOCOPT_OK);
+    unlink(path);
+    assert(docopt_parse(ctx, 6, argv1, &args) == DOCOPT_OK);
+    assert(!strcmp(args.speed, "15"));
+    assert(docopt_parse(ctx, 7, argv2, &args) == DOCOPT_OK);
+    assert(!strcmp(args.speed, "3"));
+    /* a value, like a default, does not count as given */
+    assert(docopt_parse(ctx, 5, argv3, &args) == DOCOPT_OK);
+    assert(!args.moored && !strcmp(args.speed, "15"));
+    /* the last line needs no newline */
+    path = text_file("speed=17");
+    assert(docopt_config(ctx, path) == DOCOPT_OK);
+    unlink(path);
+    assert(docopt_parse(ctx, 6, argv1, &args) == DOCOPT_OK);
+    assert(!strcmp(args.speed, "17"));
+    /* the environment wins over the file */
+    setenv("NAVAL_SPEED", "20", 1);
+    path = text_file("speed=17\n");
+    assert(docopt_config(ctx, path) == DOCOPT_OK);
+    unlink(path);
+    assert(docopt_parse(ctx, 6, argv1, &args) == DOCOPT_OK);
+    assert(!strcmp(args.speed, "20"));
+    unsetenv("NAVAL_SPEED");
+    assert(docopt_config(ctx, "/nonexistent/naval_fate.conf") == DOCOPT_BAD_CONFIG);
+    assert(!strcmp(docopt_error_token(ctx), "/nonexistent/naval_fate.conf"));
+    assert(docopt_parse(ctx, 6, argv1, &args) == DOCOPT_OK);
+    assert(!strcmp(args.speed, "10"));
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_response_files(void) {
+    char arg1[64], arg2[64], arg3[64], arg4[64];
+    char *argv1[] = {"naval_fate", "ship", "create", arg1, "x"};
+    char *argv2[] = {"naval_fate", "ship", "A", "move", "1", "2", arg2};
+    char *argv3[] = {"naval_fate", "ship", "create", "@"};
+    char *argv4[] = {"naval_fate", "ship", "create", arg3};
+    char *argv5[] = {"naval_fate", "ship", "create", "@/nonexistent/names"};
+    char *argv6[] = {"naval_fate", "ship", "shoot", arg4};
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct DocoptArgs args;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    /* quoted like the lines of a batch, the last line needs no newline */
+    sprintf(arg1, "@%s", text_file("a 'b c'\n  d\\ e\n\nf"));
+    sprintf(arg2, "@%s", text_file("--speed=7\n"));
+    sprintf(arg3, "@%s", text_file("a 'b\n"));
+    sprintf(arg4, "@%s", text_file("3 4\n"));
+    assert(docopt_parse(ctx, 5, argv1, &args) == DOCOPT_OK);
+    assert(args.create && args.name.count == 5);
+    assert(!strcmp(args.name.items[1], "b c") && !strcmp(args.name.items[2], "d e"));
+    assert(!strcmp(args.name.items[3], "f") && !strcmp(args.name.items[4], "x"));
+    assert(docopt_parse(ctx, 7, argv2, &args) == DOCOPT_OK);
+    assert(args.move && !strcmp(args.speed, "7"));
+    assert(docopt_parse(ctx, 4, argv3, &args) == DOCOPT_OK);
+    assert(args.name.count == 1 && !strcmp(args.name.items[0], "@"));
+    assert(docopt_parse(ctx, 4, argv4, &args) == DOCOPT_UNTERMINATED_QUOTE);
+    assert(!strcmp(docopt_error_token(ctx), "b"));
+    assert(docopt_parse(ctx, 4, argv5, &args) == DOCOPT_BAD_RESPONSE_FILE);
+    assert(!strcmp(docopt_error_token(ctx), "@/nonexistent/names"));
+    docopt_context_free(ctx);
+    /* the words docopt() returns outlive its call */
+    args = docopt(5, argv1, true, "1.0");
+    assert(args.create && args.name.count == 5);
+    assert(!strcmp(args.name.items[1], "b c") && !strcmp(args.name.items[4], "x"));
+    args = docopt(4, argv6, true, "1.0");
+    assert(args.shoot && !strcmp(args.x, "3") && !strcmp(args.y, "4"));
+    unlink(arg1 + 1);
+    unlink(arg2 + 1);
+    unlink(arg3 + 1);
+    unlink(arg4 + 1);
+    return EXIT_SUCCESS;
+}
+
+/* What the hooks of test_docopt_trace() saw */
+struct Seen {
+    char phases[8];
+    int n_phases;
+    int n_tokens;
+    int n_lookups;
+    enum DocoptError error;
+};
+
+static void seen_phase(void *data, enum DocoptPhase phase) {
+    struct Seen *seen = data;
+    seen->phases[seen->n_phases++] = (char) ('0' + phase);
+}
+
+static void seen_token(void *data, const char *token) {
+    (void) token;
+    ((struct Seen *) data)->n_tokens++;
+}
+
+static void seen_lookup(void *data, const char *name, size_t len, int probes) {
+    (void) name;
+    (void) len;
+    ((struct Seen *) data)->n_lookups += probes;
+}
+
+static void seen_error(void *data, enum DocoptError error, const char *token) {
+    (void) token;
+    ((struct Seen *) data)->error = error;
+}
+
+int test_docopt_trace(void) {
+    char *argv1[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed=3"};
+    char *argv2[] = {"naval_fate", "mine", "set", "-x"};
+    struct Seen seen;
+    struct DocoptTrace trace = {seen_phase, seen_token, seen_lookup, seen_error, NULL};
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct DocoptArgs args;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    trace.data = &seen;
+    docopt_trace(ctx, &trace);
+    memset(&seen, 0, sizeof(seen));
+    assert(docopt_parse(ctx, 7, argv1, &args) == DOCOPT_OK);
+    assert(!strcmp(seen.phases, "01234"));
+    assert(seen.n_tokens == 6);
+    /* --speed, then ship and move, the only tokens that may be commands */
+    assert(seen.n_lookups >= 3);
+    assert(seen.error == DOCOPT_OK);
+    memset(&seen, 0, sizeof(seen));
+    assert(docopt_parse(ctx, 4, argv2, &args) == DOCOPT_UNKNOWN_OPTION);
+    assert(!strcmp(seen.phases, "04"));
+    assert(seen.error == DOCOPT_UNKNOWN_OPTION);
+    docopt_trace(ctx, NULL);
+    memset(&seen, 0, sizeof(seen));
+    assert(docopt_parse(ctx, 4, argv2, &args) == DOCOPT_UNKNOWN_OPTION);
+    assert(seen.n_phases == 0 && seen.error == DOCOPT_OK);
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+/* What docopt_complete() prints for argv[0..argc), completing argv[cword] */
+static const char *complete(struct DocoptContext *ctx, int argc, char *argv[], int cword) {
+    static char buf[256];
+    FILE *out = tmpfile();
+    size_t n;
+
+    if (out == NULL) return "";
+    assert(docopt_complete(ctx, argc, argv, cword, out) == DOCOPT_OK);
+    rewind(out);
+    n = fread(buf, 1, sizeof(buf) - 1, out);
+    buf[n] = '\0';
+    fclose(out);
+    return buf;
+}
+
+int test_suggestions(void) {
+    char *argv1[] = {"naval_fate", "--drfiting"};
+    char *argv2[] = {"naval_fate", "-speed=3"};
+    char *argv3[] = {"naval_fate", "mnie", "set", "1", "2"};
+    char *argv4[] = {"naval_fate", "--zzz"};
+    struct DocoptContext *ctx = docopt_context_new(true, false);
+    struct DocoptArgs args;
+    static const char *const names[] = {"sitting", "kitten", "mitten", "sittin"};
+    static const int start[] = {0, 0, 0, 0, 0, 0, 0, 3, 4};
+    static const int order[] = {1, 2, 3, 0};
+    static const int lcp[] = {0, 0, 0, 0};
+    const struct ByLength by = {7, start, order, lcp};
+    int found[MAX_SUGGESTIONS];
+    int ret;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    /* a swap of neighbours is one edit */
+    ret = docopt_parse(ctx, 2, argv1, &args);
+    assert(ret == DOCOPT_UNKNOWN_OPTION);
+    assert(suggestions(&ctx->elements, ret, found) == 1);
+    assert(!strcmp(spec.option_longs[found[0]], "--drifting"));
+    /* a long option missing a dash */
+    ret = docopt_parse(ctx, 2, argv2, &args);
+    assert(ret == DOCOPT_UNKNOWN_OPTION && !strcmp(docopt_error_token(ctx), "-s"));
+    assert(suggestions(&ctx->elements, ret, found) == 1);
+    assert(!strcmp(spec.option_longs[found[0]], "--speed"));
+    ret = docopt_parse(ctx, 5, argv3, &args);
+    assert(ret == DOCOPT_NO_MATCH && !strcmp(docopt_error_token(ctx), "mnie"));
+    assert(suggestions(&ctx->elements, ret, found) == 1);
+    assert(!strcmp(spec.command_names[found[0]], "mine"));
+    ret = docopt_parse(ctx, 2, argv4, &args);
+    assert(suggestions(&ctx->elements, ret, found) == 0);
+    docopt_context_free(ctx);
+    /* by length, then alphabetically: kitten, mitten, sittin, then sitting */
+    assert(suggest(&by, names, 0, "sitten", 6, found) == 3);
+    assert(found[0] == 1 && found[1] == 2 && found[2] == 3);
+    assert(suggest(&by, names, 0, "sititng", 7, found) == 1 && found[0] == 0);
+    assert(suggest(&by, names, 0, "xyz", 3, found) == 0);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_complete(void) {
+    char *argv1[] = {"m"};
+    char *argv2[] = {"ship", "A", ""};
+    char *argv3[] = {"mine", "--"};
+    char *argv4[] = {"--moored", "--"};
+    char *argv5[] = {"--", "--"};
+    char *argv6[] = {"ship", ""};
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    assert(!strcmp(complete(ctx, 0, argv1, 0), "ship\nmine\n"));
+    assert(!strcmp(complete(ctx, 1, argv1, 0), "mine\n"));
+    assert(!strcmp(complete(ctx, 2, argv6, 1), "create\nshoot\n"));
+    assert(!strcmp(complete(ctx, 3, argv2, 1), ""));
+    assert(!strcmp(complete(ctx, 3, argv2, 2), "move\n"));
+    assert(!strcmp(complete(ctx, 2, argv3, 1),
+                   "--drifting\n--help\n--moored\n--speed\n--version\n"));
+    /* options already given are not offered again, nor any after "--" */
+    assert(!strcmp(complete(ctx, 2, argv4, 1), "--drifting\n--help\n--speed\n--version\n"));
+    assert(!strcmp(complete(ctx, 2, argv5, 1), ""));
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+ /*
+  * docopt_batch
+  */
+
+struct BatchResult {
+    int n;
+    size_t lines[8];
+    enum DocoptError errors[8];
+    char x[8][16];
+    char name[8][16];
+};
+
+int batch_callback(void *data, size_t line, enum DocoptError error, const struct DocoptArgs *args) {
+    struct BatchResult *result = data;
+
+    result->lines[result->n] = line;
+    result->errors[result->n] = error;
+    strcpy(result->x[result->n], args->x != NULL ? args->x : "");
+    strcpy(result->name[result->n], args->name.count > 0 ? args->name.items[args->name.count - 1] : "");
+    return ++result->n == 8;
+}
+
+int test_split_line(void) {
+    char line[] = "prog  'a b'\"c\\\"d\" e\\ f\\\\ ''\t\"g'h\"\n";
+    struct Batch batch = {NULL, NULL, NULL, 0, 0, 0, NULL, NULL};
+    char *next;
+
+    next = split_line(&batch, line, line + sizeof(line) - 1);
+    assert(next == line + sizeof(line) - 1);
+    assert(batch.argc == 5);
+    if (batch.argc != 5) return EXIT_FAILURE;
+    assert(batch.error == NULL);
+    assert(!strcmp(batch.argv[0], "prog"));
+    assert(!strcmp(batch.argv[1], "a bc\"d"));
+    assert(!strcmp(batch.argv[2], "e f\\"));
+    assert(!strcmp(batch.argv[3], ""));
+    assert(!strcmp(batch.argv[4], "g'h"));
+    free(batch.argv);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_batch_1(void) {
+    char buf[] = "naval_fate ship create a 'b c'\n"
+                 "\n"
+                 "naval_fate ship shoot 1\n"
+                 "naval_fate mine set \"1\" 2 --moored\n"
+                 "naval_fate ship create 'oops\n"
+                 "naval_fate ship x move 3 4";
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct BatchResult result = {0};
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    assert(docopt_batch(ctx, buf, sizeof(buf) - 1, batch_callback, &result) == 0);
+    assert(result.n == 5);
+    if (result.n != 5) return EXIT_FAILURE;
+    assert(result.lines[0] == 1 && result.errors[0] == DOCOPT_OK);
+    assert(!strcmp(result.name[0], "b c"));
+    assert(result.lines[1] == 3 && result.errors[1] == DOCOPT_NO_MATCH);
+    assert(result.lines[2] == 4 && result.errors[2] == DOCOPT_OK);
+    assert(!strcmp(result.x[2], "1"));
+    assert(result.lines[3] == 5 && result.errors[3] == DOCOPT_UNTERMINATED_QUOTE);
+    assert(result.lines[4] == 6 && result.errors[4] == DOCOPT_OK);
+    assert(!strcmp(result.name[4], "x"));
+    assert(!strcmp(result.x[4], "3"));
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_batch_2(void) {
+    const char text[] = "naval_fate ship create a\nnaval_fate ship shoot 1 2\nnaval_fate --version";
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct BatchResult result = {0};
+    FILE *file = tmpfile();
+    int fds[2];
+
+    assert(ctx != NULL && file != NULL);
+    if (ctx == NULL || file == NULL) return EXIT_FAILURE;
+    /* a regular file is mapped */
+    fputs(text, file);
+    fflush(file);
+    assert(docopt_batch_fd(ctx, fileno(file), batch_callback, &result) == 0);
+    fclose(file);
+    /* a pipe is read */
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], text, sizeof(text) - 1) == sizeof(text) - 1);
+    close(fds[1]);
+    assert(docopt_batch_fd(ctx, fds[0], batch_callback, &result) == 0);
+    close(fds[0]);
+    assert(result.n == 6);
+    if (result.n != 6) return EXIT_FAILURE;
+    assert(result.errors[0] == DOCOPT_OK && result.errors[3] == DOCOPT_OK);
+    assert(!strcmp(result.name[3], "a"));
+    assert(!strcmp(result.x[4], "1"));
+    assert(result.lines[5] == 3 && result.errors[5] == DOCOPT_VERSION);
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt_batch_3(void) {
+    /* a few rounds of blocks, each of a couple of lines */
+    char buf[] = "naval_fate ship create a0\n"
+                 "naval_fate ship create a1\n"
+                 "naval_fate ship create -x\n"
+                 "naval_fate ship create a3\n"
+                 "\n"
+                 "naval_fate ship create a5\n"
+                 "naval_fate ship create a6\n"
+                 "naval_fate ship create a7\n"
+                 "naval_fate ship create a8\n"
+                 "naval_fate ship create a9";
+    char copy[sizeof(buf)];
+    struct DocoptContext *ctx = docopt_context_new(true, true);
+    struct BatchResult result = {0};
+    int i;
+
+    assert(ctx != NULL);
+    if (ctx == NULL) return EXIT_FAILURE;
+    /* buf is tokenized in place */
+    memcpy(copy, buf, sizeof(buf));
+    /* the callback stops the batch at its 8th line */
+    assert(docopt_batch_parallel(ctx, buf, sizeof(buf) - 1, 3, batch_callback, &result) == 1);
+    assert(result.n == 8);
+    if (result.n != 8) return EXIT_FAILURE;
+    for (i = 0; i < 8; i++) {
+        assert(result.lines[i] == (size_t) (i < 4 ? i + 1 : i + 2));
+        assert(result.name[i][1] == (i == 2 ? '\0' : '0' + (char) result.lines[i] - 1));
+    }
+    assert(result.errors[2] == DOCOPT_UNKNOWN_OPTION);
+    result.n = 0;
+    assert(docopt_batch_parallel(ctx, copy + 26 * 6 + 1, sizeof(copy) - 1 - 26 * 6 - 1, 2,
+                                 batch_callback, &result) == 0);
+    assert(result.n == 3);
+    assert(!strcmp(result.name[2], "a9"));
+    docopt_context_free(ctx);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     int (*functions[])(void) = {test_tokens,
                                    test_parse_shorts_1,
@@ -297,14 +1033,42 @@ int main(int argc, char *argv[]) {
                                    test_parse_shorts_3,
                                    test_parse_shorts_4,
                                    test_parse_shorts_5,
+                                   test_parse_shorts_6,
+                                   test_parse_shorts_7,
 
                                    test_parse_long_1,
                                    test_parse_long_2,
                                    test_parse_long_3,
                                    test_parse_long_4,
+                                   test_parse_long_5,
+                                   test_parse_long_6,
+                                   test_parse_long_7,
 
                                    test_parse_args_1,
                                    test_parse_args_2,
+                                   test_parse_args_3,
+
+                                   test_match_pattern_1,
+                                   test_match_pattern_2,
+                                   test_match_pattern_3,
+                                   test_sort_values,
+
+                                   test_parse_int,
+                                   test_parse_float,
+                                   test_store_argument,
+
+                                   test_docopt_parse_1,
+                                   test_docopt_parse_2,
+                                   test_suggestions,
+                                   test_docopt_complete,
+                                   test_docopt_trace,
+                                   test_docopt_config,
+                                   test_docopt_response_files,
+
+                                   test_split_line,
+                                   test_docopt_batch_1,
+                                   test_docopt_batch_2,
+                                   test_docopt_batch_3,
                                    NULL};
     int (*function)(void);
     int i = -1;
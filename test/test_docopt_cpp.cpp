@@ -0,0 +1,182 @@
+/*
+ * Tests of the C++17 parser, docopt.hpp, generated from example.docopt with
+ * docopt_c.py --cpp.  What can be parsed at compile time is checked with
+ * static_assert, and again at run time.
+ */
+#include <cstdio>
+#include <cstdlib>
+
+#include "docopt.hpp"
+
+#define assert(x) \
+    if (x) \
+        std::printf("."); \
+    else \
+        std::printf("\n[%s, line %d] test failed", __FILE__, __LINE__)
+
+using docopt::Args;
+using docopt::Error;
+using docopt::Parser;
+
+constexpr bool parses_create() {
+    const char *argv[] = {"naval_fate", "ship", "create", "a", "b", "c"};
+    Parser<8> parser;
+    Args args;
+
+    return parser.parse(6, argv, args) == Error::ok && args.ship && args.create && !args.move
+        && args.name.size() == 3 && args.name[0] == "a" && args.name[2] == "c"
+        && args.speed == "10" && args.x.data() == nullptr;
+}
+
+constexpr bool parses_move() {
+    const char *argv[] = {"naval_fate", "ship", "Guardian", "move", "1", "2", "--spe=20"};
+    Parser<8> parser;
+    Args args;
+
+    return parser.parse(7, argv, args) == Error::ok && args.move && args.name.size() == 1
+        && args.name[0] == "Guardian" && args.x == "1" && args.y == "2" && args.speed == "20";
+}
+
+constexpr Error parse_error(int argc, const char *const *argv) {
+    Parser<4> parser;
+    Args args;
+
+    return parser.parse(argc, argv, args);
+}
+
+static_assert(parses_create());
+static_assert(parses_move());
+
+constexpr const char *argv_help[] = {"naval_fate", "-h"};
+constexpr const char *argv_unknown[] = {"naval_fate", "--sparks"};
+constexpr const char *argv_no_match[] = {"naval_fate", "mine", "set", "1", "2", "--moored", "--drifting"};
+constexpr const char *argv_too_many[] = {"naval_fate", "ship", "create", "a", "b", "c"};
+constexpr const char *argv_repeated[] = {"naval_fate", "mine", "set", "1", "2", "--moored", "--moored"};
+static_assert(parse_error(2, argv_help) == Error::help);
+static_assert(parse_error(2, argv_unknown) == Error::unknown_option);
+static_assert(parse_error(7, argv_no_match) == Error::no_match);
+static_assert(parse_error(6, argv_too_many) == Error::too_many_arguments);
+static_assert(parse_error(7, argv_repeated) == Error::no_match);
+
+constexpr long int_of(const char *s) {
+    long n = -1;
+
+    return docopt::detail::parse_int(s, -100, 100, n) == Error::ok ? n : 1000;
+}
+
+constexpr double float_of(const char *s) {
+    double x = -1;
+
+    return docopt::detail::parse_float(s, x) == Error::ok ? x : 1000;
+}
+
+static_assert(int_of("42") == 42 && int_of("-100") == -100 && int_of("+7") == 7);
+static_assert(int_of("101") == 1000 && int_of("4x") == 1000 && int_of("") == 1000);
+static_assert(float_of("0.5") == 0.5 && float_of("-2.5e2") == -250 && float_of("1e-3") == 0.001);
+static_assert(float_of(".") == 1000 && float_of("1e") == 1000);
+
+int test_parse(void) {
+    const char *argv1[] = {"naval_fate", "ship", "Guardian", "move", "10", "--", "-20"};
+    const char *argv2[] = {"naval_fate", "mine", "remove", "1", "2", "--drifting"};
+    const char *argv3[] = {"naval_fate", "mine", "set", "1"};
+    const char *argv4[] = {"naval_fate", "ship", "A", "move", "1", "2", "--speed"};
+    const char *argv5[] = {"naval_fate", "-x"};
+    Parser<> parser;
+    Args args;
+
+    assert(parses_create());
+    assert(parses_move());
+    /* after "--", "-20" is positional */
+    assert(parser.parse(7, argv1, args) == Error::no_match);
+    assert(parser.parse(6, argv2, args) == Error::ok);
+    assert(args.mine && args.remove && args.drifting && !args.moored);
+    assert(args.x == "1" && args.y == "2" && args.name.empty());
+    /* argv is left as it is, the arguments view it */
+    assert(args.x.data() == argv2[3]);
+    assert(parser.parse(4, argv3, args) == Error::no_match);
+    assert(!args.mine && args.x.data() == nullptr);
+    assert(parser.parse(7, argv4, args) == Error::missing_argument);
+    assert(parser.error_token() == "--speed");
+    assert(parser.parse(2, argv5, args) == Error::unknown_option);
+    assert(parser.error_token() == "-x");
+    return EXIT_SUCCESS;
+}
+
+int test_repeated(void) {
+    const char *argv[64];
+    Parser<64> parser;
+    Parser<8> small;
+    Args args;
+    int i;
+
+    argv[0] = "naval_fate";
+    argv[1] = "ship";
+    argv[2] = "create";
+    for (i = 3; i < 64; i++)
+        argv[i] = (i % 2 ? "odd" : "even");
+    assert(parser.parse(64, argv, args) == Error::ok);
+    assert(args.name.size() == 61);
+    assert(args.name[0] == "odd" && args.name[60] == "odd" && args.name[59] == "even");
+    assert(small.parse(64, argv, args) == Error::too_many_arguments);
+    return EXIT_SUCCESS;
+}
+
+int test_docopt(void) {
+    const char *argv1[] = {"naval_fate", "ship", "shoot", "1", "2"};
+    const char *argv2[] = {"naval_fate", "--help"};
+    static const char *argv3[303];
+    Args args;
+    int i;
+
+    args = docopt::docopt(5, argv1, true, "1.0");
+    assert(args.shoot && args.x == "1" && !args.help);
+    /* --help is left to the caller on this call, not handled as on the last */
+    args = docopt::docopt(2, argv2, false);
+    assert(!args.shoot && args.help);
+    argv3[0] = "naval_fate";
+    argv3[1] = "ship";
+    argv3[2] = "create";
+    for (i = 3; i < 303; i++)
+        argv3[i] = (i % 2 ? "odd" : "even");
+    args = docopt::docopt(303, argv3);
+    assert(args.create && args.name.size() == 300);
+    assert(args.name[0] == "odd" && args.name[299] == "even");
+    return EXIT_SUCCESS;
+}
+
+int test_parse_float(void) {
+    double x = 0;
+
+    /* not on the fast path, left to strtod() */
+    assert(docopt::detail::parse_float("0.1000000000000000055511151231257827", x) == Error::ok);
+    assert(x == 0.1);
+    assert(docopt::detail::parse_float("0.10000000000000000555111512312578270211815834045410156250000000000", x)
+           == Error::ok);
+    assert(x == 0.1);
+    assert(docopt::detail::parse_float("1e400", x) == Error::out_of_range);
+    return EXIT_SUCCESS;
+}
+
+int main(void) {
+    int (*functions[])(void) = {test_parse,
+                                test_repeated,
+                                test_docopt,
+                                test_parse_float,
+                                NULL};
+    int (*function)(void);
+    int i = -1;
+    int ret;
+
+    for (function = functions[++i];
+         function != NULL;
+         function = functions[++i]) {
+        std::printf("%d", i);
+        ret = (*function)();
+        if (ret) {
+            std::puts("\nFAILURE!");
+            return EXIT_FAILURE;
+        }
+    }
+    std::puts(" OK!");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,522 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: test_spec.py
+
+Tests of what docopt_c.py reads from specs and generates for them, some
+compiled with $CC (cc by default), or $CXX (c++) for --cpp, and run.  Prints a dot for each check
+that holds, and exits with 1 if any does not.
+
+"""
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+CC = os.environ.get('CC', 'cc')
+CXX = os.environ.get('CXX', 'c++')
+FLAGS = ['-std=c99', '-Wall', '-Wextra', '-Werror']
+
+import docopt
+import docopt_c
+
+failed = []
+
+
+def check(ok):
+    if ok:
+        sys.stdout.write('.')
+    else:
+        frame = sys._getframe(1)
+        failed.append(frame.f_lineno)
+        sys.stdout.write('\n[%s, line %d] test failed' % (os.path.basename(__file__), frame.f_lineno))
+
+
+def generate(doc):
+    return docopt_c.generate(doc, docopt_c.template_c, docopt_c.template_h, 'docopt.h')
+
+
+def run_docopt_c(*args):
+    """Output of docopt_c.py run on `args`"""
+    return subprocess.check_output([sys.executable, os.path.join(HERE, '..', 'docopt_c.py')] + list(args),
+                                   stderr=subprocess.STDOUT).decode()
+
+
+def write(path, text):
+    with open(path, 'w') as f:
+        f.write(text)
+
+
+def compiles(*args):
+    """Whether $CC takes `args`, warnings being errors"""
+    return subprocess.call([CC] + FLAGS + list(args)) == 0
+
+
+def accepted(doc, argvs):
+    """For each argv of `argvs`, whether the parser generated for `doc`
+    takes it, and whether docopt.py does"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        write(os.path.join(work, 'spec.docopt'), doc)
+        run_docopt_c('-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt'))
+        write(os.path.join(work, 'main.c'), """
+#include "docopt.h"
+
+int main(int argc, char *argv[])
+{
+    struct DocoptContext *ctx = docopt_context_new(0, 0);
+    struct DocoptArgs args;
+    int ret = docopt_parse(ctx, argc, argv, &args);
+
+    docopt_context_free(ctx);
+    return ret;
+}
+""")
+        program = os.path.join(work, 'main')
+        if not compiles('-o', program, os.path.join(work, 'main.c'), os.path.join(work, 'docopt.c')):
+            return None
+        results = []
+        for argv in argvs:
+            try:
+                docopt.docopt(doc, argv=argv, help=False)
+                python = True
+            except docopt.DocoptExit:
+                python = False
+            results.append((subprocess.call([program] + argv) == 0, python))
+        return results
+    finally:
+        shutil.rmtree(work)
+
+
+def same_as_docopt_py(doc, argvs):
+    """Whether the generated parser takes those of `argvs` docopt.py takes"""
+    results = accepted(doc, argvs)
+    if results is None:
+        return False
+    for argv, (c, python) in zip(argvs, results):
+        if c != python:
+            sys.stdout.write('\n%r: %s here, %s by docopt.py' % (argv, 'taken' if c else 'refused',
+                                                                  'taken' if python else 'refused'))
+    return all(c == python for c, python in results)
+
+
+def options(doc):
+    usage, pattern, leafs, commands, arguments, flags, options = docopt_c.parse_spec(doc)
+    return dict((o.long or o.short, o) for o in flags + options)
+
+
+def automaton(doc):
+    usage, pattern, leafs, commands, arguments, flags, options = docopt_c.parse_spec(doc)
+    names = [o.long or o.short for o in flags + options]
+    return docopt_c.Automaton(docopt_c.usage_lines(pattern), commands, arguments, flags + options), names
+
+
+def test_required_either():
+    """One of (--fast | --slow) is needed, as of (-a | -b) before <x>"""
+    a, names = automaton('Usage:\n  prog run (--fast | --slow)\n  prog get (-a | -b) <x>\n  prog [--fast]\n')
+    check([[names[i] if i >= 0 else -1 for i in line] for line in a.needed] ==
+          [['--fast', '--slow', -1], ['-a', '-b', -1], []])
+
+
+def test_options_shortcut():
+    """[options] stands for the options no usage line names"""
+    doc = 'Usage:\n  prog cp [options] <src>\n  prog go --quiet\n\n' \
+          'Options:\n  -o --out=<f>  Output.\n  -v  Verbose.\n  --quiet  Quiet.\n'
+    a, names = automaton(doc)
+    check([sorted(names[i] for i in line) for line in a.allowed] == [['--out', '-v'], ['--quiet']])
+
+
+def test_repeating_options():
+    doc = 'Usage: prog [-v]... [--out=<f>] [--in=<f>]...\n'
+    c, h = generate(doc)
+    # -v, then --in and --out
+    check('spec_option_repeating[] = {\n    1, 1, 0\n}' in c)
+
+
+def test_options_by_path():
+    """The options of one alternative do not come with the positionals of another"""
+    check(same_as_docopt_py('Usage: prog svc (start [--fast] | stop [--now])\n',
+                            [['svc', 'start', '--fast'], ['svc', 'stop', '--now'], ['svc', 'start', '--now'],
+                             ['svc', 'stop', '--fast'], ['svc', 'start']]))
+    check(same_as_docopt_py('Usage: prog cmd (-a <x> | -b <y> <z>)\n',
+                            [['cmd', '-a', '1'], ['cmd', '-b', '1', '2'], ['cmd', '-a', '1', '2'], ['cmd', '-b', '1']]))
+    check(same_as_docopt_py('Usage: prog (-a -b | -c) <x>\n  prog go [-q | -v <n>]\n',
+                            [['-a', '-b', '1'], ['-c', '1'], ['-a', '-c', '1'], ['-a', '1'], ['go', '-q'],
+                             ['go', '-v', '1'], ['go', '-q', '-v', '1'], ['go']]))
+    check(same_as_docopt_py('Usage: prog (-a <x> | -b <y>)...\n',
+                            [['-a', '1', '-b', '2'], ['-b', '1'], ['-a', '-b', '1', '2']]))
+
+
+def test_repeats():
+    """Repeated commands count, options with an argument that may repeat keep
+    every value, and the "--" ending options is not an argument where the
+    usage has [--], as in docopt.py"""
+    doc = ('Usage: prog [options] [--file=<f>]... [-I <dir>]... (add)... [--] [<g>...]\n'
+           '       prog go <y> go\n\n'
+           'Options:\n  -I <dir>  Include [default: a b]\n  -q        Quiet\n')
+    argvs = [['add', 'add'], ['--file=x', 'add', '-I', 'c', '--file', 'y', 'add', '-Id'], ['add', '--'],
+             ['add', '--', '--'], ['add', '--', 'a', '--', 'b'], ['go', '1', 'go'], ['-q', 'go', '1', 'go'],
+             ['add', '-q', '-q']]
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        write(os.path.join(work, 'spec.docopt'), doc)
+        run_docopt_c('-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt'))
+        write(os.path.join(work, 'main.c'), """
+#include <stdio.h>
+#include "docopt.h"
+
+static void list(const char *name, struct DocoptSlice slice)
+{
+    size_t i;
+
+    printf(" %s", name);
+    for (i = 0; i < slice.count; i++)
+        printf("%c%s", i > 0 ? ',' : '=', slice.items[i]);
+}
+
+int main(int argc, char *argv[])
+{
+    struct DocoptContext *ctx = docopt_context_new(0, 0);
+    struct DocoptArgs args;
+
+    if (docopt_parse(ctx, argc, argv, &args) != DOCOPT_OK) {
+        puts("refused");
+    } else {
+        printf("add=%lu go=%lu --=%lu -q=%lu <y>=%s", (unsigned long) args.add, (unsigned long) args.go,
+               (unsigned long) args.doubledash, (unsigned long) args.q, args.y != NULL ? args.y : "");
+        list("--file", args.file);
+        list("-I", args.I);
+        list("<g>", args.g);
+        puts("");
+    }
+    docopt_context_free(ctx);
+    return 0;
+}
+""")
+        run_docopt_c('--cpp', '-o', os.path.join(work, 'docopt.hpp'), os.path.join(work, 'spec.docopt'))
+        write(os.path.join(work, 'main.cpp'), """
+#include <cstdio>
+#include "docopt.hpp"
+
+static void list(const char *name, docopt::Strings strings)
+{
+    std::printf(" %s", name);
+    for (std::size_t i = 0; i < strings.size(); i++)
+        std::printf("%c%.*s", i > 0 ? ',' : '=', static_cast<int>(strings[i].size()), strings[i].data());
+}
+
+int main(int argc, char *argv[])
+{
+    docopt::Parser<> parser(false, false);
+    docopt::Args args;
+
+    if (parser.parse(argc, argv, args) != docopt::Error::ok) {
+        std::puts("refused");
+        return 0;
+    }
+    std::printf("add=%zu go=%zu --=%d -q=%d <y>=%.*s", args.add, args.go, args.doubledash, args.q,
+                static_cast<int>(args.y.size()), args.y.data());
+    list("--file", args.file);
+    list("-I", args.I);
+    list("<g>", args.g);
+    std::puts("");
+}
+""")
+        program = os.path.join(work, 'main')
+        check(compiles('-o', program, os.path.join(work, 'main.c'), os.path.join(work, 'docopt.c')))
+        check(subprocess.call([CXX, '-std=c++17', '-Wall', '-Wextra', '-Werror', '-o', program + '_cpp',
+                               os.path.join(work, 'main.cpp')]) == 0)
+        for argv in argvs:
+            try:
+                a = docopt.docopt(doc, argv=argv, help=False)
+                expected = 'add=%d go=%d --=%d -q=%d <y>=%s' % (a['add'], a['go'], a['--'], a['-q'], a['<y>'] or '')
+                expected += ''.join(' %s%s' % (name, '=' + ','.join(a[name]) if a[name] else '')
+                                    for name in ('--file', '-I', '<g>'))
+            except docopt.DocoptExit:
+                expected = 'refused'
+            for path in (program, program + '_cpp'):
+                output = subprocess.check_output([path] + argv).decode().strip()
+                if output != expected:
+                    sys.stdout.write('\n%r: %s from %s, %s by docopt.py' % (argv, output, path, expected))
+                check(output == expected)
+    finally:
+        shutil.rmtree(work)
+
+
+def test_list_errors():
+    """An option with an argument that may repeat may have no type nor source"""
+    for annotation in ('[type: int]', '[env: FILES]'):
+        try:
+            generate('Usage: prog [--file=<f>]...\n\nOptions:\n  --file=<f>  File %s.\n' % annotation)
+            check(False)
+        except docopt.DocoptLanguageError as e:
+            check(str(e).startswith('--file may repeat'))
+
+
+def test_default_then_type():
+    doc = 'Usage: prog [-n N]\n\nOptions:\n  -n N  Count [default: 10] [type: int(0..100)].\n'
+    check(options(doc)['-n'].value == '10')
+    types = docopt_c.parse_types(doc, list(options(doc).values()))
+    check(types['-n'].kind == 'int' and types['-n'].max == 100)
+    c, h = generate(doc)
+    check('10L' in c)
+
+
+def test_default_then_env():
+    doc = 'Usage: prog [--mode=M]\n\nOptions:\n  --mode=M  Mode [default: fast] [env: PROG_MODE].\n'
+    check(options(doc)['--mode'].value == 'fast')
+    check(docopt_c.parse_sources(doc, list(options(doc).values())) == {'--mode': {'env': 'PROG_MODE'}})
+    c, h = generate(doc)
+    check('(char *) "fast"' in c and '"PROG_MODE"' in c and '"fast] [env' not in c)
+
+
+def test_default_argument():
+    check(docopt.Argument.parse('<x>  X [default: a] [type: float].').value == 'a')
+
+
+COMMA_LOCALE = """LC_NUMERIC
+decimal_point "<U002C>"
+thousands_sep ""
+grouping -1
+END LC_NUMERIC
+"""
+
+
+def ascii_charmap():
+    return ('<code_set_name> ASCII\n<comment_char> %\n<escape_char> /\n<mb_cur_max> 1\n<mb_cur_min> 1\n'
+            'CHARMAP\n' + ''.join('<U%04X> /x%02x\n' % (c, c) for c in range(128)) + 'END CHARMAP\n')
+
+
+def test_float_in_comma_locale():
+    """A float too long for the fast path, nor for a 64 byte copy, parses where the decimal point is ','"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        write(os.path.join(work, 'comma.src'), COMMA_LOCALE)
+        write(os.path.join(work, 'ascii'), ascii_charmap())
+        try:
+            subprocess.call(['localedef', '-c', '-i', os.path.join(work, 'comma.src'),
+                             '-f', os.path.join(work, 'ascii'), os.path.join(work, 'comma')],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        except OSError:
+            pass
+        if not os.path.isdir(os.path.join(work, 'comma')):
+            sys.stdout.write('\n[%s] no localedef, comma locale skipped\n' % os.path.basename(__file__))
+            return
+        write(os.path.join(work, 'spec.docopt'),
+              'Usage: prog [--ratio=<r>]\n\nOptions:\n  --ratio=<r>  Ratio [default: 1] [type: float].\n')
+        run_docopt_c('-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt'))
+        write(os.path.join(work, 'main.c'), """
+#include <locale.h>
+#include <string.h>
+#include "docopt.h"
+
+int main(void)
+{
+    char ratio[96] = "--ratio=-0.125";
+    char *argv[] = {"prog", ratio, NULL};
+    struct DocoptArgs args;
+
+    if (setlocale(LC_NUMERIC, "comma") == NULL || strcmp(localeconv()->decimal_point, ",") != 0)
+        return 2;
+    memset(ratio + strlen(ratio), '0', 70);
+    args = docopt(2, argv, 1, NULL);
+    return args.ratio == -0.125 ? 0 : 1;
+}
+""")
+        program = os.path.join(work, 'main')
+        check(compiles('-o', program, os.path.join(work, 'main.c'), os.path.join(work, 'docopt.c')))
+        check(subprocess.call([program], env=dict(os.environ, LOCPATH=work)) == 0)
+    finally:
+        shutil.rmtree(work)
+
+
+def test_packed():
+    """--packed: commands and flags read as bits with DOCOPT_FLAG, DOCOPT_WORD
+    and DOCOPT_MASK, repeated flags counted and words kept"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        write(os.path.join(work, 'spec.docopt'), 'Usage: prog [-v...] [-q] (go | stop) <x> [--name=<n>]\n')
+        run_docopt_c('--packed', '-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt'))
+        write(os.path.join(work, 'main.c'), """
+#include <stdio.h>
+#include "docopt.h"
+
+int main(int argc, char *argv[])
+{
+    struct DocoptArgs args = docopt(argc, argv, 1, NULL);
+
+    printf("%d %d %d %lu %s %s %d\\n", DOCOPT_FLAG(args, go), DOCOPT_FLAG(args, stop),
+           DOCOPT_FLAG(args, q), (unsigned long) DOCOPT_FLAG(args, v), args.x,
+           args.name != NULL ? args.name : "-",
+           (DOCOPT_WORD(args, go) & (DOCOPT_MASK(go) | DOCOPT_MASK(q))) == (DOCOPT_MASK(go) | DOCOPT_MASK(q)));
+    return 0;
+}
+""")
+        program = os.path.join(work, 'main')
+        check(compiles('-o', program, os.path.join(work, 'main.c'), os.path.join(work, 'docopt.c')))
+        run = lambda *argv: subprocess.check_output([program] + list(argv)).decode()
+        check(run('go', 'a') == '1 0 0 0 a - 0\n')
+        check(run('-q', 'go', 'a') == '1 0 1 0 a - 1\n')
+        check(run('-vvv', 'stop', '--name=n', 'b', '-v') == '0 1 0 4 b n 0\n')
+        check(run('-q', '-v', 'stop', 'c') == '0 1 1 1 c - 0\n')
+    finally:
+        shutil.rmtree(work)
+
+
+def test_dispatch():
+    """A directory of specs makes a dispatcher that runs the main() of the
+    subcommand named, and fails on any other"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        os.mkdir(os.path.join(work, 'specs'))
+        write(os.path.join(work, 'specs', 'add.docopt'), 'Usage: git add [-n] <f>...\n')
+        write(os.path.join(work, 'specs', 'rm.docopt'), 'Usage: git rm [-f] <path>\n')
+        run_docopt_c('-o', os.path.join(work, 'cli'), os.path.join(work, 'specs'))
+        # the headers of the subcommands each declare a DocoptArgs of their own
+        write(os.path.join(work, 'add.c'), """
+#include <stdio.h>
+#include "cli_add.h"
+
+int add_main(int argc, char *argv[])
+{
+    struct DocoptArgs args = docopt(argc, argv, 1, NULL);
+
+    printf("add %lu %lu\\n", (unsigned long) args.n, (unsigned long) args.f.count);
+    return 0;
+}
+""")
+        write(os.path.join(work, 'rm.c'), """
+#include <stdio.h>
+#include "cli_rm.h"
+
+int rm_main(int argc, char *argv[])
+{
+    struct DocoptArgs args = docopt(argc, argv, 1, NULL);
+
+    printf("rm %lu %s\\n", (unsigned long) args.f, args.path);
+    return 0;
+}
+""")
+        write(os.path.join(work, 'main.c'), """
+#include "cli.h"
+
+int main(int argc, char *argv[])
+{
+    return docopt_dispatch(argc, argv);
+}
+""")
+        program = os.path.join(work, 'git')
+        check(compiles('-o', program, *[os.path.join(work, name) for name in (
+            'main.c', 'add.c', 'rm.c', 'cli.c', 'cli_add.c', 'cli_rm.c')]))
+        run = lambda *argv: subprocess.run([program] + list(argv), stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        check(run('add', '-n', 'a', 'b').stdout == b'add 1 2\n')
+        check(run('rm', 'a').stdout == b'rm 0 a\n')
+        check(run('rm', '-f', 'a').stdout == b'rm 1 a\n')
+        unknown = run('mv', 'a', 'b')
+        check(unknown.returncode != 0 and unknown.stdout == b'' and b'mv is not a command' in unknown.stderr)
+        check(run().returncode != 0)
+    finally:
+        shutil.rmtree(work)
+
+
+def test_cache_and_depfile():
+    """A second run on the same inputs takes the parser from --cache-dir, a
+    changed spec or template makes it anew, and --depfile lists the inputs"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        spec, template, cache = [os.path.join(work, name) for name in ('spec.docopt', 'template.c', 'cache')]
+        output, dep = os.path.join(work, 'docopt'), os.path.join(work, 'docopt.d')
+        write(spec, 'Usage: prog <x>\n')
+        write(template, docopt_c.template_c)
+        run = lambda: run_docopt_c('-t', template, '-c', cache, '-d', dep, '-o', output, spec)
+        read = lambda path: open(path).read()
+        cached = lambda: sorted(os.path.join(d, name) for d, _, names in os.walk(cache)
+                                for name in names if name.endswith('.c'))
+        run()
+        check(len(cached()) == 1)
+        # a hit is the cached file itself, marked so as to tell it from one made anew
+        write(cached()[0], '/* cached */\n' + read(cached()[0]))
+        run()
+        check(read(output + '.c').startswith('/* cached */\n') and len(cached()) == 1)
+        write(spec, 'Usage: prog <x> <y>\n')
+        run()
+        check(not read(output + '.c').startswith('/* cached */') and 'char *y;' in read(output + '.h'))
+        check(len(cached()) == 2)
+        write(template, docopt_c.template_c + '\n/* template changed */\n')
+        run()
+        check('/* template changed */' in read(output + '.c') and len(cached()) == 3)
+        rule = read(dep).replace('\\\n', ' ')
+        targets, dependencies = rule.split(': ', 1)
+        check(sorted(targets.split()) == [output + '.c', output + '.h'])
+        check(sorted(dependencies.split()) == sorted([spec, template] + docopt_c.generator_sources()))
+    finally:
+        shutil.rmtree(work)
+
+
+def test_trace_without_lookups():
+    """DOCOPT_TRACE builds cleanly for a spec with neither options nor commands"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    try:
+        write(os.path.join(work, 'spec.docopt'), 'Usage: prog <x>\n')
+        run_docopt_c('-o', os.path.join(work, 'docopt'), os.path.join(work, 'spec.docopt'))
+        check(compiles('-DDOCOPT_TRACE', '-c', '-o', os.devnull, os.path.join(work, 'docopt.c')))
+    finally:
+        shutil.rmtree(work)
+
+
+def test_manifest_errors():
+    """A spec that fails is reported on its own, the others are written"""
+    work = tempfile.mkdtemp(prefix='docopt_spec_')
+    write_parser = docopt_c.write_parser
+
+    def failing(args, doc, output_name, prefix):
+        if prefix == 'bad':
+            raise ValueError('bad value')
+        return write_parser(args, doc, output_name, prefix)
+
+    try:
+        for name in ('good', 'bad', 'other'):
+            with open(os.path.join(work, name + '.docopt'), 'w') as f:
+                f.write('Usage: prog [-v]\n')
+        with open(os.path.join(work, 'manifest'), 'w') as f:
+            f.write('good.docopt good good\nbad.docopt bad bad\nother.docopt other other\n')
+        args = docopt.docopt(docopt_c.__doc__, argv=['-m', os.path.join(work, 'manifest')])
+        docopt_c.read_templates(args)
+        # the processes of the pool are forked with the failing write_parser
+        docopt_c.write_parser = failing
+        outputs, errors = docopt_c.write_manifest(args, docopt_c.read_manifest(args['--manifest']), 2)
+        check(errors == [os.path.join(work, 'bad.docopt') + ': bad value'])
+        check(sorted(os.path.basename(path) for path in outputs) == ['good.c', 'good.h', 'other.c', 'other.h'])
+    finally:
+        docopt_c.write_parser = write_parser
+        shutil.rmtree(work)
+
+
+def main():
+    docopt.docopt(__doc__)
+    for test in [test_required_either,
+                 test_options_shortcut,
+                 test_repeating_options,
+                 test_options_by_path,
+                 test_repeats,
+                 test_list_errors,
+                 test_default_then_type,
+                 test_default_then_env,
+                 test_default_argument,
+                 test_float_in_comma_locale,
+                 test_packed,
+                 test_dispatch,
+                 test_cache_and_depfile,
+                 test_trace_without_lookups,
+                 test_manifest_errors]:
+        test()
+    print(' FAILED' if failed else ' OK!')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
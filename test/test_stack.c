@@ -0,0 +1,162 @@
+/*
+ * test_stack.c -- peak stack and heap of docopt(), help, version and error
+ * paths included, for each command line read from stdin, one per line with
+ * tab-separated words.  Built by test_stack.py against a generated parser,
+ * whose DOCOPT_STACK_BYTES it is checked against.  Results go to the file
+ * named by the first argument, docopt() writes to stdout and stderr.
+ */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *test_malloc(size_t size);
+static void *test_calloc(size_t n, size_t size);
+static void *test_realloc(void *p, size_t size);
+static void test_free(void *p);
+void test_exit(int code);
+
+/* count what the parser allocates, and come back from where it exits */
+#define malloc test_malloc
+#define calloc test_calloc
+#define realloc test_realloc
+#define free test_free
+#define exit test_exit
+#include "docopt.c"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#undef exit
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+#define MAX_ARGS 64
+#define MAX_LINE 4096
+#define STACK_PROBE (1 << 20)
+#define PAINT 0xa5
+
+union Header {
+    size_t size;
+    long l;
+    double d;
+    void *p;
+};
+
+static size_t heap_live;
+static size_t heap_peak;
+static jmp_buf exited;
+
+static void *test_malloc(size_t size) {
+    union Header *h = malloc(sizeof(union Header) + size);
+
+    if (h == NULL)
+        return NULL;
+    h->size = size;
+    heap_live += size;
+    if (heap_live > heap_peak)
+        heap_peak = heap_live;
+    return h + 1;
+}
+
+static void *test_calloc(size_t n, size_t size) {
+    void *p = test_malloc(n * size);
+
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+static void test_free(void *p) {
+    union Header *h = p;
+
+    if (p == NULL)
+        return;
+    heap_live -= h[-1].size;
+    free(h - 1);
+}
+
+static void *test_realloc(void *p, size_t size) {
+    void *q = test_malloc(size);
+
+    if (q == NULL)
+        return NULL;
+    if (p != NULL) {
+        memcpy(q, p, ((union Header *) p)[-1].size < size ? ((union Header *) p)[-1].size : size);
+        test_free(p);
+    }
+    return q;
+}
+
+void test_exit(int code) {
+    longjmp(exited, code + 1);
+}
+
+static NOINLINE void paint_stack(void) {
+    volatile unsigned char probe[STACK_PROBE];
+    size_t i;
+
+    for (i = 0; i < STACK_PROBE; i++)
+        probe[i] = PAINT;
+}
+
+/* Bytes of the painted stack written over since paint_stack() */
+static NOINLINE size_t stack_used(void) {
+    volatile unsigned char probe[STACK_PROBE];
+    size_t i;
+
+    for (i = 0; i < STACK_PROBE && probe[i] == PAINT; i++)
+        ;
+    return STACK_PROBE - i;
+}
+
+/* docopt() as a program would call it; -1 if it returned, else the
+   status it exited with */
+static NOINLINE int run(int argc, char *argv[], int call) {
+    volatile struct DocoptArgs args;
+    int code = setjmp(exited);
+
+    if (code != 0)
+        return code - 1;
+    if (call)
+        args = docopt(argc, argv, true, "1.0");
+    (void) args;
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    char line[MAX_LINE];
+    char *words[MAX_ARGS];
+    FILE *out;
+    size_t base, stack;
+    int n, status;
+
+    if (argc != 2 || (out = fopen(argv[1], "w")) == NULL)
+        return EXIT_FAILURE;
+    /* the allocator and stdio set themselves up on first use, keep that out */
+    words[0] = "prog";
+    run(1, words, 1);
+    paint_stack();
+    run(1, words, 0);
+    base = stack_used();
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        n = 0;
+        words[n++] = "prog";
+        for (words[n] = strtok(line, "\t"); words[n] != NULL && n < MAX_ARGS - 1; words[n] = strtok(NULL, "\t"))
+            n++;
+        heap_live = heap_peak = 0;
+        paint_stack();
+        status = run(n, words, 1);
+        stack = stack_used() - base;
+        fprintf(out, "{\"argc\": %d, \"exit\": %d, \"stack_bytes\": %lu, \"heap_bytes\": %lu}\n",
+                n, status, (unsigned long) stack, (unsigned long) heap_peak);
+    }
+    fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+# -*- coding:utf-8 -*-
+
+"""Usage: test_stack.py [--cc=<cc>] [--budget=<bytes>] [--heap-budget=<bytes>] [<docopt>...]
+
+Checks the DOCOPT_STACK_BYTES the generator emits for each spec, by default
+example.docopt, against what docopt() takes, and prints one JSON object per
+spec and build:
+
+  static_bytes  deepest chain of frames from docopt() down, per -fstack-usage
+                and -fcallgraph-info, calls out of docopt.c counted as 0
+  stack_bytes   most stack test_stack.c saw docopt() take, libc included,
+                over command lines for help, version, each error and each
+                command and option of the spec
+  heap_bytes    most heap it saw docopt() take
+
+Both builds, -O0 and -O2, must stay within DOCOPT_STACK_BYTES, that within
+--budget and the heap within --heap-budget; the exit status is 1 if not.
+
+Options:
+  --cc=<cc>                 C compiler, GCC or one taking its flags [default: gcc].
+  --budget=<bytes>          Most DOCOPT_STACK_BYTES may be.
+  --heap-budget=<bytes>     Most heap docopt() may take.
+
+"""
+
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(HERE))
+
+import docopt
+import docopt_c
+
+BUILDS = ['-O0', '-O2']
+BAD_VALUES = ['', '-1', '1e99999', '9' * 400, 'x' * 4096]
+
+
+def command_lines(doc):
+    """Command lines, lists of words, that take docopt() down each path"""
+    usage, pattern, leafs, commands, arguments, flags, options = docopt_c.parse_spec(doc)
+    shorts = set(o.short for o in flags + options if o.short)
+    unknown = next('-' + c for c in 'ZQzq%' if '-' + c not in shorts)
+    lines = [[], ['--help'], ['--version'], ['--no-such-option'], [unknown], ['--'] + ['word'] * 32]
+    lines += [[cmd.name] for cmd in commands]
+    for opt in flags + options:
+        name = opt.long or opt.short
+        lines.append([name])
+        if opt.argcount:
+            lines += [[name, value] for value in BAD_VALUES]
+            lines += [['{}={}'.format(name, value)] for value in BAD_VALUES if opt.long]
+        elif opt.long:
+            lines.append([name + '=x'])
+    lines += [[cmd.name] + [opt.long or opt.short for opt in flags] for cmd in commands[:1]]
+    return lines
+
+
+def call_graph(path):
+    """Frames and callees of the functions in the -fcallgraph-info file `path`"""
+    frames, calls = {}, {}
+    with open(path) as f:
+        text = f.read()
+    for name, size in re.findall(r'node: \{ title: "([^"]+)" label: "[^"]*\\n(\d+) bytes', text):
+        frames[name] = int(size)
+    for source, target in re.findall(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"', text):
+        calls.setdefault(source, []).append(target)
+    return frames, calls
+
+
+def deepest(frames, calls, name, seen=()):
+    """Most stack any chain of calls from `name` takes; a ValueError on
+    recursion, which would leave it without a bound"""
+    if name in seen:
+        raise ValueError('recursion through ' + name)
+    return frames.get(name, 0) + max([deepest(frames, calls, callee, seen + (name,))
+                                      for callee in calls.get(name, [])] or [0])
+
+
+def check(args, path):
+    with open(path) as f:
+        doc = f.read()
+    work = tempfile.mkdtemp(prefix='docopt_stack_')
+    try:
+        subprocess.check_call([sys.executable, os.path.join(HERE, '..', 'docopt_c.py'),
+                               '-o', os.path.join(work, 'docopt'), path])
+        with open(os.path.join(work, 'docopt.h')) as f:
+            bound = int(re.search(r'^#define DOCOPT_STACK_BYTES (\d+)', f.read(), re.M).group(1))
+        # docopt.c is included from the directory of the harness
+        shutil.copy(os.path.join(HERE, 'test_stack.c'), work)
+        with open(os.path.join(work, 'argv.txt'), 'w') as f:
+            f.write(''.join('\t'.join(line) + '\n' for line in command_lines(doc)))
+        ok = args['--budget'] is None or bound <= int(args['--budget'])
+        for build in BUILDS:
+            subprocess.check_call([args['--cc'], build, '-fstack-usage', '-fcallgraph-info=su', '-c',
+                                   '-o', os.path.join(work, 'docopt.o'), os.path.join(work, 'docopt.c')])
+            frames, calls = call_graph(os.path.join(work, 'docopt.ci'))
+            static = deepest(frames, calls, 'docopt')
+            # bound at load time, so that the first call of a libc function
+            # does not count the resolver
+            harness = os.path.join(work, 'test_stack')
+            subprocess.check_call([args['--cc'], build, '-Wl,-z,now', '-o', harness,
+                                   os.path.join(work, 'test_stack.c')])
+            results = os.path.join(work, 'results.txt')
+            with open(os.path.join(work, 'argv.txt')) as f, open(os.devnull, 'w') as devnull:
+                subprocess.check_call([harness, results], stdin=f, stdout=devnull, stderr=devnull)
+            with open(results) as f:
+                runs = [json.loads(line) for line in f]
+            record = {'spec': os.path.basename(path), 'build': build, 'stack_bound': bound,
+                      'static_bytes': static,
+                      'stack_bytes': max(run['stack_bytes'] for run in runs),
+                      'heap_bytes': max(run['heap_bytes'] for run in runs)}
+            print(json.dumps(record))
+            ok = ok and static <= bound and record['stack_bytes'] <= bound \
+                and (args['--heap-budget'] is None or record['heap_bytes'] <= int(args['--heap-budget']))
+        return ok
+    finally:
+        shutil.rmtree(work)
+
+
+def main():
+    args = docopt.docopt(__doc__)
+    specs = args['<docopt>'] or [os.path.join(HERE, 'example.docopt')]
+    failed = [path for path in specs if not check(args, path)]
+    for path in failed:
+        sys.stderr.write('{}: docopt() over its stack bound or budget\n'.format(path))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()